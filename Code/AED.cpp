@@ -1,6 +1,61 @@
 // IMPORTS
 #include "AED.h"
 #include "MainWindow.h"
+#include "MetricsRegistry.h"
+#include "TraceRecorder.h"
+
+#include <QDateTime>
+#include <QSaveFile>
+
+#include <thread>
+#include <vector>
+
+// Device metrics, shared by every device of the process. Durations are counted in microseconds.
+static MetricCounter &shocksDelivered = MetricsRegistry::instance()->counter("aed_shocks_delivered_total", "Shocks delivered to the patient.");
+static MetricCounter &selfTestFailures = MetricsRegistry::instance()->counter("aed_self_test_failures_total", "Self tests that failed.");
+static MetricCounter &batterySwaps = MetricsRegistry::instance()->counter("aed_battery_swaps_total", "Batteries changed by the operator.");
+static MetricHistogram &timeToFirstShock = MetricsRegistry::instance()->histogram("aed_time_to_first_shock_seconds", "Time from power on to the first shock of a session.", 1e-6);
+static MetricHistogram &reconnectWait = MetricsRegistry::instance()->histogram("aed_reconnect_wait_seconds", "Time spent waiting for the cable to be plugged back in.", 1e-6);
+static MetricHistogram &commandLatency = MetricsRegistry::instance()->histogram("aed_command_latency_seconds", "Time from a command being sent to the device to it being applied.", 1e-6);
+static MetricCounter &commandsApplied = MetricsRegistry::instance()->counter("aed_commands_applied_total", "Commands applied by the device.");
+
+/*
+    Function: stateSeconds()
+    Purpose: Gets the counter of the time spent in a state. The counters of all
+             states are registered together the first time.
+    Inputs:
+        AEDState state: The state.
+    Outputs:
+        The counter, in microseconds.
+*/
+static MetricCounter &stateSeconds(AEDState state)
+{
+    static const std::vector<MetricCounter *> counters = []()
+    {
+        std::vector<MetricCounter *> result;
+        for (int s = OFF; s <= CHECK_PADS; ++s)
+        {
+            result.push_back(&MetricsRegistry::instance()->counter("aed_state_seconds_total", "Time spent in each device state.",
+                                                                   QByteArray("state=\"") + aedStateName((AEDState)s) + "\"", 1e-6));
+        }
+        return result;
+    }();
+
+    return *counters[state];
+}
+
+/*
+    Function: microseconds()
+    Purpose: Converts a duration on the steady clock for the metrics.
+    Inputs:
+        std::chrono::steady_clock::duration duration: The duration.
+    Outputs:
+        The duration in microseconds, 0 if negative.
+*/
+static std::uint64_t microseconds(std::chrono::steady_clock::duration duration)
+{
+    return std::max<std::int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+}
 
 /*
     Function: AED()
@@ -11,8 +66,20 @@
         None
 */
 AED::AED()
-    : QObject(nullptr), patientHeartCondition(SINUS_RHYTHM), padsAttached(false), batteryLevel(100), shockCount(0), loseConnection(false)
+    : QObject(nullptr), patientHeartCondition(SINUS_RHYTHM), startWithAsystole(false), state(OFF), padsAttached(false), batteryLevel(100), shockCount(0), loseConnection(false), shockUntilHealthy(0), protocol(ProtocolLibrary::instance()->at(0)), step(0), cycle(0), physiologyModel(false), random(QRandomGenerator::global()->generate()), patient(1, random.generate()), waitingForCommand(false), drainPosted(false), impedanceStreaming(false), shockEnergy(0.0), simulatedClock(false), scheduleReset(false), running(false), stepEntered(std::chrono::steady_clock::now()), stepTime(0), firstShockDelivered(false), resuming(false), resumeState(OFF), resumeStep(0), resumeCycle(0), archive(nullptr), gui(nullptr)
 {
+    impedanceMonitor.reset(new ImpedanceMonitor);
+
+    // Forwarded directly, since the device thread is busy running the protocol.
+    connect(impedanceMonitor.get(), &ImpedanceMonitor::impedanceMeasured, this, &AED::impedanceMeasured, Qt::DirectConnection);
+
+    // The ECG follows the patient's rhythm as soon as it changes.
+    ecgMonitor.reset(new EcgMonitor);
+    connect(this, &AED::updatePatientCondition, ecgMonitor.get(), [this](int condition)
+            { ecgMonitor->setRhythm((HeartState)condition); }, Qt::DirectConnection);
+    connect(impedanceMonitor.get(), &ImpedanceMonitor::impedanceMeasured, ecgMonitor.get(), [this](double, bool goodContact)
+            { ecgMonitor->setPoorContact(!goodContact); }, Qt::DirectConnection);
+
     m_thread.reset(new QThread);
     moveToThread(m_thread.get());
     m_thread->start();
@@ -28,7 +95,9 @@ AED::AED()
 */
 AED::~AED()
 {
-    QMetaObject::invokeMethod(this, "cleanup");
+    // A session still running would keep the thread from getting to the clean up.
+    powerOff();
+    QMetaObject::invokeMethod(this, "cleanUp", Qt::QueuedConnection);
     m_thread->wait();
 }
 
@@ -46,6 +115,201 @@ void AED::cleanUp()
     m_thread->quit();
 }
 
+/*
+    Function: send()
+    Purpose: Sends a command to the device. It is queued without locking, then the device
+             thread is woken wherever it is: waiting in a step, or idle in its event loop.
+             While a step runs, the command is taken at the next drain.
+    Inputs:
+        const DeviceCommand &command: The command.
+    Outputs:
+        None
+*/
+void AED::send(const DeviceCommand &command)
+{
+    DeviceCommand sent = command;
+    sent.sent = std::chrono::steady_clock::now();
+    commands.push(sent);
+
+    // Read after the push, so that a device about to wait either sees the command or is seen here.
+    if (waitingForCommand)
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        commandSent.notify_one();
+    }
+
+    if (!drainPosted.exchange(true))
+    {
+        QMetaObject::invokeMethod(this, "drainPostedCommands", Qt::QueuedConnection);
+    }
+}
+
+/*
+    Function: drainPostedCommands()
+    Purpose: Applies the commands sent while the device thread was idle. During a session,
+             this runs once the session is over.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void AED::drainPostedCommands()
+{
+    // Commands sent from here on post another drain.
+    drainPosted = false;
+    drainCommands();
+}
+
+/*
+    Function: drainCommands()
+    Purpose: Applies every command sent so far, in order. Only on the device thread.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void AED::drainCommands()
+{
+    DeviceCommand command;
+    while (commands.pop(command))
+    {
+        commandLatency.record(microseconds(std::chrono::steady_clock::now() - command.sent));
+        commandsApplied.add();
+        apply(command);
+    }
+}
+
+/*
+    Function: apply()
+    Purpose: Applies a command on the device thread.
+    Inputs:
+        const DeviceCommand &command: The command.
+    Outputs:
+        None
+*/
+void AED::apply(const DeviceCommand &command)
+{
+    TraceSpan span("apply", "device", "command", command.type);
+
+    const int *values = command.values;
+    switch (command.type)
+    {
+    case COMMAND_POWER_ON:
+        powerOn();
+        break;
+    case COMMAND_POWER_OFF:
+        if (state != OFF && state != ABORT && state != SHOCKING)
+        {
+            state = ABORT;
+        }
+        break;
+    case COMMAND_SET_STATE:
+        // Ignored while a session runs, so that a reset scheduled at the end of a session cannot land in the next one.
+        if (!running)
+        {
+            state = (AEDState)values[0];
+        }
+        break;
+    case COMMAND_SET_BATTERY_SPECS:
+        batteryLevel = values[0];
+        batteryUnitsPerShock = values[1];
+        batteryUnitsWhenIdle = values[2];
+        break;
+    case COMMAND_SET_BATTERY_LEVEL:
+        batteryLevel = values[0];
+        break;
+    case COMMAND_DRAIN_BATTERY:
+        batteryLevel -= values[0];
+        emit batteryChanged(batteryLevel);
+        break;
+    case COMMAND_CHANGE_BATTERIES:
+        batterySwaps.add();
+        batteryLevel = MAX_BATTERY_LEVEL;
+        break;
+    case COMMAND_SET_HEART_CONDITION:
+        patientHeartCondition = (HeartState)values[0];
+        break;
+    case COMMAND_SET_SHOCKS_UNTIL_HEALTHY:
+        shockUntilHealthy = values[0];
+        break;
+    case COMMAND_SET_START_WITH_ASYSTOLE:
+        startWithAsystole = values[0] != 0;
+        break;
+    case COMMAND_SET_PADS_ATTACHED:
+        padsAttached = values[0] != 0;
+        impedanceMonitor->setPadsAttached(padsAttached);
+        break;
+    case COMMAND_ATTACH_PADS:
+        impedanceMonitor->setPadsAttached(true);
+        padsAttached = true;
+        break;
+    case COMMAND_SET_PEDIATRIC_PADS:
+        impedanceMonitor->setPediatric(values[0] != 0);
+        break;
+    case COMMAND_SET_LOST_CONNECTION:
+        loseConnection = values[0] != 0;
+        break;
+    case COMMAND_RECONNECT:
+        connectionRestored = true;
+        break;
+    case COMMAND_SET_POOR_CONTACT:
+        impedanceMonitor->setSimulatePoorContact(values[0] != 0);
+        break;
+    case COMMAND_SET_ARTIFACTS:
+        ecgMonitor->setArtifacts(values[0]);
+        break;
+    case COMMAND_SET_PROTOCOL:
+        // Programs are only looked up between sessions, so switching costs a step nothing. A
+        // session being resumed stays with the protocol of its snapshot.
+        if (!running && !resuming && ProtocolLibrary::instance()->at(values[0]) != nullptr)
+        {
+            protocol = ProtocolLibrary::instance()->at(values[0]);
+        }
+        break;
+    case COMMAND_RESTORE_SNAPSHOT:
+        // A session started since the restore was sent is not overwritten.
+        if (!running)
+        {
+            restorePendingSnapshot();
+        }
+        break;
+    }
+}
+
+/*
+    Function: waitForCommand()
+    Purpose: Waits until a command has been sent, without a deadline.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void AED::waitForCommand()
+{
+    std::unique_lock<std::mutex> lock(commandMutex);
+    waitingForCommand = true;
+    commandSent.wait(lock, [this]()
+                     { return !commands.empty(); });
+    waitingForCommand = false;
+}
+
+/*
+    Function: waitForCommand()
+    Purpose: Waits until a command has been sent, or until the given time.
+    Inputs:
+        std::chrono::steady_clock::time_point until: When to stop waiting.
+    Outputs:
+        None
+*/
+void AED::waitForCommand(std::chrono::steady_clock::time_point until)
+{
+    std::unique_lock<std::mutex> lock(commandMutex);
+    waitingForCommand = true;
+    commandSent.wait_until(lock, until, [this]()
+                           { return !commands.empty(); });
+    waitingForCommand = false;
+}
+
 /*
     Function: powerOn()
     Purpose: Powers on the AED device.
@@ -56,16 +320,53 @@ void AED::cleanUp()
 */
 void AED::powerOn()
 {
-    // Abort if there is not GUI connected.
-    if (gui == nullptr)
+    // Abort if there is not GUI connected, either a main window or a dashboard.
+    if (gui == nullptr && receivers(SIGNAL(updateGUI(int))) == 0)
         return;
 
+    // A power on sent while a session runs is ignored.
+    if (running)
+        return;
+
+    // Every session starts from OFF, whatever a late reset from the previous one left.
+    state = OFF;
+    running = true;
+
+    // Settings sent before the power on apply to this session.
+    drainCommands();
+    qint64 startMs = QDateTime::currentMSecsSinceEpoch();
+    HeartState condition = patientHeartCondition;
+
+    // The monitor is not streaming, and with a simulated clock it is only used from here.
+    if (simulatedClock)
+    {
+        impedanceMonitor->resetPatient();
+    }
+    else
+    {
+        QMetaObject::invokeMethod(impedanceMonitor.get(), "resetPatient", Qt::QueuedConnection);
+    }
+
+    ecgMonitor->setRhythm(patientHeartCondition);
+    QMetaObject::invokeMethod(ecgMonitor.get(), "start", Qt::QueuedConnection);
+
     run();
+
+    // Count the time in the final state.
+    enterState(state);
+
+    resuming = false;
+    setImpedanceStreaming(false);
+    QMetaObject::invokeMethod(ecgMonitor.get(), "stop", Qt::QueuedConnection);
+    archiveSession(startMs, condition);
+
+    running = false;
 }
 
 /*
     Function: powerOff()
-    Purpose: Powers off the AED device.
+    Purpose: Sends the device a power off. It ends the session at the next step, or
+             at once if the device is waiting, unless it is shocking.
     Inputs:
         None
     Outputs:
@@ -73,16 +374,7 @@ void AED::powerOn()
 */
 void AED::powerOff()
 {
-    if (state != OFF && state != ABORT && state != SHOCKING)
-    {
-        state = ABORT;
-
-        // Release all locks.
-        QMutexLocker padsLocker(&padsAttachedMutex);
-        waitForPadsAttachement.wakeOne();
-        QMutexLocker reconnectionlocker(&restoreConnectionMutex);
-        waitForConnection.wakeOne();
-    }
+    send(DeviceCommand(COMMAND_POWER_OFF));
 }
 
 bool AED::checkPadsAttached()
@@ -99,21 +391,32 @@ bool AED::checkPadsAttached()
         if (padsAttached)
         {
             // Keep the pads indicator message for some time.
-            QThread::msleep(1000);
+            sleepUntilNextDeadline(1000);
             return true;
         }
 
-        QMutexLocker locker(&padsAttachedMutex);
-        waitForPadsAttachement.wait(&padsAttachedMutex);
+        {
+            TraceSpan span("waitForPadsAttachement", "device");
+
+            // The pads may already have been attached, and powering off ends the wait too.
+            for (drainCommands(); !padsAttached && state != ABORT; drainCommands())
+            {
+                waitForCommand();
+            }
+        }
+
+        // The operator decides when the pads are attached, start a new schedule from here.
+        resetSchedule();
 
         // Keep the pads indicator message for some time.
-        QThread::msleep(1000);
+        sleepUntilNextDeadline(1000);
 
         padsAttached = true;
+        impedanceMonitor->setPadsAttached(true);
     }
     else
     {
-        QThread::msleep(CHECK_PADS_TIME);
+        sleepUntilNextDeadline(CHECK_PADS_TIME);
     }
 
     return true;
@@ -130,7 +433,7 @@ bool AED::checkPadsAttached()
 */
 void AED::setLostConnection(bool simulateConnectionLoss)
 {
-    this->loseConnection = simulateConnectionLoss;
+    send(DeviceCommand(COMMAND_SET_LOST_CONNECTION, simulateConnectionLoss));
 }
 
 /*
@@ -139,18 +442,95 @@ void AED::setLostConnection(bool simulateConnectionLoss)
     Inputs:
         None
     Outputs:
-        None
+        A boolean indicating whether the device can proceed.
 */
-void AED::checkConnection()
+bool AED::checkConnection()
 {
+    // The connection was fine when the snapshot was taken.
+    if (resuming)
+        return true;
+
     // Simulate connection loss if such testing requirement was selected with ~33% probability.
-    int random = QRandomGenerator::global()->bounded(RANDOM_BOUND);
-    if (loseConnection && random == 0)
+    int chance = random.bounded(RANDOM_BOUND);
+    if (loseConnection && chance == 0)
+    {
+        connectionRestored = false;
+        if (!nextStep(LOST_CONNECTION, 0, 0))
+            return false;
+
+        {
+            TraceSpan span("waitForConnection", "device");
+            auto waitStart = std::chrono::steady_clock::now();
+
+            // The cable may already have been plugged back in, and powering off ends the wait too.
+            for (drainCommands(); !connectionRestored && state != ABORT; drainCommands())
+            {
+                waitForCommand();
+            }
+            reconnectWait.record(microseconds(std::chrono::steady_clock::now() - waitStart));
+        }
+
+        // Start a new schedule once the cable is plugged back in.
+        resetSchedule();
+    }
+
+    return true;
+}
+
+/*
+    Function: checkPadContact()
+    Purpose: Asks the user to check the pads until they are in good contact with the patient.
+    Inputs:
+        None
+    Outputs:
+        A boolean indicating whether the device can proceed.
+*/
+bool AED::checkPadContact()
+{
+    if (resuming)
+        return true;
+
+    while (!impedanceMonitor->hasGoodContact())
+    {
+        if (!nextStep(CHECK_PADS, CHECK_PADS_TIME, 0))
+            return false;
+
+        // The pads were fixed, the schedule continues from here.
+        if (impedanceMonitor->hasGoodContact())
+        {
+            resetSchedule();
+        }
+    }
+
+    return true;
+}
+
+/*
+    Function: setImpedanceStreaming()
+    Purpose: Starts or stops impedance measurements. The monitor is only notified when
+             this changes, and never waited on.
+    Inputs:
+        bool streaming: True to stream measurements, false to stop.
+    Outputs:
+        None
+*/
+void AED::setImpedanceStreaming(bool streaming)
+{
+    // Without real time to stream in, a measurement is taken at every step that needs one.
+    if (simulatedClock)
     {
-        nextStep(LOST_CONNECTION, 0, 0);
-        QMutexLocker locker(&restoreConnectionMutex);
-        waitForConnection.wait(&restoreConnectionMutex);
+        if (streaming)
+        {
+            impedanceMonitor->measure();
+        }
+        return;
     }
+
+    if (streaming == impedanceStreaming)
+        return;
+
+    impedanceStreaming = streaming;
+    QMetaObject::invokeMethod(impedanceMonitor.get(), streaming ? "start" : "stop", Qt::QueuedConnection);
 }
 
 /*
@@ -164,9 +544,10 @@ void AED::checkConnection()
 bool AED::selfTest()
 {
     // Randomly determine whether the self-test should fail.
-    int random = QRandomGenerator::global()->bounded(100);
-    if (random >= 90)
+    int chance = random.bounded(100);
+    if (chance >= 90)
     {
+        selfTestFailures.add();
         if (!nextStep(SELF_TEST_FAIL, 0, 0)) return false;
     }
     else if (batteryLevel < SUFFICIENT_BATTERY_LEVEL)
@@ -183,7 +564,9 @@ bool AED::selfTest()
 
 /*
     Function: run()
-    Purpose: Runs the AED device.
+    Purpose: Runs the program of the protocol, one step after the other, until it ends
+             or a step ends the session. Once the pads are attached, the device goes on
+             with the program for them.
     Inputs:
         None
     Outputs:
@@ -191,61 +574,189 @@ bool AED::selfTest()
 */
 void AED::run()
 {
-    // Start self test procedure, only checking for battery in this case
-    QThread::msleep(SLEEP);
-
-    if (!selfTest()) return;
+    TraceRecorder::instance()->setThreadName("AED device");
+    runStart = now();
+    stepEntered = runStart;
+    resetSchedule();
 
-    // Start reducing the battery.
-    if (!checkPadsAttached()) return;
-
-    // One extra round of CPR before delivering all shocks.
-    if (startWithAsystole)
+    // The start of a resumed session is unknown, so it does not count towards the time to first shock.
+    firstShockDelivered = resuming;
+    cycle = resuming ? resumeCycle : 0;
     {
-        shockUntilHealthy++;
+        QMutexLocker locker(&transitionTimingsMutex);
+        transitionTimings.clear();
     }
 
-    for (int i = 0; i <= shockUntilHealthy; ++i)
+    // Start self test procedure, only checking for battery in this case
+    sleepUntilNextDeadline(SLEEP);
+
+    // Both programs are the same up to the pads, and a resumed session has them already.
+    const ProtocolProgram *program = &protocol->getProgram(impedanceMonitor->isPediatric());
+    bool shockNeeded = false;
+
+    for (step = resuming ? resumeStep : 0; program->steps[step].op != PROTOCOL_END;)
     {
-        if (!nextStep(ANALYZING, ANALYZING_TIME, 0)) return;
+        const ProtocolStep &current = program->steps[step];
+        int next = step + 1;
 
-        // Change patient to healthy once all shocks have been delivered.
-        if (shockable() && i == shockUntilHealthy)
+        switch (current.op)
         {
-            // Update patient heart condition to healthy since all shocks have been delivered.
-            patientHeartCondition = SINUS_RHYTHM;
-            emit updatePatientCondition(SINUS_RHYTHM);
-        }
+        case PROTOCOL_SELF_TEST:
+            if (!selfTest())
+                return;
+            break;
 
-        bool shockNeeded = shockable() && (i > 0 || !startWithAsystole);
-        if (!nextStep(shockNeeded ? SHOCK_ADVISED : NO_SHOCK_ADVISED, SLEEP, 0)) return;
+        case PROTOCOL_ATTACH_PADS:
+            // Start reducing the battery.
+            if (!checkPadsAttached())
+                return;
 
-        // Normal rhythm. Turn off the device.
-        if (!shockNeeded && patientHeartCondition == SINUS_RHYTHM)
-        {
-           emit updateGUI(ABORT);
-           return;
-        }
+            // One extra round of CPR before delivering all shocks. A snapshot taken in the loop already has it.
+            if (startWithAsystole && !physiologyModel && !resuming)
+            {
+                shockUntilHealthy++;
+            }
+
+            if (physiologyModel && !resuming)
+            {
+                // The longer the collapse, the lower the viability.
+                patient.resetPatient(0, patientHeartCondition, 0.3f + 0.7f * float(random.generateDouble()));
+            }
 
-        // Simulating connection lost.
-        checkConnection();
+            program = &protocol->getProgram(impedanceMonitor->isPediatric());
+            break;
 
-        if (shockNeeded)
-        {
+        case PROTOCOL_ANALYZE:
+            if (!nextStep(ANALYZING, current.time, 0))
+                return;
+
+            if (physiologyModel)
+            {
+                // The rhythm is whatever the heart has turned into during analysis.
+                advancePatient(current.time, false);
+            }
+            // Change patient to healthy once all shocks have been delivered.
+            else if (shockable() && cycle == shockUntilHealthy)
+            {
+                // Update patient heart condition to healthy since all shocks have been delivered.
+                patientHeartCondition = SINUS_RHYTHM;
+                emit updatePatientCondition(SINUS_RHYTHM);
+            }
+
+            shockNeeded = shockable() && (physiologyModel || cycle > 0 || !startWithAsystole);
+            if (!nextStep(shockNeeded ? SHOCK_ADVISED : NO_SHOCK_ADVISED, SLEEP, 0))
+                return;
+
+            // Normal rhythm. Turn off the device, through a step so that it is recorded.
+            if (!shockNeeded && patientHeartCondition == SINUS_RHYTHM)
+            {
+                nextStep(ABORT, 0, 0);
+                return;
+            }
+            break;
+
+        case PROTOCOL_CHECK_CONNECTION:
+            // Simulating connection lost.
+            if (!checkConnection())
+                return;
+            break;
+
+        case PROTOCOL_UNLESS_SHOCK:
+            if (!shockNeeded)
+                next = current.target;
+            break;
+
+        case PROTOCOL_CHARGE:
             // Check if we have enough battery.
             if (batteryLevel - batteryUnitsPerShock < SUFFICIENT_BATTERY_LEVEL)
             {
                 // Indicate the user to change battery.
-                if (!nextStep(CHANGE_BATTERIES, CHANGE_BATTERIES_TIME, 0)) return;
+                if (!nextStep(CHANGE_BATTERIES, CHANGE_BATTERIES_TIME, 0))
+                    return;
             }
 
-            if (!nextStep(STAND_CLEAR, SLEEP, 0)) return;
-            if (!nextStep(SHOCKING, SHOCKING_TIME, 0)) return;
-            if (!nextStep(SHOCK_DELIVERED, SLEEP, batteryUnitsPerShock)) return;
+            // Make sure the pads are in good contact before charging.
+            if (!checkPadContact())
+                return;
+
+            // Charge for the latest impedance.
+            shockEnergy = impedanceMonitor->compensatedEnergy(program->energy(shockCount));
+            break;
+
+        case PROTOCOL_PROMPT:
+            if (!nextStep(current.state, current.time, 0))
+                return;
+            break;
+
+        case PROTOCOL_SHOCK:
+            if (!nextStep(SHOCK_DELIVERED, current.time, batteryUnitsPerShock))
+                return;
+            break;
+
+        case PROTOCOL_CPR:
+            if (!nextStep(CPR, current.time, 0))
+                return;
+
+            if (physiologyModel)
+                advancePatient(current.time, true);
+            break;
+
+        case PROTOCOL_NEXT_SHOCK:
+            if (++cycle > lastCycle())
+                next = current.target;
+            break;
+
+        case PROTOCOL_REPEAT:
+            if (++cycle <= lastCycle())
+                next = current.target;
+            break;
+
+        case PROTOCOL_END:
+            break;
         }
 
-        if (!nextStep(CPR, CPR_TIME, 0)) return;
-        if (!nextStep(STOP_CPR, SLEEP, 0)) return;
+        step = next;
+    }
+}
+
+/*
+    Function: lastCycle()
+    Purpose: Gets the last analysis of the session. With the heart model, the session
+             runs until the patient recovers or MAX_PHYSIOLOGY_CYCLES; otherwise, the
+             patient turns healthy at the analysis after the last shock.
+    Inputs:
+        None
+    Outputs:
+        The index of the last analysis.
+*/
+int AED::lastCycle() const
+{
+    return physiologyModel ? MAX_PHYSIOLOGY_CYCLES - 1 : shockUntilHealthy;
+}
+
+/*
+    Function: advancePatient()
+    Purpose: Advances the heart model and reports a change of rhythm to the GUI.
+    Inputs:
+        unsigned long time: The time to advance by in milliseconds.
+        bool cpr: True if CPR was given during that time.
+    Outputs:
+        None
+*/
+void AED::advancePatient(unsigned long time, bool cpr)
+{
+    // The snapshot already has the patient as of the step being resumed.
+    if (resuming)
+        return;
+
+    patient.setCPR(0, cpr);
+    patient.advance(time / 1000.0f);
+    patient.setCPR(0, false);
+
+    if (patient.getRhythm(0) != patientHeartCondition)
+    {
+        patientHeartCondition = patient.getRhythm(0);
+        emit updatePatientCondition(patientHeartCondition);
     }
 }
 
@@ -265,6 +776,8 @@ void AED::setGUI(MainWindow *mainWindow)
     connect(this, SIGNAL(batteryChanged(int)), gui, SLOT(updateBatteryLevel(int)));
     connect(this, SIGNAL(updateShockCount(int)), gui, SLOT(updateNumberOfShocks(int)));
     connect(this, SIGNAL(updatePatientCondition(int)), gui, SLOT(updatePatientCondition(int)));
+    connect(this, SIGNAL(impedanceMeasured(double, bool)), gui, SLOT(updateImpedance(double, bool)));
+    connect(this, SIGNAL(updateDeliveredEnergy(double)), gui, SLOT(updateDeliveredEnergy(double)));
 }
 
 /*
@@ -280,10 +793,12 @@ void AED::setGUI(MainWindow *mainWindow)
 */
 bool AED::nextStep(AEDState state, unsigned long sleepTime, int batteryUsed)
 {
+    drainCommands();
+
     //Check for change batteries state first before proceeding
     if (state == CHANGE_BATTERIES)
     {
-        this -> state = CHANGE_BATTERIES;
+        enterState(CHANGE_BATTERIES);
         emit updateGUI(CHANGE_BATTERIES);
         return false;
     }
@@ -292,11 +807,34 @@ bool AED::nextStep(AEDState state, unsigned long sleepTime, int batteryUsed)
         return false;
     }
 
+    if (resuming)
+    {
+        // Fast forward to the step the snapshot was taken at, then carry on from there.
+        if (state != resumeState || cycle != resumeCycle)
+            return true;
 
-    this->state = state;
+        resuming = false;
+        resetSchedule();
+    }
+
+    // Covers the whole dwell in the step, up to its deadline.
+    TraceSpan span("nextStep", "device", "state", state);
+
+    recordTransition(state);
+    enterState(state);
+    stepTime = int(sleepTime);
     emit updateGUI(state);
+    takeSnapshot();
+
+    // A patient set to start with asystole shows none of their rhythm until the first round of CPR is over.
+    ecgMonitor->setRhythm(startWithAsystole && !physiologyModel && cycle == 0 ? ASYSTOLE : patientHeartCondition);
+    ecgMonitor->setCPR(state == CPR);
 
-    if(state == SELF_TEST_FAIL){
+    // Impedance is measured from analysis until the shock is delivered.
+    setImpedanceStreaming((state >= ANALYZING && state <= SHOCK_DELIVERED) || state == CHECK_PADS);
+
+    // Both end the session.
+    if(state == SELF_TEST_FAIL || state == ABORT){
         return false;
     }
 
@@ -311,8 +849,24 @@ bool AED::nextStep(AEDState state, unsigned long sleepTime, int batteryUsed)
 
     if (state == SHOCK_DELIVERED)
     {
+        // Discharge the capacitor into the patient. Only the energy is needed, not the trace.
+        double deliveredEnergy = ShockWaveform::simulate(shockEnergy, impedanceMonitor->getImpedance()).deliveredEnergy;
+
+        shocksDelivered.add();
+        if (!firstShockDelivered)
+        {
+            firstShockDelivered = true;
+            timeToFirstShock.record(microseconds(now() - runStart));
+        }
+
         shockCount++;
         emit updateShockCount(shockCount);
+        emit updateDeliveredEnergy(deliveredEnergy);
+
+        if (physiologyModel)
+        {
+            patient.applyShock(0, deliveredEnergy);
+        }
     }
 
     if(batteryLevel < SUFFICIENT_BATTERY_LEVEL)
@@ -320,43 +874,205 @@ bool AED::nextStep(AEDState state, unsigned long sleepTime, int batteryUsed)
 
     if (sleepTime != 0)
     {
-        QThread::msleep(sleepTime);
+        sleepUntilNextDeadline(sleepTime);
     }
 
     return true;
 }
 
 /*
-    Function: shockable()
-    Purpose: Checks if the patient is on shockable rhythm.
+    Function: resetSchedule()
+    Purpose: Starts a new schedule from the current time. Used after waiting on the
+             operator, since those waits have no deadline.
     Inputs:
         None
     Outputs:
-        True if the patient is on shockable rhythm, false otherwise.
+        None
 */
-bool AED::shockable() const
+void AED::resetSchedule()
 {
-    // if patiernt is on shockable rhythm
-    if (patientHeartCondition == VENTRICULAR_FIBRILLATION ||
-        patientHeartCondition == VENTRICULAR_TACHYCARDIA)
-    {
-        return true;
-    }
-
-    return false;
+    stepDeadline = now();
+    scheduleReset = true;
 }
 
 /*
-    Function: getPatientHeartCondition()
-    Purpose: Gets the patient's heart condition.
+    Function: sleepUntilNextDeadline()
+    Purpose: Sleeps until the next step is due. The deadline is advanced from the
+             previous deadline rather than from the current time, so a late wake-up
+             shortens the next sleep instead of delaying every step after it.
     Inputs:
-        None
+        unsigned long sleepTime: The time between the previous deadline and the next one.
     Outputs:
-        The patient's heart condition.
+        None
 */
-HeartState AED::getPatientHeartCondition() const
+void AED::sleepUntilNextDeadline(unsigned long sleepTime)
 {
-    return this->patientHeartCondition;
+    // Steps skipped while resuming take no time.
+    if (resuming)
+        return;
+
+    stepDeadline += std::chrono::milliseconds(sleepTime);
+
+    // A simulated clock jumps straight to the deadline, taking the commands sent meanwhile.
+    if (simulatedClock)
+    {
+        drainCommands();
+        simulatedNow = std::max(simulatedNow, stepDeadline);
+        return;
+    }
+
+    // Sleep coarsely, waking for commands, then spin for the last part to hide the
+    // scheduler's wake-up latency. A power off ends the step without waiting for its deadline.
+    auto wake = stepDeadline - std::chrono::microseconds(SCHEDULE_SPIN_MARGIN);
+    for (drainCommands(); state != ABORT && std::chrono::steady_clock::now() < wake; drainCommands())
+    {
+        waitForCommand(wake);
+    }
+    if (state == ABORT)
+        return;
+
+    while (std::chrono::steady_clock::now() < stepDeadline)
+    {
+        std::this_thread::yield();
+    }
+}
+
+/*
+    Function: now()
+    Purpose: Gets the time on the clock the device runs on.
+    Inputs:
+        None
+    Outputs:
+        The simulated time with a simulated clock, the steady clock otherwise.
+*/
+std::chrono::steady_clock::time_point AED::now() const
+{
+    return simulatedClock ? simulatedNow : std::chrono::steady_clock::now();
+}
+
+/*
+    Function: enterState()
+    Purpose: Enters a state, adding the time spent in the previous one to its metric.
+    Inputs:
+        AEDState state: The state being entered.
+    Outputs:
+        None
+*/
+void AED::enterState(AEDState state)
+{
+    auto entered = now();
+    stateSeconds(this->state).add(microseconds(entered - stepEntered.load()));
+
+    stepEntered = entered;
+    this->state = state;
+}
+
+/*
+    Function: recordTransition()
+    Purpose: Records how far a state transition happened from its deadline.
+    Inputs:
+        AEDState state: The state being entered.
+    Outputs:
+        None
+*/
+void AED::recordTransition(AEDState state)
+{
+    TransitionTiming timing;
+    timing.state = state;
+    timing.scheduledNs = std::chrono::duration_cast<std::chrono::nanoseconds>(stepDeadline - runStart).count();
+    timing.actualNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now() - runStart).count();
+    timing.rescheduled = scheduleReset;
+    scheduleReset = false;
+
+    if (qAbs(timing.latenessNs()) > TRANSITION_JITTER_TARGET * 1000LL)
+    {
+        qWarning() << "AED transition to state" << state << "missed its deadline by" << timing.latenessNs() / 1000 << "us";
+    }
+
+    QMutexLocker locker(&transitionTimingsMutex);
+    transitionTimings.append(timing);
+}
+
+/*
+    Function: getTransitionTimings()
+    Purpose: Gets the timing of every transition since the device was powered on.
+    Inputs:
+        None
+    Outputs:
+        The scheduled and actual time of each transition.
+*/
+QVector<TransitionTiming> AED::getTransitionTimings() const
+{
+    QMutexLocker locker(&transitionTimingsMutex);
+    return transitionTimings;
+}
+
+/*
+    Function: getMaxTransitionJitterNs()
+    Purpose: Gets the largest distance between a transition and its deadline.
+    Inputs:
+        None
+    Outputs:
+        The largest absolute lateness in nanoseconds, 0 if there was no transition.
+*/
+qint64 AED::getMaxTransitionJitterNs() const
+{
+    QMutexLocker locker(&transitionTimingsMutex);
+
+    qint64 jitter = 0;
+    for (const TransitionTiming &timing : transitionTimings)
+    {
+        jitter = qMax(jitter, qAbs(timing.latenessNs()));
+    }
+
+    return jitter;
+}
+
+/*
+    Function: setElevatedPriority()
+    Purpose: Runs the device loop at an elevated thread priority to reduce timing jitter.
+             How much this helps depends on the scheduling policy of the operating system.
+    Inputs:
+        bool elevated: True to raise the priority, false to restore the normal priority.
+    Outputs:
+        None
+*/
+void AED::setElevatedPriority(bool elevated)
+{
+    m_thread->setPriority(elevated ? QThread::TimeCriticalPriority : QThread::NormalPriority);
+}
+
+/*
+    Function: shockable()
+    Purpose: Checks if the patient is on shockable rhythm.
+    Inputs:
+        None
+    Outputs:
+        True if the patient is on shockable rhythm, false otherwise.
+*/
+bool AED::shockable() const
+{
+    // if patiernt is on shockable rhythm
+    if (patientHeartCondition == VENTRICULAR_FIBRILLATION ||
+        patientHeartCondition == VENTRICULAR_TACHYCARDIA)
+    {
+        return true;
+    }
+
+    return false;
+}
+
+/*
+    Function: getPatientHeartCondition()
+    Purpose: Gets the patient's heart condition.
+    Inputs:
+        None
+    Outputs:
+        The patient's heart condition.
+*/
+HeartState AED::getPatientHeartCondition() const
+{
+    return this->patientHeartCondition;
 }
 
 /*
@@ -374,7 +1090,8 @@ AEDState AED::getState() const
 
 /*
     Function: setState()
-    Purpose: Sets the state of the AED device.
+    Purpose: Sets the state of the AED device. Ignored while a session runs, so that a
+             reset scheduled at the end of a session cannot land in the next one.
     Inputs:
         int state: The state of the AED device.
     Outputs:
@@ -382,7 +1099,7 @@ AEDState AED::getState() const
 */
 void AED::setState(int state)
 {
-    this->state = (AEDState)state;
+    send(DeviceCommand(COMMAND_SET_STATE, state));
 }
 
 /*
@@ -398,6 +1115,32 @@ int AED::getBatteryLevel() const
     return this->batteryLevel;
 }
 
+/*
+    Function: getPadsAttached()
+    Purpose: Gets the status of the pads.
+    Inputs:
+        None
+    Outputs:
+        True if the pads are attached, false otherwise.
+*/
+bool AED::getPadsAttached() const
+{
+    return this->padsAttached;
+}
+
+/*
+    Function: getLostConnection()
+    Purpose: Gets whether connection loss is simulated.
+    Inputs:
+        None
+    Outputs:
+        True if the connection is lost at the next chance, false otherwise.
+*/
+bool AED::getLostConnection() const
+{
+    return this->loseConnection;
+}
+
 /*
     Function: setPatientHeartCondition()
     Purpose: Sets the patient's heart condition.
@@ -408,7 +1151,7 @@ int AED::getBatteryLevel() const
 */
 void AED::setPatientHeartCondition(int patientHeartCondition)
 {
-    this->patientHeartCondition = (HeartState)patientHeartCondition;
+    send(DeviceCommand(COMMAND_SET_HEART_CONDITION, patientHeartCondition));
 }
 
 /*
@@ -421,7 +1164,158 @@ void AED::setPatientHeartCondition(int patientHeartCondition)
 */
 void AED::setPadsAttached(bool padsAttached)
 {
-    this->padsAttached = padsAttached;
+    send(DeviceCommand(COMMAND_SET_PADS_ATTACHED, padsAttached));
+}
+
+/*
+    Function: setPediatricPads()
+    Purpose: Sets whether pediatric pads are used, which attenuates the shock energy.
+    Inputs:
+        bool pediatric: True for pediatric pads, false for adult pads.
+    Outputs:
+        None
+*/
+void AED::setPediatricPads(bool pediatric)
+{
+    send(DeviceCommand(COMMAND_SET_PEDIATRIC_PADS, pediatric));
+}
+
+/*
+    Function: setSimulatePoorContact()
+    Purpose: Sets whether the pads should occasionally lose contact with the patient.
+    Inputs:
+        bool simulate: True to simulate poor contact, false otherwise.
+    Outputs:
+        None
+*/
+void AED::setSimulatePoorContact(bool simulate)
+{
+    send(DeviceCommand(COMMAND_SET_POOR_CONTACT, simulate));
+}
+
+/*
+    Function: setPhysiologyModel()
+    Purpose: Sets whether the patient is simulated by the heart model.
+    Inputs:
+        bool enabled: True to use the heart model, false to follow the configured number of shocks.
+    Outputs:
+        None
+*/
+void AED::setPhysiologyModel(bool enabled)
+{
+    physiologyModel = enabled;
+}
+
+/*
+    Function: setMonitorLeads()
+    Purpose: Sets the number of ECG monitor leads acquired besides the pad lead.
+    Inputs:
+        int leads: 0 for the pads only, 3 or 12 for a monitor.
+    Outputs:
+        None
+*/
+void AED::setMonitorLeads(int leads)
+{
+    QMetaObject::invokeMethod(ecgMonitor.get(), "setMonitorLeads", Qt::QueuedConnection, Q_ARG(int, leads));
+}
+
+/*
+    Function: setArtifacts()
+    Purpose: Sends the device which artifacts are added to the ECG.
+    Inputs:
+        int artifacts: EcgArtifact flags.
+    Outputs:
+        None
+*/
+void AED::setArtifacts(int artifacts)
+{
+    send(DeviceCommand(COMMAND_SET_ARTIFACTS, artifacts));
+}
+
+/*
+    Function: setSimulatedClock()
+    Purpose: Sets whether the device runs on a simulated clock. Steps then take no
+             real time and the pad impedance is measured on the device thread, so a
+             whole session runs as fast as its steps can be computed. Only while the
+             device is off.
+    Inputs:
+        bool simulated: True for a simulated clock, false for the steady clock.
+    Outputs:
+        None
+*/
+void AED::setSimulatedClock(bool simulated)
+{
+    simulatedClock = simulated;
+    simulatedNow = std::chrono::steady_clock::now();
+}
+
+/*
+    Function: setSeed()
+    Purpose: Seeds every random choice of the device, the self test, connection loss,
+             the patient and the pad impedance, so that a session can be repeated.
+             Only while the device is off.
+    Inputs:
+        quint32 seed: The seed.
+    Outputs:
+        None
+*/
+void AED::setSeed(quint32 seed)
+{
+    random.seed(seed);
+    patient = CardiacModel(1, random.generate());
+    impedanceMonitor->setSeed(random.generate());
+}
+
+/*
+    Function: setEcgRecordingFile()
+    Purpose: Sets the file the compressed ECG of every session is written to.
+    Inputs:
+        const QString &fileName: The file, or an empty string to not write it.
+    Outputs:
+        None
+*/
+void AED::setEcgRecordingFile(const QString &fileName)
+{
+    ecgMonitor->setRecordingFile(fileName);
+}
+
+/*
+    Function: getStepEnteredTime()
+    Purpose: Gets when the latest step was entered. Can be called from any thread.
+    Inputs:
+        None
+    Outputs:
+        The time on the steady clock.
+*/
+std::chrono::steady_clock::time_point AED::getStepEnteredTime() const
+{
+    return stepEntered;
+}
+
+/*
+    Function: getStepTime()
+    Purpose: Gets how long the latest step lasts. Can be called from any thread.
+    Inputs:
+        None
+    Outputs:
+        The time in milliseconds, 0 for a step waiting on the operator.
+*/
+int AED::getStepTime() const
+{
+    return stepTime;
+}
+
+/*
+    Function: getEcgMonitor()
+    Purpose: Gets the ECG monitor, for reading the acquired samples.
+    Inputs:
+        None
+    Outputs:
+        The ECG monitor.
+*/
+const EcgMonitor *AED::getEcgMonitor() const
+{
+    return ecgMonitor.get();
 }
 
 /*
@@ -434,9 +1328,7 @@ void AED::setPadsAttached(bool padsAttached)
 */
 void AED::notifyPadsAttached()
 {
-    padsAttached = true;
-    QMutexLocker locker(&padsAttachedMutex);
-    waitForPadsAttachement.wakeOne();//Check for change batteries state first before proceeding
+    send(DeviceCommand(COMMAND_ATTACH_PADS));
 }
 
 /*
@@ -449,8 +1341,7 @@ void AED::notifyPadsAttached()
 */
 void AED::notifyReconnection()
 {
-    QMutexLocker locker(&restoreConnectionMutex);
-    waitForConnection.wakeOne();
+    send(DeviceCommand(COMMAND_RECONNECT));
 }
 
 /*
@@ -463,7 +1354,20 @@ void AED::notifyReconnection()
 */
 void AED::setBatteryLevel(int level)
 {
-    batteryLevel = level;
+    send(DeviceCommand(COMMAND_SET_BATTERY_LEVEL, level));
+}
+
+/*
+    Function: changeBatteries()
+    Purpose: Replaces the batteries with full ones.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void AED::changeBatteries()
+{
+    send(DeviceCommand(COMMAND_CHANGE_BATTERIES));
 }
 
 /*
@@ -478,9 +1382,7 @@ void AED::setBatteryLevel(int level)
 */
 void AED::setBatterySpecs(int startingLevel, int unitsPerShock, int unitsWhenIdle)
 {
-    batteryLevel = startingLevel;
-    batteryUnitsPerShock = unitsPerShock;
-    batteryUnitsWhenIdle = unitsWhenIdle;
+    send(DeviceCommand(COMMAND_SET_BATTERY_SPECS, startingLevel, unitsPerShock, unitsWhenIdle));
 }
 
 /*
@@ -493,7 +1395,7 @@ void AED::setBatterySpecs(int startingLevel, int unitsPerShock, int unitsWhenIdl
 */
 void AED::setShockUntilHealthy(int shockUntilHealthy)
 {
-    this->shockUntilHealthy = shockUntilHealthy;
+    send(DeviceCommand(COMMAND_SET_SHOCKS_UNTIL_HEALTHY, shockUntilHealthy));
 }
 
 /*
@@ -506,5 +1408,255 @@ void AED::setShockUntilHealthy(int shockUntilHealthy)
 */
 void AED::setStartWithAsystole(bool checked)
 {
-    this->startWithAsystole = checked;
+    send(DeviceCommand(COMMAND_SET_START_WITH_ASYSTOLE, checked));
+}
+
+/*
+    Function: takeSnapshot()
+    Purpose: Saves the state of the session at the start of the current step, and writes
+             it to the snapshot file if one is set. Steps that only happen under some
+             conditions, and steps that end the session, are not saved; resuming repeats
+             the step before them instead.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void AED::takeSnapshot()
+{
+    if (state == OFF || state == SELF_TEST_FAIL || state == CHANGE_BATTERIES || state == ABORT
+        || state == LOST_CONNECTION || state == CHECK_PADS)
+        return;
+
+    SessionSnapshot snapshot;
+    snapshot.protocol = protocol->getName();
+    snapshot.step = step;
+    snapshot.state = state;
+    snapshot.cycle = cycle;
+    snapshot.patientHeartCondition = patientHeartCondition;
+    snapshot.startWithAsystole = startWithAsystole;
+    snapshot.shockUntilHealthy = shockUntilHealthy;
+    snapshot.physiologyModel = physiologyModel;
+    snapshot.patient = patient.getPatientState(0);
+    snapshot.padsAttached = padsAttached;
+    snapshot.pediatricPads = impedanceMonitor->isPediatric();
+    snapshot.simulatePoorContact = impedanceMonitor->getSimulatePoorContact();
+    snapshot.loseConnection = loseConnection;
+    snapshot.batteryLevel = batteryLevel;
+    snapshot.batteryUnitsPerShock = batteryUnitsPerShock;
+    snapshot.batteryUnitsWhenIdle = batteryUnitsWhenIdle;
+    snapshot.shockCount = shockCount;
+    snapshot.shockEnergy = shockEnergy;
+
+    QByteArray data = snapshot.serialize();
+
+    QString fileName;
+    {
+        QMutexLocker locker(&snapshotMutex);
+        latestSnapshot = data;
+        fileName = snapshotFile;
+    }
+
+    // Written before the step's deadline, so the write does not delay the schedule.
+    if (!fileName.isEmpty())
+    {
+        QSaveFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit())
+        {
+            qWarning() << "Could not write the session snapshot to" << fileName;
+        }
+    }
+}
+
+/*
+    Function: getSnapshot()
+    Purpose: Gets the snapshot taken at the start of the latest step. Can be called from any thread.
+    Inputs:
+        None
+    Outputs:
+        The binary snapshot, empty if no step has been taken yet.
+*/
+QByteArray AED::getSnapshot() const
+{
+    QMutexLocker locker(&snapshotMutex);
+    return latestSnapshot;
+}
+
+/*
+    Function: setArchive()
+    Purpose: Sets the archive the sessions are appended to once they end.
+    Inputs:
+        SessionArchive *archive: The archive, or null to not archive the sessions.
+        const QString &scenario: What the sessions are run for.
+    Outputs:
+        None
+*/
+void AED::setArchive(SessionArchive *archive, const QString &scenario)
+{
+    QMutexLocker locker(&archiveMutex);
+    this->archive = archive;
+    archiveScenario = scenario;
+}
+
+/*
+    Function: archiveSession()
+    Purpose: Appends the session that just ended to the archive, with the state of every
+             transition, on the device clock.
+    Inputs:
+        qint64 startMs: When the session was powered on, on the wall clock.
+        HeartState condition: The condition of the patient at power on.
+    Outputs:
+        None
+*/
+void AED::archiveSession(qint64 startMs, HeartState condition)
+{
+    QMutexLocker locker(&archiveMutex);
+    if (archive == nullptr)
+        return;
+
+    ArchivedSession session;
+    session.startMs = startMs;
+    session.durationMs = quint32(std::chrono::duration_cast<std::chrono::milliseconds>(now() - runStart).count());
+    session.scenario = archiveScenario;
+    session.protocol = protocol->getName();
+    session.condition = condition;
+    session.finalCondition = patientHeartCondition;
+    session.shocks = shockCount;
+    session.batteryLevel = batteryLevel;
+
+    for (const TransitionTiming &timing : getTransitionTimings())
+    {
+        session.states.append(timing.state);
+        session.timesMs.append(quint32(timing.actualNs / 1000000));
+    }
+
+    archive->append(session);
+}
+
+/*
+    Function: restoreSnapshot()
+    Purpose: Restores a session from a snapshot. The snapshot is checked here, and restored
+             on the device thread by a command, in order with the other commands sent; the
+             next power on goes to the step of the program the snapshot was taken at, and
+             continues the protocol from there. Can be called from any thread.
+    Inputs:
+        const QByteArray &data: The binary snapshot.
+        SessionSnapshot *restored: Set to the snapshot, if not null.
+    Outputs:
+        True if the snapshot will be restored, false if the device is running, or it is not
+        a valid snapshot or its protocol is not loaded.
+*/
+bool AED::restoreSnapshot(const QByteArray &data, SessionSnapshot *restored)
+{
+    if (running)
+        return false;
+
+    SessionSnapshot snapshot;
+    if (!SessionSnapshot::deserialize(data, snapshot))
+        return false;
+
+    // The step is only meaningful in the program it was taken in.
+    const ResuscitationProtocol *resumed = ProtocolLibrary::instance()->at(ProtocolLibrary::instance()->find(snapshot.protocol));
+    if (resumed == nullptr || snapshot.step >= resumed->getProgram(snapshot.pediatricPads).steps.size())
+        return false;
+
+    if (restored != nullptr)
+    {
+        *restored = snapshot;
+    }
+
+    {
+        QMutexLocker locker(&snapshotMutex);
+        pendingSnapshot = snapshot;
+        pendingSnapshotData = data;
+    }
+
+    send(DeviceCommand(COMMAND_RESTORE_SNAPSHOT));
+    return true;
+}
+
+/*
+    Function: restorePendingSnapshot()
+    Purpose: Restores the snapshot checked by restoreSnapshot(). Only on the device thread,
+             while the device is off.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void AED::restorePendingSnapshot()
+{
+    SessionSnapshot snapshot;
+    QByteArray data;
+    {
+        QMutexLocker locker(&snapshotMutex);
+        if (pendingSnapshotData.isEmpty())
+            return;
+
+        snapshot = pendingSnapshot;
+        data = pendingSnapshotData;
+        pendingSnapshotData.clear();
+    }
+
+    patientHeartCondition = snapshot.patientHeartCondition;
+    startWithAsystole = snapshot.startWithAsystole;
+    shockUntilHealthy = snapshot.shockUntilHealthy;
+    physiologyModel = snapshot.physiologyModel;
+    patient.setPatientState(0, snapshot.patient);
+
+    padsAttached = snapshot.padsAttached;
+    impedanceMonitor->setPadsAttached(snapshot.padsAttached);
+    impedanceMonitor->setPediatric(snapshot.pediatricPads);
+    impedanceMonitor->setSimulatePoorContact(snapshot.simulatePoorContact);
+    loseConnection = snapshot.loseConnection;
+
+    batteryLevel = snapshot.batteryLevel;
+    batteryUnitsPerShock = snapshot.batteryUnitsPerShock;
+    batteryUnitsWhenIdle = snapshot.batteryUnitsWhenIdle;
+    shockCount = snapshot.shockCount;
+    shockEnergy = snapshot.shockEnergy;
+
+    protocol = ProtocolLibrary::instance()->at(ProtocolLibrary::instance()->find(snapshot.protocol));
+    state = OFF;
+    resumeState = snapshot.state;
+    resumeStep = snapshot.step;
+    resumeCycle = snapshot.cycle;
+    resuming = true;
+
+    {
+        QMutexLocker locker(&snapshotMutex);
+        latestSnapshot = data;
+    }
+
+    emit batteryChanged(batteryLevel);
+    emit updateShockCount(shockCount);
+    emit updatePatientCondition(patientHeartCondition);
+}
+
+/*
+    Function: setSnapshotFile()
+    Purpose: Sets the file that a snapshot is written to at the start of every step.
+    Inputs:
+        const QString &fileName: The file, or an empty string to stop writing snapshots.
+    Outputs:
+        None
+*/
+void AED::setSnapshotFile(const QString &fileName)
+{
+    QMutexLocker locker(&snapshotMutex);
+    snapshotFile = fileName;
+}
+
+/*
+    Function: setProtocol()
+    Purpose: Sends the device a switch to another protocol, for the sessions after the
+             current one. A session restored from a snapshot keeps the protocol of the snapshot.
+    Inputs:
+        int protocol: The index of the protocol in the library.
+    Outputs:
+        None
+*/
+void AED::setProtocol(int protocol)
+{
+    send(DeviceCommand(COMMAND_SET_PROTOCOL, protocol));
 }
@@ -9,14 +9,42 @@
 #include <QMutex>
 #include <QThread>
 #include <QRandomGenerator>
+#include <QVector>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 
 #ifndef AED_H
 #define AED_H
 
 #include "defs.h"
+#include "CardiacModel.h"
+#include "DeviceCommandQueue.h"
+#include "EcgMonitor.h"
+#include "ImpedanceMonitor.h"
+#include "ResuscitationProtocol.h"
+#include "SessionArchive.h"
+#include "SessionSnapshot.h"
+#include "ShockWaveform.h"
 
 class MainWindow;
 
+// Timing of a single state transition against its scheduled deadline.
+// Times are in nanoseconds since the device was powered on.
+struct TransitionTiming
+{
+    AEDState state;
+    qint64 scheduledNs;
+    qint64 actualNs;
+
+    // True if the schedule was restarted since the previous transition,
+    // for example after waiting on the operator.
+    bool rescheduled;
+
+    qint64 latenessNs() const { return actualNs - scheduledNs; }
+};
+
 class AED : public QObject
 {
     Q_OBJECT
@@ -30,12 +58,40 @@ public:
     HeartState getPatientHeartCondition() const;
     AEDState getState() const;
     bool getPadsAttached() const;
+    bool getLostConnection() const;
     int getBatteryLevel() const;
+    QVector<TransitionTiming> getTransitionTimings() const;
+    qint64 getMaxTransitionJitterNs() const;
+    const EcgMonitor *getEcgMonitor() const;
+
+    // When the latest step was entered, for measuring how long the GUI takes to follow.
+    std::chrono::steady_clock::time_point getStepEnteredTime() const;
+
+    // How long the protocol keeps the latest step, in milliseconds.
+    int getStepTime() const;
+
+    // Snapshot taken at the start of the latest step, empty before the first step.
+    QByteArray getSnapshot() const;
+
+    // Only while the device is off. The next power on resumes at the snapshot's step.
+    // The snapshot is checked here and restored on the device thread, by a command.
+    bool restoreSnapshot(const QByteArray &data, SessionSnapshot *restored = nullptr);
 
     // Setters
     void setGUI(MainWindow *mainWindow);
+    void setElevatedPriority(bool elevated);
+
+    // Every session that ends is appended to the archive, if there is one, under the
+    // scenario. Can be called from any thread, and applies from the next session on.
+    void setArchive(SessionArchive *archive, const QString &scenario);
+
+    // Sends a command, applied on the device thread in the order sent: when the thread
+    // is idle, at the start of every step, and while it waits in one. Can be called
+    // from any thread. The operator slots below send their command.
+    void send(const DeviceCommand &command);
 
 public slots:
+    // Runs a session on the device thread, returning once it is over.
     void powerOn();
     void powerOff();
 
@@ -48,24 +104,58 @@ public slots:
     void setStartWithAsystole(bool checked);
     void setLostConnection(bool simulateConnectionLoss);
     void setBatteryLevel(int level);
+    void changeBatteries();
     void notifyReconnection();
     void setState(int state);
+    void setPediatricPads(bool pediatric);
+    void setSimulatePoorContact(bool simulate);
+    void setPhysiologyModel(bool enabled);
+    void setMonitorLeads(int leads);
+    void setArtifacts(int artifacts);
+    void setEcgRecordingFile(const QString &fileName);
+    void setSimulatedClock(bool simulated);
+    void setSeed(quint32 seed);
+    void setSnapshotFile(const QString &fileName);
+    void setProtocol(int protocol);
 private slots:
     void cleanUp();
+    void drainPostedCommands();
 signals:
     // For updating UI state.
     void updateGUI(int state);
     void batteryChanged(int level);
     void updateShockCount(int count);
     void updatePatientCondition(int condition);
+    void impedanceMeasured(double impedance, bool goodContact);
+    void updateDeliveredEnergy(double energy);
 
 private:
     bool selfTest();
     bool nextStep(AEDState state, unsigned long sleepTime, int batteryUsed);
     bool shockable() const;
+    int lastCycle() const;
     void run();
     bool checkPadsAttached();
-    void checkConnection();
+    bool checkConnection();
+    bool checkPadContact();
+    void setImpedanceStreaming(bool streaming);
+    void advancePatient(unsigned long time, bool cpr);
+
+    // Steps are scheduled against absolute deadlines so that timing errors do not add up.
+    void resetSchedule();
+    void sleepUntilNextDeadline(unsigned long sleepTime);
+    void recordTransition(AEDState state);
+    void enterState(AEDState state);
+    std::chrono::steady_clock::time_point now() const;
+
+    void takeSnapshot();
+    void restorePendingSnapshot();
+    void archiveSession(qint64 startMs, HeartState condition);
+
+    void drainCommands();
+    void apply(const DeviceCommand &command);
+    void waitForCommand();
+    void waitForCommand(std::chrono::steady_clock::time_point until);
 
     HeartState patientHeartCondition;
     bool startWithAsystole;
@@ -78,15 +168,77 @@ private:
     // For simulation purpose.
     int shockUntilHealthy;
 
+    // The protocol followed, from the library, and the step of its program being run.
+    const ResuscitationProtocol *protocol;
+    int step;
+
+    // Analysis of the protocol, counting every analysis of a cycle with more than one shock.
+    int cycle;
+
+    // When enabled, the patient responds to shocks and CPR through a model of the
+    // heart instead of turning healthy after shockUntilHealthy shocks.
+    bool physiologyModel;
+    QRandomGenerator random;
+    CardiacModel patient;
+
     // Indicate battery discharge for each operation.
     int batteryUnitsPerShock = 5;
     int batteryUnitsWhenIdle = 1;
 
-    QMutex padsAttachedMutex;
-    QWaitCondition waitForPadsAttachement;
-
-    QMutex restoreConnectionMutex;
-    QWaitCondition waitForConnection;
+    // Commands sent to the device. The device thread waits on the pads, the cable and
+    // the deadline of a step for the next command, and is woken by its sender.
+    DeviceCommandQueue commands;
+    std::mutex commandMutex;
+    std::condition_variable commandSent;
+    std::atomic<bool> waitingForCommand;
+
+    // True from a drain being posted to the idle device thread until it starts.
+    std::atomic<bool> drainPosted;
+
+    bool connectionRestored = false;
+
+    // Pad impedance, measured on its own thread.
+    std::unique_ptr<ImpedanceMonitor> impedanceMonitor;
+    bool impedanceStreaming;
+    std::atomic<double> shockEnergy;
+
+    // Multi-lead ECG, acquired on its own thread.
+    std::unique_ptr<EcgMonitor> ecgMonitor;
+
+    std::chrono::steady_clock::time_point runStart;
+    std::chrono::steady_clock::time_point stepDeadline;
+    bool simulatedClock;
+    std::chrono::steady_clock::time_point simulatedNow;
+    bool scheduleReset;
+
+    // Between the start and the end of powerOn().
+    std::atomic<bool> running;
+
+    // For the metrics: time in the current state and whether this run has shocked yet.
+    std::atomic<std::chrono::steady_clock::time_point> stepEntered;
+    std::atomic<int> stepTime;
+    bool firstShockDelivered;
+
+    // While resuming, steps are skipped until the one the snapshot was taken at.
+    bool resuming;
+    AEDState resumeState;
+    int resumeStep;
+    int resumeCycle;
+
+    // Written at the start of every step that can be resumed.
+    QString snapshotFile;
+    QByteArray latestSnapshot;
+    mutable QMutex snapshotMutex;
+
+    // Checked by restoreSnapshot() and waiting for its command, empty data for none.
+    SessionSnapshot pendingSnapshot;
+    QByteArray pendingSnapshotData;
+    QVector<TransitionTiming> transitionTimings;
+    mutable QMutex transitionTimingsMutex;
+
+    SessionArchive *archive;
+    QString archiveScenario;
+    QMutex archiveMutex;
 
     MainWindow *gui;
     std::unique_ptr<QThread> m_thread;
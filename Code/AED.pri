@@ -0,0 +1,103 @@
+# The device, its simulations and its windows, shared by the application and the tests.
+QT       += core gui concurrent
+
+# The soak counts live QObjects through the hooks of qhooks_p.h.
+QT += core-private
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+# Voice prompts play through Qt Multimedia where it is installed, otherwise only to a file or nowhere.
+qtHaveModule(multimedia) {
+    QT += multimedia
+    DEFINES += AED_SPEAKER
+}
+
+CONFIG += c++17
+
+# Let the compiler vectorize the batch simulation kernels.
+gcc|clang: QMAKE_CXXFLAGS_RELEASE += -O3
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/MainWindow.cpp \
+    $$PWD/ArchiveQuery.cpp \
+    $$PWD/AudioSink.cpp \
+    $$PWD/BiquadFilterBank.cpp \
+    $$PWD/CardiacModel.cpp \
+    $$PWD/CprMetronome.cpp \
+    $$PWD/DeviceCommandQueue.cpp \
+    $$PWD/EcgArtifacts.cpp \
+    $$PWD/EcgBenchmark.cpp \
+    $$PWD/EcgBuffer.cpp \
+    $$PWD/EcgDisplay.cpp \
+    $$PWD/EcgEnvelope.cpp \
+    $$PWD/EcgMonitor.cpp \
+    $$PWD/EcgRecording.cpp \
+    $$PWD/ImpedanceMonitor.cpp \
+    $$PWD/JitterBenchmark.cpp \
+    $$PWD/MetricsRegistry.cpp \
+    $$PWD/ProtocolExplorer.cpp \
+    $$PWD/ProtocolRules.cpp \
+    $$PWD/ResuscitationProtocol.cpp \
+    $$PWD/QrsDetector.cpp \
+    $$PWD/ScenarioRunner.cpp \
+    $$PWD/SessionArchive.cpp \
+    $$PWD/SessionBranch.cpp \
+    $$PWD/SessionSnapshot.cpp \
+    $$PWD/ShockWaveform.cpp \
+    $$PWD/SoakRunner.cpp \
+    $$PWD/StartupProfiler.cpp \
+    $$PWD/TickScheduler.cpp \
+    $$PWD/TraceRecorder.cpp \
+    $$PWD/UiFuzzer.cpp \
+    $$PWD/VoicePrompter.cpp \
+    $$PWD/WardDashboard.cpp \
+    $$PWD/AED.cpp
+
+HEADERS += \
+    $$PWD/MainWindow.h \
+    $$PWD/defs.h \
+    $$PWD/ArchiveQuery.h \
+    $$PWD/AudioSink.h \
+    $$PWD/BiquadFilterBank.h \
+    $$PWD/CardiacModel.h \
+    $$PWD/CprMetronome.h \
+    $$PWD/DeviceCommandQueue.h \
+    $$PWD/EcgArtifacts.h \
+    $$PWD/EcgBenchmark.h \
+    $$PWD/EcgBuffer.h \
+    $$PWD/EcgDisplay.h \
+    $$PWD/EcgEnvelope.h \
+    $$PWD/EcgMonitor.h \
+    $$PWD/EcgRecording.h \
+    $$PWD/ImpedanceMonitor.h \
+    $$PWD/JitterBenchmark.h \
+    $$PWD/MetricsRegistry.h \
+    $$PWD/ProtocolExplorer.h \
+    $$PWD/ProtocolRules.h \
+    $$PWD/ResuscitationProtocol.h \
+    $$PWD/QrsDetector.h \
+    $$PWD/ScenarioRunner.h \
+    $$PWD/SessionArchive.h \
+    $$PWD/SessionBranch.h \
+    $$PWD/SessionSnapshot.h \
+    $$PWD/ShockWaveform.h \
+    $$PWD/SoakRunner.h \
+    $$PWD/StartupProfiler.h \
+    $$PWD/TickScheduler.h \
+    $$PWD/TraceRecorder.h \
+    $$PWD/UiFuzzer.h \
+    $$PWD/VoicePrompter.h \
+    $$PWD/WardDashboard.h \
+    $$PWD/AED.h
+
+FORMS += \
+    $$PWD/MainWindow.ui
+
+RESOURCES += \
+    $$PWD/Resources.qrc
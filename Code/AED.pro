@@ -1,31 +1,6 @@
-QT       += core gui
+# The application and its tests. "make check" runs the tests.
+TEMPLATE = subdirs
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-CONFIG += c++17
-
-# You can make your code fail to compile if it uses deprecated APIs.
-# In order to do so, uncomment the following line.
-#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
-
-SOURCES += \
-    main.cpp \
-    MainWindow.cpp \
-    AED.cpp
-
-HEADERS += \
-    MainWindow.h \
-    defs.h \
-    AED.h
-
-
-FORMS += \
-    MainWindow.ui
-
-# Default rules for deployment.
-qnx: target.path = /tmp/$${TARGET}/bin
-else: unix:!android: target.path = /opt/$${TARGET}/bin
-!isEmpty(target.path): INSTALLS += target
-
-RESOURCES += \
-    Resources.qrc
+SUBDIRS += \
+    app \
+    tests
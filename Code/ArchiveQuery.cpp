@@ -0,0 +1,450 @@
+// IMPORTS
+#include "ArchiveQuery.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QVector>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cmath>
+
+// Names of the queries on the command line, in the order of their enum.
+static const char *const QUERY_NAMES[] = {"summary", "time-to-shock", "cpr-fraction", "self-test-failures"};
+
+// Scenarios the synthetic sessions of the benchmark are spread over.
+static const char *const BENCHMARK_SCENARIOS[] = {"manual", "ward", "pads-late", "refractory-vf"};
+
+/*
+    Function: percentile()
+    Purpose: Finds a percentile by the nearest rank, partially sorting the values.
+    Inputs:
+        std::vector<quint32> &values: The values, at least one.
+        double fraction: The percentile, between 0 and 1.
+    Outputs:
+        The value at the percentile.
+*/
+static quint32 percentile(std::vector<quint32> &values, double fraction)
+{
+    std::size_t rank = std::size_t(std::ceil(fraction * values.size()));
+    rank = std::min(values.size(), std::max<std::size_t>(rank, 1)) - 1;
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+
+/*
+    Function: syntheticSession()
+    Purpose: Makes a session going through the built-in protocol, as the device would
+             archive it. A tenth of them fail the self test.
+    Inputs:
+        QRandomGenerator &random: Draws the scenario, the patient and the wait on the pads.
+        qint64 startMs: When the session was powered on.
+    Outputs:
+        The session.
+*/
+static ArchivedSession syntheticSession(QRandomGenerator &random, qint64 startMs)
+{
+    ArchivedSession session;
+    session.startMs = startMs;
+    session.scenario = BENCHMARK_SCENARIOS[random.bounded(4)];
+    session.protocol = DEFAULT_PROTOCOL_NAME;
+    session.condition = (HeartState)random.bounded(3);
+    session.batteryLevel = MAX_BATTERY_LEVEL;
+
+    quint32 t = 0;
+    auto enter = [&session, &t](AEDState state, quint32 time)
+    {
+        session.states.append(state);
+        session.timesMs.append(t);
+        t += time;
+    };
+
+    if (random.bounded(10) == 0)
+    {
+        session.finalCondition = session.condition;
+        enter(SELF_TEST_FAIL, 0);
+    }
+    else
+    {
+        enter(SELF_TEST_SUCCESS, SLEEP);
+        if (session.scenario != "ward")
+        {
+            enter(STAY_CALM, SLEEP);
+            enter(CHECK_RESPONSE, SLEEP);
+            enter(CALL_HELP, SLEEP);
+            enter(ATTACH_PADS, ATTACH_PADS_TIME + random.bounded(30000));
+        }
+
+        session.shocks = session.condition == SINUS_RHYTHM ? 0 : 1 + random.bounded(3);
+        for (int shock = 0; shock < session.shocks; ++shock)
+        {
+            enter(ANALYZING, ANALYZING_TIME);
+            enter(SHOCK_ADVISED, SLEEP);
+            enter(STAND_CLEAR, SLEEP);
+            enter(SHOCKING, SHOCKING_TIME);
+            enter(SHOCK_DELIVERED, SLEEP);
+            enter(CPR, CPR_TIME);
+            enter(STOP_CPR, SLEEP);
+        }
+        enter(ANALYZING, ANALYZING_TIME);
+        enter(NO_SHOCK_ADVISED, SLEEP);
+        enter(ABORT, 0);
+    }
+
+    session.durationMs = t;
+    return session;
+}
+
+/*
+    Function: names()
+    Purpose: Gets the names of the queries.
+    Inputs:
+        None
+    Outputs:
+        The names, in the order of ArchiveQueryType.
+*/
+QStringList ArchiveQuery::names()
+{
+    QStringList result;
+    for (const char *name : QUERY_NAMES)
+    {
+        result.append(name);
+    }
+    return result;
+}
+
+/*
+    Function: find()
+    Purpose: Finds a query by its name.
+    Inputs:
+        const QString &name: The name.
+        ArchiveQueryType &type: Set to the query, if there is one.
+    Outputs:
+        True if there is a query with the name, false otherwise.
+*/
+bool ArchiveQuery::find(const QString &name, ArchiveQueryType &type)
+{
+    int index = names().indexOf(name);
+    if (index < 0)
+        return false;
+
+    type = (ArchiveQueryType)index;
+    return true;
+}
+
+/*
+    Function: run()
+    Purpose: Runs a query over every segment of an archive in parallel, then merges
+             the partial results in the order of the segments.
+    Inputs:
+        const ArchiveReader &archive: The archive.
+        ArchiveQueryType type: The query.
+    Outputs:
+        The result as lines of text.
+*/
+QStringList ArchiveQuery::run(const ArchiveReader &archive, ArchiveQueryType type)
+{
+    const QVector<ArchiveSegment> &segments = archive.getSegments();
+    QVector<Partial> partials(segments.size());
+    QVector<int> indexes;
+    for (int i = 0; i < segments.size(); ++i)
+    {
+        indexes.append(i);
+    }
+
+    // Every index touches only its own partial result.
+    Partial *data = partials.data();
+    QtConcurrent::blockingMap(indexes, [data, &segments, type](int index)
+                              { scan(segments.at(index), type, data[index]); });
+
+    Partial total;
+    for (Partial &partial : partials)
+    {
+        merge(total, partial);
+    }
+
+    return report(type, total);
+}
+
+/*
+    Function: scan()
+    Purpose: Runs a query over the sessions of a segment. Totals by scenario are
+             kept by the index of the scenario in the segment, and named at the end.
+    Inputs:
+        const ArchiveSegment &segment: The segment.
+        ArchiveQueryType type: The query.
+        Partial &partial: Set to what the segment adds to the result.
+    Outputs:
+        None
+*/
+void ArchiveQuery::scan(const ArchiveSegment &segment, ArchiveQueryType type, Partial &partial)
+{
+    partial.sessions = segment.sessions;
+    partial.events = segment.events;
+
+    switch (type)
+    {
+    case QUERY_SUMMARY:
+        // Sessions are appended as they end, so they are not in the order they started.
+        partial.firstStartMs = segment.sessions > 0 ? segment.startMs(0) : 0;
+        partial.lastStartMs = partial.firstStartMs;
+        for (int i = 0; i < segment.sessions; ++i)
+        {
+            partial.shocks += segment.shocks(i);
+            if (segment.finalCondition(i) <= ASYSTOLE)
+            {
+                partial.finalConditions[segment.finalCondition(i)]++;
+            }
+            partial.firstStartMs = qMin(partial.firstStartMs, segment.startMs(i));
+            partial.lastStartMs = qMax(partial.lastStartMs, segment.startMs(i));
+        }
+        break;
+
+    case QUERY_TIME_TO_SHOCK:
+        for (int i = 0; i < segment.sessions; ++i)
+        {
+            int event = segment.eventBegin(i);
+            int end = segment.eventEnd(i);
+            while (event < end && segment.state(event) != ATTACH_PADS)
+            {
+                event++;
+            }
+            if (event == end)
+                continue;
+
+            partial.padsPrompted++;
+            quint32 padsMs = segment.timeMs(event);
+            while (event < end && segment.state(event) != SHOCK_DELIVERED)
+            {
+                event++;
+            }
+            if (event < end)
+            {
+                partial.timesToShockMs.push_back(segment.timeMs(event) - padsMs);
+            }
+        }
+        break;
+
+    case QUERY_CPR_FRACTION:
+    {
+        QVector<CprTotals> totals(segment.scenarios.size());
+        for (int i = 0; i < segment.sessions; ++i)
+        {
+            if (segment.scenario(i) >= totals.size())
+                continue;
+
+            // A state lasts until the next one, the last one until the end of the session.
+            CprTotals &scenario = totals[segment.scenario(i)];
+            int end = segment.eventEnd(i);
+            for (int event = segment.eventBegin(i); event < end; ++event)
+            {
+                if (segment.state(event) == CPR)
+                {
+                    quint32 leftMs = event + 1 < end ? segment.timeMs(event + 1) : segment.durationMs(i);
+                    scenario.cprMs += qMax<qint64>(0, qint64(leftMs) - segment.timeMs(event));
+                }
+            }
+            scenario.durationMs += segment.durationMs(i);
+            scenario.sessions++;
+        }
+
+        for (int s = 0; s < totals.size(); ++s)
+        {
+            CprTotals &scenario = partial.cprByScenario[segment.scenarios[s]];
+            scenario.sessions += totals[s].sessions;
+            scenario.cprMs += totals[s].cprMs;
+            scenario.durationMs += totals[s].durationMs;
+        }
+        break;
+    }
+
+    case QUERY_SELF_TEST_FAILURES:
+        // The self test ends in the first state of a session, a resumed session has none.
+        // A low battery passes the test, but ends the session.
+        for (int i = 0; i < segment.sessions; ++i)
+        {
+            int begin = segment.eventBegin(i);
+            if (begin == segment.eventEnd(i))
+                continue;
+
+            AEDState first = segment.state(begin);
+            if (first == SELF_TEST_SUCCESS || first == SELF_TEST_FAIL || first == CHANGE_BATTERIES)
+            {
+                partial.selfTests++;
+                partial.selfTestFailures += first == SELF_TEST_FAIL;
+            }
+        }
+        break;
+    }
+}
+
+/*
+    Function: merge()
+    Purpose: Adds a partial result to the total, taking its values.
+    Inputs:
+        Partial &total: The total.
+        Partial &partial: The partial result, of a segment after the ones merged.
+    Outputs:
+        None
+*/
+void ArchiveQuery::merge(Partial &total, Partial &partial)
+{
+    if (partial.sessions > 0)
+    {
+        total.firstStartMs = total.sessions == 0 ? partial.firstStartMs : qMin(total.firstStartMs, partial.firstStartMs);
+        total.lastStartMs = total.sessions == 0 ? partial.lastStartMs : qMax(total.lastStartMs, partial.lastStartMs);
+    }
+
+    total.sessions += partial.sessions;
+    total.events += partial.events;
+    total.shocks += partial.shocks;
+    for (int c = SINUS_RHYTHM; c <= ASYSTOLE; ++c)
+    {
+        total.finalConditions[c] += partial.finalConditions[c];
+    }
+
+    total.padsPrompted += partial.padsPrompted;
+    total.timesToShockMs.insert(total.timesToShockMs.end(), partial.timesToShockMs.begin(), partial.timesToShockMs.end());
+    std::vector<quint32>().swap(partial.timesToShockMs);
+
+    for (auto it = partial.cprByScenario.constBegin(); it != partial.cprByScenario.constEnd(); ++it)
+    {
+        CprTotals &scenario = total.cprByScenario[it.key()];
+        scenario.sessions += it.value().sessions;
+        scenario.cprMs += it.value().cprMs;
+        scenario.durationMs += it.value().durationMs;
+    }
+
+    total.selfTests += partial.selfTests;
+    total.selfTestFailures += partial.selfTestFailures;
+}
+
+/*
+    Function: report()
+    Purpose: Writes the result of a query.
+    Inputs:
+        ArchiveQueryType type: The query.
+        Partial &total: The merged result. Its times are reordered.
+    Outputs:
+        The result as lines of text.
+*/
+QStringList ArchiveQuery::report(ArchiveQueryType type, Partial &total)
+{
+    QStringList lines;
+
+    switch (type)
+    {
+    case QUERY_SUMMARY:
+        lines.append(QString("Sessions: %1, %2 state transitions").arg(total.sessions).arg(total.events));
+        if (total.sessions > 0)
+        {
+            lines.append(QString("Powered on from %1 to %2")
+                             .arg(QDateTime::fromMSecsSinceEpoch(total.firstStartMs).toString(Qt::ISODate))
+                             .arg(QDateTime::fromMSecsSinceEpoch(total.lastStartMs).toString(Qt::ISODate)));
+        }
+        lines.append(QString("Shocks delivered: %1").arg(total.shocks));
+        lines.append(QString("Final rhythm: sinus rhythm %1, VF %2, VT %3, asystole %4")
+                         .arg(total.finalConditions[SINUS_RHYTHM]).arg(total.finalConditions[VENTRICULAR_FIBRILLATION])
+                         .arg(total.finalConditions[VENTRICULAR_TACHYCARDIA]).arg(total.finalConditions[ASYSTOLE]));
+        break;
+
+    case QUERY_TIME_TO_SHOCK:
+        if (total.timesToShockMs.empty())
+        {
+            lines.append(QString("No shock after ATTACH_PADS, in %1 sessions prompting for the pads").arg(total.padsPrompted));
+            break;
+        }
+
+        lines.append(QString("ATTACH_PADS to first SHOCK_DELIVERED: median %1 s, 90th percentile %2 s")
+                         .arg(percentile(total.timesToShockMs, 0.5) / 1000.0, 0, 'f', 1)
+                         .arg(percentile(total.timesToShockMs, 0.9) / 1000.0, 0, 'f', 1));
+        lines.append(QString("Over %1 shocked of %2 sessions prompting for the pads")
+                         .arg(total.timesToShockMs.size()).arg(total.padsPrompted));
+        break;
+
+    case QUERY_CPR_FRACTION:
+    {
+        QStringList scenarios = total.cprByScenario.keys();
+        std::sort(scenarios.begin(), scenarios.end());
+        for (const QString &name : scenarios)
+        {
+            const CprTotals &scenario = total.cprByScenario.value(name);
+            lines.append(QString("%1: CPR fraction %2% over %3 sessions")
+                             .arg(name.isEmpty() ? QString("(none)") : name)
+                             .arg(100.0 * scenario.cprMs / qMax<qint64>(1, scenario.durationMs), 0, 'f', 1)
+                             .arg(scenario.sessions));
+        }
+        break;
+    }
+
+    case QUERY_SELF_TEST_FAILURES:
+        lines.append(QString("Self tests: %1 of %2 failed (%3%)")
+                         .arg(total.selfTestFailures).arg(total.selfTests)
+                         .arg(100.0 * total.selfTestFailures / qMax<qint64>(1, total.selfTests), 0, 'f', 2));
+        break;
+    }
+
+    return lines;
+}
+
+/*
+    Function: benchmark()
+    Purpose: Measures how fast sessions are archived and how fast each query runs over them.
+    Inputs:
+        int sessions: The number of sessions to archive.
+        quint32 seed: Seed of the sessions.
+        QStringList &lines: The results of the benchmark and of every query are appended
+                            as lines of text.
+    Outputs:
+        True if the archive was written and read back, false otherwise.
+*/
+bool ArchiveQuery::benchmark(int sessions, quint32 seed, QStringList &lines)
+{
+    sessions = qMax(1, sessions);
+
+    QTemporaryDir dir;
+    QString fileName = dir.filePath("sessions.archive");
+    QRandomGenerator random(seed);
+
+    QElapsedTimer timer;
+    timer.start();
+    {
+        SessionArchive writer;
+        if (!writer.open(fileName))
+            return false;
+
+        qint64 startMs = QDateTime::currentMSecsSinceEpoch();
+        for (int i = 0; i < sessions; ++i)
+        {
+            writer.append(syntheticSession(random, startMs + i * 60000LL));
+        }
+    }
+    double writeSeconds = timer.nsecsElapsed() / 1e9;
+
+    ArchiveReader reader;
+    if (!reader.open(fileName))
+        return false;
+
+    lines.append(QString("%1 sessions, %2 state transitions, %3 bytes per session, written in %4 s")
+                     .arg(reader.sessionCount()).arg(reader.eventCount())
+                     .arg(double(QFileInfo(fileName).size()) / sessions, 0, 'f', 1).arg(writeSeconds, 0, 'f', 2));
+
+    for (int type = QUERY_SUMMARY; type <= QUERY_SELF_TEST_FAILURES; ++type)
+    {
+        timer.restart();
+        QStringList result = run(reader, (ArchiveQueryType)type);
+        double seconds = timer.nsecsElapsed() / 1e9;
+
+        lines.append(QString("%1: %2 ms, %3 sessions/s")
+                         .arg(QUERY_NAMES[type]).arg(seconds * 1000.0, 0, 'f', 1).arg(sessions / seconds, 0, 'e', 2));
+        for (const QString &line : result)
+        {
+            lines.append("  " + line);
+        }
+    }
+
+    return true;
+}
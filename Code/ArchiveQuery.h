@@ -0,0 +1,74 @@
+#ifndef ARCHIVEQUERY_H
+#define ARCHIVEQUERY_H
+
+// Qt imports
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+#include <vector>
+
+// Local imports
+#include "defs.h"
+#include "SessionArchive.h"
+
+// Questions asked of an archive.
+enum ArchiveQueryType
+{
+    QUERY_SUMMARY,           // Sessions, shocks and how the patients ended up.
+    QUERY_TIME_TO_SHOCK,     // Time from the pads prompt to the first shock, median and 90th percentile.
+    QUERY_CPR_FRACTION,      // Time in CPR over the time of the sessions, by scenario.
+    QUERY_SELF_TEST_FAILURES // Self tests that failed, over the sessions that ran one.
+};
+
+// Answers a query by scanning every segment of an archive on its own thread, each
+// into a partial result of its own, and merging the partial results at the end.
+// A query only reads the columns it needs.
+class ArchiveQuery
+{
+public:
+    // The names of the queries, in the order of their enum.
+    static QStringList names();
+
+    // Returns false if there is no query with the name.
+    static bool find(const QString &name, ArchiveQueryType &type);
+
+    // The result as lines of text.
+    static QStringList run(const ArchiveReader &archive, ArchiveQueryType type);
+
+    // Archives synthetic sessions to a temporary file and times every query over them.
+    // Returns false if the archive could not be written or read back.
+    static bool benchmark(int sessions, quint32 seed, QStringList &lines);
+
+private:
+    struct CprTotals
+    {
+        qint64 sessions = 0;
+        qint64 cprMs = 0;
+        qint64 durationMs = 0;
+    };
+
+    struct Partial
+    {
+        qint64 sessions = 0;
+        qint64 events = 0;
+        qint64 shocks = 0;
+        qint64 finalConditions[ASYSTOLE + 1] = {};
+        qint64 firstStartMs = 0;
+        qint64 lastStartMs = 0;
+
+        qint64 padsPrompted = 0;
+        std::vector<quint32> timesToShockMs;
+
+        QHash<QString, CprTotals> cprByScenario;
+
+        qint64 selfTests = 0;
+        qint64 selfTestFailures = 0;
+    };
+
+    static void scan(const ArchiveSegment &segment, ArchiveQueryType type, Partial &partial);
+    static void merge(Partial &total, Partial &partial);
+    static QStringList report(ArchiveQueryType type, Partial &total);
+};
+
+#endif
@@ -0,0 +1,272 @@
+// IMPORTS
+#include "AudioSink.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QSaveFile>
+
+#ifdef AED_SPEAKER
+#include <QAudioFormat>
+#include <QIODevice>
+#endif
+
+/*
+    Function: create()
+    Purpose: Makes a sink by name. Without Qt Multimedia, the speaker is replaced by
+             a null sink.
+    Inputs:
+        const QString &name: "speaker", "null", or the name of a WAV file.
+    Outputs:
+        The sink.
+*/
+std::unique_ptr<AudioSink> AudioSink::create(const QString &name)
+{
+    if (name == "null")
+        return std::unique_ptr<AudioSink>(new NullAudioSink());
+
+    if (name != "speaker")
+        return std::unique_ptr<AudioSink>(new FileAudioSink(name));
+
+#ifdef AED_SPEAKER
+    return std::unique_ptr<AudioSink>(new SpeakerAudioSink());
+#else
+    qWarning().noquote() << "Built without Qt Multimedia, voice prompts are not played";
+    return std::unique_ptr<AudioSink>(new NullAudioSink());
+#endif
+}
+
+/*
+    Function: NullAudioSink()
+    Purpose: Constructor.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+NullAudioSink::NullAudioSink() : samplesWritten(0)
+{
+}
+
+/*
+    Function: open()
+    Purpose: Opens the sink, at any sample rate.
+    Inputs:
+        int sampleRate: The sample rate.
+    Outputs:
+        True
+*/
+bool NullAudioSink::open(int sampleRate)
+{
+    Q_UNUSED(sampleRate);
+    samplesWritten = 0;
+    return true;
+}
+
+/*
+    Function: write()
+    Purpose: Counts the samples and drops them.
+    Inputs:
+        const qint16 *samples: The samples.
+        int count: The number of samples.
+    Outputs:
+        The number of samples, all of them are taken.
+*/
+int NullAudioSink::write(const qint16 *samples, int count)
+{
+    Q_UNUSED(samples);
+    samplesWritten += count;
+    return count;
+}
+
+/*
+    Function: close()
+    Purpose: Closes the sink.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void NullAudioSink::close()
+{
+}
+
+/*
+    Function: getSamplesWritten()
+    Purpose: Gets the number of samples written since the sink was opened.
+    Inputs:
+        None
+    Outputs:
+        The number of samples.
+*/
+quint64 NullAudioSink::getSamplesWritten() const
+{
+    return samplesWritten;
+}
+
+/*
+    Function: FileAudioSink()
+    Purpose: Constructor.
+    Inputs:
+        const QString &fileName: The WAV file written when the sink is closed.
+    Outputs:
+        None
+*/
+FileAudioSink::FileAudioSink(const QString &fileName) : fileName(fileName), sampleRate(0)
+{
+}
+
+/*
+    Function: open()
+    Purpose: Opens the sink and starts its clock.
+    Inputs:
+        int sampleRate: The sample rate of the file.
+    Outputs:
+        True
+*/
+bool FileAudioSink::open(int sampleRate)
+{
+    this->sampleRate = sampleRate;
+    samples.clear();
+    clock.start();
+    return true;
+}
+
+/*
+    Function: write()
+    Purpose: Appends samples. If the sink was idle until now, the time since the last
+             sample is filled with silence first.
+    Inputs:
+        const qint16 *samples: The samples.
+        int count: The number of samples.
+    Outputs:
+        The number of samples, all of them are taken.
+*/
+int FileAudioSink::write(const qint16 *samples, int count)
+{
+    std::size_t now = std::size_t(clock.nsecsElapsed() / 1000 * sampleRate / 1000000);
+    if (this->samples.size() < now)
+    {
+        this->samples.resize(now, 0);
+    }
+
+    this->samples.insert(this->samples.end(), samples, samples + count);
+    return count;
+}
+
+/*
+    Function: close()
+    Purpose: Writes the samples to the file as 16 bit mono PCM.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void FileAudioSink::close()
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 dataSize = quint32(samples.size() * sizeof(qint16));
+    stream.writeRawData("RIFF", 4);
+    stream << quint32(36 + dataSize);
+    stream.writeRawData("WAVEfmt ", 8);
+    stream << quint32(16) << quint16(1) << quint16(1) << quint32(sampleRate) << quint32(sampleRate * 2) << quint16(2) << quint16(16);
+    stream.writeRawData("data", 4);
+    stream << dataSize;
+    for (qint16 sample : samples)
+    {
+        stream << sample;
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit())
+    {
+        qWarning().noquote() << "Could not write the voice prompts to" << fileName;
+    }
+}
+
+#ifdef AED_SPEAKER
+/*
+    Function: SpeakerAudioSink()
+    Purpose: Constructor. The output is made when the sink is opened, on its thread.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+SpeakerAudioSink::SpeakerAudioSink() : device(nullptr)
+{
+}
+
+/*
+    Function: open()
+    Purpose: Opens the default audio output, with a buffer of PROMPT_LEAD_TIME and a period.
+    Inputs:
+        int sampleRate: The sample rate.
+    Outputs:
+        True if the output plays 16 bit mono PCM at the sample rate, false otherwise.
+*/
+bool SpeakerAudioSink::open(int sampleRate)
+{
+    QAudioFormat format;
+    format.setSampleRate(sampleRate);
+    format.setChannelCount(1);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    format.setSampleFormat(QAudioFormat::Int16);
+#else
+    format.setSampleSize(16);
+    format.setCodec("audio/pcm");
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(QAudioFormat::SignedInt);
+#endif
+
+    output.reset(new SpeakerOutput(format));
+    output->setBufferSize(sampleRate * (PROMPT_LEAD_TIME + PROMPT_PERIOD_TIME) / 1000 * int(sizeof(qint16)));
+    device = output->start();
+    if (device == nullptr)
+    {
+        qWarning().noquote() << "Could not open the audio output, voice prompts are not played";
+        output.reset();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Function: write()
+    Purpose: Writes as many samples as the output buffer has room for.
+    Inputs:
+        const qint16 *samples: The samples.
+        int count: The number of samples.
+    Outputs:
+        The number of samples taken.
+*/
+int SpeakerAudioSink::write(const qint16 *samples, int count)
+{
+    if (device == nullptr)
+        return count;
+
+    qint64 written = device->write(reinterpret_cast<const char *>(samples), qint64(count) * qint64(sizeof(qint16)));
+    return written < 0 ? count : int(written / qint64(sizeof(qint16)));
+}
+
+/*
+    Function: close()
+    Purpose: Stops the output.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void SpeakerAudioSink::close()
+{
+    if (output)
+    {
+        output->stop();
+        output.reset();
+    }
+    device = nullptr;
+}
+#endif
@@ -0,0 +1,101 @@
+#ifndef AUDIOSINK_H
+#define AUDIOSINK_H
+
+// Qt imports
+#include <QElapsedTimer>
+#include <QString>
+#include <QtGlobal>
+
+#include <memory>
+#include <vector>
+
+#ifdef AED_SPEAKER
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+#include <QAudioSink>
+typedef QAudioSink SpeakerOutput;
+#else
+#include <QAudioOutput>
+typedef QAudioOutput SpeakerOutput;
+#endif
+#endif
+
+// Local imports
+#include "defs.h"
+
+// Prompts are written a period at a time, kept this far ahead of the speaker. Times in milliseconds.
+#define PROMPT_PERIOD_TIME 10
+#define PROMPT_LEAD_TIME 40
+
+class QIODevice;
+
+// Where the voice prompts are played. Samples are 16 bit mono PCM. A sink is
+// opened, written and closed on the same thread.
+class AudioSink
+{
+public:
+    virtual ~AudioSink() = default;
+
+    // Returns false if the sink cannot play at the sample rate.
+    virtual bool open(int sampleRate) = 0;
+
+    // Returns the number of samples taken, fewer than given if the sink is full.
+    virtual int write(const qint16 *samples, int count) = 0;
+
+    virtual void close() = 0;
+
+    // "speaker", "null", or the name of a WAV file to write.
+    static std::unique_ptr<AudioSink> create(const QString &name);
+};
+
+// Takes every sample and plays none, for machines without audio.
+class NullAudioSink : public AudioSink
+{
+public:
+    NullAudioSink();
+
+    bool open(int sampleRate) override;
+    int write(const qint16 *samples, int count) override;
+    void close() override;
+
+    quint64 getSamplesWritten() const;
+
+private:
+    quint64 samplesWritten;
+};
+
+// Writes what was played to a WAV file when closed. Time between prompts is
+// kept as silence, so that the file sounds the way the device did.
+class FileAudioSink : public AudioSink
+{
+public:
+    explicit FileAudioSink(const QString &fileName);
+
+    bool open(int sampleRate) override;
+    int write(const qint16 *samples, int count) override;
+    void close() override;
+
+private:
+    QString fileName;
+    int sampleRate;
+    QElapsedTimer clock;
+    std::vector<qint16> samples;
+};
+
+#ifdef AED_SPEAKER
+// Plays through the default audio output.
+class SpeakerAudioSink : public AudioSink
+{
+public:
+    SpeakerAudioSink();
+
+    bool open(int sampleRate) override;
+    int write(const qint16 *samples, int count) override;
+    void close() override;
+
+private:
+    std::unique_ptr<SpeakerOutput> output;
+    QIODevice *device;
+};
+#endif
+
+#endif
@@ -0,0 +1,211 @@
+// IMPORTS
+#include "BiquadFilterBank.h"
+#include "defs.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const float PI = 3.14159265358979f;
+static const float BUTTERWORTH_Q = 0.70710678f;
+
+/*
+    Function: BiquadFilterBank()
+    Purpose: Constructor. Starts without sections, passing samples through.
+    Inputs:
+        int leads: The number of leads.
+    Outputs:
+        None
+*/
+BiquadFilterBank::BiquadFilterBank(int leads)
+{
+    reset(leads);
+}
+
+/*
+    Function: reset()
+    Purpose: Forgets the filter state and changes the number of leads.
+    Inputs:
+        int leads: The number of leads.
+    Outputs:
+        None
+*/
+void BiquadFilterBank::reset(int leads)
+{
+    this->leads = std::max(leads, 1);
+    z1.assign(sections.size() * std::size_t(this->leads), 0.0f);
+    z2.assign(sections.size() * std::size_t(this->leads), 0.0f);
+}
+
+/*
+    Function: leadCount()
+    Purpose: Gets the number of leads.
+    Inputs:
+        None
+    Outputs:
+        The number of leads.
+*/
+int BiquadFilterBank::leadCount() const
+{
+    return leads;
+}
+
+/*
+    Function: addSection()
+    Purpose: Appends a section to the cascade.
+    Inputs:
+        const Section &section: The coefficients.
+    Outputs:
+        None
+*/
+void BiquadFilterBank::addSection(const Section &section)
+{
+    sections.push_back(section);
+    z1.resize(sections.size() * std::size_t(leads), 0.0f);
+    z2.resize(sections.size() * std::size_t(leads), 0.0f);
+}
+
+/*
+    Function: sectionCount()
+    Purpose: Gets the number of sections.
+    Inputs:
+        None
+    Outputs:
+        The number of sections.
+*/
+int BiquadFilterBank::sectionCount() const
+{
+    return int(sections.size());
+}
+
+/*
+    Function: process()
+    Purpose: Filters a block in place. The block is transposed, every section runs over
+             all leads of one sample at a time, and the block is transposed back.
+    Inputs:
+        float *block: count samples of lead 0, then count samples of lead 1, and so on.
+        std::size_t count: The number of samples for each lead.
+    Outputs:
+        None
+*/
+void BiquadFilterBank::process(float *block, std::size_t count)
+{
+    if (sections.empty() || count == 0)
+        return;
+
+    const std::size_t n = std::size_t(leads);
+    interleaved.resize(n * count);
+    float *x = interleaved.data();
+
+    for (std::size_t lead = 0; lead < n; ++lead)
+    {
+        for (std::size_t t = 0; t < count; ++t)
+        {
+            x[t * n + lead] = block[lead * count + t];
+        }
+    }
+
+    for (std::size_t s = 0; s < sections.size(); ++s)
+    {
+        const Section c = sections[s];
+        float *s1 = z1.data() + s * n;
+        float *s2 = z2.data() + s * n;
+
+        for (std::size_t t = 0; t < count; ++t)
+        {
+            float *sample = x + t * n;
+            for (std::size_t lead = 0; lead < n; ++lead)
+            {
+                float in = sample[lead];
+                float out = c.b0 * in + s1[lead];
+                s1[lead] = c.b1 * in - c.a1 * out + s2[lead];
+                s2[lead] = c.b2 * in - c.a2 * out;
+                sample[lead] = out;
+            }
+        }
+    }
+
+    for (std::size_t lead = 0; lead < n; ++lead)
+    {
+        for (std::size_t t = 0; t < count; ++t)
+        {
+            block[lead * count + t] = x[t * n + lead];
+        }
+    }
+}
+
+/*
+    Function: highPass()
+    Purpose: Computes a second order Butterworth high pass section.
+    Inputs:
+        float cutoff: The cutoff frequency in hertz.
+        float sampleRate: The sample rate in hertz.
+    Outputs:
+        The section.
+*/
+BiquadFilterBank::Section BiquadFilterBank::highPass(float cutoff, float sampleRate)
+{
+    float w = 2.0f * PI * cutoff / sampleRate;
+    float alpha = std::sin(w) / (2.0f * BUTTERWORTH_Q);
+    float cosw = std::cos(w);
+    float a0 = 1.0f + alpha;
+
+    return {(1.0f + cosw) / 2.0f / a0, -(1.0f + cosw) / a0, (1.0f + cosw) / 2.0f / a0,
+            -2.0f * cosw / a0, (1.0f - alpha) / a0};
+}
+
+/*
+    Function: lowPass()
+    Purpose: Computes a second order Butterworth low pass section.
+    Inputs:
+        float cutoff: The cutoff frequency in hertz.
+        float sampleRate: The sample rate in hertz.
+    Outputs:
+        The section.
+*/
+BiquadFilterBank::Section BiquadFilterBank::lowPass(float cutoff, float sampleRate)
+{
+    float w = 2.0f * PI * cutoff / sampleRate;
+    float alpha = std::sin(w) / (2.0f * BUTTERWORTH_Q);
+    float cosw = std::cos(w);
+    float a0 = 1.0f + alpha;
+
+    return {(1.0f - cosw) / 2.0f / a0, (1.0f - cosw) / a0, (1.0f - cosw) / 2.0f / a0,
+            -2.0f * cosw / a0, (1.0f - alpha) / a0};
+}
+
+/*
+    Function: notch()
+    Purpose: Computes a notch section.
+    Inputs:
+        float frequency: The frequency to remove in hertz.
+        float q: The quality factor, higher for a narrower notch.
+        float sampleRate: The sample rate in hertz.
+    Outputs:
+        The section.
+*/
+BiquadFilterBank::Section BiquadFilterBank::notch(float frequency, float q, float sampleRate)
+{
+    float w = 2.0f * PI * frequency / sampleRate;
+    float alpha = std::sin(w) / (2.0f * q);
+    float cosw = std::cos(w);
+    float a0 = 1.0f + alpha;
+
+    return {1.0f / a0, -2.0f * cosw / a0, 1.0f / a0, -2.0f * cosw / a0, (1.0f - alpha) / a0};
+}
+
+/*
+    Function: frontEnd()
+    Purpose: Builds the analyzer front end filters.
+    Inputs:
+        int leads: The number of leads.
+    Outputs:
+        The filter bank.
+*/
+BiquadFilterBank BiquadFilterBank::frontEnd(int leads)
+{
+    BiquadFilterBank bank(leads);
+    bank.addSection(highPass(HIGHPASS_CUTOFF, ECG_SAMPLE_RATE));
+    bank.addSection(notch(MAINS_FREQUENCY, NOTCH_Q, ECG_SAMPLE_RATE));
+    bank.addSection(lowPass(LOWPASS_CUTOFF, ECG_SAMPLE_RATE));
+    return bank;
+}
@@ -0,0 +1,61 @@
+#ifndef BIQUADFILTERBANK_H
+#define BIQUADFILTERBANK_H
+
+#include <cstddef>
+#include <vector>
+
+// Analyzer front end filters, cutoffs in hertz.
+#define HIGHPASS_CUTOFF 0.5f
+#define LOWPASS_CUTOFF 40.0f
+#define NOTCH_Q 30.0f
+
+// A cascade of biquad sections applied to every lead of an ECG.
+//
+// A biquad depends on its previous outputs, so it cannot be vectorized along
+// time. Every lead runs the same sections though, so blocks are transposed to
+// store the leads of a sample together and each section updates all leads at
+// once, which the compiler vectorizes. The state of each section is kept as an
+// array over the leads.
+class BiquadFilterBank
+{
+public:
+    // Coefficients of a section, normalized so that a0 is 1.
+    struct Section
+    {
+        float b0, b1, b2;
+        float a1, a2;
+    };
+
+    explicit BiquadFilterBank(int leads = 1);
+
+    // Forget the filter state and change the number of leads. Keeps the sections.
+    void reset(int leads);
+    int leadCount() const;
+
+    void addSection(const Section &section);
+    int sectionCount() const;
+
+    // Filters count samples of every lead in place. block holds lead l at block[l * count].
+    void process(float *block, std::size_t count);
+
+    // Butterworth and notch sections, from the Audio EQ Cookbook.
+    static Section highPass(float cutoff, float sampleRate);
+    static Section lowPass(float cutoff, float sampleRate);
+    static Section notch(float frequency, float q, float sampleRate);
+
+    // The analyzer front end: baseline wander high pass, mains notch and muscle noise low pass.
+    static BiquadFilterBank frontEnd(int leads);
+
+private:
+    int leads;
+    std::vector<Section> sections;
+
+    // Transposed direct form II state, one array of leads per section.
+    std::vector<float> z1;
+    std::vector<float> z2;
+
+    // The block with the leads of a sample side by side.
+    std::vector<float> interleaved;
+};
+
+#endif
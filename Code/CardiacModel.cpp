@@ -0,0 +1,500 @@
+// IMPORTS
+#include "CardiacModel.h"
+#include "ShockWaveform.h"
+
+#include <algorithm>
+#include <cmath>
+
+// FitzHugh-Nagumo recovery parameters.
+static const float FHN_A = 0.7f;
+static const float FHN_B = 0.8f;
+static const float FHN_TAU = 12.5f;
+
+// Oscillator stimulus, speed (model time units per second) and noise for each rhythm.
+struct RhythmParameters
+{
+    float stimulus;
+    float speed;
+    float noise;
+};
+
+static const RhythmParameters RHYTHM_PARAMETERS[] = {
+    {0.5f, 45.0f, 0.02f},  // SINUS_RHYTHM, about 70 bpm.
+    {0.9f, 250.0f, 1.5f},  // VENTRICULAR_FIBRILLATION, fast and disorganized.
+    {0.6f, 150.0f, 0.05f}, // VENTRICULAR_TACHYCARDIA, about 200 bpm.
+    {0.0f, 45.0f, 0.02f},  // ASYSTOLE, stays at rest.
+};
+
+/*
+    Function: CardiacModel()
+    Purpose: Constructor. All patients start in sinus rhythm with full viability.
+    Inputs:
+        std::size_t patients: The number of patients.
+        std::uint32_t seed: Seed of the random number generators.
+    Outputs:
+        None
+*/
+CardiacModel::CardiacModel(std::size_t patients, std::uint32_t seed)
+    : eventClock(0.0f)
+{
+    resize(patients);
+
+    // Every patient gets its own generator so that the kernels need no shared state.
+    for (std::size_t i = 0; i < patients; ++i)
+    {
+        rng[i] = (seed + std::uint32_t(i)) * 2654435761u | 1u;
+    }
+}
+
+/*
+    Function: resize()
+    Purpose: Changes the number of patients. New patients start in sinus rhythm.
+    Inputs:
+        std::size_t patients: The number of patients.
+    Outputs:
+        None
+*/
+void CardiacModel::resize(std::size_t patients)
+{
+    std::size_t previous = size();
+
+    v.resize(patients, -1.2f);
+    w.resize(patients, -0.6f);
+    stimulus.resize(patients);
+    speed.resize(patients);
+    noise.resize(patients);
+    viability.resize(patients, 1.0f);
+    perfusion.resize(patients);
+    cpr.resize(patients, 0);
+    rhythm.resize(patients);
+    rng.resize(patients, 1u);
+
+    for (std::size_t i = previous; i < patients; ++i)
+    {
+        rng[i] = std::uint32_t(i + 1) * 2654435761u | 1u;
+        setRhythm(i, SINUS_RHYTHM);
+    }
+}
+
+/*
+    Function: size()
+    Purpose: Gets the number of patients.
+    Inputs:
+        None
+    Outputs:
+        The number of patients.
+*/
+std::size_t CardiacModel::size() const
+{
+    return rhythm.size();
+}
+
+/*
+    Function: resetPatient()
+    Purpose: Starts a patient over.
+    Inputs:
+        std::size_t patient: The index of the patient.
+        HeartState rhythm: The initial rhythm.
+        float viability: The initial myocardial viability, between 0 and 1.
+    Outputs:
+        None
+*/
+void CardiacModel::resetPatient(std::size_t patient, HeartState rhythm, float viability)
+{
+    v[patient] = -1.2f;
+    w[patient] = -0.6f;
+    cpr[patient] = 0;
+    this->viability[patient] = std::min(std::max(viability, 0.0f), 1.0f);
+    setRhythm(patient, rhythm);
+}
+
+/*
+    Function: getRhythm()
+    Purpose: Gets the current rhythm of a patient.
+    Inputs:
+        std::size_t patient: The index of the patient.
+    Outputs:
+        The rhythm.
+*/
+HeartState CardiacModel::getRhythm(std::size_t patient) const
+{
+    return HeartState(rhythm[patient]);
+}
+
+/*
+    Function: getViability()
+    Purpose: Gets the myocardial viability of a patient.
+    Inputs:
+        std::size_t patient: The index of the patient.
+    Outputs:
+        The viability, between 0 and 1.
+*/
+float CardiacModel::getViability(std::size_t patient) const
+{
+    return viability[patient];
+}
+
+/*
+    Function: getECG()
+    Purpose: Gets the latest ECG sample of a patient. VF gets finer as viability drops.
+    Inputs:
+        std::size_t patient: The index of the patient.
+    Outputs:
+        The sample, roughly between -1 and 1.
+*/
+float CardiacModel::getECG(std::size_t patient) const
+{
+    float gain = rhythm[patient] == VENTRICULAR_FIBRILLATION ? 0.3f + 0.7f * viability[patient] : 1.0f;
+    return 0.5f * gain * v[patient];
+}
+
+/*
+    Function: getPatientState()
+    Purpose: Gets the full state of a patient, for saving it.
+    Inputs:
+        std::size_t patient: The index of the patient.
+    Outputs:
+        The state of the patient.
+*/
+CardiacModel::PatientState CardiacModel::getPatientState(std::size_t patient) const
+{
+    return {v[patient], w[patient], viability[patient], cpr[patient], rhythm[patient], rng[patient]};
+}
+
+/*
+    Function: setPatientState()
+    Purpose: Restores a patient saved with getPatientState().
+    Inputs:
+        std::size_t patient: The index of the patient.
+        const PatientState &state: The saved state.
+    Outputs:
+        None
+*/
+void CardiacModel::setPatientState(std::size_t patient, const PatientState &state)
+{
+    v[patient] = state.v;
+    w[patient] = state.w;
+    viability[patient] = state.viability;
+    cpr[patient] = state.cpr;
+    rng[patient] = state.rng;
+    setRhythm(patient, HeartState(std::min(std::max(state.rhythm, std::int32_t(SINUS_RHYTHM)), std::int32_t(ASYSTOLE))));
+}
+
+/*
+    Function: setCPR()
+    Purpose: Starts or stops CPR on a patient.
+    Inputs:
+        std::size_t patient: The index of the patient.
+        bool active: True while CPR is given.
+    Outputs:
+        None
+*/
+void CardiacModel::setCPR(std::size_t patient, bool active)
+{
+    cpr[patient] = active ? 1 : 0;
+    perfusion[patient] = (active || rhythm[patient] == SINUS_RHYTHM) ? 1.0f : 0.0f;
+}
+
+/*
+    Function: setCPRAll()
+    Purpose: Starts or stops CPR on every patient.
+    Inputs:
+        bool active: True while CPR is given.
+    Outputs:
+        None
+*/
+void CardiacModel::setCPRAll(bool active)
+{
+    for (std::size_t i = 0; i < size(); ++i)
+    {
+        setCPR(i, active);
+    }
+}
+
+/*
+    Function: setRhythm()
+    Purpose: Changes the rhythm of a patient and the oscillator parameters with it.
+    Inputs:
+        std::size_t patient: The index of the patient.
+        HeartState rhythm: The new rhythm.
+    Outputs:
+        None
+*/
+void CardiacModel::setRhythm(std::size_t patient, HeartState rhythm)
+{
+    const RhythmParameters &parameters = RHYTHM_PARAMETERS[rhythm];
+
+    this->rhythm[patient] = rhythm;
+    stimulus[patient] = parameters.stimulus;
+    speed[patient] = parameters.speed;
+    noise[patient] = parameters.noise;
+    perfusion[patient] = (cpr[patient] || rhythm == SINUS_RHYTHM) ? 1.0f : 0.0f;
+}
+
+/*
+    Function: random()
+    Purpose: Draws a uniform random number from the generator of a patient.
+    Inputs:
+        std::size_t patient: The index of the patient.
+    Outputs:
+        A number between 0 and 1.
+*/
+float CardiacModel::random(std::size_t patient)
+{
+    std::uint32_t x = rng[patient];
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng[patient] = x;
+
+    return float(std::int32_t(x >> 8)) * (1.0f / 16777216.0f);
+}
+
+/*
+    Function: advance()
+    Purpose: Advances every patient, checking for rhythm changes every MODEL_EVENT_INTERVAL.
+    Inputs:
+        float seconds: The time to advance by.
+    Outputs:
+        None
+*/
+void CardiacModel::advance(float seconds)
+{
+    int steps = int(std::lround(seconds / MODEL_TIME_STEP));
+    for (int i = 0; i < steps; ++i)
+    {
+        step(MODEL_TIME_STEP);
+
+        eventClock += MODEL_TIME_STEP;
+        if (eventClock >= MODEL_EVENT_INTERVAL)
+        {
+            rhythmEvents(eventClock);
+            eventClock = 0.0f;
+        }
+    }
+}
+
+/*
+    Function: step()
+    Purpose: Integrates the oscillators and viability of every patient over one time step
+             with the forward Euler method. Every patient runs the same number of substeps
+             and the same arithmetic, so the loops have no branches and are vectorized.
+    Inputs:
+        float dt: The time step in seconds.
+    Outputs:
+        None
+*/
+void CardiacModel::step(float dt)
+{
+    const std::size_t n = size();
+    const float subDt = dt / MODEL_SUBSTEPS;
+
+    float *V = v.data();
+    float *W = w.data();
+    float *M = viability.data();
+    std::uint32_t *R = rng.data();
+    const float *I = stimulus.data();
+    const float *S = speed.data();
+    const float *N = noise.data();
+    const float *P = perfusion.data();
+
+    for (int sub = 0; sub < MODEL_SUBSTEPS; ++sub)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            float h = subDt * S[i];
+
+            // Xorshift noise between -1 and 1.
+            std::uint32_t x = R[i];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            R[i] = x;
+            float u = float(std::int32_t(x >> 9)) * (1.0f / 4194304.0f) - 1.0f;
+
+            float vi = V[i];
+            float wi = W[i];
+            float dv = vi - vi * vi * vi * (1.0f / 3.0f) - wi + I[i];
+            float dw = (vi + FHN_A - FHN_B * wi) * (1.0f / FHN_TAU);
+
+            V[i] = vi + h * dv + h * N[i] * u;
+            W[i] = wi + h * dw;
+        }
+    }
+
+    // Viability recovers while perfused and decays otherwise.
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        float m = M[i];
+        float p = P[i];
+        M[i] = m + dt * (p * VIABILITY_RESTORE_RATE * (1.0f - m) - (1.0f - p) * VIABILITY_DECAY_RATE * m);
+    }
+}
+
+/*
+    Function: rhythmEvents()
+    Purpose: Applies spontaneous rhythm changes. VT degenerates into VF, VF into asystole
+             as viability drops, a weak heart can fibrillate again, and CPR can restart
+             a heart in asystole.
+    Inputs:
+        float dt: The time since the last check in seconds.
+    Outputs:
+        None
+*/
+void CardiacModel::rhythmEvents(float dt)
+{
+    for (std::size_t i = 0; i < size(); ++i)
+    {
+        float m = viability[i];
+        float chance = random(i);
+
+        switch (rhythm[i])
+        {
+        case VENTRICULAR_TACHYCARDIA:
+            if (chance < VT_DEGENERATION_RATE * dt)
+                setRhythm(i, VENTRICULAR_FIBRILLATION);
+            break;
+
+        case VENTRICULAR_FIBRILLATION:
+            if (chance < VF_DEGENERATION_RATE * (1.0f - m) * dt)
+                setRhythm(i, ASYSTOLE);
+            break;
+
+        case SINUS_RHYTHM:
+            if (chance < REFIBRILLATION_RATE * (1.0f - m) * dt)
+                setRhythm(i, VENTRICULAR_FIBRILLATION);
+            break;
+
+        case ASYSTOLE:
+            if (cpr[i] && chance < CPR_ROSC_RATE * m * dt)
+                setRhythm(i, SINUS_RHYTHM);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+/*
+    Function: applyShock()
+    Purpose: Delivers a shock. The chance of ending VF or VT rises with the delivered
+             energy around SHOCK_E50. Once ended, the heart restarts in sinus rhythm
+             with a chance equal to its viability, and stays in asystole otherwise.
+    Inputs:
+        std::size_t patient: The index of the patient.
+        double deliveredEnergy: The energy delivered to the patient in joules.
+    Outputs:
+        True if the shock ended a shockable rhythm, false otherwise.
+*/
+bool CardiacModel::applyShock(std::size_t patient, double deliveredEnergy)
+{
+    if (rhythm[patient] != VENTRICULAR_FIBRILLATION && rhythm[patient] != VENTRICULAR_TACHYCARDIA)
+        return false;
+
+    double conversion = 1.0 / (1.0 + std::exp(-(deliveredEnergy - SHOCK_E50) / SHOCK_ENERGY_SCALE));
+    if (random(patient) >= conversion)
+        return false;
+
+    setRhythm(patient, random(patient) < viability[patient] ? SINUS_RHYTHM : ASYSTOLE);
+    return true;
+}
+
+/*
+    Function: runBatch()
+    Purpose: Runs the device protocol on many random patients at once. Every cycle
+             analyzes, shocks the patients in a shockable rhythm and gives CPR, with the
+             same timing as the device. A patient found in sinus rhythm leaves the batch,
+             like the device turning off.
+    Inputs:
+        std::size_t patients: The number of patients.
+        int cycles: The maximum number of analyze/shock/CPR cycles.
+        std::uint32_t seed: Seed of the random number generators.
+    Outputs:
+        The rhythm of each patient at the end and shock statistics.
+*/
+OutcomeSummary CardiacModel::runBatch(std::size_t patients, int cycles, std::uint32_t seed)
+{
+    CardiacModel model(patients, seed);
+
+    OutcomeSummary summary = {};
+    summary.patients = patients;
+
+    // Random presentations: mostly VF, then VT, some asystole.
+    std::vector<double> impedance(patients);
+    std::vector<int> shocks(patients, 0);
+    std::vector<char> done(patients, 0);
+    for (std::size_t i = 0; i < patients; ++i)
+    {
+        float presentation = model.random(i);
+        HeartState rhythm = presentation < 0.6f ? VENTRICULAR_FIBRILLATION : (presentation < 0.85f ? VENTRICULAR_TACHYCARDIA : ASYSTOLE);
+        model.resetPatient(i, rhythm, 0.3f + 0.7f * model.random(i));
+        impedance[i] = IMPEDANCE_MIN_PATIENT + model.random(i) * (IMPEDANCE_MAX_PATIENT - IMPEDANCE_MIN_PATIENT);
+    }
+
+    std::vector<std::size_t> shocked;
+    std::vector<double> chargeEnergy;
+    std::vector<double> shockImpedance;
+    std::vector<double> deliveredEnergy;
+
+    for (int cycle = 0; cycle < cycles; ++cycle)
+    {
+        model.setCPRAll(false);
+        model.advance(ANALYZING_TIME / 1000.0f);
+
+        // Gather the patients to shock, and let those in sinus rhythm go.
+        shocked.clear();
+        chargeEnergy.clear();
+        shockImpedance.clear();
+        for (std::size_t i = 0; i < patients; ++i)
+        {
+            if (done[i])
+                continue;
+
+            HeartState rhythm = model.getRhythm(i);
+            if (rhythm == SINUS_RHYTHM)
+            {
+                done[i] = 1;
+                summary.finalRhythm[SINUS_RHYTHM]++;
+            }
+            else if (rhythm == VENTRICULAR_FIBRILLATION || rhythm == VENTRICULAR_TACHYCARDIA)
+            {
+                shocked.push_back(i);
+                chargeEnergy.push_back(ShockWaveform::compensatedChargeEnergy(ShockWaveform::nominalEnergy(shocks[i], false), impedance[i]));
+                shockImpedance.push_back(impedance[i]);
+            }
+        }
+
+        // Shock advised, stand clear, shocking and shock delivered.
+        model.advance((3 * SLEEP + SHOCKING_TIME) / 1000.0f);
+
+        deliveredEnergy.resize(shocked.size());
+        ShockWaveform::simulateBatch(chargeEnergy.data(), shockImpedance.data(), deliveredEnergy.data(), shocked.size());
+        for (std::size_t k = 0; k < shocked.size(); ++k)
+        {
+            shocks[shocked[k]]++;
+            summary.shocksDelivered++;
+            if (model.applyShock(shocked[k], deliveredEnergy[k]))
+            {
+                summary.shocksConverted++;
+            }
+        }
+
+        model.setCPRAll(true);
+        model.advance(CPR_TIME / 1000.0f);
+        model.setCPRAll(false);
+        model.advance(SLEEP / 1000.0f);
+
+        summary.simulatedSeconds += (ANALYZING_TIME + 4 * SLEEP + SHOCKING_TIME + CPR_TIME) / 1000.0;
+    }
+
+    for (std::size_t i = 0; i < patients; ++i)
+    {
+        if (!done[i])
+        {
+            summary.finalRhythm[model.getRhythm(i)]++;
+        }
+    }
+
+    return summary;
+}
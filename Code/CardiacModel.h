@@ -0,0 +1,111 @@
+#ifndef CARDIACMODEL_H
+#define CARDIACMODEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Local imports
+#include "defs.h"
+
+// Rates are per second of model time, shock energies in joules.
+#define MODEL_SUBSTEPS 4
+#define MODEL_EVENT_INTERVAL 1.0f
+#define VIABILITY_DECAY_RATE 0.01f
+#define VIABILITY_RESTORE_RATE 0.02f
+#define SHOCK_E50 60.0
+#define SHOCK_ENERGY_SCALE 20.0
+#define VT_DEGENERATION_RATE 0.016f
+#define VF_DEGENERATION_RATE 0.008f
+#define REFIBRILLATION_RATE 0.03f
+#define CPR_ROSC_RATE 0.01f
+
+// Outcome of a batch of simulated resuscitations.
+struct OutcomeSummary
+{
+    std::size_t patients;
+    std::size_t finalRhythm[ASYSTOLE + 1]; // Patients in each rhythm at the end.
+    std::size_t shocksDelivered;
+    std::size_t shocksConverted;           // Shocks that ended a shockable rhythm.
+    double simulatedSeconds;               // Per patient.
+};
+
+// A small model of the heart of many patients at once.
+//
+// Electrical activity is a FitzHugh-Nagumo oscillator whose stimulus, speed and
+// noise depend on the rhythm, which makes sinus rhythm slow and regular, VT fast
+// and regular, VF fast and disorganized and asystole flat. Myocardial viability
+// decays while the heart is not pumping and recovers with CPR or sinus rhythm,
+// and it drives the chance that a shock or CPR converts the rhythm.
+//
+// State is kept as a structure of arrays so that step() runs the same
+// branch-free arithmetic over contiguous arrays, which the compiler vectorizes.
+// Rhythm changes are rare events and are handled separately.
+class CardiacModel
+{
+public:
+    // Everything needed to continue a patient exactly where it left off.
+    struct PatientState
+    {
+        float v;
+        float w;
+        float viability;
+        std::uint8_t cpr;
+        std::int32_t rhythm;
+        std::uint32_t rng;
+    };
+
+    explicit CardiacModel(std::size_t patients = 0, std::uint32_t seed = 1);
+
+    void resize(std::size_t patients);
+    std::size_t size() const;
+
+    // Start a patient over with the given rhythm and viability between 0 and 1.
+    void resetPatient(std::size_t patient, HeartState rhythm, float viability);
+
+    HeartState getRhythm(std::size_t patient) const;
+    float getViability(std::size_t patient) const;
+    float getECG(std::size_t patient) const;
+
+    PatientState getPatientState(std::size_t patient) const;
+    void setPatientState(std::size_t patient, const PatientState &state);
+
+    void setCPR(std::size_t patient, bool active);
+    void setCPRAll(bool active);
+
+    // Advance every patient by the given number of seconds.
+    void advance(float seconds);
+
+    // Deliver a shock. Returns true if it ended a shockable rhythm.
+    bool applyShock(std::size_t patient, double deliveredEnergy);
+
+    // Run the device protocol on many random patients at once, all in lockstep.
+    static OutcomeSummary runBatch(std::size_t patients, int cycles, std::uint32_t seed);
+
+private:
+    void step(float dt);
+    void rhythmEvents(float dt);
+    void setRhythm(std::size_t patient, HeartState rhythm);
+    float random(std::size_t patient);
+
+    // Oscillator state.
+    std::vector<float> v;
+    std::vector<float> w;
+
+    // Oscillator parameters, set from the rhythm.
+    std::vector<float> stimulus;
+    std::vector<float> speed;
+    std::vector<float> noise;
+
+    // Perfusion is 1 while the heart pumps or CPR is given, 0 otherwise.
+    std::vector<float> viability;
+    std::vector<float> perfusion;
+    std::vector<std::uint8_t> cpr;
+
+    std::vector<std::int32_t> rhythm;
+    std::vector<std::uint32_t> rng;
+
+    float eventClock;
+};
+
+#endif
@@ -0,0 +1,199 @@
+// IMPORTS
+#include "CprMetronome.h"
+#include "AED.h"
+#include "MetricsRegistry.h"
+#include "TraceRecorder.h"
+
+#include <thread>
+
+static MetricHistogram &tickError = MetricsRegistry::instance()->histogram("aed_cpr_metronome_tick_error_seconds", "Time from a CPR metronome beat being due to it being given.", 1e-6);
+static MetricCounter &ticks = MetricsRegistry::instance()->counter("aed_cpr_metronome_ticks_total", "Beats given by the CPR metronome.");
+
+/*
+    Function: CprMetronome()
+    Purpose: Constructor. Starts the metronome thread, without beating.
+    Inputs:
+        int rate: The compressions per minute.
+    Outputs:
+        None
+*/
+CprMetronome::CprMetronome(int rate)
+    : QObject(nullptr),
+      period(std::chrono::nanoseconds(60000000000LL / qBound(CPR_METRONOME_MIN_RATE, rate, CPR_METRONOME_MAX_RATE))),
+      maxTickErrorNs(0), duration(0), running(false), quitting(false), generation(0)
+{
+    m_thread.reset(QThread::create([this]()
+                                   { beat(); }));
+    m_thread->start(QThread::TimeCriticalPriority);
+}
+
+/*
+    Function: ~CprMetronome()
+    Purpose: Destructor. Stops the metronome thread.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+CprMetronome::~CprMetronome()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quitting = true;
+        generation++;
+    }
+    changed.notify_one();
+    m_thread->wait();
+}
+
+/*
+    Function: follow()
+    Purpose: Beats during every CPR step of a device and stops at the step after it,
+             or when the device is powered off.
+    Inputs:
+        AED *device: The device.
+    Outputs:
+        None
+*/
+void CprMetronome::follow(AED *device)
+{
+    connect(device, &AED::updateGUI, this, [this, device](int state)
+    {
+        if (state == CPR)
+        {
+            start(device->getStepEnteredTime(), std::chrono::milliseconds(device->getStepTime()));
+        }
+        else
+        {
+            stop();
+        } }, Qt::DirectConnection);
+}
+
+/*
+    Function: start()
+    Purpose: Beats for the duration from the given time, the first beat at that time.
+             Beating that was already going on is replaced.
+    Inputs:
+        std::chrono::steady_clock::time_point from: When CPR started.
+        std::chrono::milliseconds duration: How long CPR lasts, as long as the protocol has it.
+    Outputs:
+        None
+*/
+void CprMetronome::start(std::chrono::steady_clock::time_point from, std::chrono::milliseconds duration)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->from = from;
+        this->duration = duration;
+        running = true;
+        generation++;
+    }
+    changed.notify_one();
+}
+
+/*
+    Function: stop()
+    Purpose: Stops beating.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void CprMetronome::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running)
+            return;
+
+        running = false;
+        generation++;
+    }
+    changed.notify_one();
+}
+
+/*
+    Function: getRate()
+    Purpose: Gets the rate of the beats.
+    Inputs:
+        None
+    Outputs:
+        The compressions per minute.
+*/
+int CprMetronome::getRate() const
+{
+    return int(60000000000LL / period.count());
+}
+
+/*
+    Function: getMaxTickErrorNs()
+    Purpose: Gets the latest any beat has been. Can be called from any thread.
+    Inputs:
+        None
+    Outputs:
+        The time in nanoseconds.
+*/
+qint64 CprMetronome::getMaxTickErrorNs() const
+{
+    return maxTickErrorNs;
+}
+
+/*
+    Function: beat()
+    Purpose: Body of the metronome thread. Waits to be started, then sleeps until each
+             beat is nearly due, and spins for the rest, like the device does between steps.
+             Starting again or stopping wakes the sleep.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void CprMetronome::beat()
+{
+    TraceRecorder::instance()->setThreadName("CPR metronome");
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!quitting)
+    {
+        if (!running)
+        {
+            changed.wait(lock);
+            continue;
+        }
+
+        quint64 beating = generation;
+        auto end = from + duration;
+        for (int n = 0;; ++n)
+        {
+            auto deadline = from + n * period;
+            if (deadline >= end)
+            {
+                running = false;
+                break;
+            }
+
+            if (changed.wait_until(lock, deadline - std::chrono::microseconds(SCHEDULE_SPIN_MARGIN), [&]()
+                                   { return generation != beating; }))
+                break;
+
+            lock.unlock();
+            while (std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::yield();
+            }
+            auto late = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - deadline).count();
+
+            emit tick(n, std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count());
+            ticks.add();
+            tickError.record(std::uint64_t(late / 1000));
+            if (late > maxTickErrorNs)
+            {
+                maxTickErrorNs = late;
+            }
+
+            lock.lock();
+            if (generation != beating)
+                break;
+        }
+    }
+}
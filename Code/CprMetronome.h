@@ -0,0 +1,69 @@
+#ifndef CPRMETRONOME_H
+#define CPRMETRONOME_H
+
+// Qt imports
+#include <QObject>
+#include <QThread>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+// Local imports
+#include "defs.h"
+
+// CPR metronome, in compressions per minute.
+#define CPR_METRONOME_RATE 110
+#define CPR_METRONOME_MIN_RATE 100
+#define CPR_METRONOME_MAX_RATE 120
+
+class AED;
+
+// Beats the pace of compressions for the whole CPR step, on a thread of its own at
+// time critical priority, so a busy GUI does not hold a beat back. Beat n is due
+// n periods after CPR was entered, never after the previous beat, so errors do not
+// add up. How late each beat is, is recorded.
+class CprMetronome : public QObject
+{
+    Q_OBJECT
+
+public:
+    // The rate is kept between CPR_METRONOME_MIN_RATE and CPR_METRONOME_MAX_RATE.
+    explicit CprMetronome(int rate = CPR_METRONOME_RATE);
+    ~CprMetronome();
+
+    // Beats during the CPR steps of the device, from when each is entered.
+    void follow(AED *device);
+
+    // Beats for the duration from the given time. Can be called from any thread.
+    void start(std::chrono::steady_clock::time_point from, std::chrono::milliseconds duration);
+    void stop();
+
+    int getRate() const;
+    qint64 getMaxTickErrorNs() const;
+
+signals:
+    // Emitted on the metronome thread at every beat.
+    void tick(int beat, qint64 deadlineNs);
+
+private:
+    void beat();
+
+    std::chrono::nanoseconds period;
+    std::atomic<qint64> maxTickErrorNs;
+
+    // Guards the beating, changed by start and stop.
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::chrono::steady_clock::time_point from;
+    std::chrono::milliseconds duration;
+    bool running;
+    bool quitting;
+    quint64 generation;
+
+    std::unique_ptr<QThread> m_thread;
+};
+
+#endif
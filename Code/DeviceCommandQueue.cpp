@@ -0,0 +1,158 @@
+// IMPORTS
+#include "DeviceCommandQueue.h"
+
+// Nodes in the pool, more than the commands the GUI sends while a step runs.
+static const std::uint32_t POOL_SIZE = 256;
+
+/*
+    Function: DeviceCommandQueue()
+    Purpose: Constructor. Makes an empty queue, with every node of the pool free
+             but one, which stands for the last command popped.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+DeviceCommandQueue::DeviceCommandQueue() : pool(new Node[POOL_SIZE]), freeTop(0)
+{
+    for (std::uint32_t i = 0; i < POOL_SIZE; ++i)
+    {
+        pool[i].nextFree.store(i + 1 < POOL_SIZE ? i + 2 : 0, std::memory_order_relaxed);
+        pool[i].pooled = true;
+    }
+    freeTop.store(1);
+
+    head.store(allocate(DeviceCommand()));
+    tail = head.load();
+}
+
+/*
+    Function: ~DeviceCommandQueue()
+    Purpose: Destructor. Drops the commands left.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+DeviceCommandQueue::~DeviceCommandQueue()
+{
+    DeviceCommand command;
+    while (pop(command))
+    {
+    }
+    release(tail);
+}
+
+/*
+    Function: push()
+    Purpose: Adds a command. The exchange orders it among the commands of every thread,
+             and linking it in afterwards makes it visible to the consumer. Linking is
+             sequentially consistent, so that a consumer about to sleep either sees the
+             command or is seen to be sleeping by the producer.
+    Inputs:
+        const DeviceCommand &command: The command.
+    Outputs:
+        None
+*/
+void DeviceCommandQueue::push(const DeviceCommand &command)
+{
+    Node *node = allocate(command);
+    Node *previous = head.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node);
+}
+
+/*
+    Function: pop()
+    Purpose: Takes the oldest command.
+    Inputs:
+        DeviceCommand &command: Set to the command.
+    Outputs:
+        True if there was a command, false otherwise.
+*/
+bool DeviceCommandQueue::pop(DeviceCommand &command)
+{
+    Node *next = tail->next.load(std::memory_order_acquire);
+    if (next == nullptr)
+        return false;
+
+    command = next->command;
+    release(tail);
+    tail = next;
+    return true;
+}
+
+/*
+    Function: empty()
+    Purpose: Checks if there is a command to pop.
+    Inputs:
+        None
+    Outputs:
+        True if there is none, false otherwise.
+*/
+bool DeviceCommandQueue::empty() const
+{
+    return tail->next.load() == nullptr;
+}
+
+/*
+    Function: allocate()
+    Purpose: Takes a free node of the pool, or a node from the heap once the pool is
+             used up, and fills it with a command. Can be called from any thread.
+    Inputs:
+        const DeviceCommand &command: The command.
+    Outputs:
+        The node, not linked to any other.
+*/
+DeviceCommandQueue::Node *DeviceCommandQueue::allocate(const DeviceCommand &command)
+{
+    Node *node = nullptr;
+    std::uint64_t top = freeTop.load(std::memory_order_acquire);
+    while (std::uint32_t(top) != 0)
+    {
+        // The next free node read here is stale if the node was taken meanwhile, and
+        // then the count has changed and the exchange fails.
+        Node *first = &pool[std::uint32_t(top) - 1];
+        std::uint64_t next = ((top >> 32) + 1) << 32 | first->nextFree.load(std::memory_order_relaxed);
+        if (freeTop.compare_exchange_weak(top, next, std::memory_order_acquire, std::memory_order_acquire))
+        {
+            node = first;
+            break;
+        }
+    }
+
+    if (node == nullptr)
+    {
+        node = new Node;
+    }
+
+    node->next.store(nullptr, std::memory_order_relaxed);
+    node->command = command;
+    return node;
+}
+
+/*
+    Function: release()
+    Purpose: Returns a node to the pool, or to the heap if it came from there. Only
+             from the consumer, and the destructor.
+    Inputs:
+        Node *node: The node, no longer in the queue.
+    Outputs:
+        None
+*/
+void DeviceCommandQueue::release(Node *node)
+{
+    if (!node->pooled)
+    {
+        delete node;
+        return;
+    }
+
+    std::uint64_t index = node - pool.get() + 1;
+    std::uint64_t top = freeTop.load(std::memory_order_relaxed);
+    std::uint64_t next;
+    do
+    {
+        node->nextFree.store(std::uint32_t(top), std::memory_order_relaxed);
+        next = ((top >> 32) + 1) << 32 | index;
+    } while (!freeTop.compare_exchange_weak(top, next, std::memory_order_release, std::memory_order_relaxed));
+}
@@ -0,0 +1,98 @@
+#ifndef DEVICECOMMANDQUEUE_H
+#define DEVICECOMMANDQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+// Local imports
+#include "defs.h"
+
+// What the device is asked to do, by the operator or whatever stands in for them.
+enum DeviceCommandType
+{
+    COMMAND_POWER_ON,
+    COMMAND_POWER_OFF,
+    COMMAND_SET_STATE,                // The state. Ignored while a session runs.
+    COMMAND_SET_BATTERY_SPECS,        // The starting level, units per shock and units when idle.
+    COMMAND_SET_BATTERY_LEVEL,        // The level.
+    COMMAND_DRAIN_BATTERY,            // The units drained.
+    COMMAND_CHANGE_BATTERIES,
+    COMMAND_SET_HEART_CONDITION,      // The HeartState.
+    COMMAND_SET_SHOCKS_UNTIL_HEALTHY, // The number of shocks.
+    COMMAND_SET_START_WITH_ASYSTOLE,  // 1 to start with asystole.
+    COMMAND_SET_PADS_ATTACHED,        // 1 if the pads are attached, before or between sessions.
+    COMMAND_ATTACH_PADS,              // The operator attaches the pads, ending a wait on them.
+    COMMAND_SET_PEDIATRIC_PADS,       // 1 for pediatric pads.
+    COMMAND_SET_LOST_CONNECTION,      // 1 to lose the connection at the next chance.
+    COMMAND_RECONNECT,                // The operator plugs the cable back in, ending a wait on it.
+    COMMAND_SET_POOR_CONTACT,         // 1 to simulate poor pad contact.
+    COMMAND_SET_ARTIFACTS,            // EcgArtifact flags.
+    COMMAND_SET_PROTOCOL,             // The index of the protocol in the library. Ignored while a session runs or is resumed.
+    COMMAND_RESTORE_SNAPSHOT          // Restores the snapshot given to restoreSnapshot(). Ignored while a session runs.
+};
+
+struct DeviceCommand
+{
+    DeviceCommand(DeviceCommandType type = COMMAND_POWER_OFF, int first = 0, int second = 0, int third = 0)
+        : type(type), values{first, second, third}
+    {
+    }
+
+    DeviceCommandType type;
+    int values[3];
+
+    // Set when the command is sent, for measuring how long the device takes to apply it.
+    std::chrono::steady_clock::time_point sent;
+};
+
+// An unbounded queue of commands, that any number of threads push to without
+// locking and one thread pops from. Commands from one thread are popped in the
+// order they were pushed, and commands from different threads in the order their
+// pushes took place. Commands are kept in nodes taken from a pool allocated with
+// the queue, so a push does not allocate unless more commands are waiting than the
+// pool holds. Taking a node is retried when another thread takes or returns one at
+// the same time, and linking it in is a single exchange, so a push never locks.
+class DeviceCommandQueue
+{
+public:
+    DeviceCommandQueue();
+    ~DeviceCommandQueue();
+
+    DeviceCommandQueue(const DeviceCommandQueue &) = delete;
+    DeviceCommandQueue &operator=(const DeviceCommandQueue &) = delete;
+
+    // Can be called from any thread.
+    void push(const DeviceCommand &command);
+
+    // Only from the consumer. A command whose push has not finished yet is not
+    // popped, its producer wakes the consumer once it has.
+    bool pop(DeviceCommand &command);
+    bool empty() const;
+
+private:
+    struct Node
+    {
+        std::atomic<Node *> next;
+        DeviceCommand command;
+        std::atomic<std::uint32_t> nextFree; // The index of the next free node plus one, 0 for none.
+        bool pooled = false;                 // False for a node from the heap, once the pool was used up.
+    };
+
+    Node *allocate(const DeviceCommand &command);
+    void release(Node *node);
+
+    // The nodes of the pool, and the first free one as its index plus one in the low
+    // half and a count of the changes in the high half, so that a node taken and put
+    // back while a thread was taking it does not look unchanged to that thread.
+    std::unique_ptr<Node[]> pool;
+    std::atomic<std::uint64_t> freeTop;
+
+    // Producers add after the head, the consumer takes from after the tail, which
+    // is the node of the command popped last.
+    std::atomic<Node *> head;
+    Node *tail;
+};
+
+#endif
@@ -0,0 +1,201 @@
+// IMPORTS
+#include "EcgArtifacts.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const double TWO_PI = 6.283185307179586;
+
+// Motion is a random walk pulled back to zero over about a second, smoothed so
+// that it has no content above a few hertz.
+static const float MOTION_TIME_CONSTANT = 1.0f;
+static const float MOTION_BANDWIDTH = 3.0f;
+
+/*
+    Function: EcgArtifacts()
+    Purpose: Constructor. Starts with a single lead and no artifacts.
+    Inputs:
+        std::uint32_t seed: Seed of the random numbers.
+    Outputs:
+        None
+*/
+EcgArtifacts::EcgArtifacts(std::uint32_t seed)
+    : leads(1), enabled(0), cpr(false), poorContact(false), rng(seed * 2654435761u | 1u), time(0.0), motionWalk(0.0f), motion(0.0f)
+{
+    reset(1);
+}
+
+/*
+    Function: reset()
+    Purpose: Changes the number of leads and picks the gains of each lead.
+    Inputs:
+        int leads: The number of leads.
+    Outputs:
+        None
+*/
+void EcgArtifacts::reset(int leads)
+{
+    this->leads = std::max(leads, 1);
+
+    humGain.resize(this->leads);
+    wanderGain.resize(this->leads);
+    motionGain.resize(this->leads);
+    cprGain.resize(this->leads);
+    for (int lead = 0; lead < this->leads; ++lead)
+    {
+        humGain[lead] = 0.5f + random();
+        wanderGain[lead] = 2.0f * random() - 1.0f;
+        motionGain[lead] = 2.0f * random() - 1.0f;
+        cprGain[lead] = 0.5f + 0.5f * random();
+    }
+
+    // The pads sit where the compressions are given.
+    cprGain[0] = 1.0f;
+}
+
+/*
+    Function: setEnabled()
+    Purpose: Sets which artifacts are added.
+    Inputs:
+        int artifacts: EcgArtifact flags.
+    Outputs:
+        None
+*/
+void EcgArtifacts::setEnabled(int artifacts)
+{
+    enabled = artifacts & ARTIFACT_ALL;
+}
+
+/*
+    Function: getEnabled()
+    Purpose: Gets which artifacts are added.
+    Inputs:
+        None
+    Outputs:
+        EcgArtifact flags.
+*/
+int EcgArtifacts::getEnabled() const
+{
+    return enabled;
+}
+
+/*
+    Function: setCPR()
+    Purpose: Sets whether compressions are given, for the CPR artifact.
+    Inputs:
+        bool active: True while CPR is given.
+    Outputs:
+        None
+*/
+void EcgArtifacts::setCPR(bool active)
+{
+    cpr = active;
+}
+
+/*
+    Function: setPoorContact()
+    Purpose: Sets whether the pad contact is poor, for the pad contact noise.
+    Inputs:
+        bool poorContact: True while the contact is poor.
+    Outputs:
+        None
+*/
+void EcgArtifacts::setPoorContact(bool poorContact)
+{
+    this->poorContact = poorContact;
+}
+
+/*
+    Function: apply()
+    Purpose: Adds the enabled artifacts to a block. The artifacts are generated for
+             each sample first, then added to all leads in one pass per lead.
+    Inputs:
+        float *block: count samples of lead 0, then count samples of lead 1, and so on.
+        std::size_t count: The number of samples for each lead.
+    Outputs:
+        None
+*/
+void EcgArtifacts::apply(float *block, std::size_t count)
+{
+    const double dt = 1.0 / ECG_SAMPLE_RATE;
+    const float pull = float(dt / MOTION_TIME_CONSTANT);
+    const float smoothing = float(TWO_PI * MOTION_BANDWIDTH * dt);
+
+    hum.resize(count);
+    wander.resize(count);
+    motionSamples.resize(count);
+    cprSamples.resize(count);
+
+    for (std::size_t t = 0; t < count; ++t)
+    {
+        double now = time + t * dt;
+
+        hum[t] = (enabled & ARTIFACT_MAINS_HUM) ? MAINS_HUM_AMPLITUDE * float(std::sin(TWO_PI * MAINS_FREQUENCY * now)) : 0.0f;
+        wander[t] = (enabled & ARTIFACT_BASELINE_WANDER) ? BASELINE_WANDER_AMPLITUDE * float(std::sin(TWO_PI * BASELINE_WANDER_FREQUENCY * now)) : 0.0f;
+
+        if (enabled & ARTIFACT_MOTION)
+        {
+            motionWalk += -pull * motionWalk + MOTION_ARTIFACT_AMPLITUDE * std::sqrt(2.0f * pull) * gaussian();
+            motion += smoothing * (motionWalk - motion);
+        }
+        motionSamples[t] = (enabled & ARTIFACT_MOTION) ? motion : 0.0f;
+
+        // Each compression is a half sine pulse.
+        float phase = float(std::fmod(now * CPR_COMPRESSION_RATE, 1.0));
+        cprSamples[t] = ((enabled & ARTIFACT_CPR) && cpr && phase < 0.5f) ? CPR_ARTIFACT_AMPLITUDE * float(std::sin(TWO_PI * phase)) : 0.0f;
+    }
+
+    for (int lead = 0; lead < leads; ++lead)
+    {
+        float *x = block + std::size_t(lead) * count;
+        const float h = humGain[lead];
+        const float w = wanderGain[lead];
+        const float m = motionGain[lead];
+        const float c = cprGain[lead];
+        for (std::size_t t = 0; t < count; ++t)
+        {
+            x[t] += h * hum[t] + w * wander[t] + m * motionSamples[t] + c * cprSamples[t];
+        }
+    }
+
+    if ((enabled & ARTIFACT_PAD_CONTACT) && poorContact)
+    {
+        for (std::size_t t = 0; t < count; ++t)
+        {
+            block[t] += PAD_CONTACT_NOISE_AMPLITUDE * gaussian();
+        }
+    }
+
+    time += count * dt;
+}
+
+/*
+    Function: random()
+    Purpose: Draws a uniform random number.
+    Inputs:
+        None
+    Outputs:
+        A number between 0 and 1.
+*/
+float EcgArtifacts::random()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return float(rng >> 8) * (1.0f / 16777216.0f);
+}
+
+/*
+    Function: gaussian()
+    Purpose: Draws a normally distributed random number with the Box-Muller transform.
+    Inputs:
+        None
+    Outputs:
+        A number with mean 0 and standard deviation 1.
+*/
+float EcgArtifacts::gaussian()
+{
+    float u = std::max(random(), 1e-7f);
+    float v = random();
+    return std::sqrt(-2.0f * std::log(u)) * std::cos(float(TWO_PI) * v);
+}
@@ -0,0 +1,77 @@
+#ifndef ECGARTIFACTS_H
+#define ECGARTIFACTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Local imports
+#include "defs.h"
+
+// ECG artifacts, amplitudes in millivolts and frequencies in hertz.
+#define MAINS_HUM_AMPLITUDE 0.2f
+#define BASELINE_WANDER_AMPLITUDE 0.5f
+#define BASELINE_WANDER_FREQUENCY 0.25f
+#define MOTION_ARTIFACT_AMPLITUDE 0.3f
+#define CPR_ARTIFACT_AMPLITUDE 1.5f
+#define CPR_COMPRESSION_RATE 1.83f
+#define PAD_CONTACT_NOISE_AMPLITUDE 1.0f
+
+// Kinds of artifacts, combined as flags.
+enum EcgArtifact
+{
+    ARTIFACT_MAINS_HUM = 1,       // Mains interference.
+    ARTIFACT_BASELINE_WANDER = 2, // Breathing moves the baseline.
+    ARTIFACT_MOTION = 4,          // The patient or the pads are moved.
+    ARTIFACT_CPR = 8,             // Chest compressions, only while CPR is given.
+    ARTIFACT_PAD_CONTACT = 16,    // Noise on the pad lead, only while pad contact is poor.
+    ARTIFACT_ALL = 31
+};
+
+// Adds artifacts to a clean ECG. Each artifact is generated once per sample and
+// added to every lead with a gain of its own, since leads pick up interference
+// differently. The pad lead, lead 0, is the only one hit by pad contact noise.
+class EcgArtifacts
+{
+public:
+    explicit EcgArtifacts(std::uint32_t seed = 1);
+
+    // Change the number of leads and pick new gains for them.
+    void reset(int leads);
+
+    void setEnabled(int artifacts);
+    int getEnabled() const;
+
+    void setCPR(bool active);
+    void setPoorContact(bool poorContact);
+
+    // Adds the artifacts to count samples of every lead. block holds lead l at block[l * count].
+    void apply(float *block, std::size_t count);
+
+private:
+    float random();
+    float gaussian();
+
+    int leads;
+    int enabled;
+    bool cpr;
+    bool poorContact;
+    std::uint32_t rng;
+    double time;
+    float motionWalk;
+    float motion;
+
+    // Gains of each lead, for each artifact.
+    std::vector<float> humGain;
+    std::vector<float> wanderGain;
+    std::vector<float> motionGain;
+    std::vector<float> cprGain;
+
+    // Artifact of each sample in the block, before the lead gains.
+    std::vector<float> hum;
+    std::vector<float> wander;
+    std::vector<float> motionSamples;
+    std::vector<float> cprSamples;
+};
+
+#endif
@@ -0,0 +1,161 @@
+// IMPORTS
+#include "EcgBenchmark.h"
+#include "BiquadFilterBank.h"
+#include "CardiacModel.h"
+#include "EcgArtifacts.h"
+#include "EcgRecording.h"
+
+#include <QElapsedTimer>
+#include <QtMath>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Length of the synthetic ECG, in seconds.
+static const int BENCHMARK_SECONDS = 600;
+
+/*
+    Function: codec()
+    Purpose: Measures the compression ratio of the codec and how fast it encodes and
+             decodes, then checks that decoding gave back every sample.
+    Inputs:
+        int leads: The number of leads.
+        quint32 seed: Seed of the heart model.
+        QStringList &lines: The results are appended as lines of text.
+    Outputs:
+        True if the recording was lossless, false otherwise.
+*/
+bool EcgBenchmark::codec(int leads, quint32 seed, QStringList &lines)
+{
+    leads = qMax(1, leads);
+    const std::size_t samples = BENCHMARK_SECONDS * ECG_SAMPLE_RATE;
+    const std::size_t blockSamples = ECG_BLOCK_TIME * ECG_SAMPLE_RATE / 1000;
+
+    // A VF heart, the hardest rhythm to compress, seen from evenly spread angles.
+    CardiacModel heart(1, seed);
+    heart.resetPatient(0, VENTRICULAR_FIBRILLATION, 1.0f);
+    std::vector<float> ecg(leads * samples);
+    for (std::size_t t = 0; t < samples; ++t)
+    {
+        heart.advance(MODEL_TIME_STEP);
+        for (int lead = 0; lead < leads; ++lead)
+        {
+            ecg[lead * samples + t] = 0.5f * qCos(lead * M_PI / leads) * heart.getPatientState(0).v;
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Fed in blocks like the monitor acquires them.
+    EcgRecording recording(leads);
+    std::vector<float> block(leads * blockSamples);
+    for (std::size_t t = 0; t < samples; t += blockSamples)
+    {
+        for (int lead = 0; lead < leads; ++lead)
+        {
+            std::copy_n(&ecg[lead * samples + t], blockSamples, &block[lead * blockSamples]);
+        }
+        recording.append(block.data(), blockSamples);
+    }
+    recording.finish();
+    double encodeSeconds = timer.nsecsElapsed() / 1e9;
+
+    timer.restart();
+    std::vector<float> decoded(leads * samples);
+    for (int lead = 0; lead < leads; ++lead)
+    {
+        recording.read(lead, 0, &decoded[lead * samples], samples);
+    }
+    double decodeSeconds = timer.nsecsElapsed() / 1e9;
+
+    double total = double(leads) * samples;
+    lines.append(QString("%1 leads, %2 bits per sample (%3x smaller than 16 bit samples)")
+                     .arg(leads).arg(recording.compressedSize() * 8.0 / total, 0, 'f', 2)
+                     .arg(total * 2.0 / recording.compressedSize(), 0, 'f', 1));
+    lines.append(QString("Encode %1 samples/s (%2x real time), decode %3 samples/s, one lead at a time")
+                     .arg(total / encodeSeconds, 0, 'e', 2).arg(BENCHMARK_SECONDS / encodeSeconds, 0, 'f', 0)
+                     .arg(total / decodeSeconds, 0, 'e', 2));
+
+    // Quantizing is the only loss, at most half a step.
+    std::size_t mismatches = 0;
+    for (std::size_t i = 0; i < decoded.size(); ++i)
+    {
+        if (std::fabs(decoded[i] - ecg[i]) > 0.501f * ECG_ADC_RESOLUTION)
+        {
+            mismatches++;
+        }
+    }
+    if (mismatches > 0)
+    {
+        lines.append(QString("%1 decoded samples differ from the ECG by more than the quantization").arg(mismatches));
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Function: filters()
+    Purpose: Measures how fast the front end filters process the ECG.
+    Inputs:
+        int leads: The number of leads.
+        quint32 seed: Seed of the heart model and of the artifacts.
+        QStringList &lines: The results are appended as lines of text.
+    Outputs:
+        None
+*/
+void EcgBenchmark::filters(int leads, quint32 seed, QStringList &lines)
+{
+    leads = qMax(1, leads);
+    const std::size_t samples = BENCHMARK_SECONDS * ECG_SAMPLE_RATE;
+    const std::size_t blockSamples = ECG_BLOCK_TIME * ECG_SAMPLE_RATE / 1000;
+
+    // Filtering does not depend on the signal, so every artifact on a sinus heart will do.
+    CardiacModel heart(1, seed);
+    heart.resetPatient(0, SINUS_RHYTHM, 1.0f);
+    EcgArtifacts noise(seed + 1);
+    noise.reset(leads);
+    noise.setEnabled(ARTIFACT_ALL);
+    noise.setCPR(true);
+
+    std::vector<float> ecg(leads * samples);
+    std::vector<float> block(leads * blockSamples);
+    for (std::size_t t = 0; t < samples; t += blockSamples)
+    {
+        for (std::size_t i = 0; i < blockSamples; ++i)
+        {
+            heart.advance(MODEL_TIME_STEP);
+            for (int lead = 0; lead < leads; ++lead)
+            {
+                block[lead * blockSamples + i] = 0.5f * qCos(lead * M_PI / leads) * heart.getPatientState(0).v;
+            }
+        }
+        noise.apply(block.data(), blockSamples);
+        for (int lead = 0; lead < leads; ++lead)
+        {
+            std::copy_n(&block[lead * blockSamples], blockSamples, &ecg[lead * samples + t]);
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Filtered in blocks like the monitor acquires them.
+    BiquadFilterBank filters = BiquadFilterBank::frontEnd(leads);
+    for (std::size_t t = 0; t < samples; t += blockSamples)
+    {
+        for (int lead = 0; lead < leads; ++lead)
+        {
+            std::copy_n(&ecg[lead * samples + t], blockSamples, &block[lead * blockSamples]);
+        }
+        filters.process(block.data(), blockSamples);
+    }
+    double seconds = timer.nsecsElapsed() / 1e9;
+
+    double total = double(leads) * samples;
+    lines.append(QString("%1 leads, %2 sections: %3 samples/s (%4x real time)")
+                     .arg(leads).arg(filters.sectionCount())
+                     .arg(total / seconds, 0, 'e', 2).arg(BENCHMARK_SECONDS / seconds, 0, 'f', 0));
+}
@@ -0,0 +1,23 @@
+#ifndef ECGBENCHMARK_H
+#define ECGBENCHMARK_H
+
+// Qt imports
+#include <QStringList>
+
+// Local imports
+#include "defs.h"
+
+// Throughput of the ECG processing, measured on 10 minutes of a synthetic ECG of
+// any number of leads, fed in blocks the size the monitor acquires them in.
+class EcgBenchmark
+{
+public:
+    // Compresses the ECG of a VF heart and decodes it back, one lead at a time. Returns
+    // false if a decoded sample differs from the original by more than the quantization.
+    static bool codec(int leads, quint32 seed, QStringList &lines);
+
+    // Runs the front end filters over a sinus ECG with every artifact on it.
+    static void filters(int leads, quint32 seed, QStringList &lines);
+};
+
+#endif
@@ -0,0 +1,127 @@
+// IMPORTS
+#include "EcgBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+/*
+    Function: EcgBuffer()
+    Purpose: Constructor. Allocates the samples of every lead at once.
+    Inputs:
+        int leads: The number of leads.
+        std::size_t capacity: The number of samples kept for each lead.
+    Outputs:
+        None
+*/
+EcgBuffer::EcgBuffer(int leads, std::size_t capacity)
+    : leads(std::max(leads, 1)), size(1), mask(0), count(0)
+{
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    mask = size - 1;
+
+    samples.assign(std::size_t(this->leads) * size, 0.0f);
+}
+
+/*
+    Function: leadCount()
+    Purpose: Gets the number of leads.
+    Inputs:
+        None
+    Outputs:
+        The number of leads.
+*/
+int EcgBuffer::leadCount() const
+{
+    return leads;
+}
+
+/*
+    Function: capacity()
+    Purpose: Gets the number of samples kept for each lead.
+    Inputs:
+        None
+    Outputs:
+        The capacity.
+*/
+std::size_t EcgBuffer::capacity() const
+{
+    return size;
+}
+
+/*
+    Function: written()
+    Purpose: Gets the number of samples appended to every lead so far.
+    Inputs:
+        None
+    Outputs:
+        The number of samples.
+*/
+std::uint64_t EcgBuffer::written() const
+{
+    return count.load(std::memory_order_acquire);
+}
+
+/*
+    Function: append()
+    Purpose: Appends a block of samples to every lead. Each lead is copied in at most
+             two pieces, before and after the end of the ring.
+    Inputs:
+        const float *block: count samples of lead 0, then count samples of lead 1, and so on.
+        std::size_t count: The number of samples for each lead, at most the capacity.
+    Outputs:
+        None
+*/
+void EcgBuffer::append(const float *block, std::size_t count)
+{
+    count = std::min(count, size);
+
+    std::uint64_t first = this->count.load(std::memory_order_relaxed);
+    std::size_t start = std::size_t(first) & mask;
+    std::size_t before = std::min(count, size - start);
+
+    for (int lead = 0; lead < leads; ++lead)
+    {
+        float *ring = samples.data() + std::size_t(lead) * size;
+        const float *source = block + std::size_t(lead) * count;
+
+        std::memcpy(ring + start, source, before * sizeof(float));
+        std::memcpy(ring, source + before, (count - before) * sizeof(float));
+    }
+
+    this->count.store(first + count, std::memory_order_release);
+}
+
+/*
+    Function: read()
+    Purpose: Copies samples of a lead out of the ring.
+    Inputs:
+        int lead: The lead.
+        std::uint64_t first: The number of the first sample, counted from the first append.
+        float *out: Receives count samples.
+        std::size_t count: The number of samples.
+    Outputs:
+        True if all samples were valid, false if some were not written yet or were
+        overwritten while copying.
+*/
+bool EcgBuffer::read(int lead, std::uint64_t first, float *out, std::size_t count) const
+{
+    if (lead < 0 || lead >= leads || count > size)
+        return false;
+
+    std::uint64_t end = written();
+    if (first + count > end || end - first > size)
+        return false;
+
+    const float *ring = samples.data() + std::size_t(lead) * size;
+    std::size_t start = std::size_t(first) & mask;
+    std::size_t before = std::min(count, size - start);
+
+    std::memcpy(out, ring + start, before * sizeof(float));
+    std::memcpy(out + before, ring, (count - before) * sizeof(float));
+
+    // The writer may have lapped us while copying.
+    return written() - first <= size;
+}
@@ -0,0 +1,42 @@
+#ifndef ECGBUFFER_H
+#define ECGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A ring buffer of ECG samples for a fixed number of leads. Samples are stored
+// lead after lead in a single allocation, so every lead is a contiguous array
+// and adding leads adds no allocations.
+//
+// One thread appends, any thread can read. A reader that falls more than the
+// capacity behind gets overwritten samples, which read() reports.
+class EcgBuffer
+{
+public:
+    // The capacity is rounded up to a power of two.
+    EcgBuffer(int leads, std::size_t capacity);
+
+    int leadCount() const;
+    std::size_t capacity() const;
+
+    // Number of samples appended to every lead so far.
+    std::uint64_t written() const;
+
+    // Appends count samples to every lead. block holds lead l at block[l * count].
+    void append(const float *block, std::size_t count);
+
+    // Copies samples first to first + count of a lead. Returns false if some of them
+    // were not written yet or have already been overwritten.
+    bool read(int lead, std::uint64_t first, float *out, std::size_t count) const;
+
+private:
+    int leads;
+    std::size_t size;
+    std::size_t mask;
+    std::vector<float> samples;
+    std::atomic<std::uint64_t> count;
+};
+
+#endif
@@ -0,0 +1,241 @@
+// IMPORTS
+#include "EcgDisplay.h"
+#include "EcgBuffer.h"
+#include "EcgMonitor.h"
+
+#include <QPainter>
+#include <QWheelEvent>
+#include <QtMath>
+
+/*
+    Function: EcgDisplay(QWidget *parent)
+    Purpose: Constructor. The strip stays black until it is started.
+    Input:
+        parent - The parent widget.
+    Output:
+        None
+*/
+EcgDisplay::EcgDisplay(QWidget *parent)
+    : QWidget(parent), monitor(nullptr), lead(0), nextSample(0), window(ECG_DISPLAY_WINDOW)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+
+    refreshTimer = new QTimer(this);
+    refreshTimer->setInterval(ECG_DISPLAY_REFRESH_TIME);
+    connect(refreshTimer, &QTimer::timeout, this, &EcgDisplay::refresh);
+}
+
+/*
+    Function: setMonitor(const EcgMonitor *monitor)
+    Purpose: Set the monitor whose ECG is drawn.
+    Input:
+        monitor - The ECG monitor.
+    Output:
+        None
+*/
+void EcgDisplay::setMonitor(const EcgMonitor *monitor)
+{
+    this->monitor = monitor;
+    buffer.reset();
+}
+
+/*
+    Function: setLead(int lead)
+    Purpose: Set the lead that is drawn. Lead 0 is the pad lead.
+    Input:
+        lead - The index of the lead.
+    Output:
+        None
+*/
+void EcgDisplay::setLead(int lead)
+{
+    this->lead = lead;
+
+    // Start over with the new lead.
+    buffer.reset();
+    envelope.reset(1);
+    update();
+}
+
+/*
+    Function: setWindowSeconds(double seconds)
+    Purpose: Set how much of the ECG is shown across the strip.
+    Input:
+        seconds - The length of the window, kept between ECG_DISPLAY_MIN_WINDOW and ECG_BUFFER_SECONDS.
+    Output:
+        None
+*/
+void EcgDisplay::setWindowSeconds(double seconds)
+{
+    window = qBound(ECG_DISPLAY_MIN_WINDOW, seconds, double(ECG_BUFFER_SECONDS));
+    update();
+}
+
+/*
+    Function: windowSeconds()
+    Purpose: Get how much of the ECG is shown across the strip.
+    Input:
+        None
+    Output:
+        The length of the window in seconds.
+*/
+double EcgDisplay::windowSeconds() const
+{
+    return window;
+}
+
+/*
+    Function: start()
+    Purpose: Start drawing the samples acquired from now on.
+    Input:
+        None
+    Output:
+        None
+*/
+void EcgDisplay::start()
+{
+    if (refreshTimer->isActive())
+        return;
+
+    buffer.reset();
+    refresh();
+    refreshTimer->start();
+}
+
+/*
+    Function: stop()
+    Purpose: Stop drawing and clear the strip.
+    Input:
+        None
+    Output:
+        None
+*/
+void EcgDisplay::stop()
+{
+    refreshTimer->stop();
+    buffer.reset();
+    envelope.reset(1);
+    update();
+}
+
+/*
+    Function: refresh()
+    Purpose: Add the samples acquired since the last refresh to the envelope and
+             repaint. A new buffer, after the monitor leads changed, or a strip that
+             fell behind by more than the buffer starts over from the newest sample.
+    Input:
+        None
+    Output:
+        None
+*/
+void EcgDisplay::refresh()
+{
+    if (monitor == nullptr)
+        return;
+
+    std::shared_ptr<const EcgBuffer> latest = monitor->getBuffer();
+    if (latest != buffer || latest->written() - nextSample > latest->capacity())
+    {
+        buffer = latest;
+        envelope.reset(buffer->capacity());
+        nextSample = buffer->written();
+    }
+
+    if (lead >= buffer->leadCount())
+        return;
+
+    std::uint64_t written = buffer->written();
+    incoming.resize(written - nextSample);
+    if (!incoming.empty())
+    {
+        if (buffer->read(lead, nextSample, incoming.data(), incoming.size()))
+        {
+            envelope.append(incoming.data(), incoming.size());
+        }
+        else
+        {
+            envelope.reset(buffer->capacity());
+        }
+        nextSample = written;
+    }
+
+    update();
+}
+
+/*
+    Function: paintEvent(QPaintEvent *event)
+    Purpose: Draw the strip. Each pixel column gets a vertical line over the envelope
+             of its samples, and a line joining it to the previous column when the two
+             do not overlap, so the cost only depends on the width of the strip.
+    Input:
+        event - The paint event.
+    Output:
+        None
+*/
+void EcgDisplay::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+
+    const int columns = width();
+    if (envelope.written() == 0 || columns <= 0)
+        return;
+
+    const double samples = window * ECG_SAMPLE_RATE;
+    minimum.resize(columns);
+    maximum.resize(columns);
+    envelope.columns(double(envelope.written()) - samples, samples / columns, columns, minimum.data(), maximum.data());
+
+    const qreal center = height() / 2.0;
+    const qreal scale = height() / (2.0 * ECG_DISPLAY_RANGE);
+    const qreal bottom = height() - 1;
+
+    QVector<QLineF> lines;
+    lines.reserve(2 * columns);
+
+    bool previous = false;
+    qreal previousTop = 0.0, previousBase = 0.0;
+    for (int x = 0; x < columns; ++x)
+    {
+        // Columns without samples, before the strip started, are left black.
+        if (minimum[x] > maximum[x])
+        {
+            previous = false;
+            continue;
+        }
+
+        qreal top = qBound(0.0, center - maximum[x] * scale, bottom);
+        qreal base = qBound(0.0, center - minimum[x] * scale, bottom);
+
+        if (previous && top > previousBase)
+        {
+            lines << QLineF(x - 1, previousBase, x, top);
+        }
+        else if (previous && base < previousTop)
+        {
+            lines << QLineF(x - 1, previousTop, x, base);
+        }
+        lines << QLineF(x, top, x, base);
+
+        previous = true;
+        previousTop = top;
+        previousBase = base;
+    }
+
+    painter.setPen(QPen(QColor("#3ddc84"), 0));
+    painter.drawLines(lines);
+}
+
+/*
+    Function: wheelEvent(QWheelEvent *event)
+    Purpose: Zoom the strip, halving or doubling the window every two steps of the wheel.
+    Input:
+        event - The wheel event.
+    Output:
+        None
+*/
+void EcgDisplay::wheelEvent(QWheelEvent *event)
+{
+    setWindowSeconds(window * qPow(2.0, -event->angleDelta().y() / 240.0));
+    event->accept();
+}
@@ -0,0 +1,67 @@
+#ifndef ECGDISPLAY_H
+#define ECGDISPLAY_H
+
+// Qt imports
+#include <QTimer>
+#include <QWidget>
+
+#include <memory>
+#include <vector>
+
+// Local imports
+#include "EcgEnvelope.h"
+#include "defs.h"
+
+// ECG display. The window is in seconds and the range in millivolts from the center to the edge.
+#define ECG_DISPLAY_REFRESH_TIME 40
+#define ECG_DISPLAY_WINDOW 4.0
+#define ECG_DISPLAY_MIN_WINDOW 1.0
+#define ECG_DISPLAY_RANGE 1.5f
+
+class EcgBuffer;
+class EcgMonitor;
+
+// Draws one lead of the ECG acquired by a monitor as a scrolling strip, the
+// newest sample at the right edge. Samples are taken from the monitor buffer on
+// every refresh and added to an envelope pyramid, so every pixel column is
+// drawn with one or two lines however long the window is. The mouse wheel
+// zooms between ECG_DISPLAY_MIN_WINDOW and ECG_BUFFER_SECONDS.
+class EcgDisplay : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit EcgDisplay(QWidget *parent = nullptr);
+
+    void setMonitor(const EcgMonitor *monitor);
+    void setLead(int lead);
+
+    void setWindowSeconds(double seconds);
+    double windowSeconds() const;
+
+    // Start drawing the samples acquired from now on, or stop and clear the strip.
+    void start();
+    void stop();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+
+private:
+    void refresh();
+
+    const EcgMonitor *monitor;
+    std::shared_ptr<const EcgBuffer> buffer;
+    int lead;
+    std::uint64_t nextSample;
+    double window;
+
+    EcgEnvelope envelope;
+    std::vector<float> incoming;
+    std::vector<float> minimum;
+    std::vector<float> maximum;
+
+    QTimer *refreshTimer;
+};
+
+#endif
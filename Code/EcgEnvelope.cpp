@@ -0,0 +1,185 @@
+// IMPORTS
+#include "EcgEnvelope.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/*
+    Function: EcgEnvelope()
+    Purpose: Constructor. Allocates every level of the pyramid.
+    Inputs:
+        std::size_t capacity: The number of samples kept.
+    Outputs:
+        None
+*/
+EcgEnvelope::EcgEnvelope(std::size_t capacity)
+    : size(1), count(0)
+{
+    reset(capacity);
+}
+
+/*
+    Function: reset()
+    Purpose: Forgets all samples and builds the levels for a new capacity. Levels are
+             added until the coarsest has ECG_ENVELOPE_MIN_BUCKETS buckets.
+    Inputs:
+        std::size_t capacity: The number of samples kept.
+    Outputs:
+        None
+*/
+void EcgEnvelope::reset(std::size_t capacity)
+{
+    size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    count = 0;
+
+    levels.clear();
+    for (int shift = 0; shift == 0 || (size >> shift) >= ECG_ENVELOPE_MIN_BUCKETS; shift += ECG_ENVELOPE_LEVEL_SHIFT)
+    {
+        // Above level 0, the bucket straddling the oldest kept sample is kept as well.
+        std::size_t buckets = shift == 0 ? size : 2 * (size >> shift);
+
+        Level level;
+        level.shift = shift;
+        level.mask = buckets - 1;
+        level.minimum.assign(buckets, 0.0f);
+        level.maximum.assign(buckets, 0.0f);
+        levels.push_back(std::move(level));
+    }
+}
+
+/*
+    Function: capacity()
+    Purpose: Gets the number of samples kept.
+    Inputs:
+        None
+    Outputs:
+        The capacity.
+*/
+std::size_t EcgEnvelope::capacity() const
+{
+    return size;
+}
+
+/*
+    Function: levelCount()
+    Purpose: Gets the number of levels of the pyramid, the samples included.
+    Inputs:
+        None
+    Outputs:
+        The number of levels.
+*/
+int EcgEnvelope::levelCount() const
+{
+    return int(levels.size());
+}
+
+/*
+    Function: written()
+    Purpose: Gets the number of samples appended so far.
+    Inputs:
+        None
+    Outputs:
+        The number of samples.
+*/
+std::uint64_t EcgEnvelope::written() const
+{
+    return count;
+}
+
+/*
+    Function: append()
+    Purpose: Appends samples and updates every level. The bucket a sample falls in is
+             started by the first sample of the bucket and widened by the others, so
+             the newest bucket of every level is always up to date.
+    Inputs:
+        const float *samples: The samples.
+        std::size_t count: The number of samples.
+    Outputs:
+        None
+*/
+void EcgEnvelope::append(const float *samples, std::size_t count)
+{
+    for (Level &level : levels)
+    {
+        const std::uint64_t bucketMask = (std::uint64_t(1) << level.shift) - 1;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const std::uint64_t position = this->count + i;
+            const std::size_t slot = std::size_t(position >> level.shift) & level.mask;
+
+            if ((position & bucketMask) == 0)
+            {
+                level.minimum[slot] = samples[i];
+                level.maximum[slot] = samples[i];
+            }
+            else
+            {
+                level.minimum[slot] = std::min(level.minimum[slot], samples[i]);
+                level.maximum[slot] = std::max(level.maximum[slot], samples[i]);
+            }
+        }
+    }
+
+    this->count += count;
+}
+
+/*
+    Function: columns()
+    Purpose: Computes the envelope of display columns. Each column is read from the
+             coarsest level whose buckets are no wider than the column, so it takes
+             at most a few buckets. Buckets at the edges of a column may reach a
+             little past it, which only widens the envelope by less than a column.
+    Inputs:
+        double first: The first sample of the first column. May be negative.
+        double samplesPerColumn: The number of samples covered by each column.
+        int columns: The number of columns.
+        float *minimum: Receives the minimum of each column.
+        float *maximum: Receives the maximum of each column.
+    Outputs:
+        None
+*/
+void EcgEnvelope::columns(double first, double samplesPerColumn, int columns, float *minimum, float *maximum) const
+{
+    const std::int64_t oldest = std::int64_t(count > size ? count - size : 0);
+    const std::int64_t newest = std::int64_t(count);
+
+    for (int column = 0; column < columns; ++column)
+    {
+        // A column narrower than a sample still shows the sample it falls on.
+        std::int64_t begin = std::int64_t(std::floor(first + column * samplesPerColumn));
+        std::int64_t end = std::max(begin + 1, std::int64_t(std::floor(first + (column + 1) * samplesPerColumn)));
+        begin = std::max(begin, oldest);
+        end = std::min(end, newest);
+
+        if (begin >= end)
+        {
+            minimum[column] = 1.0f;
+            maximum[column] = -1.0f;
+            continue;
+        }
+
+        std::size_t level = 0;
+        while (level + 1 < levels.size() && (std::int64_t(1) << levels[level + 1].shift) <= end - begin)
+        {
+            level++;
+        }
+        const Level &source = levels[level];
+
+        float low = std::numeric_limits<float>::max();
+        float high = std::numeric_limits<float>::lowest();
+        for (std::int64_t bucket = begin >> source.shift; bucket <= (end - 1) >> source.shift; ++bucket)
+        {
+            const std::size_t slot = std::size_t(bucket) & source.mask;
+            low = std::min(low, source.minimum[slot]);
+            high = std::max(high, source.maximum[slot]);
+        }
+
+        minimum[column] = low;
+        maximum[column] = high;
+    }
+}
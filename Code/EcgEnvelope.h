@@ -0,0 +1,58 @@
+#ifndef ECGENVELOPE_H
+#define ECGENVELOPE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Local imports
+#include "defs.h"
+
+// Buckets merged by each level, as a power of two, and the fewest buckets a level can have.
+#define ECG_ENVELOPE_LEVEL_SHIFT 2
+#define ECG_ENVELOPE_MIN_BUCKETS 16
+
+// The history of one lead as a pyramid of min/max envelopes, for drawing it at
+// any zoom. Level 0 holds the samples, and every level above holds the minimum
+// and maximum of 1 << ECG_ENVELOPE_LEVEL_SHIFT buckets of the level below. Every
+// level is a ring buffer over the same history and is updated as samples are
+// appended.
+//
+// A column of the display is filled from the coarsest level whose buckets still
+// fit in it, so it never takes more than a few buckets, whatever the zoom.
+class EcgEnvelope
+{
+public:
+    // The capacity is rounded up to a power of two.
+    explicit EcgEnvelope(std::size_t capacity = 1);
+
+    // Forget all samples and change the capacity.
+    void reset(std::size_t capacity);
+    std::size_t capacity() const;
+    int levelCount() const;
+
+    // Number of samples appended so far.
+    std::uint64_t written() const;
+
+    void append(const float *samples, std::size_t count);
+
+    // Fills the envelope of columns consecutive columns, column c covering samples
+    // first + c * samplesPerColumn up to the next column. Columns without kept
+    // samples get a minimum above their maximum.
+    void columns(double first, double samplesPerColumn, int columns, float *minimum, float *maximum) const;
+
+private:
+    struct Level
+    {
+        int shift;      // Buckets hold 1 << shift samples.
+        std::size_t mask;
+        std::vector<float> minimum;
+        std::vector<float> maximum;
+    };
+
+    std::size_t size;
+    std::uint64_t count;
+    std::vector<Level> levels;
+};
+
+#endif
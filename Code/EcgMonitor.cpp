@@ -0,0 +1,387 @@
+// IMPORTS
+#include "EcgMonitor.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+#include <QtMath>
+
+#include <algorithm>
+
+// Lead 0 is the pads, placed like lead II. The rest are the monitor leads, of
+// which the first three are used by a 3 lead monitor.
+struct LeadDefinition
+{
+    const char *name;
+    float angle;
+};
+
+static const LeadDefinition LEADS[] = {
+    {"Pads", 60.0f},
+    {"I", 0.0f}, {"II", 60.0f}, {"III", 120.0f},
+    {"aVR", -150.0f}, {"aVL", -30.0f}, {"aVF", 90.0f},
+    {"V1", 120.0f}, {"V2", 100.0f}, {"V3", 80.0f}, {"V4", 60.0f}, {"V5", 30.0f}, {"V6", 0.0f},
+};
+static const int MAX_LEADS = sizeof(LEADS) / sizeof(LEADS[0]);
+
+// Most of the signal follows depolarization, some of it recovery.
+static const float RECOVERY_GAIN = 0.2f;
+
+/*
+    Function: EcgMonitor()
+    Purpose: Constructor. Starts the monitor thread with only the pad lead, without acquiring.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+EcgMonitor::EcgMonitor()
+    : QObject(nullptr), rhythm(SINUS_RHYTHM), heartRate(0.0f), artifactFlags(0), cpr(false), poorContact(false),
+      heart(1, QRandomGenerator::global()->generate()), artifacts(QRandomGenerator::global()->generate()), acquired(0), blockTimer(nullptr)
+{
+    setMonitorLeads(0);
+
+    m_thread.reset(new QThread);
+    moveToThread(m_thread.get());
+    m_thread->start();
+}
+
+/*
+    Function: ~EcgMonitor()
+    Purpose: Destructor. Stops acquiring and the monitor thread.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+EcgMonitor::~EcgMonitor()
+{
+    QMetaObject::invokeMethod(this, "stop", Qt::BlockingQueuedConnection);
+    m_thread->quit();
+    m_thread->wait();
+}
+
+/*
+    Function: setMonitorLeads()
+    Purpose: Sets the number of monitor leads and starts a new buffer for them.
+    Inputs:
+        int leads: 0 for the pads only, 3 or 12 for a monitor.
+    Outputs:
+        None
+*/
+void EcgMonitor::setMonitorLeads(int leads)
+{
+    int count = 1 + (leads >= 12 ? 12 : leads >= 3 ? 3 : 0);
+    count = std::min(count, MAX_LEADS);
+
+    gainV.resize(count);
+    gainW.resize(count);
+    artifacts.reset(count);
+    frontEnd = BiquadFilterBank::frontEnd(count);
+    detector.reset(count);
+    for (int lead = 0; lead < count; ++lead)
+    {
+        float angle = qDegreesToRadians(LEADS[lead].angle - ECG_HEART_AXIS);
+        gainV[lead] = 0.5f * std::cos(angle);
+        gainW[lead] = 0.5f * RECOVERY_GAIN * std::sin(angle);
+        detector.setInverted(lead, gainV[lead] < 0.0f);
+    }
+
+    {
+        QMutexLocker locker(&recordingMutex);
+        recording.reset(count);
+    }
+
+    QMutexLocker locker(&bufferMutex);
+    buffer = std::make_shared<EcgBuffer>(count, std::size_t(ECG_BUFFER_SECONDS * ECG_SAMPLE_RATE));
+}
+
+/*
+    Function: start()
+    Purpose: Starts acquiring a block of samples every ECG_BLOCK_TIME milliseconds.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void EcgMonitor::start()
+{
+    // Created here so that the timer belongs to the monitor thread.
+    if (blockTimer == nullptr)
+    {
+        blockTimer = new QTimer(this);
+        blockTimer->setTimerType(Qt::PreciseTimer);
+        connect(blockTimer, &QTimer::timeout, this, &EcgMonitor::acquire);
+    }
+
+    if (!blockTimer->isActive())
+    {
+        {
+            QMutexLocker locker(&recordingMutex);
+            recording.reset(int(gainV.size()));
+        }
+
+        clock.start();
+        acquired = 0;
+        blockTimer->start(ECG_BLOCK_TIME);
+    }
+}
+
+/*
+    Function: stop()
+    Purpose: Stops acquiring samples.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void EcgMonitor::stop()
+{
+    if (blockTimer == nullptr || !blockTimer->isActive())
+        return;
+
+    blockTimer->stop();
+    heartRate = 0.0f;
+
+    QMutexLocker locker(&recordingMutex);
+    recording.finish();
+
+    if (!recordingFile.isEmpty())
+    {
+        std::vector<std::uint8_t> data = recording.serialize();
+        QFile file(recordingFile);
+        if (!file.open(QIODevice::WriteOnly) || file.write(reinterpret_cast<const char *>(data.data()), qint64(data.size())) != qint64(data.size()))
+        {
+            qWarning() << "Could not write the ECG recording to" << recordingFile;
+        }
+    }
+}
+
+/*
+    Function: acquire()
+    Purpose: Acquires the samples due since the last block. The heart is advanced one
+             sample at a time, then every lead is computed from it in a single pass.
+             Artifacts are added to the block, which is filtered for the QRS detector
+             and appended to the buffer as is.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void EcgMonitor::acquire()
+{
+    std::uint64_t due = std::uint64_t(clock.nsecsElapsed() / (1000000000LL / ECG_SAMPLE_RATE));
+    std::size_t count = std::size_t(std::min<std::uint64_t>(due - acquired, ECG_SAMPLE_RATE));
+    acquired = due;
+    if (count == 0)
+        return;
+
+    // The device decides the rhythm, the model only gives it its shape.
+    HeartState wanted = HeartState(rhythm.load());
+    if (heart.getRhythm(0) != wanted)
+    {
+        CardiacModel::PatientState state = heart.getPatientState(0);
+        state.rhythm = wanted;
+        state.viability = 1.0f;
+        heart.setPatientState(0, state);
+    }
+
+    v.resize(count);
+    w.resize(count);
+    for (std::size_t t = 0; t < count; ++t)
+    {
+        heart.advance(MODEL_TIME_STEP);
+        CardiacModel::PatientState state = heart.getPatientState(0);
+        v[t] = state.v;
+        w[t] = state.w;
+    }
+
+    const int leads = int(gainV.size());
+    block.resize(std::size_t(leads) * count);
+    for (int lead = 0; lead < leads; ++lead)
+    {
+        float *out = block.data() + std::size_t(lead) * count;
+        const float a = gainV[lead];
+        const float b = gainW[lead];
+        for (std::size_t t = 0; t < count; ++t)
+        {
+            out[t] = a * v[t] + b * w[t];
+        }
+    }
+
+    artifacts.setEnabled(artifactFlags);
+    artifacts.setCPR(cpr);
+    artifacts.setPoorContact(poorContact);
+    artifacts.apply(block.data(), count);
+
+    // The analyzer sees the filtered signal, the buffer and the recording the signal as acquired.
+    filtered.assign(block.begin(), block.end());
+    frontEnd.process(filtered.data(), count);
+    detector.process(filtered.data(), count);
+    heartRate = detector.getHeartRate(0);
+
+    std::shared_ptr<EcgBuffer> target;
+    {
+        QMutexLocker locker(&bufferMutex);
+        target = buffer;
+    }
+    target->append(block.data(), count);
+
+    {
+        QMutexLocker locker(&recordingMutex);
+        recording.append(block.data(), count);
+    }
+
+    emit samplesAcquired(target->written());
+}
+
+/*
+    Function: getBuffer()
+    Purpose: Gets the samples acquired so far. Can be called from any thread.
+    Inputs:
+        None
+    Outputs:
+        The buffer. Kept alive by the caller even if the leads change.
+*/
+std::shared_ptr<const EcgBuffer> EcgMonitor::getBuffer() const
+{
+    QMutexLocker locker(&bufferMutex);
+    return buffer;
+}
+
+/*
+    Function: getLeadCount()
+    Purpose: Gets the number of leads, including the pad lead.
+    Inputs:
+        None
+    Outputs:
+        The number of leads.
+*/
+int EcgMonitor::getLeadCount() const
+{
+    return getBuffer()->leadCount();
+}
+
+/*
+    Function: leadName()
+    Purpose: Gets the name of a lead.
+    Inputs:
+        int lead: The lead.
+    Outputs:
+        The name, as printed on a monitor.
+*/
+QString EcgMonitor::leadName(int lead)
+{
+    return (lead >= 0 && lead < MAX_LEADS) ? QString(LEADS[lead].name) : QString();
+}
+
+/*
+    Function: setRecordingFile()
+    Purpose: Sets the file the recording is written to when acquisition stops.
+    Inputs:
+        const QString &fileName: The file, or an empty string to keep the recording in memory only.
+    Outputs:
+        None
+*/
+void EcgMonitor::setRecordingFile(const QString &fileName)
+{
+    QMutexLocker locker(&recordingMutex);
+    recordingFile = fileName;
+}
+
+/*
+    Function: readRecording()
+    Purpose: Decodes samples of the recording. Can be called from any thread.
+    Inputs:
+        int lead: The lead.
+        std::uint64_t first: The number of the first sample since acquisition started.
+        float *out: Receives count samples.
+        std::size_t count: The number of samples.
+    Outputs:
+        True if all samples were recorded, false otherwise.
+*/
+bool EcgMonitor::readRecording(int lead, std::uint64_t first, float *out, std::size_t count) const
+{
+    QMutexLocker locker(&recordingMutex);
+    return recording.read(lead, first, out, count);
+}
+
+/*
+    Function: getRecordedSamples()
+    Purpose: Gets the number of samples recorded for each lead since acquisition started.
+    Inputs:
+        None
+    Outputs:
+        The number of samples.
+*/
+std::uint64_t EcgMonitor::getRecordedSamples() const
+{
+    QMutexLocker locker(&recordingMutex);
+    return recording.sampleCount();
+}
+
+/*
+    Function: getHeartRate()
+    Purpose: Gets the heart rate seen by the pad lead.
+    Inputs:
+        None
+    Outputs:
+        The heart rate in beats per minute, 0 without recent beats.
+*/
+float EcgMonitor::getHeartRate() const
+{
+    return heartRate;
+}
+
+/*
+    Function: setRhythm()
+    Purpose: Sets the rhythm of the patient. Taken up by the next block.
+    Inputs:
+        HeartState rhythm: The rhythm.
+    Outputs:
+        None
+*/
+void EcgMonitor::setRhythm(HeartState rhythm)
+{
+    this->rhythm = rhythm;
+}
+
+/*
+    Function: setArtifacts()
+    Purpose: Sets which artifacts are added to the ECG. Taken up by the next block.
+    Inputs:
+        int artifacts: EcgArtifact flags.
+    Outputs:
+        None
+*/
+void EcgMonitor::setArtifacts(int artifacts)
+{
+    artifactFlags = artifacts;
+}
+
+/*
+    Function: setCPR()
+    Purpose: Sets whether compressions are given, for the CPR artifact.
+    Inputs:
+        bool active: True while CPR is given.
+    Outputs:
+        None
+*/
+void EcgMonitor::setCPR(bool active)
+{
+    cpr = active;
+}
+
+/*
+    Function: setPoorContact()
+    Purpose: Sets whether the pad contact is poor, for the pad contact noise.
+    Inputs:
+        bool poorContact: True while the contact is poor.
+    Outputs:
+        None
+*/
+void EcgMonitor::setPoorContact(bool poorContact)
+{
+    this->poorContact = poorContact;
+}
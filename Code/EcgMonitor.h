@@ -0,0 +1,110 @@
+#ifndef ECGMONITOR_H
+#define ECGMONITOR_H
+
+// Qt imports
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QTimer>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Local imports
+#include "defs.h"
+#include "CardiacModel.h"
+#include "BiquadFilterBank.h"
+#include "EcgArtifacts.h"
+#include "EcgBuffer.h"
+#include "EcgRecording.h"
+#include "QrsDetector.h"
+
+// Direction of the heart's electrical axis, in degrees.
+#define ECG_HEART_AXIS 60.0f
+
+// Acquires the ECG of the patient on a thread of its own. Lead 0 is the pad
+// lead, the signal the device analyzes; a 3 or 12 lead monitor can add leads
+// after it. Every lead is a projection of the same heart, so all leads are made
+// by one pass over the samples. Artifacts are added like the real world would,
+// and the analyzer front end filters them out again before the QRS detector.
+class EcgMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit EcgMonitor();
+    ~EcgMonitor();
+
+    // Samples acquired so far. Replaced when the leads change.
+    std::shared_ptr<const EcgBuffer> getBuffer() const;
+
+    int getLeadCount() const;
+    static QString leadName(int lead);
+
+    // Copies samples of the full recording since the last start.
+    bool readRecording(int lead, std::uint64_t first, float *out, std::size_t count) const;
+    std::uint64_t getRecordedSamples() const;
+
+    // Heart rate seen by the pad lead, 0 without recent beats.
+    float getHeartRate() const;
+
+    // Can be called from any thread.
+    void setRhythm(HeartState rhythm);
+    void setArtifacts(int artifacts);
+    void setCPR(bool active);
+    void setPoorContact(bool poorContact);
+
+public slots:
+    // Add 0, 3 or 12 monitor leads to the pad lead.
+    void setMonitorLeads(int leads);
+
+    // Written when acquisition stops, if set.
+    void setRecordingFile(const QString &fileName);
+
+    // Start and stop acquiring samples.
+    void start();
+    void stop();
+
+signals:
+    void samplesAcquired(quint64 written);
+
+private slots:
+    void acquire();
+
+private:
+    std::atomic<int> rhythm;
+    std::atomic<float> heartRate;
+    std::atomic<int> artifactFlags;
+    std::atomic<bool> cpr;
+    std::atomic<bool> poorContact;
+
+    // Only used on the monitor thread.
+    CardiacModel heart;
+    EcgArtifacts artifacts;
+    BiquadFilterBank frontEnd;
+    QrsDetector detector;
+    std::vector<float> gainV;
+    std::vector<float> gainW;
+    std::vector<float> v;
+    std::vector<float> w;
+    std::vector<float> block;
+    std::vector<float> filtered;
+    QElapsedTimer clock;
+    std::uint64_t acquired;
+    QTimer *blockTimer;
+
+    std::shared_ptr<EcgBuffer> buffer;
+    mutable QMutex bufferMutex;
+
+    // Everything acquired since the last start, compressed.
+    EcgRecording recording;
+    QString recordingFile;
+    mutable QMutex recordingMutex;
+
+    std::unique_ptr<QThread> m_thread;
+};
+
+#endif
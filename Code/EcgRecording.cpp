@@ -0,0 +1,501 @@
+// IMPORTS
+#include "EcgRecording.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Quotients from this size on are escaped and followed by the raw residual.
+static const unsigned RICE_ESCAPE = 24;
+static const unsigned RICE_PARAMETER_BITS = 5;
+static const std::int32_t MAX_COUNTS = 1 << 24;
+
+// Writes bits most significant first.
+class BitWriter
+{
+public:
+    explicit BitWriter(std::vector<std::uint8_t> &out) : out(out), bits(0), used(0) {}
+
+    void write(std::uint32_t value, unsigned count)
+    {
+        bits = (bits << count) | (count == 32 ? value : value & ((1u << count) - 1));
+        used += count;
+        while (used >= 8)
+        {
+            used -= 8;
+            out.push_back(std::uint8_t(bits >> used));
+        }
+    }
+
+    void writeZeros(unsigned count)
+    {
+        while (count > 16)
+        {
+            write(0, 16);
+            count -= 16;
+        }
+        write(0, count);
+    }
+
+    // Pads the last byte with zeros.
+    void flush()
+    {
+        if (used > 0)
+        {
+            out.push_back(std::uint8_t(bits << (8 - used)));
+            used = 0;
+        }
+    }
+
+private:
+    std::vector<std::uint8_t> &out;
+    std::uint64_t bits;
+    unsigned used;
+};
+
+// Reads bits written by BitWriter. Reads past the end give zeros.
+class BitReader
+{
+public:
+    BitReader(const std::uint8_t *data, std::size_t size) : data(data), end(data + size), bits(0), available(0) {}
+
+    std::uint32_t read(unsigned count)
+    {
+        if (count == 0)
+            return 0;
+
+        refill();
+        std::uint32_t value = std::uint32_t(bits >> (64 - count));
+        bits <<= count;
+        available -= std::min(available, count);
+        return value;
+    }
+
+    // Counts and consumes zeros up to the next one bit, which is consumed too.
+    unsigned readUnary(unsigned limit)
+    {
+        unsigned zeros = 0;
+        for (;;)
+        {
+            refill();
+            if (bits != 0)
+            {
+                unsigned leading = countLeadingZeros(bits);
+                if (zeros + leading >= limit)
+                {
+                    read(limit - zeros);
+                    return limit;
+                }
+                read(leading + 1);
+                return zeros + leading;
+            }
+            if (available == 0)
+                return limit;
+
+            zeros += available;
+            if (zeros >= limit)
+            {
+                return limit;
+            }
+            bits = 0;
+            available = 0;
+        }
+    }
+
+private:
+    void refill()
+    {
+        while (available <= 56 && data < end)
+        {
+            bits |= std::uint64_t(*data++) << (56 - available);
+            available += 8;
+        }
+    }
+
+    static unsigned countLeadingZeros(std::uint64_t value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return unsigned(__builtin_clzll(value));
+#else
+        unsigned count = 0;
+        while (!(value & (std::uint64_t(1) << 63)))
+        {
+            value <<= 1;
+            count++;
+        }
+        return count;
+#endif
+    }
+
+    const std::uint8_t *data;
+    const std::uint8_t *end;
+    std::uint64_t bits;
+    unsigned available;
+};
+
+/*
+    Function: EcgRecording()
+    Purpose: Constructor. Starts an empty recording.
+    Inputs:
+        int leads: The number of leads.
+    Outputs:
+        None
+*/
+EcgRecording::EcgRecording(int leads)
+{
+    reset(leads);
+}
+
+/*
+    Function: reset()
+    Purpose: Forgets all samples and changes the number of leads.
+    Inputs:
+        int leads: The number of leads.
+    Outputs:
+        None
+*/
+void EcgRecording::reset(int leads)
+{
+    this->leads = std::max(leads, 1);
+    samples = 0;
+    data.clear();
+    blockOffsets.clear();
+    pending.assign(std::size_t(this->leads) * ECG_CODEC_BLOCK_SAMPLES, 0);
+    pendingCount = 0;
+    finished = false;
+}
+
+/*
+    Function: leadCount()
+    Purpose: Gets the number of leads.
+    Inputs:
+        None
+    Outputs:
+        The number of leads.
+*/
+int EcgRecording::leadCount() const
+{
+    return leads;
+}
+
+/*
+    Function: sampleCount()
+    Purpose: Gets the number of samples recorded for each lead.
+    Inputs:
+        None
+    Outputs:
+        The number of samples.
+*/
+std::uint64_t EcgRecording::sampleCount() const
+{
+    return samples;
+}
+
+/*
+    Function: compressedSize()
+    Purpose: Gets the size of the encoded blocks.
+    Inputs:
+        None
+    Outputs:
+        The size in bytes.
+*/
+std::size_t EcgRecording::compressedSize() const
+{
+    return data.size();
+}
+
+/*
+    Function: append()
+    Purpose: Quantizes samples and encodes every block that fills up.
+    Inputs:
+        const float *block: count samples of lead 0, then count samples of lead 1, and so on.
+        std::size_t count: The number of samples for each lead.
+    Outputs:
+        None
+*/
+void EcgRecording::append(const float *block, std::size_t count)
+{
+    if (finished)
+        return;
+
+    const float scale = 1.0f / ECG_ADC_RESOLUTION;
+    std::size_t done = 0;
+    while (done < count)
+    {
+        std::size_t take = std::min(count - done, std::size_t(ECG_CODEC_BLOCK_SAMPLES) - pendingCount);
+        for (int lead = 0; lead < leads; ++lead)
+        {
+            const float *in = block + std::size_t(lead) * count + done;
+            std::int32_t *out = pending.data() + std::size_t(lead) * ECG_CODEC_BLOCK_SAMPLES + pendingCount;
+            for (std::size_t t = 0; t < take; ++t)
+            {
+                long counts = std::lround(in[t] * scale);
+                out[t] = std::int32_t(std::min<long>(std::max<long>(counts, -MAX_COUNTS), MAX_COUNTS));
+            }
+        }
+
+        pendingCount += take;
+        samples += take;
+        done += take;
+
+        if (pendingCount == ECG_CODEC_BLOCK_SAMPLES)
+        {
+            encodePending();
+        }
+    }
+}
+
+/*
+    Function: finish()
+    Purpose: Encodes the samples of an unfinished block. Afterwards the recording only
+             grows by restarting it.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void EcgRecording::finish()
+{
+    if (pendingCount > 0)
+    {
+        encodePending();
+    }
+    finished = true;
+}
+
+/*
+    Function: encodePending()
+    Purpose: Encodes the pending samples as a block. Each lead is written as its Rice
+             parameter followed by the residuals of the second order prediction
+             x[n] - 2 x[n - 1] + x[n - 2], mapped to unsigned numbers by zigzag.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void EcgRecording::encodePending()
+{
+    std::uint32_t residuals[ECG_CODEC_BLOCK_SAMPLES];
+    const std::size_t count = pendingCount;
+
+    blockOffsets.push_back(data.size());
+    BitWriter writer(data);
+
+    for (int lead = 0; lead < leads; ++lead)
+    {
+        const std::int32_t *x = pending.data() + std::size_t(lead) * ECG_CODEC_BLOCK_SAMPLES;
+
+        std::uint64_t sum = 0;
+        for (std::size_t t = 0; t < count; ++t)
+        {
+            std::int64_t prediction = t >= 2 ? 2 * std::int64_t(x[t - 1]) - x[t - 2] : t == 1 ? x[0] : 0;
+            std::int64_t residual = x[t] - prediction;
+            std::uint64_t zigzag = residual >= 0 ? std::uint64_t(residual) << 1 : (std::uint64_t(-residual) << 1) - 1;
+            residuals[t] = std::uint32_t(zigzag);
+            sum += t >= 2 ? zigzag : 0;
+        }
+
+        // The best parameter is close to log2 of the mean residual.
+        unsigned k = 0;
+        std::uint64_t mean = count > 2 ? sum / (count - 2) : 0;
+        while (k < 23 && (std::uint64_t(2) << k) <= mean)
+        {
+            k++;
+        }
+        writer.write(k, RICE_PARAMETER_BITS);
+
+        for (std::size_t t = 0; t < count; ++t)
+        {
+            std::uint32_t u = residuals[t];
+            std::uint32_t quotient = u >> k;
+            if (quotient < RICE_ESCAPE)
+            {
+                writer.writeZeros(quotient);
+                writer.write(1, 1);
+                writer.write(u, k);
+            }
+            else
+            {
+                writer.writeZeros(RICE_ESCAPE);
+                writer.write(u, 32);
+            }
+        }
+    }
+
+    writer.flush();
+    pendingCount = 0;
+}
+
+/*
+    Function: decodeBlock()
+    Purpose: Decodes every lead of an encoded block.
+    Inputs:
+        std::size_t block: The index of the block.
+        std::int32_t *out: Receives the samples, ECG_CODEC_BLOCK_SAMPLES per lead, lead after lead.
+    Outputs:
+        None
+*/
+void EcgRecording::decodeBlock(std::size_t block, std::int32_t *out) const
+{
+    std::size_t begin = blockOffsets[block];
+    std::size_t end = block + 1 < blockOffsets.size() ? blockOffsets[block + 1] : data.size();
+    std::size_t count = std::min<std::uint64_t>(samples - std::uint64_t(block) * ECG_CODEC_BLOCK_SAMPLES, ECG_CODEC_BLOCK_SAMPLES);
+
+    BitReader reader(data.data() + begin, end - begin);
+    for (int lead = 0; lead < leads; ++lead)
+    {
+        std::int32_t *x = out + std::size_t(lead) * ECG_CODEC_BLOCK_SAMPLES;
+        unsigned k = reader.read(RICE_PARAMETER_BITS);
+
+        for (std::size_t t = 0; t < count; ++t)
+        {
+            unsigned quotient = reader.readUnary(RICE_ESCAPE);
+            std::uint32_t u = quotient < RICE_ESCAPE ? (quotient << k) | reader.read(k) : reader.read(32);
+
+            std::int64_t residual = (u & 1) ? -std::int64_t((u + 1) >> 1) : std::int64_t(u >> 1);
+            std::int64_t prediction = t >= 2 ? 2 * std::int64_t(x[t - 1]) - x[t - 2] : t == 1 ? x[0] : 0;
+            x[t] = std::int32_t(prediction + residual);
+        }
+    }
+}
+
+/*
+    Function: read()
+    Purpose: Decodes samples of a lead, one block at a time. Samples not encoded yet are
+             read from the pending block.
+    Inputs:
+        int lead: The lead.
+        std::uint64_t first: The number of the first sample.
+        float *out: Receives count samples.
+        std::size_t count: The number of samples.
+    Outputs:
+        True if all samples were recorded, false otherwise.
+*/
+bool EcgRecording::read(int lead, std::uint64_t first, float *out, std::size_t count) const
+{
+    if (lead < 0 || lead >= leads || first + count > samples)
+        return false;
+
+    std::vector<std::int32_t> decoded(std::size_t(leads) * ECG_CODEC_BLOCK_SAMPLES);
+    std::size_t done = 0;
+    while (done < count)
+    {
+        std::uint64_t sample = first + done;
+        std::size_t block = std::size_t(sample / ECG_CODEC_BLOCK_SAMPLES);
+        std::size_t offset = std::size_t(sample % ECG_CODEC_BLOCK_SAMPLES);
+        std::size_t take = std::min(count - done, std::size_t(ECG_CODEC_BLOCK_SAMPLES) - offset);
+
+        const std::int32_t *x;
+        if (block < blockOffsets.size())
+        {
+            decodeBlock(block, decoded.data());
+            x = decoded.data();
+        }
+        else
+        {
+            x = pending.data();
+        }
+
+        x += std::size_t(lead) * ECG_CODEC_BLOCK_SAMPLES + offset;
+        for (std::size_t t = 0; t < take; ++t)
+        {
+            out[done + t] = x[t] * ECG_ADC_RESOLUTION;
+        }
+        done += take;
+    }
+
+    return true;
+}
+
+/*
+    Function: serialize()
+    Purpose: Writes the recording as a file: ECG_RECORDING_MAGIC, ECG_RECORDING_VERSION,
+             the number of leads, samples and blocks, the block index and the blocks,
+             all little endian. Unfinished blocks are not included.
+    Inputs:
+        None
+    Outputs:
+        The file contents.
+*/
+std::vector<std::uint8_t> EcgRecording::serialize() const
+{
+    std::vector<std::uint8_t> out;
+    auto put = [&out](std::uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+        {
+            out.push_back(std::uint8_t(value >> (8 * i)));
+        }
+    };
+
+    std::uint64_t encodedSamples = std::min<std::uint64_t>(samples, std::uint64_t(blockOffsets.size()) * ECG_CODEC_BLOCK_SAMPLES);
+
+    put(ECG_RECORDING_MAGIC, 4);
+    put(ECG_RECORDING_VERSION, 2);
+    put(std::uint64_t(leads), 2);
+    put(encodedSamples, 8);
+    put(blockOffsets.size(), 8);
+    for (std::uint64_t offset : blockOffsets)
+    {
+        put(offset, 8);
+    }
+    out.insert(out.end(), data.begin(), data.end());
+
+    return out;
+}
+
+/*
+    Function: deserialize()
+    Purpose: Reads a recording written by serialize().
+    Inputs:
+        const std::uint8_t *data: The file contents.
+        std::size_t size: The size of the file.
+        EcgRecording &recording: Receives the recording, finished.
+    Outputs:
+        True if the file is a valid recording, false otherwise.
+*/
+bool EcgRecording::deserialize(const std::uint8_t *data, std::size_t size, EcgRecording &recording)
+{
+    std::size_t position = 0;
+    auto get = [&](int bytes, std::uint64_t &value)
+    {
+        if (size - position < std::size_t(bytes))
+            return false;
+
+        value = 0;
+        for (int i = 0; i < bytes; ++i)
+        {
+            value |= std::uint64_t(data[position++]) << (8 * i);
+        }
+        return true;
+    };
+
+    std::uint64_t magic, version, leads, samples, blocks;
+    if (!get(4, magic) || !get(2, version) || !get(2, leads) || !get(8, samples) || !get(8, blocks))
+        return false;
+    if (magic != ECG_RECORDING_MAGIC || version != ECG_RECORDING_VERSION || leads == 0)
+        return false;
+    if (blocks > (size - position) / 8 || samples > blocks * ECG_CODEC_BLOCK_SAMPLES
+        || samples + ECG_CODEC_BLOCK_SAMPLES <= blocks * ECG_CODEC_BLOCK_SAMPLES)
+        return false;
+
+    EcgRecording result(static_cast<int>(leads));
+    result.blockOffsets.resize(std::size_t(blocks));
+    for (std::uint64_t &offset : result.blockOffsets)
+    {
+        get(8, offset);
+    }
+
+    result.data.assign(data + position, data + size);
+    for (std::size_t i = 0; i < result.blockOffsets.size(); ++i)
+    {
+        std::uint64_t next = i + 1 < result.blockOffsets.size() ? result.blockOffsets[i + 1] : result.data.size();
+        if (result.blockOffsets[i] > next)
+            return false;
+    }
+
+    result.samples = samples;
+    result.finished = true;
+    recording = std::move(result);
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef ECGRECORDING_H
+#define ECGRECORDING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Local imports
+#include "defs.h"
+
+// ECG recording, quantized like an ADC before compression.
+#define ECG_ADC_RESOLUTION 0.005f
+#define ECG_CODEC_BLOCK_SAMPLES 256
+#define ECG_RECORDING_MAGIC 0x41454347
+#define ECG_RECORDING_VERSION 1
+
+// A compressed full disclosure ECG recording of any number of leads.
+//
+// Samples are quantized to ECG_ADC_RESOLUTION like an ADC would, and from then
+// on the compression is lossless. Every ECG_CODEC_BLOCK_SAMPLES samples of all
+// leads make a block. Each lead of a block is predicted with second order
+// differences, and the residuals are Rice coded with a parameter picked for that
+// lead and block. Blocks are indexed, so any sample can be read by decoding a
+// single block.
+class EcgRecording
+{
+public:
+    explicit EcgRecording(int leads = 1);
+
+    // Forget all samples and change the number of leads.
+    void reset(int leads);
+
+    int leadCount() const;
+    std::uint64_t sampleCount() const;
+    std::size_t compressedSize() const;
+
+    // Appends count samples to every lead. block holds lead l at block[l * count].
+    void append(const float *block, std::size_t count);
+
+    // Encodes the samples of an unfinished block. Nothing can be appended afterwards.
+    void finish();
+
+    // Copies samples first to first + count of a lead.
+    // Returns false if some of them were not recorded.
+    bool read(int lead, std::uint64_t first, float *out, std::size_t count) const;
+
+    // The recording as a file, and back.
+    std::vector<std::uint8_t> serialize() const;
+    static bool deserialize(const std::uint8_t *data, std::size_t size, EcgRecording &recording);
+
+private:
+    void encodePending();
+    void decodeBlock(std::size_t block, std::int32_t *out) const;
+
+    int leads;
+    std::uint64_t samples;
+
+    // Encoded blocks, and where each starts in data.
+    std::vector<std::uint8_t> data;
+    std::vector<std::uint64_t> blockOffsets;
+
+    // Samples of the block being filled, lead after lead.
+    std::vector<std::int32_t> pending;
+    std::size_t pendingCount;
+    bool finished;
+};
+
+#endif
@@ -0,0 +1,260 @@
+// IMPORTS
+#include "ImpedanceMonitor.h"
+#include "ShockWaveform.h"
+
+#include <QRandomGenerator>
+#include <QtMath>
+
+// Breathing changes the impedance slightly, at about 15 breaths per minute.
+static const double BREATHING_AMPLITUDE = 3.0;
+static const double BREATHING_RATE = 0.25;
+static const double MEASUREMENT_NOISE = 1.0;
+
+// When simulated, poor contact starts about every five seconds and lasts one to three seconds.
+static const double POOR_CONTACT_CHANCE = IMPEDANCE_SAMPLE_TIME / 5000.0;
+static const int MIN_POOR_CONTACT_SAMPLES = 1000 / IMPEDANCE_SAMPLE_TIME;
+static const int MAX_POOR_CONTACT_SAMPLES = 3000 / IMPEDANCE_SAMPLE_TIME;
+
+/*
+    Function: ImpedanceMonitor()
+    Purpose: Constructor. Starts the monitor thread, without streaming.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+ImpedanceMonitor::ImpedanceMonitor()
+    : QObject(nullptr), impedance(IMPEDANCE_OPEN_CIRCUIT), goodContact(false), padsAttached(false), pediatric(false),
+      simulatePoorContact(false), random(QRandomGenerator::global()->generate()), baseline(IMPEDANCE_MIN_PATIENT), elapsedSec(0.0), poorContactSamples(0), sampleTimer(nullptr)
+{
+    resetPatient();
+
+    m_thread.reset(new QThread);
+    moveToThread(m_thread.get());
+    m_thread->start();
+}
+
+/*
+    Function: ~ImpedanceMonitor()
+    Purpose: Destructor. Stops streaming and the monitor thread.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+ImpedanceMonitor::~ImpedanceMonitor()
+{
+    QMetaObject::invokeMethod(this, "stop", Qt::BlockingQueuedConnection);
+    m_thread->quit();
+    m_thread->wait();
+}
+
+/*
+    Function: start()
+    Purpose: Starts taking a measurement every IMPEDANCE_SAMPLE_TIME milliseconds.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void ImpedanceMonitor::start()
+{
+    // Created here so that the timer belongs to the monitor thread.
+    if (sampleTimer == nullptr)
+    {
+        sampleTimer = new QTimer(this);
+        sampleTimer->setTimerType(Qt::PreciseTimer);
+        connect(sampleTimer, &QTimer::timeout, this, &ImpedanceMonitor::measure);
+    }
+
+    if (!sampleTimer->isActive())
+    {
+        measure();
+        sampleTimer->start(IMPEDANCE_SAMPLE_TIME);
+    }
+}
+
+/*
+    Function: stop()
+    Purpose: Stops taking measurements.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void ImpedanceMonitor::stop()
+{
+    if (sampleTimer != nullptr)
+    {
+        sampleTimer->stop();
+    }
+}
+
+/*
+    Function: resetPatient()
+    Purpose: Picks the baseline impedance of a new patient.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void ImpedanceMonitor::resetPatient()
+{
+    baseline = IMPEDANCE_MIN_PATIENT + random.generateDouble() * (IMPEDANCE_MAX_PATIENT - IMPEDANCE_MIN_PATIENT);
+    poorContactSamples = 0;
+}
+
+/*
+    Function: measure()
+    Purpose: Takes a measurement and publishes it.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void ImpedanceMonitor::measure()
+{
+    elapsedSec += IMPEDANCE_SAMPLE_TIME / 1000.0;
+
+    double value = IMPEDANCE_OPEN_CIRCUIT;
+    if (padsAttached)
+    {
+        value = baseline
+              + BREATHING_AMPLITUDE * qSin(2.0 * M_PI * BREATHING_RATE * elapsedSec)
+              + MEASUREMENT_NOISE * (2.0 * random.generateDouble() - 1.0);
+
+        // A pad lifting off the skin raises the impedance well above the patient's.
+        if (poorContactSamples == 0 && simulatePoorContact && random.generateDouble() < POOR_CONTACT_CHANCE)
+        {
+            poorContactSamples = random.bounded(MIN_POOR_CONTACT_SAMPLES, MAX_POOR_CONTACT_SAMPLES + 1);
+        }
+        if (poorContactSamples > 0)
+        {
+            poorContactSamples--;
+            value += 2.0 * IMPEDANCE_MAX_GOOD_CONTACT;
+        }
+    }
+
+    bool good = value >= IMPEDANCE_MIN_GOOD_CONTACT && value <= IMPEDANCE_MAX_GOOD_CONTACT;
+    impedance = value;
+    goodContact = good;
+
+    emit impedanceMeasured(value, good);
+}
+
+/*
+    Function: getImpedance()
+    Purpose: Gets the latest measured impedance.
+    Inputs:
+        None
+    Outputs:
+        The impedance between the pads in ohms.
+*/
+double ImpedanceMonitor::getImpedance() const
+{
+    return impedance;
+}
+
+/*
+    Function: hasGoodContact()
+    Purpose: Checks whether both pads are in good contact with the patient.
+    Inputs:
+        None
+    Outputs:
+        True if the latest impedance is within the good contact range, false otherwise.
+*/
+bool ImpedanceMonitor::hasGoodContact() const
+{
+    return goodContact;
+}
+
+/*
+    Function: compensatedEnergy()
+    Purpose: Computes the energy to charge for a shock at the latest measured impedance.
+    Inputs:
+        double nominalEnergy: The energy the protocol has for the shock, in joules.
+    Outputs:
+        The energy to charge in joules.
+*/
+double ImpedanceMonitor::compensatedEnergy(double nominalEnergy) const
+{
+    return ShockWaveform::compensatedChargeEnergy(nominalEnergy, impedance);
+}
+
+/*
+    Function: setPadsAttached()
+    Purpose: Sets whether the pads are attached to the patient.
+    Inputs:
+        bool attached: True if the pads are attached, false otherwise.
+    Outputs:
+        None
+*/
+void ImpedanceMonitor::setPadsAttached(bool attached)
+{
+    padsAttached = attached;
+}
+
+/*
+    Function: setPediatric()
+    Purpose: Sets whether pediatric pads are used.
+    Inputs:
+        bool pediatric: True for pediatric pads, false for adult pads.
+    Outputs:
+        None
+*/
+void ImpedanceMonitor::setPediatric(bool pediatric)
+{
+    this->pediatric = pediatric;
+}
+
+/*
+    Function: setSimulatePoorContact()
+    Purpose: Sets whether the pads should occasionally lose contact with the patient.
+    Inputs:
+        bool simulate: True to simulate poor contact, false otherwise.
+    Outputs:
+        None
+*/
+void ImpedanceMonitor::setSimulatePoorContact(bool simulate)
+{
+    simulatePoorContact = simulate;
+}
+
+/*
+    Function: setSeed()
+    Purpose: Seeds the patient and the measurement noise, so that measurements can be repeated.
+    Inputs:
+        quint32 seed: The seed.
+    Outputs:
+        None
+*/
+void ImpedanceMonitor::setSeed(quint32 seed)
+{
+    random.seed(seed);
+}
+
+/*
+    Function: isPediatric()
+    Purpose: Checks whether pediatric pads are used.
+    Inputs:
+        None
+    Outputs:
+        True for pediatric pads, false for adult pads.
+*/
+bool ImpedanceMonitor::isPediatric() const
+{
+    return pediatric;
+}
+
+/*
+    Function: getSimulatePoorContact()
+    Purpose: Checks whether the pads occasionally lose contact with the patient.
+    Inputs:
+        None
+    Outputs:
+        True if poor contact is simulated, false otherwise.
+*/
+bool ImpedanceMonitor::getSimulatePoorContact() const
+{
+    return simulatePoorContact;
+}
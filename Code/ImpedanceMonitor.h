@@ -0,0 +1,79 @@
+#ifndef IMPEDANCEMONITOR_H
+#define IMPEDANCEMONITOR_H
+
+// Qt imports
+#include <QObject>
+#include <QRandomGenerator>
+#include <QThread>
+#include <QTimer>
+
+#include <atomic>
+#include <memory>
+
+// Local imports
+#include "defs.h"
+
+// Time between measurements in milliseconds, and the impedance in ohms with the pads off.
+#define IMPEDANCE_SAMPLE_TIME 20
+#define IMPEDANCE_OPEN_CIRCUIT 1000.0
+
+// Simulates the transthoracic impedance measured between the pads. Samples are
+// taken on a thread of its own, and the latest one can be read from any thread
+// without locking, so the protocol thread is never held up by a measurement.
+class ImpedanceMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ImpedanceMonitor();
+    ~ImpedanceMonitor();
+
+    // Latest measurement.
+    double getImpedance() const;
+    bool hasGoodContact() const;
+
+    // Energy to charge so that the nominal energy of a shock reaches the patient.
+    double compensatedEnergy(double nominalEnergy) const;
+
+    // Can be called from any thread.
+    void setPadsAttached(bool attached);
+    void setPediatric(bool pediatric);
+    void setSimulatePoorContact(bool simulate);
+    bool isPediatric() const;
+    bool getSimulatePoorContact() const;
+
+    // Only while not streaming.
+    void setSeed(quint32 seed);
+
+public slots:
+    // Start and stop streaming measurements.
+    void start();
+    void stop();
+
+    // Pick a new patient baseline impedance.
+    void resetPatient();
+
+    // Take and publish a measurement. Called directly, from any one thread, while not streaming.
+    void measure();
+
+signals:
+    void impedanceMeasured(double impedance, bool goodContact);
+
+private:
+    std::atomic<double> impedance;
+    std::atomic<bool> goodContact;
+    std::atomic<bool> padsAttached;
+    std::atomic<bool> pediatric;
+    std::atomic<bool> simulatePoorContact;
+
+    // Only used on the monitor thread, or by the thread measuring while not streaming.
+    QRandomGenerator random;
+    double baseline;
+    double elapsedSec;
+    int poorContactSamples;
+    QTimer *sampleTimer;
+
+    std::unique_ptr<QThread> m_thread;
+};
+
+#endif
@@ -0,0 +1,332 @@
+// IMPORTS
+#include "JitterBenchmark.h"
+#include "AED.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+
+#include <cstring>
+#include <iterator>
+
+// Size of each buffer copied by the memory load threads.
+static const size_t MEMORY_LOAD_BYTES = 32 * 1024 * 1024;
+
+// Time the GUI thread is kept busy on every turn of the event loop.
+static const int GUI_LOAD_MS = 5;
+
+// Upper bounds of the buckets of the report histograms, in microseconds.
+static constexpr qint64 JITTER_BUCKETS[] = {10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000};
+static constexpr int JITTER_BUCKET_COUNT = int(std::size(JITTER_BUCKETS));
+
+/*
+    Function: JitterBenchmark()
+    Purpose: Constructor.
+    Inputs:
+        const QString &reportPath: The file the JSON report is written to.
+        int runs: The number of complete protocol runs to measure.
+        QObject *parent: The parent object.
+    Outputs:
+        None
+*/
+JitterBenchmark::JitterBenchmark(const QString &reportPath, int runs, QObject *parent)
+    : QObject(parent), device(new AED()), reportPath(reportPath), runs(qMax(1, runs)), completedRuns(0), loadRunning(false)
+{
+    int cores = qMax(1, QThread::idealThreadCount());
+    cpuThreads = cores;
+    memoryThreads = qMax(1, cores / 4);
+
+    guiLoadTimer = new QTimer(this);
+    guiLoadTimer->setInterval(0);
+    connect(guiLoadTimer, &QTimer::timeout, this, []()
+            {
+        // Keep the event loop busy, like a slow slot would.
+        QElapsedTimer busy;
+        busy.start();
+        while (busy.elapsed() < GUI_LOAD_MS) {} });
+
+    // Also makes the device accept powerOn() without a main window.
+    connect(device, &AED::updateGUI, this, &JitterBenchmark::deviceStateChanged);
+}
+
+/*
+    Function: ~JitterBenchmark()
+    Purpose: Destructor. Stops the load threads and deletes the device.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+JitterBenchmark::~JitterBenchmark()
+{
+    stopLoad();
+
+    // The device lives on its own thread, so it has no parent to delete it.
+    delete device;
+}
+
+/*
+    Function: start()
+    Purpose: Starts the synthetic load and the first run.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void JitterBenchmark::start()
+{
+    qInfo() << "Jitter benchmark:" << runs << "runs with" << cpuThreads << "CPU and" << memoryThreads << "memory load threads";
+
+    startLoad();
+    startRun();
+}
+
+/*
+    Function: startLoad()
+    Purpose: Starts the threads loading the CPU and the memory bus, and the GUI load timer.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void JitterBenchmark::startLoad()
+{
+    loadRunning = true;
+
+    for (int i = 0; i < cpuThreads; ++i)
+    {
+        loadThreads.emplace_back([this]()
+                                 {
+            volatile double x = 1.0;
+            while (loadRunning)
+            {
+                for (int j = 0; j < 10000; ++j)
+                {
+                    x = x * 1.0000001 + 0.0000001;
+                }
+            } });
+    }
+
+    for (int i = 0; i < memoryThreads; ++i)
+    {
+        loadThreads.emplace_back([this]()
+                                 {
+            std::vector<char> source(MEMORY_LOAD_BYTES, 1);
+            std::vector<char> destination(MEMORY_LOAD_BYTES);
+            while (loadRunning)
+            {
+                std::memcpy(destination.data(), source.data(), MEMORY_LOAD_BYTES);
+                std::swap(source, destination);
+            } });
+    }
+
+    guiLoadTimer->start();
+}
+
+/*
+    Function: stopLoad()
+    Purpose: Stops all synthetic load.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void JitterBenchmark::stopLoad()
+{
+    guiLoadTimer->stop();
+
+    loadRunning = false;
+    for (std::thread &thread : loadThreads)
+    {
+        thread.join();
+    }
+    loadThreads.clear();
+}
+
+/*
+    Function: startRun()
+    Purpose: Configures the device with a shockable patient and powers it on.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void JitterBenchmark::startRun()
+{
+    // Applied on the device thread, in the order sent, before it runs.
+    device->send(DeviceCommand(COMMAND_SET_STATE, OFF));
+    device->send(DeviceCommand(COMMAND_SET_BATTERY_SPECS, MAX_BATTERY_LEVEL, 5, 1));
+    device->send(DeviceCommand(COMMAND_SET_HEART_CONDITION, VENTRICULAR_FIBRILLATION));
+    device->send(DeviceCommand(COMMAND_SET_SHOCKS_UNTIL_HEALTHY, 3));
+    device->send(DeviceCommand(COMMAND_SET_START_WITH_ASYSTOLE, false));
+    device->send(DeviceCommand(COMMAND_SET_PADS_ATTACHED, true));
+    device->send(DeviceCommand(COMMAND_SET_LOST_CONNECTION, false));
+    device->send(DeviceCommand(COMMAND_POWER_ON));
+}
+
+/*
+    Function: deviceStateChanged()
+    Purpose: Collects the timings once a run has ended and starts the next one.
+    Inputs:
+        int state: The new state of the device.
+    Outputs:
+        None
+*/
+void JitterBenchmark::deviceStateChanged(int state)
+{
+    if (state != ABORT && state != SELF_TEST_FAIL && state != CHANGE_BATTERIES)
+        return;
+
+    collectRun();
+    completedRuns++;
+    qInfo() << "Jitter benchmark: run" << completedRuns << "of" << runs << "done";
+
+    if (completedRuns < runs)
+    {
+        startRun();
+        return;
+    }
+
+    stopLoad();
+
+    bool written = writeReport();
+    emit finished(written && getMaxDeviationUs() <= TRANSITION_JITTER_TARGET ? 0 : 1);
+}
+
+/*
+    Function: getMaxDeviationUs()
+    Purpose: Gets the largest deviation of any step measured so far.
+    Inputs:
+        None
+    Outputs:
+        The absolute deviation in microseconds.
+*/
+qint64 JitterBenchmark::getMaxDeviationUs() const
+{
+    qint64 maxDeviation = 0;
+    for (const QVector<qint64> &samples : deviations)
+    {
+        for (qint64 deviation : samples)
+        {
+            maxDeviation = qMax(maxDeviation, qAbs(deviation));
+        }
+    }
+    return maxDeviation;
+}
+
+/*
+    Function: collectRun()
+    Purpose: Computes the dwell time deviation of every step of the last run. The dwell
+             of a step is the time between entering it and entering the next step. Steps
+             followed by a wait on the operator have no nominal dwell and are skipped.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void JitterBenchmark::collectRun()
+{
+    QVector<TransitionTiming> timings = device->getTransitionTimings();
+
+    for (int i = 1; i < timings.size(); ++i)
+    {
+        if (timings[i].rescheduled)
+            continue;
+
+        const TransitionTiming &step = timings[i - 1];
+        qint64 deviationNs = timings[i].latenessNs() - step.latenessNs();
+
+        deviations[step.state].append(deviationNs / 1000);
+        nominalDwell[step.state] = (timings[i].scheduledNs - step.scheduledNs) / 1000000;
+    }
+}
+
+/*
+    Function: writeReport()
+    Purpose: Writes the deviation histograms of every state and of all states combined.
+    Inputs:
+        None
+    Outputs:
+        True if the report was written, false otherwise.
+*/
+bool JitterBenchmark::writeReport() const
+{
+    // Histogram and summary of a set of deviations.
+    auto summarize = [](const QVector<qint64> &samples)
+    {
+        QVector<int> counts(JITTER_BUCKET_COUNT + 1, 0);
+        qint64 sum = 0;
+        qint64 maxAbs = 0;
+
+        for (qint64 deviation : samples)
+        {
+            qint64 magnitude = qAbs(deviation);
+            int bucket = 0;
+            while (bucket < JITTER_BUCKET_COUNT && magnitude > JITTER_BUCKETS[bucket])
+            {
+                bucket++;
+            }
+            counts[bucket]++;
+            sum += deviation;
+            maxAbs = qMax(maxAbs, magnitude);
+        }
+
+        QJsonArray histogram;
+        for (int count : counts)
+        {
+            histogram.append(count);
+        }
+
+        QJsonObject summary;
+        summary["samples"] = samples.size();
+        summary["meanUs"] = samples.isEmpty() ? 0.0 : double(sum) / samples.size();
+        summary["maxAbsUs"] = double(maxAbs);
+        summary["histogram"] = histogram;
+        return summary;
+    };
+
+    QJsonObject states;
+    QVector<qint64> all;
+    for (auto it = deviations.constBegin(); it != deviations.constEnd(); ++it)
+    {
+        QJsonObject state = summarize(it.value());
+        state["nominalMs"] = double(nominalDwell.value(it.key()));
+        states[aedStateName((AEDState)it.key())] = state;
+        all += it.value();
+    }
+
+    QJsonArray bucketBounds;
+    for (qint64 bound : JITTER_BUCKETS)
+    {
+        bucketBounds.append(double(bound));
+    }
+
+    QJsonObject load;
+    load["cpuThreads"] = cpuThreads;
+    load["memoryThreads"] = memoryThreads;
+    load["guiBusyMs"] = GUI_LOAD_MS;
+
+    QJsonObject report;
+    report["runs"] = completedRuns;
+    report["load"] = load;
+    report["targetUs"] = TRANSITION_JITTER_TARGET;
+    report["bucketUpperBoundsUs"] = bucketBounds;
+    report["states"] = states;
+    report["overall"] = summarize(all);
+
+    QFile file(reportPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning() << "Jitter benchmark: cannot write" << reportPath;
+        return false;
+    }
+
+    file.write(QJsonDocument(report).toJson());
+    qInfo() << "Jitter benchmark: report written to" << reportPath;
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef JITTERBENCHMARK_H
+#define JITTERBENCHMARK_H
+
+// Qt imports
+#include <QObject>
+#include <QMap>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Local imports
+#include "defs.h"
+
+class AED;
+
+// Runs the device protocol repeatedly while background threads load the CPU,
+// the memory bus and the GUI event loop, then writes a histogram of how far
+// each step's dwell time deviated from its nominal value as a JSON report.
+class JitterBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    JitterBenchmark(const QString &reportPath, int runs, QObject *parent = nullptr);
+    ~JitterBenchmark();
+
+    void start();
+
+    // The largest deviation of a step from its nominal dwell, in microseconds.
+    qint64 getMaxDeviationUs() const;
+
+signals:
+    // Exit code is 0 if every dwell stayed within TRANSITION_JITTER_TARGET.
+    void finished(int exitCode);
+
+private slots:
+    void startRun();
+    void deviceStateChanged(int state);
+
+private:
+    void startLoad();
+    void stopLoad();
+    void collectRun();
+    bool writeReport() const;
+
+    AED *device;
+    QString reportPath;
+    int runs;
+    int completedRuns;
+
+    // Synthetic load.
+    std::atomic<bool> loadRunning;
+    std::vector<std::thread> loadThreads;
+    int cpuThreads;
+    int memoryThreads;
+    QTimer *guiLoadTimer;
+
+    // Dwell deviations in microseconds and nominal dwell in milliseconds, per state.
+    QMap<int, QVector<qint64>> deviations;
+    QMap<int, qint64> nominalDwell;
+};
+
+#endif
@@ -1,5 +1,9 @@
 #include "MainWindow.h"
-#include <QMovie>
+#include "MetricsRegistry.h"
+#include "StartupProfiler.h"
+#include "TraceRecorder.h"
+
+static MetricHistogram &guiUpdateLatency = MetricsRegistry::instance()->histogram("aed_gui_update_latency_seconds", "Time from the device entering a step to the GUI having shown it.", 1e-6);
 
 /*
     Function: MainWindow(QWidget *parent)
@@ -10,9 +14,11 @@
         None
 */
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent), ui(new Ui::MainWindow), currentStep(-1)
+    : QMainWindow(parent), ui(new Ui::MainWindow), currentStep(-1),
+      scheduler(new TickScheduler(this)), blinkTask(0), elapsedTimeTask(0), resetTimeTask(0), batteryTask(0), cprFlashTask(0)
 {
     ui->setupUi(this);
+    StartupProfiler::instance()->mark("main window setupUi");
 
     // Set styling for all indicators.
     stepIndicators << ui->responseIndicator
@@ -32,12 +38,15 @@ MainWindow::MainWindow(QWidget *parent)
     ui->selfCheckIndicator->setEnabled(false);
     ui->padsIndicator->setEnabled(false);
 
+    // Not shown before a self test passes or the pads are attached, so kept out of start-up.
+    setCheckedIconOnFirstUse(ui->selfCheckIndicator, ":/Icons/self_check_success.png");
+    setCheckedIconOnFirstUse(ui->cprPadsAttached, ":/Icons/attach_cpr_pads.png");
+
     // Set initial CPR depth.
     setCPRDepth(0.0);
 
     // Time-related code.
     elapsedTimeSec = 0;
-    timeUpdateCounter = new QTimer(this);
 
     // Set default value for patient condition.
     ui->conditionSelector->setCurrentIndex(0);
@@ -52,20 +61,6 @@ MainWindow::MainWindow(QWidget *parent)
     ui->deepPushButton->setEnabled(false);
     ui->changeBatteries->setEnabled(false);
     ui->reconnectBtn->setEnabled(false);
-
-    batteryUpdateTimer = new QTimer(this);
-    batteryUpdateTimer->setInterval(BATTERY_DRAIN_TIME);
-    connect(batteryUpdateTimer, &QTimer::timeout, this, &MainWindow::drainBatteryWhenIdle);
-
-    // Set up timer for flashing step indicator.
-    indicatorTimer = new QTimer(this);
-    connect(indicatorTimer, &QTimer::timeout, this, [this]()
-            {
-        if (this->currentStep > -1)
-        {
-            stepIndicators[this->currentStep]->toggle();
-        } });
-    indicatorTimer->start(500);
 }
 
 /*
@@ -81,6 +76,28 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+/*
+    Function: setCheckedIconOnFirstUse(QAbstractButton *button, const QString &fileName)
+    Purpose: Adds the image a checkable button shows when checked, the first time it is checked.
+    Input:
+        button - The button, whose icon has its unchecked images.
+        fileName - The checked image.
+    Output:
+        None
+*/
+void MainWindow::setCheckedIconOnFirstUse(QAbstractButton *button, const QString &fileName)
+{
+    connect(button, &QAbstractButton::toggled, this, [button, fileName](bool checked) {
+        QIcon icon = button->icon();
+        if (!checked || !icon.availableSizes(QIcon::Normal, QIcon::On).isEmpty())
+            return;
+
+        icon.addFile(fileName, QSize(), QIcon::Normal, QIcon::On);
+        icon.addFile(fileName, QSize(), QIcon::Disabled, QIcon::On);
+        button->setIcon(icon);
+    });
+}
+
 /*
     Function: addAED(AED *device)
     Purpose: Add an AED device to the GUI.
@@ -94,18 +111,23 @@ void MainWindow::addAED(AED *device)
     if (device == nullptr)
         return;
 
+    // Everything the window asks of the device is sent to it with AED::send.
     this->device = device;
 
-    // Conect signals and slots.
-    connect(this, SIGNAL(setPatientHeartCondition(int)), device, SLOT(setPatientHeartCondition(int)));
-    connect(this, SIGNAL(setStartWithAsystole(bool)), device, SLOT(setStartWithAsystole(bool)));
-    connect(this, SIGNAL(setShockUntilHealthy(int)), device, SLOT(setShockUntilHealthy(int)));
-    connect(this, SIGNAL(setPadsAttached(bool)), device, SLOT(setPadsAttached(bool)));
-    connect(this, SIGNAL(notifyPadsAttached()), device, SLOT(notifyPadsAttached()));
-    connect(this, SIGNAL(setBatterySpecs(int, int, int)), device, SLOT(setBatterySpecs(int, int, int)));
-    connect(this, &MainWindow::powerOn, device, &AED::powerOn);
-    connect(this, &MainWindow::notifyReconnection, device, &AED::notifyReconnection);
-    connect(this, &MainWindow::setLostConnection, device, &AED::setLostConnection);
+    ui->ecgDisplay->setMonitor(device->getEcgMonitor());
+}
+
+/*
+    Function: getScheduler()
+    Purpose: Get the scheduler of the window's timed work.
+    Input:
+        None
+    Output:
+        The scheduler.
+*/
+TickScheduler *MainWindow::getScheduler() const
+{
+    return scheduler;
 }
 
 /*
@@ -123,6 +145,7 @@ void MainWindow::turnOnIndicator(int index)
         return;
 
     currentStep = index;
+    startBlinking();
 
     for (int i = 0; i < stepIndicators.length(); ++i)
     {
@@ -142,7 +165,7 @@ void MainWindow::turnOnIndicator(int index)
         }
     }
 
-    QCoreApplication::processEvents();
+    processEvents();
 }
 
 /*
@@ -163,7 +186,7 @@ void MainWindow::turnOffIndicator(int index)
 
     stepIndicators[index]->setChecked(false);
 
-    QCoreApplication::processEvents();
+    processEvents();
 }
 
 /*
@@ -183,18 +206,15 @@ void MainWindow::turnOffAllIndicators()
         indicator->setChecked(false);
     }
 
-    QCoreApplication::processEvents();
+    processEvents();
 }
 
 void MainWindow::drainBatteryWhenIdle()
 {
     if (device != nullptr)
     {
-        int currentBatteryLevel = device->getBatteryLevel();
-        int batteryWhenIdle = ui->batteryWhenIdle->value();
-        currentBatteryLevel -= batteryWhenIdle;
-        device->setBatteryLevel(currentBatteryLevel);
-        updateBatteryLevel(currentBatteryLevel);
+        // Drained on the device thread, which reports the new level back.
+        device->send(DeviceCommand(COMMAND_DRAIN_BATTERY, ui->batteryWhenIdle->value()));
     }
 }
 
@@ -212,21 +232,13 @@ void MainWindow::on_powerBtn_toggled(bool checked)
     if (checked)
     {
         // Disable all configuration settings.
-        ui->conditionSelector->setEnabled(false);
-        ui->numOfRunsSelector->setEnabled(false);
-        toggleBatteryUnitControls(false);
-
-        // Disable loss connection selector.
-        ui->connectionLoss->setEnabled(false);
+        toggleConfigurationControls(false);
 
         if (ui->cprPadsAttached->isChecked())
         {
             ui->cprPadsAttached->setEnabled(false);
         }
 
-        // Disable pads selector.
-        ui->padsSelector->setEnabled(false);
-
         // Set the battery spec for the device.
         setDeviceBatterySpecs();
 
@@ -234,22 +246,24 @@ void MainWindow::on_powerBtn_toggled(bool checked)
         setPatientCondition();
 
         // Set other conditions prior to running the device.
-        emit setPadsAttached(ui->cprPadsAttached->isChecked());
-        emit setLostConnection(ui->connectionLoss->isChecked());
+        device->send(DeviceCommand(COMMAND_SET_PADS_ATTACHED, ui->cprPadsAttached->isChecked()));
+        device->send(DeviceCommand(COMMAND_SET_LOST_CONNECTION, ui->connectionLoss->isChecked()));
+        device->send(DeviceCommand(COMMAND_SET_POOR_CONTACT, ui->poorContact->isChecked()));
+        device->send(DeviceCommand(COMMAND_SET_PEDIATRIC_PADS, ui->padsSelector->currentIndex() == 1));
 
         // Start the AED thread.
-        emit powerOn();
-
-        // Start battery update indicator.
-        batteryUpdateTimer->start();
+        device->send(DeviceCommand(COMMAND_POWER_ON));
 
         ui->powerBtn->blockSignals(true);
         ui->powerBtn->setChecked(true);
         ui->powerBtn->blockSignals(false);
 
-        // Reset timer and remove event listeners.
-        disconnect(timeUpdateCounter, &QTimer::timeout, this, &MainWindow::updateElapsedTime);
-        timeUpdateCounter->start(1000);
+        // A new session starts its time at zero, the time counter starts with the self test.
+        scheduler->cancel(resetTimeTask);
+        resetElapsedTime();
+        scheduler->cancel(batteryTask);
+        batteryTask = scheduler->every(BATTERY_DRAIN_TIME, [this]()
+                                       { drainBatteryWhenIdle(); });
     }
     else
     {
@@ -266,27 +280,21 @@ void MainWindow::on_powerBtn_toggled(bool checked)
         {
             // Stop the thread.
             // Ensure that the AED thread is running.
-            device->powerOff();
+            device->send(DeviceCommand(COMMAND_POWER_OFF));
             QThread::msleep(100);
         }
 
-        // Reset timer and remove event listeners.
-        timeUpdateCounter->stop();
-        disconnect(timeUpdateCounter, &QTimer::timeout, this, &MainWindow::updateElapsedTime);
-
-        batteryUpdateTimer->stop();
+        stopSessionTasks();
 
         turnOffAllIndicators();
         setTextMsg("");
         currentStep = -1;
 
         // Remove ECG waveforms.
-        ui->ecgDisplay->clear();
+        ui->ecgDisplay->stop();
 
-        // Enable the patient condition selectors.
-        ui->conditionSelector->setEnabled(true);
-        ui->numOfRunsSelector->setEnabled(true);
-        toggleBatteryUnitControls(true);
+        // Enable the configuration settings.
+        toggleConfigurationControls(true);
 
         ui->cprPadsAttached->setChecked(false);
 
@@ -296,23 +304,19 @@ void MainWindow::on_powerBtn_toggled(bool checked)
         ui->selfCheckIndicator->setChecked(false);
 
         ui->padsAttachedIndicator->setChecked(false);
-        device->setPadsAttached(false);
+        device->send(DeviceCommand(COMMAND_SET_PADS_ATTACHED, false));
 
         ui->startWithAsystole->setChecked(false);
 
-        // Disable pads selector.
-        ui->padsSelector->setEnabled(true);
-
-        // Re-enable loss connection selector.
-        ui->connectionLoss->setEnabled(true);
+        ui->impedanceLabel->clear();
 
         ui->powerBtn->blockSignals(true);
         ui->powerBtn->setChecked(false);
         ui->powerBtn->blockSignals(false);
 
-        // Set up a reset timer.
-        connect(timeUpdateCounter, &QTimer::timeout, this, &MainWindow::resetElapsedTime);
-        timeUpdateCounter->start(5000);
+        // Leave the time of the session up for a while.
+        resetTimeTask = scheduler->after(ELAPSED_TIME_RESET_TIME, [this]()
+                                         { resetElapsedTime(); });
     }
 }
 
@@ -363,7 +367,7 @@ void MainWindow::setCPRDepth(float depth)
     ui->cprDepthMark5cm->setVisible(depth >= 5.0);
     ui->cprDepthMark6cm->setVisible(depth >= 6.0);
 
-    QApplication::processEvents();
+    processEvents();
 }
 
 /*
@@ -381,6 +385,51 @@ void MainWindow::toggleBatteryUnitControls(bool enable)
     ui->startingBatteryLevel->setEnabled(enable);
 }
 
+/*
+    Function: toggleConfigurationControls(bool enable)
+    Purpose: Enable/disable the settings that can only be changed while the device is off.
+    Input:
+        enable - Whether to enable/disable the controls.
+    Output:
+        None
+*/
+void MainWindow::toggleConfigurationControls(bool enable)
+{
+    ui->conditionSelector->setEnabled(enable);
+    ui->numOfRunsSelector->setEnabled(enable);
+    toggleBatteryUnitControls(enable);
+    ui->connectionLoss->setEnabled(enable);
+    ui->poorContact->setEnabled(enable);
+    ui->padsSelector->setEnabled(enable);
+}
+
+/*
+    Function: resumeSession()
+    Purpose: Turn on the device to continue a session restored from a snapshot. The
+             configuration comes from the snapshot, so it is not sent to the device.
+    Input:
+        padsAttached - Whether the pads were attached in the snapshot. The device may
+                       not have restored it yet.
+    Output:
+        None
+*/
+void MainWindow::resumeSession(bool padsAttached)
+{
+    toggleConfigurationControls(false);
+
+    ui->cprPadsAttached->setChecked(padsAttached);
+    ui->cprPadsAttached->setEnabled(!padsAttached);
+
+    ui->powerBtn->blockSignals(true);
+    ui->powerBtn->setChecked(true);
+    ui->powerBtn->blockSignals(false);
+
+    device->send(DeviceCommand(COMMAND_POWER_ON));
+
+    // The self test, which starts the time counter, is already behind us.
+    startSessionTasks();
+}
+
 /*
     Function: updateElapsedTime()
     Purpose: Update the elapsed time.
@@ -424,10 +473,67 @@ void MainWindow::resetElapsedTime()
     ui->elapsedTime->setText("00:00");
     ui->shockCount->setText("SHOCKS: 00");
 
-    timeUpdateCounter -> stop();
-    disconnect(timeUpdateCounter, &QTimer::timeout, this, &MainWindow::resetElapsedTime);
+    processEvents();
+}
 
-    QApplication::processEvents();
+/*
+    Function: startBlinking()
+    Purpose: Blink the indicator of the current step, until there is none. The CPR
+             indicator flashes on the beats of the metronome instead.
+    Input:
+        None
+    Output:
+        None
+*/
+void MainWindow::startBlinking()
+{
+    if (scheduler->isScheduled(blinkTask))
+        return;
+
+    blinkTask = scheduler->every(INDICATOR_BLINK_TIME, [this]()
+                                 {
+        if (this->currentStep == -1)
+        {
+            scheduler->cancel(blinkTask);
+        }
+        else if (this->currentStep != CPR_INDICATOR)
+        {
+            stepIndicators[this->currentStep]->toggle();
+        } });
+}
+
+/*
+    Function: startSessionTasks()
+    Purpose: Start counting the elapsed time and draining the battery, and keep the
+             elapsed time from being reset.
+    Input:
+        None
+    Output:
+        None
+*/
+void MainWindow::startSessionTasks()
+{
+    stopSessionTasks();
+    scheduler->cancel(resetTimeTask);
+
+    elapsedTimeTask = scheduler->every(ELAPSED_TIME_UPDATE_TIME, [this]()
+                                       { updateElapsedTime(); });
+    batteryTask = scheduler->every(BATTERY_DRAIN_TIME, [this]()
+                                   { drainBatteryWhenIdle(); });
+}
+
+/*
+    Function: stopSessionTasks()
+    Purpose: Stop counting the elapsed time and draining the battery.
+    Input:
+        None
+    Output:
+        None
+*/
+void MainWindow::stopSessionTasks()
+{
+    scheduler->cancel(elapsedTimeTask);
+    scheduler->cancel(batteryTask);
 }
 
 /*
@@ -547,8 +653,7 @@ void MainWindow::setDeviceBatterySpecs()
     // Update battery indicator.
     ui->batteryIndicator->setValue(startingValue);
 
-    // Emit a singal to the AED to set battery specs.
-    emit setBatterySpecs(startingValue, batteryPerShock, batteryWhenIdle);
+    device->send(DeviceCommand(COMMAND_SET_BATTERY_SPECS, startingValue, batteryPerShock, batteryWhenIdle));
 }
 
 /*
@@ -564,54 +669,23 @@ void MainWindow::setPatientCondition()
     int patientHeartCondition = ui->conditionSelector->currentIndex();
     int numberOfShock = ui->numOfRunsSelector->value();
 
-    // Emit signals to the AED device to set patient condtions.
-    emit setPatientHeartCondition(patientHeartCondition);
-    emit setShockUntilHealthy(numberOfShock);
-    emit setStartWithAsystole(ui->startWithAsystole->isChecked());
+    device->send(DeviceCommand(COMMAND_SET_HEART_CONDITION, patientHeartCondition));
+    device->send(DeviceCommand(COMMAND_SET_SHOCKS_UNTIL_HEALTHY, numberOfShock));
+    device->send(DeviceCommand(COMMAND_SET_START_WITH_ASYSTOLE, ui->startWithAsystole->isChecked()));
 }
 
 /*
-    Function: updateECGDisplay(const QString &image)
-    Purpose: Update the ECG display.
+    Function: processEvents()
+    Purpose: Process pending events so that changes show up right away.
     Input:
-        image - The image to display.
-    Output:
         None
-*/
-void MainWindow::updateECGDisplay(const QString &animation)
-{
-    QMovie* sinusAnimation = new QMovie(animation);
-    ui->ecgDisplay->setMovie(sinusAnimation);
-    sinusAnimation->start();
-}
-
-/*
-    Function: updateECGDisplay(HeartState state)
-    Purpose: Update the ECG display depending on the heart condition of the patient.
-    Input:
-        state - The heart condition of the patient.
     Output:
         None
 */
-void MainWindow::updateECGDisplay(HeartState state)
+void MainWindow::processEvents()
 {
-    switch (state)
-    {
-    case SINUS_RHYTHM:
-        updateECGDisplay("://Icons/sinus_animation.gif");
-        break;
-
-    case VENTRICULAR_FIBRILLATION:
-        updateECGDisplay("://Icons/ventricullar_fibrillation_animation.gif");
-        break;
-
-    case VENTRICULAR_TACHYCARDIA:
-        updateECGDisplay("://Icons/ventricular_tachycardia_animation.gif");
-        break;
-
-    default:
-        break;
-    }
+    TraceSpan span("processEvents", "gui");
+    QApplication::processEvents();
 }
 
 /*
@@ -624,6 +698,8 @@ void MainWindow::updateECGDisplay(HeartState state)
 */
 void MainWindow::updateGUI(int state)
 {
+    TraceSpan span("updateGUI", "gui", "state", state);
+
     AEDState theState = (AEDState)state;
     switch (theState)
     {
@@ -637,9 +713,9 @@ void MainWindow::updateGUI(int state)
     case SELF_TEST_FAIL:
         setTextMsg("UNIT FAILED");
         ui->selfCheckIndicator->setChecked(false);
-        QTimer::singleShot(2000, this, [this]() {
+        scheduler->after(FAILED_POWER_OFF_TIME, [this]() {
             this->ui->powerBtn->setChecked(false);
-            this->device->setState(OFF);
+            this->device->send(DeviceCommand(COMMAND_SET_STATE, OFF));
         });
         break;
 
@@ -649,8 +725,9 @@ void MainWindow::updateGUI(int state)
         ui->powerBtn->setChecked(true);
 
         // Set up the time counter.
-        connect(timeUpdateCounter, &QTimer::timeout, this, &MainWindow::updateElapsedTime);
-        timeUpdateCounter->start(1000);
+        scheduler->cancel(elapsedTimeTask);
+        elapsedTimeTask = scheduler->every(ELAPSED_TIME_UPDATE_TIME, [this]()
+                                           { updateElapsedTime(); });
 
         break;
 
@@ -665,10 +742,10 @@ void MainWindow::updateGUI(int state)
         // Enable the button for switching batteries;
         ui->changeBatteries->setEnabled(true);
 
-        QTimer::singleShot(2000, this, [this]() {
+        scheduler->after(FAILED_POWER_OFF_TIME, [this]() {
             this -> ui->selfCheckIndicator->setChecked(false);
             this -> ui -> powerBtn -> setChecked(false);
-            this -> device -> setState(OFF);
+            this -> device -> send(DeviceCommand(COMMAND_SET_STATE, OFF));
         });
 
         break;
@@ -710,6 +787,9 @@ void MainWindow::updateGUI(int state)
     case ANALYZING:
         turnOnIndicator(CONTACT_INDICATOR);
         setTextMsg("ANALYZING");
+
+        // The ECG is shown from the first analysis on.
+        ui->ecgDisplay->start();
         break;
 
     case LOST_CONNECTION:
@@ -717,27 +797,19 @@ void MainWindow::updateGUI(int state)
         ui->reconnectBtn->setEnabled(true);
         break;
 
+    case CHECK_PADS:
+        turnOnIndicator(PADS_INDICATOR);
+        setTextMsg("CHECK PADS");
+        break;
+
     case NO_SHOCK_ADVISED:
         turnOnIndicator(CONTACT_INDICATOR);
         setTextMsg("NO SHOCK ADVISED");
-
-        if (ui->startWithAsystole->isChecked() &&
-            device->getPatientHeartCondition() != SINUS_RHYTHM)
-        {
-            updateECGDisplay("://Icons/asystole_animation.gif");
-        }
-        else
-        {
-            updateECGDisplay(SINUS_RHYTHM);
-        }
         break;
 
     case SHOCK_ADVISED:
         turnOnIndicator(CONTACT_INDICATOR);
         setTextMsg("SHOCK ADVISED");
-
-        // TODO: Update ECG waveform.
-        updateECGDisplay(device->getPatientHeartCondition());
         break;
 
     case STAND_CLEAR:
@@ -775,7 +847,7 @@ void MainWindow::updateGUI(int state)
     case ABORT:
         // Turn off the device.
         ui->powerBtn->setChecked(false);
-        device->setState(OFF);
+        device->send(DeviceCommand(COMMAND_SET_STATE, OFF));
     break;
 
     default:
@@ -783,7 +855,36 @@ void MainWindow::updateGUI(int state)
         break;
     }
 
-    QApplication::processEvents();
+    processEvents();
+
+    // Updates the device sends outside of a step, such as ABORT, have no entry time.
+    if (state == device->getState())
+    {
+        guiUpdateLatency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                                    std::chrono::steady_clock::now() - device->getStepEnteredTime()).count());
+    }
+}
+
+/*
+    Function: cprBeat(int beat)
+    Purpose: Flash the CPR indicator on a beat of the metronome.
+    Input:
+        beat - The number of the beat since CPR started.
+    Output:
+        None
+*/
+void MainWindow::cprBeat(int beat)
+{
+    Q_UNUSED(beat);
+
+    // A beat queued behind the end of CPR is not shown.
+    if (currentStep != CPR_INDICATOR)
+        return;
+
+    stepIndicators[CPR_INDICATOR]->setChecked(true);
+    scheduler->cancel(cprFlashTask);
+    cprFlashTask = scheduler->after(CPR_BEAT_FLASH_TIME, [this]()
+                                    { stepIndicators[CPR_INDICATOR]->setChecked(false); });
 }
 
 /*
@@ -796,7 +897,11 @@ void MainWindow::updateGUI(int state)
 */
 void MainWindow::updatePatientCondition(int condition)
 {
-    ui->conditionSelector->setCurrentIndex(condition);
+    // Asystole can only be reached through the heart model and has no entry in the selector.
+    if (condition < ui->conditionSelector->count())
+    {
+        ui->conditionSelector->setCurrentIndex(condition);
+    }
 }
 
 /*
@@ -813,6 +918,44 @@ void MainWindow::updateNumberOfShocks(int shocks)
     ui->shockCount->setText(QString("SHOCKS: %1").arg(shocks, 2, 10, QChar('0')));
 }
 
+/*
+    Function: updateImpedance(double impedance, bool goodContact)
+    Purpose: Update the pad impedance reading.
+    Input:
+        impedance - The impedance between the pads in ohms.
+        goodContact - Whether the pads are in good contact with the patient.
+    Output:
+        None
+*/
+void MainWindow::updateImpedance(double impedance, bool goodContact)
+{
+    // Ignore readings still queued after the device was turned off.
+    if (!ui->powerBtn->isChecked())
+        return;
+
+    if (goodContact)
+    {
+        ui->impedanceLabel->setText(QString("%1 %2").arg(qRound(impedance)).arg(QChar(0x03A9)));
+    }
+    else
+    {
+        ui->impedanceLabel->setText("NO CONTACT");
+    }
+}
+
+/*
+    Function: updateDeliveredEnergy(double energy)
+    Purpose: Show the energy delivered by the last shock.
+    Input:
+        energy - The energy delivered to the patient in joules.
+    Output:
+        None
+*/
+void MainWindow::updateDeliveredEnergy(double energy)
+{
+    setTextMsg(QString("SHOCK DELIVERED %1 J").arg(qRound(energy)));
+}
+
 /*
     Function: on_cprPadsAttached_clicked(bool checked)
     Purpose: Attach the pads to the patient.
@@ -840,10 +983,13 @@ void MainWindow::on_cprPadsAttached_clicked(bool checked)
             // Display the kind of pads that were attached.
             bool adultPads = ui->padsSelector->currentIndex() == 0;
             setTextMsg(QString("%1 PADS").arg(adultPads ? "ADULT" : "PEDIATRIC"));
+
+            // Sent before the pads, so the device has them when its wait ends.
+            device->send(DeviceCommand(COMMAND_SET_PEDIATRIC_PADS, !adultPads));
         }
 
         // Operator is attaching the pads to the patient.
-        device->notifyPadsAttached();
+        device->send(DeviceCommand(COMMAND_ATTACH_PADS));
     }
 }
 
@@ -859,7 +1005,7 @@ void MainWindow::on_changeBatteries_clicked()
 {
     // Reset the battery to max battery level.
     ui->startingBatteryLevel->setValue(MAX_BATTERY_LEVEL);
-    device->setBatteryLevel(MAX_BATTERY_LEVEL);
+    device->send(DeviceCommand(COMMAND_CHANGE_BATTERIES));
 }
 
 /*
@@ -877,6 +1023,6 @@ void MainWindow::on_reconnectBtn_clicked()
 
     // Disable reconnectBtn.
     ui->reconnectBtn->setEnabled(false);
-    emit setLostConnection(false);
-    device->notifyReconnection();
+    device->send(DeviceCommand(COMMAND_SET_LOST_CONNECTION, false));
+    device->send(DeviceCommand(COMMAND_RECONNECT));
 }
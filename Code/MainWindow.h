@@ -12,8 +12,16 @@
 // Local imports
 #include "AED.h"
 #include "defs.h"
+#include "TickScheduler.h"
 #include "ui_MainWindow.h"
 
+// Indicator and clock updates, times in milliseconds.
+#define INDICATOR_BLINK_TIME 500
+#define ELAPSED_TIME_UPDATE_TIME 1000
+#define ELAPSED_TIME_RESET_TIME 5000
+#define FAILED_POWER_OFF_TIME 2000
+#define CPR_BEAT_FLASH_TIME 150
+
 QT_BEGIN_NAMESPACE
 namespace Ui
 {
@@ -33,6 +41,12 @@ public:
 
     void addAED(AED *device);
 
+    // Turn on the device after restoring a snapshot into it.
+    void resumeSession(bool padsAttached);
+
+    // Runs all timed work of the window, on the GUI thread.
+    TickScheduler *getScheduler() const;
+
 public slots:
     void turnOnIndicator(int index);
     void turnOffIndicator(int index);
@@ -49,19 +63,14 @@ public slots:
     void updateGUI(int state);
     void updatePatientCondition(int condition);
     void updateNumberOfShocks(int shocks);
+    void updateImpedance(double impedance, bool goodContact);
+    void updateDeliveredEnergy(double energy);
+
+    // Flash the CPR indicator on a beat of the metronome.
+    void cprBeat(int beat);
 
 signals:
-    void setPatientHeartCondition(int patientHeartCondition);
-    void setShockUntilHealthy(int numberOfShocks);
-    void setStartWithAsystole(bool checked);
-    void setPadsAttached(bool attached);
-    void notifyPadsAttached();
-    void setBatterySpecs(int startingLevel, int unitsPerShock, int unitsWhenIdle);
     void terminate();
-    void powerOn();
-    void setLostConnection(bool simulateConnectionLoss);
-    void notifyReconnection();
-    void setState(int state);
 
 private slots:
     void on_powerBtn_toggled(bool checked);
@@ -76,30 +85,38 @@ private:
     Ui::MainWindow *ui;
 
     void updateElapsedTime();
+    void processEvents();
     void resetElapsedTime();
     void resetStats();
 
     void toggleBatteryUnitControls(bool enable);
+    void toggleConfigurationControls(bool enable);
 
     // Set battery specs on the AED device.
     void setDeviceBatterySpecs();
     void setPatientCondition();
 
-    // ECG Display updating
-    void updateECGDisplay(HeartState state);
-    void updateECGDisplay(const QString &image);
-
     void drainBatteryWhenIdle();
 
+    // Only the unchecked images are in the .ui, the checked one is decoded when the button is first checked.
+    void setCheckedIconOnFirstUse(QAbstractButton *button, const QString &fileName);
+
     // Keep a list of the indicators shoing current AED operation step.
     QList<QPushButton *> stepIndicators;
 
     int currentStep;
 
-    // Used to update the elapsed time.
-    QTimer *timeUpdateCounter;
-    QTimer *indicatorTimer;
-    QTimer *batteryUpdateTimer;
+    // Runs all timed work of the window.
+    TickScheduler *scheduler;
+    TickScheduler::Task blinkTask;
+    TickScheduler::Task elapsedTimeTask;
+    TickScheduler::Task resetTimeTask;
+    TickScheduler::Task batteryTask;
+    TickScheduler::Task cprFlashTask;
+
+    void startBlinking();
+    void startSessionTasks();
+    void stopSessionTasks();
 
     // Saves elapsed time.
     int elapsedTimeSec;
@@ -0,0 +1,319 @@
+// IMPORTS
+#include "MetricsRegistry.h"
+
+#include <QList>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+#include <cmath>
+#include <limits>
+
+// Quantiles exported for every histogram.
+static const double EXPORTED_QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+/*
+    Function: MetricHistogram()
+    Purpose: Constructor. Starts with every bucket empty.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+MetricHistogram::MetricHistogram()
+    : total(0), values(0)
+{
+    for (auto &bucket : buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+/*
+    Function: bucketIndex()
+    Purpose: Finds the bucket of a value. Values below SUB_BUCKETS have a bucket each;
+             above that, the top METRIC_HISTOGRAM_SUB_BITS bits after the leading one
+             pick the bucket within the power of two.
+    Inputs:
+        std::uint64_t value: The value.
+    Outputs:
+        The index of the bucket.
+*/
+int MetricHistogram::bucketIndex(std::uint64_t value)
+{
+    if (value < std::uint64_t(SUB_BUCKETS))
+        return int(value);
+
+    int exponent = 63 - __builtin_clzll(value);
+    int shift = exponent - METRIC_HISTOGRAM_SUB_BITS;
+    return (shift + 1) * SUB_BUCKETS + int(value >> shift) - SUB_BUCKETS;
+}
+
+/*
+    Function: bucketEnd()
+    Purpose: Gets the first value past a bucket.
+    Inputs:
+        int index: The index of the bucket.
+    Outputs:
+        The end of the bucket, saturated for the last bucket.
+*/
+std::uint64_t MetricHistogram::bucketEnd(int index)
+{
+    if (index < SUB_BUCKETS)
+        return std::uint64_t(index) + 1;
+
+    int shift = index / SUB_BUCKETS - 1;
+    std::uint64_t end = std::uint64_t(SUB_BUCKETS + index % SUB_BUCKETS + 1);
+    if (end > (std::numeric_limits<std::uint64_t>::max() >> shift))
+        return std::numeric_limits<std::uint64_t>::max();
+
+    return end << shift;
+}
+
+/*
+    Function: record()
+    Purpose: Adds a value to the histogram.
+    Inputs:
+        std::uint64_t value: The value.
+    Outputs:
+        None
+*/
+void MetricHistogram::record(std::uint64_t value)
+{
+    buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(value, std::memory_order_relaxed);
+    values.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+    Function: count()
+    Purpose: Gets the number of values recorded.
+    Inputs:
+        None
+    Outputs:
+        The number of values.
+*/
+std::uint64_t MetricHistogram::count() const
+{
+    return values.load(std::memory_order_relaxed);
+}
+
+/*
+    Function: sum()
+    Purpose: Gets the sum of the values recorded.
+    Inputs:
+        None
+    Outputs:
+        The sum of the values.
+*/
+std::uint64_t MetricHistogram::sum() const
+{
+    return total.load(std::memory_order_relaxed);
+}
+
+/*
+    Function: countBelow()
+    Purpose: Counts the values below a bound. Exact when the bound starts a bucket,
+             which every power of two does.
+    Inputs:
+        std::uint64_t bound: The bound.
+    Outputs:
+        The number of values below the bound.
+*/
+std::uint64_t MetricHistogram::countBelow(std::uint64_t bound) const
+{
+    std::uint64_t below = 0;
+    for (int i = 0, end = bucketIndex(bound); i < end; ++i)
+    {
+        below += buckets[i].load(std::memory_order_relaxed);
+    }
+
+    return below;
+}
+
+/*
+    Function: quantile()
+    Purpose: Finds the bucket holding a quantile of the values.
+    Inputs:
+        double q: The quantile, between 0 and 1.
+    Outputs:
+        The largest value of that bucket, 0 if nothing was recorded.
+*/
+std::uint64_t MetricHistogram::quantile(double q) const
+{
+    std::uint64_t rank = std::uint64_t(std::ceil(q * count()));
+    std::uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen > 0 && seen >= rank)
+            return bucketEnd(i) - 1;
+    }
+
+    return 0;
+}
+
+/*
+    Function: instance()
+    Purpose: Gets the process-wide registry.
+    Inputs:
+        None
+    Outputs:
+        A pointer to the registry.
+*/
+MetricsRegistry *MetricsRegistry::instance()
+{
+    static MetricsRegistry registry;
+    return &registry;
+}
+
+/*
+    Function: find()
+    Purpose: Finds a registered metric. The registry must be locked.
+    Inputs:
+        const char *name: The name of the metric.
+        const QByteArray &labels: The labels of the metric.
+    Outputs:
+        The metric, or null if it is not registered.
+*/
+MetricsRegistry::Metric *MetricsRegistry::find(const char *name, const QByteArray &labels)
+{
+    for (const auto &metric : metrics)
+    {
+        if (metric->name == name && metric->labels == labels)
+            return metric.get();
+    }
+
+    return nullptr;
+}
+
+/*
+    Function: counter()
+    Purpose: Registers a counter, or gets it if it is already registered.
+    Inputs:
+        const char *name: The name of the metric.
+        const char *help: What the metric counts.
+        const QByteArray &labels: The labels, as in the text format, or none.
+        double scale: The factor the count is exported with.
+    Outputs:
+        The counter, valid for the whole run.
+*/
+MetricCounter &MetricsRegistry::counter(const char *name, const char *help, const QByteArray &labels, double scale)
+{
+    QMutexLocker locker(&mutex);
+
+    Metric *metric = find(name, labels);
+    if (metric == nullptr)
+    {
+        metrics.emplace_back(new Metric{name, help, labels, scale, std::unique_ptr<MetricCounter>(new MetricCounter), nullptr});
+        metric = metrics.back().get();
+    }
+
+    return *metric->counter;
+}
+
+/*
+    Function: histogram()
+    Purpose: Registers a histogram, or gets it if it is already registered.
+    Inputs:
+        const char *name: The name of the metric.
+        const char *help: What the metric measures.
+        double scale: The factor the values are exported with.
+    Outputs:
+        The histogram, valid for the whole run.
+*/
+MetricHistogram &MetricsRegistry::histogram(const char *name, const char *help, double scale)
+{
+    QMutexLocker locker(&mutex);
+
+    Metric *metric = find(name, QByteArray());
+    if (metric == nullptr)
+    {
+        metrics.emplace_back(new Metric{name, help, QByteArray(), scale, nullptr, std::unique_ptr<MetricHistogram>(new MetricHistogram)});
+        metric = metrics.back().get();
+    }
+
+    return *metric->histogram;
+}
+
+/*
+    Function: exposition()
+    Purpose: Formats every metric in the Prometheus text format. Counters sharing a
+             name are grouped under one HELP and TYPE line. A histogram is exported
+             with a bucket at every power of two up to METRIC_HISTOGRAM_EXPORT_OCTAVES,
+             and its quantiles as a gauge named after it.
+    Inputs:
+        None
+    Outputs:
+        The exposition text.
+*/
+QByteArray MetricsRegistry::exposition() const
+{
+    QMutexLocker locker(&mutex);
+
+    auto number = [](double value)
+    {
+        return QByteArray::number(value, 'g', 15);
+    };
+
+    QByteArray text;
+    QList<QByteArray> exported;
+    for (const auto &family : metrics)
+    {
+        if (exported.contains(family->name))
+            continue;
+        exported.append(family->name);
+
+        const QByteArray &name = family->name;
+        text += "# HELP " + name + " " + family->help + "\n";
+
+        if (family->histogram)
+        {
+            const MetricHistogram &histogram = *family->histogram;
+            text += "# TYPE " + name + " histogram\n";
+            for (int octave = 0; octave <= METRIC_HISTOGRAM_EXPORT_OCTAVES; ++octave)
+            {
+                std::uint64_t bound = std::uint64_t(1) << octave;
+                text += name + "_bucket{le=\"" + number(bound * family->scale) + "\"} " + QByteArray::number(quint64(histogram.countBelow(bound))) + "\n";
+            }
+            text += name + "_bucket{le=\"+Inf\"} " + QByteArray::number(quint64(histogram.count())) + "\n";
+            text += name + "_sum " + number(histogram.sum() * family->scale) + "\n";
+            text += name + "_count " + QByteArray::number(quint64(histogram.count())) + "\n";
+
+            text += "# HELP " + name + "_quantile Quantiles of " + name + ".\n";
+            text += "# TYPE " + name + "_quantile gauge\n";
+            for (double q : EXPORTED_QUANTILES)
+            {
+                text += name + "_quantile{quantile=\"" + number(q) + "\"} " + number(histogram.quantile(q) * family->scale) + "\n";
+            }
+            continue;
+        }
+
+        text += "# TYPE " + name + " counter\n";
+        for (const auto &metric : metrics)
+        {
+            if (metric->name != name)
+                continue;
+
+            QByteArray labels = metric->labels.isEmpty() ? QByteArray() : "{" + metric->labels + "}";
+            text += name + labels + " " + number(metric->counter->get() * metric->scale) + "\n";
+        }
+    }
+
+    return text;
+}
+
+/*
+    Function: write()
+    Purpose: Writes the exposition to a file through a temporary file that replaces it.
+    Inputs:
+        const QString &fileName: The file to write.
+    Outputs:
+        True if the file was written, false otherwise.
+*/
+bool MetricsRegistry::write(const QString &fileName) const
+{
+    QByteArray text = exposition();
+
+    QSaveFile file(fileName);
+    return file.open(QIODevice::WriteOnly) && file.write(text) == text.size() && file.commit();
+}
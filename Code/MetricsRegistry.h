@@ -0,0 +1,113 @@
+#ifndef METRICSREGISTRY_H
+#define METRICSREGISTRY_H
+
+// Qt imports
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Local imports
+#include "defs.h"
+
+// Metrics. Histograms keep values to within 1 / 2^METRIC_HISTOGRAM_SUB_BITS.
+#define METRIC_HISTOGRAM_SUB_BITS 3
+#define METRIC_HISTOGRAM_EXPORT_OCTAVES 36
+#define METRICS_WRITE_INTERVAL 5000
+
+// A count that only goes up. Safe to add to from any thread.
+class MetricCounter
+{
+public:
+    void add(std::uint64_t amount = 1)
+    {
+        value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    std::uint64_t get() const
+    {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t> value{0};
+};
+
+// A distribution of integer values, such as durations in microseconds. Buckets
+// are laid out like an HDR histogram: every power of two is split into
+// 1 << METRIC_HISTOGRAM_SUB_BITS equal buckets, so any value is kept to within
+// 1 / (1 << METRIC_HISTOGRAM_SUB_BITS) of itself, from 1 up to 2^64, in a fixed
+// array. Recording is a few atomic increments and never allocates.
+class MetricHistogram
+{
+public:
+    MetricHistogram();
+
+    void record(std::uint64_t value);
+
+    std::uint64_t count() const;
+    std::uint64_t sum() const;
+
+    // Number of values below the bound.
+    std::uint64_t countBelow(std::uint64_t bound) const;
+
+    // Upper bound of the bucket holding the given quantile, 0 while empty.
+    std::uint64_t quantile(double q) const;
+
+private:
+    static const int SUB_BUCKETS = 1 << METRIC_HISTOGRAM_SUB_BITS;
+    static const int BUCKETS = (64 - METRIC_HISTOGRAM_SUB_BITS + 1) * SUB_BUCKETS;
+
+    static int bucketIndex(std::uint64_t value);
+    static std::uint64_t bucketEnd(int index);
+
+    std::atomic<std::uint64_t> buckets[BUCKETS];
+    std::atomic<std::uint64_t> total;
+    std::atomic<std::uint64_t> values;
+};
+
+// Process-wide metrics, exported in the Prometheus text format. Metrics are
+// registered once, usually into static references, and then updated without
+// going through the registry. Every device of the process adds to the same
+// metrics.
+class MetricsRegistry
+{
+public:
+    static MetricsRegistry *instance();
+
+    // A counter, exported multiplied by scale, such as 1e-6 for microseconds
+    // counted in seconds. Labels are given as in the text format, for example
+    // state="CPR". Asking for a registered metric returns it.
+    MetricCounter &counter(const char *name, const char *help, const QByteArray &labels = QByteArray(), double scale = 1.0);
+    MetricHistogram &histogram(const char *name, const char *help, double scale = 1.0);
+
+    // The metrics in the Prometheus text exposition format.
+    QByteArray exposition() const;
+
+    // Writes the exposition to a file, replacing it at once so that scrapers
+    // never read half of it. Returns false if the file could not be written.
+    bool write(const QString &fileName) const;
+
+private:
+    struct Metric
+    {
+        QByteArray name;
+        QByteArray help;
+        QByteArray labels;
+        double scale;
+        std::unique_ptr<MetricCounter> counter;
+        std::unique_ptr<MetricHistogram> histogram;
+    };
+
+    MetricsRegistry() = default;
+    Metric *find(const char *name, const QByteArray &labels);
+
+    mutable QMutex mutex;
+    std::vector<std::unique_ptr<Metric>> metrics;
+};
+
+#endif
@@ -0,0 +1,375 @@
+// IMPORTS
+#include "ProtocolExplorer.h"
+#include "AED.h"
+#include "ProtocolRules.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSaveFile>
+
+#include <thread>
+#include <vector>
+
+// Inputs given at each new state, other than poor contact, whose outcome is random.
+static const ScenarioAction BRANCH_INPUTS[] = {
+    {OFF, 0, INPUT_ATTACH_PADS, true},
+    {OFF, 0, INPUT_DETACH_PADS, true},
+    {OFF, 0, INPUT_RECONNECT, true},
+    {OFF, 0, INPUT_POWER_OFF, true},
+    {OFF, 0, INPUT_CHANGE_BATTERIES, true},
+    {OFF, 0, INPUT_RESET, true},
+    {OFF, 0, INPUT_LOSE_CONNECTION, true},
+    {OFF, 0, INPUT_LOSE_CONNECTION, false}};
+
+/*
+    Function: ProtocolExplorer()
+    Purpose: Constructor.
+    Inputs:
+        int threads: The number of sessions replayed at once, each on a device of its own.
+    Outputs:
+        None
+*/
+ProtocolExplorer::ProtocolExplorer(int threads)
+    : threads(qMax(1, threads)), visited(EXPLORER_VISITED_BITS), full(false), sessions(0)
+{
+}
+
+/*
+    Function: run()
+    Purpose: Explores the state space one input deeper at a time, the sessions of each
+             depth spread over the threads, then reports the properties checked and
+             writes a counterexample for each violation.
+    Inputs:
+        const QString &counterexampleFile: The file the counterexamples are written to, as a scenario script.
+    Outputs:
+        True if every reachable state was explored and no property failed, false otherwise.
+*/
+bool ProtocolExplorer::run(const QString &counterexampleFile)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    while (devices.size() < threads)
+    {
+        devices.append(new AED());
+    }
+
+    QVector<Node> frontier = roots();
+    int depth = 0;
+    while (!frontier.isEmpty() && !full)
+    {
+        std::atomic<int> next(0);
+        std::vector<QVector<Node>> children(threads);
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads; ++i)
+        {
+            workers.emplace_back(&ProtocolExplorer::explore, this, std::ref(devices[i]), std::cref(frontier),
+                                 std::ref(next), std::ref(children[i]));
+        }
+        for (std::thread &worker : workers)
+        {
+            worker.join();
+        }
+
+        frontier.clear();
+        for (const QVector<Node> &nodes : children)
+        {
+            frontier += nodes;
+        }
+        depth++;
+    }
+
+    double elapsed = timer.nsecsElapsed() / 1e9;
+    qInfo().noquote() << QString("Explorer: %1 states, %2 sessions up to %3 inputs deep on %4 threads in %5 s")
+                             .arg(visited.size()).arg(sessions.load()).arg(depth - 1).arg(threads).arg(elapsed, 0, 'f', 1);
+
+    if (full)
+    {
+        qWarning().noquote() << QString("Explorer: the set of states seen is full, the state space was not explored to the end");
+    }
+
+    if (counterexamples.isEmpty())
+    {
+        qInfo().noquote() << QString("Explorer: in every state, a shock follows SHOCK_ADVISED, a power off ends the session within %1 steps,")
+                                 .arg(POWER_OFF_MAX_STEPS);
+        qInfo().noquote() << "          every wait ends, every step follows the protocol and the device returns to OFF";
+        return !full;
+    }
+
+    QString script;
+    int index = 0;
+    for (auto it = counterexamples.begin(); it != counterexamples.end(); ++it)
+    {
+        Scenario &counterexample = it.value();
+        counterexample.name = QString("explore-%1").arg(++index);
+        qInfo().noquote() << QString("FAIL %1: %2").arg(counterexample.name, it.key());
+
+        script += "# " + it.key() + "\n";
+        script += ScenarioRunner::format(counterexample) + "\n";
+    }
+
+    QSaveFile file(counterexampleFile);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Text) && file.write(script.toUtf8()) >= 0 && file.commit())
+    {
+        qInfo().noquote() << "Explorer: counterexamples written to" << counterexampleFile;
+    }
+    else
+    {
+        qWarning().noquote() << "Explorer: cannot write" << counterexampleFile;
+    }
+
+    return false;
+}
+
+/*
+    Function: explore()
+    Purpose: Replays sessions of a depth until there are none left. Every state of a
+             session not seen before is branched from, with each input given at it.
+    Inputs:
+        AED *&device: The device of this thread. Replaced by a new device if it deadlocks.
+        const QVector<Node> &frontier: The sessions of this depth.
+        std::atomic<int> &next: The index of the next session to replay, shared by the threads.
+        QVector<Node> &children: Receives the sessions of the next depth.
+    Outputs:
+        None
+*/
+void ProtocolExplorer::explore(AED *&device, const QVector<Node> &frontier, std::atomic<int> &next, QVector<Node> &children)
+{
+    for (int index = next++; index < frontier.size(); index = next++)
+    {
+        const Node &node = frontier[index];
+
+        // Written on the device thread, read once the session is over.
+        QVector<quint64> keys;
+        int cycles = 0;
+        bool advised = false;
+        ScenarioResult result = ScenarioRunner::play(device, node.scenario, EXPLORER_TIMEOUT, [&](const AED *target, AEDState state)
+        {
+            if (state == ANALYZING)
+            {
+                cycles++;
+                advised = false;
+            }
+            advised = advised || state == SHOCK_ADVISED;
+            keys.append(stateKey(target, state, node.scenario, cycles, advised));
+        });
+        sessions++;
+
+        QString violation = check(device, result);
+        if (!violation.isEmpty())
+        {
+            Scenario counterexample = node.scenario;
+            counterexample.expected = result.states;
+
+            QMutexLocker locker(&counterexamplesMutex);
+            if (!counterexamples.contains(violation))
+            {
+                counterexamples.insert(violation, counterexample);
+            }
+        }
+
+        QMap<AEDState, int> occurrences;
+        for (int step = 0; step < keys.size(); ++step)
+        {
+            AEDState state = result.states[step];
+            int occurrence = ++occurrences[state];
+            if (step < node.firstBranch)
+                continue;
+
+            bool setFull = false;
+            bool seen = !visited.insert(keys[step], setFull);
+            if (setFull)
+            {
+                full = true;
+            }
+            if (seen)
+                continue;
+
+            for (const ScenarioAction &input : BRANCH_INPUTS)
+            {
+                Node child{node.scenario, step + 1};
+                child.scenario.actions.append(ScenarioAction{state, occurrence, input.input, input.enabled});
+                children.append(child);
+            }
+        }
+    }
+}
+
+/*
+    Function: check()
+    Purpose: Checks the properties of a session that the protocol rules do not cover,
+             then returns the device to OFF the way the main window does.
+    Inputs:
+        AED *device: The device the session ran on.
+        const ScenarioResult &result: The session.
+    Outputs:
+        The property violated, empty if there is none.
+*/
+QString ProtocolExplorer::check(AED *device, const ScenarioResult &result) const
+{
+    if (result.deadlocked)
+        return "powering off did not end the session";
+
+    // The operator attaches the pads and plugs the cable back in whenever asked.
+    if (result.timedOut)
+        return QString("still waiting after the operator gave the input asked for");
+
+    if (!result.violation.isEmpty())
+        return result.violation;
+
+    ScenarioRunner::give(device, INPUT_RESET, true);
+    if (device->getState() != OFF)
+        return QString("the device did not return to OFF after %1").arg(aedStateName(result.states.isEmpty() ? OFF : result.states.last()));
+
+    return QString();
+}
+
+/*
+    Function: roots()
+    Purpose: Makes a session for every configuration of the device, with an operator
+             who attaches the pads and plugs the cable back in whenever asked, so that
+             only the inputs added by the explorer can end a session early.
+    Inputs:
+        None
+    Outputs:
+        The sessions to start from.
+*/
+QVector<ProtocolExplorer::Node> ProtocolExplorer::roots()
+{
+    Scenario base;
+    base.actions = {{ATTACH_PADS, 0, INPUT_ATTACH_PADS, true},
+                    {CHECK_PADS, 0, INPUT_ATTACH_PADS, true},
+                    {LOST_CONNECTION, 0, INPUT_RECONNECT, true}};
+
+    // Battery for the self test to fail, for no shock, for one shock, and full.
+    int perShock = base.batteryUnitsPerShock;
+    const int batteryLevels[] = {SUFFICIENT_BATTERY_LEVEL - 1, SUFFICIENT_BATTERY_LEVEL + perShock - 1,
+                                 SUFFICIENT_BATTERY_LEVEL + perShock, MAX_BATTERY_LEVEL};
+
+    QVector<Node> nodes;
+    for (quint32 seed = 1; seed <= EXPLORER_SEEDS; ++seed)
+    {
+        for (int condition = SINUS_RHYTHM; condition <= ASYSTOLE; ++condition)
+        {
+            for (int shocks = 0; shocks <= EXPLORER_MAX_SHOCKS; ++shocks)
+            {
+                for (int configuration = 0; configuration < 4; ++configuration)
+                {
+                    for (int batteryLevel : batteryLevels)
+                    {
+                        Scenario scenario = base;
+                        scenario.seed = seed;
+                        scenario.condition = (HeartState)condition;
+                        scenario.shocks = shocks;
+                        scenario.padsAttached = configuration & 1;
+                        scenario.startWithAsystole = configuration & 2;
+                        scenario.batteryLevel = batteryLevel;
+                        nodes.append(Node{scenario, 0});
+                    }
+                }
+            }
+        }
+    }
+
+    return nodes;
+}
+
+/*
+    Function: stateKey()
+    Purpose: Packs the state of the protocol after a step into a word.
+    Inputs:
+        const AED *device: The device, on its thread, having just reported the step.
+        AEDState state: The step reported.
+        const Scenario &scenario: The session.
+        int cycles: The number of analyses so far.
+        bool advised: True if a shock was advised since the latest analysis.
+    Outputs:
+        The state, packed.
+*/
+quint64 ProtocolExplorer::stateKey(const AED *device, AEDState state, const Scenario &scenario, int cycles, bool advised)
+{
+    // Shocks the battery has left, up to two.
+    int perShock = scenario.batteryUnitsPerShock;
+    int battery = device->getBatteryLevel();
+    quint64 batteryBand = battery < SUFFICIENT_BATTERY_LEVEL ? 0 : qMin(3, 1 + (battery - SUFFICIENT_BATTERY_LEVEL) / perShock);
+
+    // The patient turns healthy at the analysis after the last shock, one analysis later for asystole.
+    int shocksLeft = scenario.shocks + (scenario.startWithAsystole ? 1 : 0) - qMax(0, cycles - 1);
+    bool asystole = scenario.startWithAsystole && cycles <= 1;
+
+    quint64 key = quint64(state);
+    key |= quint64(device->getState() == ABORT) << 5;
+    key |= quint64(device->getPadsAttached()) << 6;
+    key |= quint64(device->getLostConnection()) << 7;
+    key |= batteryBand << 8;
+    key |= quint64(device->getPatientHeartCondition()) << 10;
+    key |= quint64(qBound(0, shocksLeft, 7)) << 12;
+    key |= quint64(asystole) << 15;
+    key |= quint64(advised) << 16;
+    return key;
+}
+
+/*
+    Function: VisitedSet()
+    Purpose: Constructor. The table starts out empty.
+    Inputs:
+        int bits: The table has 2^bits states.
+    Outputs:
+        None
+*/
+ProtocolExplorer::VisitedSet::VisitedSet(int bits)
+    : slots(new std::atomic<quint64>[quint64(1) << bits]()), mask((quint64(1) << bits) - 1), count(0)
+{
+}
+
+/*
+    Function: insert()
+    Purpose: Adds a state to the set, probing linearly from its hash. A slot is claimed
+             with a compare and swap, so two threads never both add the same state.
+    Inputs:
+        quint64 key: The packed state.
+        bool &full: Set to true once the table is three quarters full.
+    Outputs:
+        True if the state was not in the set, false otherwise.
+*/
+bool ProtocolExplorer::VisitedSet::insert(quint64 key, bool &full)
+{
+    // Zero marks an empty slot.
+    quint64 stored = key | (quint64(1) << 63);
+
+    // Finalizer of splitmix64, the packed fields are mostly in the low bits.
+    quint64 hash = key;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+
+    for (quint64 probe = 0; probe <= mask; ++probe)
+    {
+        std::atomic<quint64> &slot = slots[(hash + probe) & mask];
+        quint64 current = slot.load(std::memory_order_relaxed);
+        if (current == 0 && slot.compare_exchange_strong(current, stored, std::memory_order_relaxed))
+        {
+            full = ++count > (mask + 1) / 4 * 3;
+            return true;
+        }
+
+        if (current == stored)
+            return false;
+    }
+
+    full = true;
+    return false;
+}
+
+/*
+    Function: size()
+    Purpose: Gets the number of states in the set.
+    Inputs:
+        None
+    Outputs:
+        The number of states.
+*/
+quint64 ProtocolExplorer::VisitedSet::size() const
+{
+    return count.load();
+}
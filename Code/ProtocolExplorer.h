@@ -0,0 +1,87 @@
+#ifndef PROTOCOLEXPLORER_H
+#define PROTOCOLEXPLORER_H
+
+// Qt imports
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+#include <memory>
+
+// Local imports
+#include "defs.h"
+#include "ScenarioRunner.h"
+
+// Protocol explorer. Seeds enough for some sessions to fail the self test, timeout in milliseconds.
+#define EXPLORER_SEEDS 16
+#define EXPLORER_MAX_SHOCKS 2
+#define EXPLORER_VISITED_BITS 20
+#define EXPLORER_TIMEOUT 1000
+
+class AED;
+
+// Explores every reachable state of the device protocol. A state is what decides
+// where a session goes next: the step reported, whether it was powered off, the
+// pads, the connection, the battery band, the heart condition and the shocks left.
+// Starting from every device configuration, a session is replayed on a simulated
+// clock with each operator input given at each state not seen before, until no new
+// states turn up. Every session is checked against the protocol rules, so that a
+// property such as "no shock without SHOCK_ADVISED" holds in every reachable state.
+class ProtocolExplorer
+{
+public:
+    explicit ProtocolExplorer(int threads);
+
+    // Explores the whole state space and writes a scenario for each distinct property
+    // violation to a file. Returns true if every state was reached and no property failed.
+    bool run(const QString &counterexampleFile);
+
+private:
+    // A session to replay. Inputs are only added at the steps after its last one,
+    // the earlier steps were branched from by the sessions it came from.
+    struct Node
+    {
+        Scenario scenario;
+        int firstBranch;
+    };
+
+    // Set of states seen, shared by all threads without a lock. Open addressing on a
+    // fixed table of packed states, so a state costs a single word.
+    class VisitedSet
+    {
+    public:
+        explicit VisitedSet(int bits);
+
+        // Returns true if the state was not in the set. Sets full once the table is three quarters full.
+        bool insert(quint64 key, bool &full);
+        quint64 size() const;
+
+    private:
+        std::unique_ptr<std::atomic<quint64>[]> slots;
+        quint64 mask;
+        std::atomic<quint64> count;
+    };
+
+    void explore(AED *&device, const QVector<Node> &frontier, std::atomic<int> &next, QVector<Node> &children);
+    QString check(AED *device, const ScenarioResult &result) const;
+
+    static QVector<Node> roots();
+    static quint64 stateKey(const AED *device, AEDState state, const Scenario &scenario, int cycles, bool advised);
+
+    int threads;
+
+    // One per thread, they live for the whole application.
+    QVector<AED *> devices;
+
+    VisitedSet visited;
+    std::atomic<bool> full;
+    std::atomic<quint64> sessions;
+
+    // First session violating each property, by description.
+    QMutex counterexamplesMutex;
+    QMap<QString, Scenario> counterexamples;
+};
+
+#endif
@@ -0,0 +1,151 @@
+// IMPORTS
+#include "ProtocolRules.h"
+
+/*
+    Function: canStart()
+    Purpose: Checks whether a session can start with a state. The self test comes first,
+             unless the device is powered off or the battery is low before it.
+    Inputs:
+        AEDState state: The first state reported.
+    Outputs:
+        True if the state can start a session, false otherwise.
+*/
+bool ProtocolRules::canStart(AEDState state)
+{
+    return state == SELF_TEST_SUCCESS || state == SELF_TEST_FAIL || state == CHANGE_BATTERIES || state == ABORT;
+}
+
+/*
+    Function: isFinal()
+    Purpose: Checks whether a state ends the session.
+    Inputs:
+        AEDState state: The state.
+    Outputs:
+        True if nothing can follow the state, false otherwise.
+*/
+bool ProtocolRules::isFinal(AEDState state)
+{
+    return state == ABORT || state == SELF_TEST_FAIL || state == CHANGE_BATTERIES;
+}
+
+/*
+    Function: canEnd()
+    Purpose: Checks whether a session can end with a state.
+    Inputs:
+        AEDState state: The last state reported.
+    Outputs:
+        True if the session can end there, false otherwise.
+*/
+bool ProtocolRules::canEnd(AEDState state)
+{
+    return isFinal(state) || state == STOP_CPR;
+}
+
+/*
+    Function: canFollow()
+    Purpose: Checks whether a state can follow another, in the programs of the protocols.
+    Inputs:
+        AEDState previous: The state reported before.
+        AEDState next: The state reported after it.
+        bool shockAdvised: True if the latest analysis advised a shock.
+    Outputs:
+        True if the transition is allowed, false otherwise.
+*/
+bool ProtocolRules::canFollow(AEDState previous, AEDState next, bool shockAdvised)
+{
+    if (isFinal(previous))
+        return false;
+    if (next == CHANGE_BATTERIES)
+        return true;
+    if (next == ABORT)
+        return previous != SHOCKING;
+
+    switch (previous)
+    {
+    case SELF_TEST_SUCCESS:
+        return next == STAY_CALM || next == ANALYZING;
+    case STAY_CALM:
+        return next == CHECK_RESPONSE;
+    case CHECK_RESPONSE:
+        return next == CALL_HELP;
+    case CALL_HELP:
+        return next == ATTACH_PADS;
+    case ATTACH_PADS:
+        return next == ANALYZING;
+    case ANALYZING:
+        return next == SHOCK_ADVISED || next == NO_SHOCK_ADVISED;
+    case SHOCK_ADVISED:
+        return next == LOST_CONNECTION || next == CHECK_PADS || next == STAND_CLEAR;
+    case NO_SHOCK_ADVISED:
+        return next == LOST_CONNECTION || next == CPR;
+    case LOST_CONNECTION:
+        return shockAdvised ? next == CHECK_PADS || next == STAND_CLEAR : next == CPR;
+    case CHECK_PADS:
+        return next == CHECK_PADS || next == STAND_CLEAR;
+    case STAND_CLEAR:
+        return next == SHOCKING;
+    case SHOCKING:
+        return next == SHOCK_DELIVERED;
+    case SHOCK_DELIVERED:
+        // A protocol with more than one shock per cycle analyzes again after a shock.
+        return next == CPR || next == ANALYZING;
+    case CPR:
+        return next == STOP_CPR;
+    case STOP_CPR:
+        return next == ANALYZING;
+    default:
+        return false;
+    }
+}
+
+/*
+    Function: check()
+    Purpose: Checks every transition of a session, how it ended, and that every power
+             off that was not refused ended it.
+    Inputs:
+        const QVector<AEDState> &states: The states reported, in order.
+        const QVector<int> &powerOffs: For each power off, the number of states reported before it.
+    Outputs:
+        A description of the first violation, or an empty string if there is none.
+*/
+QString ProtocolRules::check(const QVector<AEDState> &states, const QVector<int> &powerOffs)
+{
+    if (states.isEmpty())
+        return "the device reported no state";
+
+    bool shockAdvised = false;
+    for (int i = 0; i < states.size(); ++i)
+    {
+        if (i == 0 && !canStart(states[i]))
+            return QString("the session started with %1").arg(aedStateName(states[i]));
+
+        if (i > 0 && !canFollow(states[i - 1], states[i], shockAdvised))
+            return QString("%1 followed %2").arg(aedStateName(states[i]), aedStateName(states[i - 1]));
+
+        if (states[i] == SHOCK_ADVISED)
+        {
+            shockAdvised = true;
+        }
+        else if (states[i] == ANALYZING || states[i] == NO_SHOCK_ADVISED)
+        {
+            shockAdvised = false;
+        }
+    }
+
+    if (!canEnd(states.last()))
+        return QString("the session ended at %1").arg(aedStateName(states.last()));
+
+    for (int reported : powerOffs)
+    {
+        // Nothing left to power off, or the shock was under way and it was refused.
+        AEDState current = reported > 0 ? states[reported - 1] : OFF;
+        if (reported >= states.size() || isFinal(current) || current == STAND_CLEAR || current == SHOCKING)
+            continue;
+
+        int end = states.indexOf(ABORT, reported);
+        if (end < 0 || end - reported >= POWER_OFF_MAX_STEPS)
+            return QString("a power off at %1 did not end the session").arg(aedStateName(current));
+    }
+
+    return QString();
+}
@@ -0,0 +1,42 @@
+#ifndef PROTOCOLRULES_H
+#define PROTOCOLRULES_H
+
+// Qt imports
+#include <QString>
+#include <QVector>
+
+// Local imports
+#include "defs.h"
+
+// A power off ends the session within this many states, unless it came during the shock.
+#define POWER_OFF_MAX_STEPS 2
+
+// The sequences of states the protocol programs of AED::run() can report, for
+// checking a session from the outside. Any step can be followed by CHANGE_BATTERIES,
+// when the battery runs low, and by ABORT, when the device is powered off, except
+// for the shock itself, which cannot be interrupted.
+class ProtocolRules
+{
+public:
+    // States a session can start with.
+    static bool canStart(AEDState state);
+
+    // States after which the device reports nothing more.
+    static bool isFinal(AEDState state);
+
+    // States a session can end with: the final states, or STOP_CPR when the
+    // protocol loop ran out of cycles.
+    static bool canEnd(AEDState state);
+
+    // Whether a state can follow another. Shocks are only allowed after a shock
+    // was advised in the same analysis cycle.
+    static bool canFollow(AEDState previous, AEDState next, bool shockAdvised);
+
+    // Finds the first violation in the states reported by a session. A power off
+    // is given after the number of states in powerOffs were reported, and must end
+    // the session within POWER_OFF_MAX_STEPS states, unless it came during the shock.
+    // Returns an empty string if the session followed the protocol.
+    static QString check(const QVector<AEDState> &states, const QVector<int> &powerOffs);
+};
+
+#endif
@@ -0,0 +1,177 @@
+// IMPORTS
+#include "QrsDetector.h"
+
+#include <algorithm>
+
+// The threshold follows the peak energy down by this factor per sample, about a
+// tenth of the peak per second.
+static const float PEAK_DECAY = 0.99f;
+
+/*
+    Function: QrsDetector()
+    Purpose: Constructor.
+    Inputs:
+        int leads: The number of leads.
+    Outputs:
+        None
+*/
+QrsDetector::QrsDetector(int leads)
+{
+    reset(leads);
+}
+
+/*
+    Function: reset()
+    Purpose: Forgets all beats and changes the number of leads.
+    Inputs:
+        int leads: The number of leads.
+    Outputs:
+        None
+*/
+void QrsDetector::reset(int leads)
+{
+    this->leads = std::max(leads, 1);
+    clock = 0;
+
+    previous.assign(this->leads, 0.0f);
+    inverted.assign(this->leads, 0);
+    peak.assign(this->leads, 0.0f);
+    rate.assign(this->leads, 0.0f);
+    lastBeat.assign(this->leads, 0);
+    beats.assign(this->leads, 0);
+}
+
+/*
+    Function: setInverted()
+    Purpose: Sets whether a lead sees depolarization as a falling edge, like aVR.
+    Inputs:
+        int lead: The lead.
+        bool inverted: True if the lead is inverted, false otherwise.
+    Outputs:
+        None
+*/
+void QrsDetector::setInverted(int lead, bool inverted)
+{
+    this->inverted.at(lead) = inverted ? 1 : 0;
+}
+
+/*
+    Function: leadCount()
+    Purpose: Gets the number of leads.
+    Inputs:
+        None
+    Outputs:
+        The number of leads.
+*/
+int QrsDetector::leadCount() const
+{
+    return leads;
+}
+
+/*
+    Function: process()
+    Purpose: Detects beats in a block of samples. The squared slope of every lead is
+             computed first in a single pass, then each lead compares it against a
+             threshold that follows its recent peak.
+    Inputs:
+        const float *block: count samples of lead 0, then count samples of lead 1, and so on.
+        std::size_t count: The number of samples for each lead.
+    Outputs:
+        None
+*/
+void QrsDetector::process(const float *block, std::size_t count)
+{
+    if (count == 0)
+        return;
+
+    const std::size_t n = std::size_t(leads) * count;
+    if (rising.size() < n)
+    {
+        rising.resize(n);
+        falling.resize(n);
+    }
+
+    // Slope energy of all leads at once, of the rising and the falling edges apart.
+    // The first sample of each lead is fixed below.
+    float *R = rising.data();
+    float *F = falling.data();
+    R[0] = F[0] = 0.0f;
+    for (std::size_t i = 1; i < n; ++i)
+    {
+        float slope = block[i] - block[i - 1];
+        float up = std::max(slope, 0.0f);
+        float down = std::min(slope, 0.0f);
+        R[i] = up * up;
+        F[i] = down * down;
+    }
+
+    const std::uint64_t refractory = std::uint64_t(QRS_REFRACTORY_TIME * ECG_SAMPLE_RATE);
+    const std::uint64_t timeout = std::uint64_t(QRS_TIMEOUT * ECG_SAMPLE_RATE);
+
+    for (int lead = 0; lead < leads; ++lead)
+    {
+        const float *x = block + std::size_t(lead) * count;
+        float *r = R + std::size_t(lead) * count;
+        float *f = F + std::size_t(lead) * count;
+
+        float slope = x[0] - previous[lead];
+        r[0] = slope > 0.0f ? slope * slope : 0.0f;
+        f[0] = slope < 0.0f ? slope * slope : 0.0f;
+        previous[lead] = x[count - 1];
+
+        for (std::size_t t = 0; t < count; ++t)
+        {
+            std::uint64_t now = clock + t;
+
+            // Both edges of a beat are steep. Only the depolarizing one counts, which
+            // depends on the polarity of the lead, so that a beat is not counted twice.
+            float e = inverted[lead] ? f[t] : r[t];
+            peak[lead] = std::max(peak[lead] * PEAK_DECAY, e);
+
+            bool beat = e > QRS_MIN_ENERGY && e >= QRS_THRESHOLD_RATIO * peak[lead]
+                     && (beats[lead] == 0 || now - lastBeat[lead] > refractory);
+            if (!beat)
+                continue;
+
+            if (beats[lead] > 0)
+            {
+                rate[lead] = 60.0f * ECG_SAMPLE_RATE / float(now - lastBeat[lead]);
+            }
+            lastBeat[lead] = now;
+            beats[lead]++;
+        }
+
+        if (clock + count - lastBeat[lead] > timeout)
+        {
+            rate[lead] = 0.0f;
+        }
+    }
+
+    clock += count;
+}
+
+/*
+    Function: getHeartRate()
+    Purpose: Gets the heart rate seen by a lead, from the last two beats.
+    Inputs:
+        int lead: The lead.
+    Outputs:
+        The heart rate in beats per minute, 0 if there were no recent beats.
+*/
+float QrsDetector::getHeartRate(int lead) const
+{
+    return rate.at(lead);
+}
+
+/*
+    Function: getBeatCount()
+    Purpose: Gets the number of beats detected in a lead.
+    Inputs:
+        int lead: The lead.
+    Outputs:
+        The number of beats.
+*/
+std::uint64_t QrsDetector::getBeatCount(int lead) const
+{
+    return beats.at(lead);
+}
@@ -0,0 +1,57 @@
+#ifndef QRSDETECTOR_H
+#define QRSDETECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Local imports
+#include "defs.h"
+
+// Beat detection. The threshold is a fraction of the peak slope energy, times are in seconds.
+#define QRS_THRESHOLD_RATIO 0.3f
+#define QRS_MIN_ENERGY 1e-4f
+#define QRS_REFRACTORY_TIME 0.2f
+#define QRS_TIMEOUT 3.0f
+
+// Finds QRS complexes in every lead of an ECG and tracks the heart rate seen by
+// each lead. Blocks are stored lead after lead like in EcgBuffer, so the slope
+// filter runs over all leads as one flat loop, which the compiler vectorizes.
+// The threshold, which follows the previous samples, is tracked lead by lead.
+class QrsDetector
+{
+public:
+    explicit QrsDetector(int leads = 1);
+
+    // Forget all beats and change the number of leads.
+    void reset(int leads);
+    int leadCount() const;
+
+    // Leads are upright unless set otherwise.
+    void setInverted(int lead, bool inverted);
+
+    // Processes count samples of every lead. block holds lead l at block[l * count].
+    void process(const float *block, std::size_t count);
+
+    // Beats per minute, 0 without a beat for QRS_TIMEOUT seconds.
+    float getHeartRate(int lead) const;
+    std::uint64_t getBeatCount(int lead) const;
+
+private:
+    int leads;
+    std::uint64_t clock; // Samples processed for each lead.
+
+    // Per lead state.
+    std::vector<float> previous;
+    std::vector<std::uint8_t> inverted;
+    std::vector<float> peak;
+    std::vector<float> rate;
+    std::vector<std::uint64_t> lastBeat;
+    std::vector<std::uint64_t> beats;
+
+    // Slope energy of the current block, reused between blocks.
+    std::vector<float> rising;
+    std::vector<float> falling;
+};
+
+#endif
@@ -0,0 +1,517 @@
+// IMPORTS
+#include "ResuscitationProtocol.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QMutexLocker>
+#include <QStringList>
+
+#include <algorithm>
+
+/*
+    Function: adultEnergies()
+    Purpose: Gets the energies of the built-in protocol, the default of every protocol.
+    Inputs:
+        None
+    Outputs:
+        ADULT_SHOCK_ENERGIES in joules.
+*/
+static QVector<double> adultEnergies()
+{
+    static const double energies[] = ADULT_SHOCK_ENERGIES;
+
+    QVector<double> result;
+    for (double energy : energies)
+    {
+        result.append(energy);
+    }
+
+    return result;
+}
+
+/*
+    Function: pediatricOf()
+    Purpose: Gets the pediatric variant a protocol has unless it sets its own: the
+             adult one, with its energies attenuated.
+    Inputs:
+        const ProtocolVariant &adult: The adult variant.
+    Outputs:
+        The pediatric variant.
+*/
+static ProtocolVariant pediatricOf(const ProtocolVariant &adult)
+{
+    ProtocolVariant pediatric = adult;
+    for (double &energy : pediatric.energies)
+    {
+        energy *= PEDIATRIC_ENERGY_ATTENUATION;
+    }
+
+    return pediatric;
+}
+
+/*
+    Function: parseSetting()
+    Purpose: Reads a setting of a variant. Numbers must be positive; whether they are
+             in range is checked once the whole protocol is read.
+    Inputs:
+        const QString &setting: The setting, analyzing, cpr, shocks or energies.
+        const QStringList &words: Its arguments.
+        ProtocolVariant &variant: The variant set.
+    Outputs:
+        True if the setting was read, false otherwise.
+*/
+static bool parseSetting(const QString &setting, const QStringList &words, ProtocolVariant &variant)
+{
+    if (words.isEmpty())
+        return false;
+
+    bool ok = true;
+    if (setting == "energies")
+    {
+        QVector<double> energies;
+        for (const QString &word : words)
+        {
+            double energy = word.toDouble(&ok);
+            if (!ok || energy <= 0.0)
+                return false;
+            energies.append(energy);
+        }
+
+        variant.energies = energies;
+        return true;
+    }
+
+    int value = words.size() == 1 ? words[0].toInt(&ok) : 0;
+    if (!ok || value <= 0)
+        return false;
+
+    if (setting == "analyzing")
+    {
+        variant.analyzingTime = value;
+    }
+    else if (setting == "cpr")
+    {
+        variant.cprTime = value;
+    }
+    else if (setting == "shocks")
+    {
+        variant.shocksPerCycle = value;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Function: energy()
+    Purpose: Gets the energy that should reach the patient. It escalates with every
+             shock, and stays at the last energy once they are all used.
+    Inputs:
+        int shockIndex: The number of shocks already delivered.
+    Outputs:
+        The nominal energy in joules.
+*/
+double ProtocolProgram::energy(int shockIndex) const
+{
+    return energies[std::min(std::max(shockIndex, 0), energies.size() - 1)];
+}
+
+/*
+    Function: find()
+    Purpose: Finds the first step of the program doing something.
+    Inputs:
+        ProtocolOp op: What the step does.
+    Outputs:
+        The index of the step, -1 if there is none.
+*/
+int ProtocolProgram::find(ProtocolOp op) const
+{
+    for (int i = 0; i < steps.size(); ++i)
+    {
+        if (steps[i].op == op)
+            return i;
+    }
+
+    return -1;
+}
+
+/*
+    Function: builtin()
+    Purpose: Makes the protocol the device followed before protocols could be loaded.
+    Inputs:
+        None
+    Outputs:
+        The protocol, named DEFAULT_PROTOCOL_NAME.
+*/
+ResuscitationProtocol ResuscitationProtocol::builtin()
+{
+    ResuscitationProtocol protocol;
+    protocol.name = DEFAULT_PROTOCOL_NAME;
+    protocol.adult.energies = adultEnergies();
+    protocol.pediatric = pediatricOf(protocol.adult);
+    protocol.compile();
+
+    return protocol;
+}
+
+/*
+    Function: load()
+    Purpose: Reads the protocol definitions of a file.
+    Inputs:
+        const QString &fileName: The file.
+        QVector<ResuscitationProtocol> &protocols: The protocols read are appended to it.
+    Outputs:
+        True if the file was read, false if it could not be opened or has an error.
+*/
+bool ResuscitationProtocol::load(const QString &fileName, QVector<ResuscitationProtocol> &protocols)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qCritical().noquote() << "Could not read the protocols in" << fileName;
+        return false;
+    }
+
+    QString error;
+    if (!parse(QString::fromUtf8(file.readAll()), protocols, error))
+    {
+        qCritical().noquote() << QString("%1:%2").arg(fileName, error);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Function: parse()
+    Purpose: Parses protocol definitions. Each line is a setting followed by its
+             arguments, and text after a # is ignored. A protocol starts with
+             "protocol <name>" and ends with "end". Settings not given keep the values
+             of the built-in protocol, and pediatric ones, given after "pediatric",
+             default to the adult ones with attenuated energies.
+    Inputs:
+        const QString &text: The definitions.
+        QVector<ResuscitationProtocol> &protocols: The protocols compiled are appended to it.
+        QString &error: Set to the line and the reason when the definitions have an error.
+    Outputs:
+        True if every protocol is valid, false otherwise.
+*/
+bool ResuscitationProtocol::parse(const QString &text, QVector<ResuscitationProtocol> &protocols, QString &error)
+{
+    const QStringList lines = text.split('\n');
+    ResuscitationProtocol protocol;
+    int line = 0;
+    bool open = false;
+
+    // Applied once the adult settings they default to are all known.
+    QVector<QStringList> pediatricSettings;
+
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        QStringList words = lines[i].section('#', 0, 0).simplified().split(' ', Qt::SkipEmptyParts);
+        if (words.isEmpty())
+            continue;
+
+        auto fail = [&](const QString &reason)
+        {
+            error = QString("%1: %2").arg(i + 1).arg(reason);
+            return false;
+        };
+
+        const QString command = words.takeFirst();
+        if (command == "protocol")
+        {
+            if (open)
+                return fail("protocol \"" + protocol.name + "\" has no end");
+            if (words.size() != 1)
+                return fail("a protocol is named with a single word");
+
+            bool taken = words[0] == DEFAULT_PROTOCOL_NAME;
+            for (const ResuscitationProtocol &other : protocols)
+            {
+                taken = taken || other.name == words[0];
+            }
+            if (taken)
+                return fail("there already is a protocol named \"" + words[0] + "\"");
+
+            protocol = ResuscitationProtocol();
+            protocol.name = words[0];
+            protocol.adult.energies = adultEnergies();
+            pediatricSettings.clear();
+            line = i + 1;
+            open = true;
+            continue;
+        }
+
+        if (!open)
+            return fail("\"" + command + "\" outside of a protocol");
+
+        if (command == "end")
+        {
+            protocol.pediatric = pediatricOf(protocol.adult);
+            for (QStringList setting : pediatricSettings)
+            {
+                parseSetting(setting.takeFirst(), setting, protocol.pediatric);
+            }
+
+            QString reason = protocol.compile();
+            if (!reason.isEmpty())
+                return fail("protocol \"" + protocol.name + "\": " + reason);
+
+            protocols.append(protocol);
+            open = false;
+            continue;
+        }
+
+        // Read into a scratch variant first, so that errors are reported at their line.
+        ProtocolVariant scratch;
+        bool ok;
+        if (command == "pediatric")
+        {
+            ok = !words.isEmpty() && parseSetting(words[0], words.mid(1), scratch);
+            pediatricSettings.append(words);
+        }
+        else
+        {
+            ok = parseSetting(command, words, protocol.adult);
+        }
+
+        if (!ok)
+            return fail("cannot read \"" + lines[i].trimmed() + "\"");
+    }
+
+    if (open)
+    {
+        error = QString("%1: protocol \"%2\" has no end").arg(line).arg(protocol.name);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Function: getName()
+    Purpose: Gets the name of the protocol.
+    Inputs:
+        None
+    Outputs:
+        The name.
+*/
+const QString &ResuscitationProtocol::getName() const
+{
+    return name;
+}
+
+/*
+    Function: getProgram()
+    Purpose: Gets the program the device runs for the pads.
+    Inputs:
+        bool pediatric: True for pediatric pads, false for adult pads.
+    Outputs:
+        The program.
+*/
+const ProtocolProgram &ResuscitationProtocol::getProgram(bool pediatric) const
+{
+    return pediatric ? pediatricProgram : adultProgram;
+}
+
+/*
+    Function: compile()
+    Purpose: Checks both variants and compiles them into their programs.
+    Inputs:
+        None
+    Outputs:
+        An empty string if the protocol is valid, otherwise what is wrong with it.
+*/
+QString ResuscitationProtocol::compile()
+{
+    QString reason = validate(adult);
+    if (!reason.isEmpty())
+        return reason;
+
+    reason = validate(pediatric);
+    if (!reason.isEmpty())
+        return "pediatric " + reason;
+
+    adultProgram = compileVariant(adult);
+    pediatricProgram = compileVariant(pediatric);
+    return QString();
+}
+
+/*
+    Function: validate()
+    Purpose: Checks that the settings of a variant are in range.
+    Inputs:
+        const ProtocolVariant &variant: The variant.
+    Outputs:
+        An empty string if they are, otherwise the setting that is not.
+*/
+QString ResuscitationProtocol::validate(const ProtocolVariant &variant)
+{
+    if (variant.analyzingTime < PROTOCOL_MIN_ANALYZING_TIME || variant.analyzingTime > PROTOCOL_MAX_ANALYZING_TIME)
+        return QString("analyzing must take from %1 to %2 ms").arg(PROTOCOL_MIN_ANALYZING_TIME).arg(PROTOCOL_MAX_ANALYZING_TIME);
+
+    if (variant.cprTime < PROTOCOL_MIN_CPR_TIME || variant.cprTime > PROTOCOL_MAX_CPR_TIME)
+        return QString("cpr must take from %1 to %2 ms").arg(PROTOCOL_MIN_CPR_TIME).arg(PROTOCOL_MAX_CPR_TIME);
+
+    if (variant.shocksPerCycle < 1 || variant.shocksPerCycle > PROTOCOL_MAX_SHOCKS_PER_CYCLE)
+        return QString("shocks must be from 1 to %1").arg(PROTOCOL_MAX_SHOCKS_PER_CYCLE);
+
+    if (variant.energies.isEmpty() || variant.energies.size() > PROTOCOL_MAX_ENERGY_LEVELS)
+        return QString("energies must have from 1 to %1 levels").arg(PROTOCOL_MAX_ENERGY_LEVELS);
+
+    for (int i = 0; i < variant.energies.size(); ++i)
+    {
+        if (variant.energies[i] > MAX_CHARGE_ENERGY)
+            return QString("energies must be at most %1 J").arg(MAX_CHARGE_ENERGY);
+        if (i > 0 && variant.energies[i] < variant.energies[i - 1])
+            return "energies must not decrease";
+    }
+
+    return QString();
+}
+
+/*
+    Function: compileVariant()
+    Purpose: Lays out the steps of a variant. After the self test and the pads, every
+             shock of a cycle has an analysis of its own, and CPR follows the last
+             shock, or the first analysis that advises none. CPR then repeats the cycle
+             until the analyses run out.
+    Inputs:
+        const ProtocolVariant &variant: A valid variant.
+    Outputs:
+        The program.
+*/
+ProtocolProgram ResuscitationProtocol::compileVariant(const ProtocolVariant &variant)
+{
+    ProtocolProgram program;
+    program.energies = variant.energies;
+
+    QVector<ProtocolStep> &steps = program.steps;
+    auto add = [&steps](ProtocolOp op, AEDState state = OFF, int time = 0)
+    {
+        steps.append(ProtocolStep{op, state, time, -1});
+        return steps.size() - 1;
+    };
+
+    add(PROTOCOL_SELF_TEST);
+    add(PROTOCOL_ATTACH_PADS);
+
+    int cycle = steps.size();
+    QVector<int> toCpr;
+    for (int shock = 0; shock < variant.shocksPerCycle; ++shock)
+    {
+        if (shock > 0)
+        {
+            toCpr.append(add(PROTOCOL_NEXT_SHOCK));
+        }
+
+        add(PROTOCOL_ANALYZE, ANALYZING, variant.analyzingTime);
+        add(PROTOCOL_CHECK_CONNECTION);
+        toCpr.append(add(PROTOCOL_UNLESS_SHOCK));
+        add(PROTOCOL_CHARGE);
+        add(PROTOCOL_PROMPT, STAND_CLEAR, SLEEP);
+        add(PROTOCOL_PROMPT, SHOCKING, SHOCKING_TIME);
+        add(PROTOCOL_SHOCK, SHOCK_DELIVERED, SLEEP);
+    }
+
+    int cpr = add(PROTOCOL_CPR, CPR, variant.cprTime);
+    add(PROTOCOL_PROMPT, STOP_CPR, SLEEP);
+    steps[add(PROTOCOL_REPEAT)].target = cycle;
+    add(PROTOCOL_END);
+
+    for (int step : toCpr)
+    {
+        steps[step].target = cpr;
+    }
+
+    return program;
+}
+
+/*
+    Function: ProtocolLibrary()
+    Purpose: Constructor. Starts with the built-in protocol.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+ProtocolLibrary::ProtocolLibrary()
+{
+    protocols.push_back(ResuscitationProtocol::builtin());
+}
+
+/*
+    Function: instance()
+    Purpose: Gets the process-wide library.
+    Inputs:
+        None
+    Outputs:
+        A pointer to the library.
+*/
+ProtocolLibrary *ProtocolLibrary::instance()
+{
+    static ProtocolLibrary library;
+    return &library;
+}
+
+/*
+    Function: add()
+    Purpose: Adds a protocol, for the devices to switch to by its index.
+    Inputs:
+        const ResuscitationProtocol &protocol: The protocol.
+    Outputs:
+        The index of the protocol, -1 if the name is already taken.
+*/
+int ProtocolLibrary::add(const ResuscitationProtocol &protocol)
+{
+    QMutexLocker locker(&mutex);
+    for (const ResuscitationProtocol &other : protocols)
+    {
+        if (other.getName() == protocol.getName())
+            return -1;
+    }
+
+    protocols.push_back(protocol);
+    return int(protocols.size()) - 1;
+}
+
+/*
+    Function: find()
+    Purpose: Finds a protocol by its name.
+    Inputs:
+        const QString &name: The name.
+    Outputs:
+        The index of the protocol, -1 if there is none with the name.
+*/
+int ProtocolLibrary::find(const QString &name) const
+{
+    QMutexLocker locker(&mutex);
+    for (std::size_t i = 0; i < protocols.size(); ++i)
+    {
+        if (protocols[i].getName() == name)
+            return int(i);
+    }
+
+    return -1;
+}
+
+/*
+    Function: at()
+    Purpose: Gets a protocol by its index.
+    Inputs:
+        int index: The index.
+    Outputs:
+        The protocol, null if there is none at the index.
+*/
+const ResuscitationProtocol *ProtocolLibrary::at(int index) const
+{
+    QMutexLocker locker(&mutex);
+    if (index < 0 || std::size_t(index) >= protocols.size())
+        return nullptr;
+
+    return &protocols[index];
+}
@@ -0,0 +1,129 @@
+#ifndef RESUSCITATIONPROTOCOL_H
+#define RESUSCITATIONPROTOCOL_H
+
+// Qt imports
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include <deque>
+
+// Local imports
+#include "defs.h"
+
+// Limits of the settings of a protocol definition, times in milliseconds. Energies
+// are at most MAX_CHARGE_ENERGY.
+#define PROTOCOL_MIN_ANALYZING_TIME 1000
+#define PROTOCOL_MAX_ANALYZING_TIME 30000
+#define PROTOCOL_MIN_CPR_TIME 1000
+#define PROTOCOL_MAX_CPR_TIME 300000
+#define PROTOCOL_MAX_SHOCKS_PER_CYCLE 3
+#define PROTOCOL_MAX_ENERGY_LEVELS 8
+
+// What a step of a protocol program does. Times are in milliseconds.
+enum ProtocolOp
+{
+    PROTOCOL_SELF_TEST,        // Run the self test.
+    PROTOCOL_ATTACH_PADS,      // Prompt for the pads until they are attached.
+    PROTOCOL_ANALYZE,          // Analyze for the time, then advise a shock or not. A healthy patient ends the session.
+    PROTOCOL_CHECK_CONNECTION, // Wait for the cable, if it was lost.
+    PROTOCOL_UNLESS_SHOCK,     // Go to the target if no shock was advised.
+    PROTOCOL_CHARGE,           // Check the battery and the pad contact, then charge for the next shock.
+    PROTOCOL_PROMPT,           // Enter the state for the time.
+    PROTOCOL_SHOCK,            // Deliver the shock, then wait for the time.
+    PROTOCOL_CPR,              // Prompt for CPR for the time.
+    PROTOCOL_NEXT_SHOCK,       // Count the analysis. Go to the target if it was the last one.
+    PROTOCOL_REPEAT,           // Count the analysis. Go to the target unless it was the last one.
+    PROTOCOL_END               // The protocol is over.
+};
+
+struct ProtocolStep
+{
+    ProtocolOp op;
+    AEDState state; // For PROTOCOL_PROMPT.
+    int time;
+    int target;     // Index of the step gone to.
+};
+
+// Settings of a protocol for one kind of pads. Times are in milliseconds.
+struct ProtocolVariant
+{
+    int analyzingTime = ANALYZING_TIME;
+    int cprTime = CPR_TIME;
+    int shocksPerCycle = 1;   // Shocks in a row, each after its own analysis, before CPR.
+    QVector<double> energies; // Nominal energy of each shock in joules, the last one repeated.
+};
+
+// A variant compiled into the steps the device runs, one after the other unless
+// a step goes elsewhere.
+struct ProtocolProgram
+{
+    QVector<ProtocolStep> steps;
+    QVector<double> energies;
+
+    // The nominal energy of a shock, escalating with every shock.
+    double energy(int shockIndex) const;
+
+    // The first step doing something, -1 if there is none.
+    int find(ProtocolOp op) const;
+};
+
+// A resuscitation protocol, defined as data and compiled into a flat program for
+// adult and for pediatric pads. The programs start with the same steps, up to the
+// pads being attached, where the device goes on with the program of the pads.
+class ResuscitationProtocol
+{
+public:
+    // The protocol the device has always followed: one shock per cycle, escalating
+    // through ADULT_SHOCK_ENERGIES, attenuated for pediatric pads.
+    static ResuscitationProtocol builtin();
+
+    // Reads the definitions of a file. Errors are reported with their line.
+    static bool load(const QString &fileName, QVector<ResuscitationProtocol> &protocols);
+
+    // Parses definitions, appending the protocols compiled from them.
+    static bool parse(const QString &text, QVector<ResuscitationProtocol> &protocols, QString &error);
+
+    const QString &getName() const;
+    const ProtocolProgram &getProgram(bool pediatric) const;
+
+private:
+    // Checks the settings of both variants and compiles them. Returns an empty string
+    // on success, otherwise what is wrong.
+    QString compile();
+    static QString validate(const ProtocolVariant &variant);
+    static ProtocolProgram compileVariant(const ProtocolVariant &variant);
+
+    QString name;
+    ProtocolVariant adult;
+    ProtocolVariant pediatric;
+    ProtocolProgram adultProgram;
+    ProtocolProgram pediatricProgram;
+};
+
+// The protocols the devices can run, by index, with the built-in one at 0.
+// Protocols are only ever added, so an index and the protocol it stands for stay
+// valid for the whole application.
+class ProtocolLibrary
+{
+public:
+    static ProtocolLibrary *instance();
+
+    // Returns the index of the protocol, -1 if one with its name was already added.
+    int add(const ResuscitationProtocol &protocol);
+
+    // Returns -1 if there is no protocol with the name.
+    int find(const QString &name) const;
+
+    // Returns null if there is no protocol at the index.
+    const ResuscitationProtocol *at(int index) const;
+
+private:
+    ProtocolLibrary();
+
+    // A deque, so that adding does not move the protocols already added.
+    std::deque<ResuscitationProtocol> protocols;
+    mutable QMutex mutex;
+};
+
+#endif
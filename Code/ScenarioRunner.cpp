@@ -0,0 +1,624 @@
+// IMPORTS
+#include "ScenarioRunner.h"
+#include "AED.h"
+
+#include "ProtocolRules.h"
+#include "ResuscitationProtocol.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QSemaphore>
+#include <QStringList>
+
+#include <memory>
+
+// Names of the heart conditions and inputs in scripts, in the order of their enums.
+static const char *const CONDITION_NAMES[] = {"sinus", "vf", "vt", "asystole"};
+static const char *const INPUT_NAMES[] = {"attach-pads", "detach-pads", "reconnect", "power-off",
+                                          "change-batteries", "reset", "lose-connection", "poor-contact"};
+
+/*
+    Function: parseName()
+    Purpose: Finds a name in a table of names.
+    Inputs:
+        const QString &name: The name.
+        const char *const (&names)[count]: The table.
+    Outputs:
+        The index of the name, -1 if it is not in the table.
+*/
+template <int count>
+static int parseName(const QString &name, const char *const (&names)[count])
+{
+    for (int i = 0; i < count; ++i)
+    {
+        if (name == names[i])
+            return i;
+    }
+
+    return -1;
+}
+
+/*
+    Function: parseState()
+    Purpose: Finds a device state by the name it has in reports.
+    Inputs:
+        const QString &name: The name, such as SHOCK_ADVISED.
+        AEDState &state: Set to the state.
+    Outputs:
+        True if the name is a state, false otherwise.
+*/
+static bool parseState(const QString &name, AEDState &state)
+{
+    for (int s = OFF; s <= CHECK_PADS; ++s)
+    {
+        if (name == aedStateName((AEDState)s))
+        {
+            state = (AEDState)s;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+    Function: parseSwitch()
+    Purpose: Reads an on or off argument.
+    Inputs:
+        const QString &word: The argument.
+        bool &value: Set to true for on and false for off.
+    Outputs:
+        True if the argument is on or off, false otherwise.
+*/
+static bool parseSwitch(const QString &word, bool &value)
+{
+    if (word != "on" && word != "off")
+        return false;
+
+    value = word == "on";
+    return true;
+}
+
+/*
+    Function: stateList()
+    Purpose: Formats a sequence of states for a report.
+    Inputs:
+        const QVector<AEDState> &states: The states.
+    Outputs:
+        The names of the states separated by spaces.
+*/
+static QString stateList(const QVector<AEDState> &states)
+{
+    QStringList names;
+    for (AEDState state : states)
+    {
+        names << aedStateName(state);
+    }
+
+    return names.join(' ');
+}
+
+/*
+    Function: ScenarioRunner()
+    Purpose: Constructor.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+ScenarioRunner::ScenarioRunner()
+    : device(nullptr), archive(nullptr)
+{
+}
+
+/*
+    Function: ~ScenarioRunner()
+    Purpose: Destructor. Deletes the device the scenarios ran on.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+ScenarioRunner::~ScenarioRunner()
+{
+    delete device;
+}
+
+/*
+    Function: load()
+    Purpose: Reads the scenarios of a script and adds them to the ones to run.
+    Inputs:
+        const QString &fileName: The script.
+    Outputs:
+        True if the script was read, false if it could not be opened or has an error.
+*/
+bool ScenarioRunner::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qCritical().noquote() << "Could not read the scenarios in" << fileName;
+        return false;
+    }
+
+    QString error;
+    if (!parse(QString::fromUtf8(file.readAll()), error))
+    {
+        qCritical().noquote() << QString("%1:%2").arg(fileName, error);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Function: parse()
+    Purpose: Parses a script. Each line is a command followed by its arguments, and
+             text after a # is ignored. A scenario starts with "scenario <name>" and
+             ends with "end"; the settings, inputs and expected states in between are
+             described in the README.
+    Inputs:
+        const QString &text: The script.
+        QString &error: Set to the line and the reason when the script has an error.
+    Outputs:
+        True if the script is valid, false otherwise.
+*/
+bool ScenarioRunner::parse(const QString &text, QString &error)
+{
+    const QStringList lines = text.split('\n');
+    Scenario scenario;
+    bool open = false;
+
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        QStringList words = lines[i].section('#', 0, 0).simplified().split(' ', Qt::SkipEmptyParts);
+        if (words.isEmpty())
+            continue;
+
+        auto fail = [&](const QString &reason)
+        {
+            error = QString("%1: %2").arg(i + 1).arg(reason);
+            return false;
+        };
+
+        const QString command = words.takeFirst();
+        if (command == "scenario")
+        {
+            if (open)
+                return fail("scenario \"" + scenario.name + "\" has no end");
+            if (words.isEmpty())
+                return fail("the scenario has no name");
+
+            scenario = Scenario();
+            scenario.name = words.join(' ');
+            scenario.line = i + 1;
+            open = true;
+            continue;
+        }
+
+        if (!open)
+            return fail("\"" + command + "\" outside of a scenario");
+
+        bool ok = true;
+        if (command == "end")
+        {
+            if (scenario.expected.isEmpty())
+                return fail("scenario \"" + scenario.name + "\" expects no states");
+
+            scenarios.append(scenario);
+            open = false;
+        }
+        else if (command == "seed" && words.size() == 1)
+        {
+            scenario.seed = words[0].toUInt(&ok);
+        }
+        else if (command == "protocol" && words.size() == 1)
+        {
+            if (ProtocolLibrary::instance()->find(words[0]) < 0)
+                return fail("unknown protocol \"" + words[0] + "\"");
+            scenario.protocol = words[0];
+        }
+        else if (command == "condition" && words.size() == 1)
+        {
+            int condition = parseName(words[0], CONDITION_NAMES);
+            ok = condition >= 0;
+            scenario.condition = (HeartState)condition;
+        }
+        else if (command == "shocks" && words.size() == 1)
+        {
+            scenario.shocks = words[0].toInt(&ok);
+            ok = ok && scenario.shocks >= 0;
+        }
+        else if (command == "pads" && words.size() == 1)
+        {
+            ok = words[0] == "attached" || words[0] == "detached";
+            scenario.padsAttached = words[0] == "attached";
+        }
+        else if (command == "battery" && words.size() == 3)
+        {
+            bool levelOk, perShockOk, idleOk;
+            scenario.batteryLevel = words[0].toInt(&levelOk);
+            scenario.batteryUnitsPerShock = words[1].toInt(&perShockOk);
+            scenario.batteryUnitsWhenIdle = words[2].toInt(&idleOk);
+            ok = levelOk && perShockOk && idleOk;
+        }
+        else if (command == "poor-contact" && words.size() == 1)
+        {
+            ok = parseSwitch(words[0], scenario.poorContact);
+        }
+        else if (command == "lose-connection" && words.size() == 1)
+        {
+            ok = parseSwitch(words[0], scenario.loseConnection);
+        }
+        else if (command == "start-with-asystole" && words.size() == 1)
+        {
+            ok = parseSwitch(words[0], scenario.startWithAsystole);
+        }
+        else if (command == "physiology" && words.size() == 1)
+        {
+            ok = parseSwitch(words[0], scenario.physiologyModel);
+        }
+        else if (command == "on" && words.size() >= 2)
+        {
+            // on <STATE> [<occurrence>|every] <input> [on|off]
+            ScenarioAction action;
+            action.occurrence = 1;
+            action.enabled = true;
+            if (!parseState(words.takeFirst(), action.state))
+                return fail("unknown state in \"" + lines[i].trimmed() + "\"");
+
+            if (!words.isEmpty() && words[0] == "every")
+            {
+                words.removeFirst();
+                action.occurrence = 0;
+            }
+            else if (!words.isEmpty() && words[0][0].isDigit())
+            {
+                action.occurrence = words.takeFirst().toInt(&ok);
+                ok = ok && action.occurrence > 0;
+            }
+
+            int input = words.isEmpty() ? -1 : parseName(words.takeFirst(), INPUT_NAMES);
+            ok = ok && input >= 0;
+            if (ok)
+            {
+                action.input = (ScenarioInput)input;
+
+                bool takesSwitch = action.input == INPUT_LOSE_CONNECTION || action.input == INPUT_POOR_CONTACT;
+                ok = takesSwitch ? words.size() == 1 && parseSwitch(words[0], action.enabled) : words.isEmpty();
+            }
+            scenario.actions.append(action);
+        }
+        else if (command == "expect" && !words.isEmpty())
+        {
+            for (const QString &word : words)
+            {
+                AEDState state;
+                if (!parseState(word, state))
+                    return fail("unknown state \"" + word + "\"");
+                scenario.expected.append(state);
+            }
+        }
+        else
+        {
+            ok = false;
+        }
+
+        if (!ok)
+            return fail("cannot read \"" + lines[i].trimmed() + "\"");
+    }
+
+    if (open)
+    {
+        error = QString("%1: scenario \"%2\" has no end").arg(scenario.line).arg(scenario.name);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Function: run()
+    Purpose: Runs every scenario loaded, one after the other on the same device.
+    Inputs:
+        None
+    Outputs:
+        The number of scenarios that failed.
+*/
+int ScenarioRunner::run()
+{
+    if (device == nullptr)
+    {
+        device = new AED();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int failed = 0;
+    for (const Scenario &scenario : scenarios)
+    {
+        if (!runScenario(scenario))
+        {
+            failed++;
+        }
+    }
+
+    qInfo().noquote() << QString("Scenarios: %1 passed, %2 failed in %3 ms")
+                             .arg(scenarios.size() - failed).arg(failed).arg(timer.nsecsElapsed() / 1e6, 0, 'f', 1);
+    return failed;
+}
+
+/*
+    Function: setArchive()
+    Purpose: Sets the archive the sessions of the scenarios are appended to.
+    Inputs:
+        SessionArchive *archive: The archive, or null to not archive them.
+    Outputs:
+        None
+*/
+void ScenarioRunner::setArchive(SessionArchive *archive)
+{
+    this->archive = archive;
+}
+
+/*
+    Function: runScenario()
+    Purpose: Runs one session of a scenario and compares the states the device went
+             through with the expected ones.
+    Inputs:
+        const Scenario &scenario: The scenario.
+    Outputs:
+        True if the device followed the protocol through exactly the expected states, false otherwise.
+*/
+bool ScenarioRunner::runScenario(const Scenario &scenario)
+{
+    device->setArchive(archive, scenario.name);
+    ScenarioResult result = play(device, scenario, SCENARIO_TIMEOUT);
+    const QVector<AEDState> &states = result.states;
+
+    if (!result.failed() && states == scenario.expected)
+    {
+        qInfo().noquote() << QString("PASS %1: %2 states, %3 s of device time in %4 ms")
+                                 .arg(scenario.name).arg(states.size()).arg(result.simulatedSeconds, 0, 'f', 1).arg(result.wallMs, 0, 'f', 2);
+        return true;
+    }
+
+    int mismatch = 0;
+    while (mismatch < states.size() && mismatch < scenario.expected.size() && states[mismatch] == scenario.expected[mismatch])
+    {
+        mismatch++;
+    }
+
+    QString reason;
+    if (result.deadlocked)
+    {
+        reason = "powering off did not end the session";
+    }
+    else if (result.timedOut)
+    {
+        reason = QString("still waiting on the operator after %1 ms, powered off").arg(SCENARIO_TIMEOUT);
+    }
+    else if (!result.violation.isEmpty())
+    {
+        reason = result.violation;
+    }
+    else
+    {
+        reason = QString("state %1 is %2, expected %3").arg(mismatch + 1)
+                     .arg(QString(mismatch < states.size() ? aedStateName(states[mismatch]) : "missing"))
+                     .arg(QString(mismatch < scenario.expected.size() ? aedStateName(scenario.expected[mismatch]) : "none"));
+    }
+
+    qInfo().noquote() << QString("FAIL %1 (line %2): %3").arg(scenario.name).arg(scenario.line).arg(reason);
+    qInfo().noquote() << "  expected:" << stateList(scenario.expected);
+    qInfo().noquote() << "  actual:  " << stateList(states);
+
+    return false;
+}
+
+/*
+    Function: play()
+    Purpose: Runs one session of a scenario on a simulated clock. Inputs are given from
+             the device thread, as soon as the device reports the state they are given at,
+             so the session is the same every time. The states are then checked against
+             the protocol.
+    Inputs:
+        AED *&device: A device that is off. Replaced by a new device if it deadlocks.
+        const Scenario &scenario: The scenario.
+        int timeout: The time in milliseconds to wait for the session, and then for the power off.
+        const std::function<void(const AED *, AEDState)> &observe: Called with every state reported, may be null.
+    Outputs:
+        The states reported and how the session ended.
+*/
+ScenarioResult ScenarioRunner::play(AED *&device, const Scenario &scenario, int timeout,
+                                    const std::function<void(const AED *, AEDState)> &observe)
+{
+    configure(device, scenario);
+
+    // Written on the device thread, read here once it is done with them.
+    ScenarioResult result;
+    QVector<int> powerOffs;
+    QMap<AEDState, int> occurrences;
+    AED *target = device;
+    QMetaObject::Connection connection = QObject::connect(device, &AED::updateGUI, device, [&, target](int value)
+    {
+        AEDState state = (AEDState)value;
+        result.states.append(state);
+        if (observe)
+        {
+            observe(target, state);
+        }
+
+        // A session stuck in a loop, such as checking pads that are never fixed, is powered off.
+        if (result.states.size() == SCENARIO_MAX_STEPS)
+        {
+            target->powerOff();
+            return;
+        }
+
+        int occurrence = ++occurrences[state];
+        for (const ScenarioAction &action : scenario.actions)
+        {
+            if (action.state == state && (action.occurrence == 0 || action.occurrence == occurrence))
+            {
+                if (action.input == INPUT_POWER_OFF)
+                {
+                    powerOffs.append(result.states.size());
+                }
+                give(target, action.input, action.enabled);
+            }
+        }
+    }, Qt::DirectConnection);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Shared with the device thread, which may outlive this call if it deadlocks.
+    std::shared_ptr<QSemaphore> finished(new QSemaphore);
+    device->send(DeviceCommand(COMMAND_POWER_ON));
+
+    // Queued behind the drain that powers on, so it runs once the session is over.
+    QMetaObject::invokeMethod(device, [finished]()
+                              { finished->release(); }, Qt::QueuedConnection);
+
+    // Only a wait on the operator takes real time. Powering off ends it.
+    result.timedOut = !finished->tryAcquire(1, timeout);
+    if (result.timedOut)
+    {
+        device->powerOff();
+        result.deadlocked = !finished->tryAcquire(1, timeout);
+    }
+
+    result.wallMs = timer.nsecsElapsed() / 1e6;
+    QObject::disconnect(connection);
+
+    if (result.deadlocked)
+    {
+        // The thread of the device is stuck, leave it be and carry on with a new device.
+        qWarning().noquote() << "Scenario" << scenario.name << "deadlocked its device";
+        device = new AED();
+        return result;
+    }
+
+    QVector<TransitionTiming> timings = device->getTransitionTimings();
+    result.simulatedSeconds = timings.isEmpty() ? 0.0 : timings.last().actualNs / 1e9;
+    result.violation = ProtocolRules::check(result.states, powerOffs);
+
+    return result;
+}
+
+/*
+    Function: configure()
+    Purpose: Applies the configuration of a scenario. The device thread is idle, and
+             posting powerOn afterwards makes the settings visible to it.
+    Inputs:
+        AED *device: A device that is off.
+        const Scenario &scenario: The scenario.
+    Outputs:
+        None
+*/
+void ScenarioRunner::configure(AED *device, const Scenario &scenario)
+{
+    device->setState(OFF);
+    device->setSimulatedClock(true);
+    device->setSeed(scenario.seed);
+    device->setProtocol(ProtocolLibrary::instance()->find(scenario.protocol));
+    device->setBatterySpecs(scenario.batteryLevel, scenario.batteryUnitsPerShock, scenario.batteryUnitsWhenIdle);
+    device->setPatientHeartCondition(scenario.condition);
+    device->setShockUntilHealthy(scenario.shocks);
+    device->setStartWithAsystole(scenario.startWithAsystole);
+    device->setPadsAttached(scenario.padsAttached);
+    device->setLostConnection(scenario.loseConnection);
+    device->setSimulatePoorContact(scenario.poorContact);
+    device->setPhysiologyModel(scenario.physiologyModel);
+}
+
+/*
+    Function: give()
+    Purpose: Gives an operator input to the device, the way the main window does.
+    Inputs:
+        AED *device: The device.
+        ScenarioInput input: The input.
+        bool enabled: For the inputs turning a simulation on or off.
+    Outputs:
+        None
+*/
+void ScenarioRunner::give(AED *device, ScenarioInput input, bool enabled)
+{
+    switch (input)
+    {
+    case INPUT_ATTACH_PADS:
+        device->notifyPadsAttached();
+        break;
+    case INPUT_DETACH_PADS:
+        device->setPadsAttached(false);
+        break;
+    case INPUT_RECONNECT:
+        device->setLostConnection(false);
+        device->notifyReconnection();
+        break;
+    case INPUT_POWER_OFF:
+        device->powerOff();
+        break;
+    case INPUT_CHANGE_BATTERIES:
+        device->changeBatteries();
+        break;
+    case INPUT_RESET:
+        device->setState(OFF);
+        break;
+    case INPUT_LOSE_CONNECTION:
+        device->setLostConnection(enabled);
+        break;
+    case INPUT_POOR_CONTACT:
+        device->setSimulatePoorContact(enabled);
+        break;
+    }
+}
+
+/*
+    Function: format()
+    Purpose: Writes a scenario as a script. Settings left at their defaults are written too,
+             so that the script does not depend on them.
+    Inputs:
+        const Scenario &scenario: The scenario.
+    Outputs:
+        The script, from "scenario" to "end".
+*/
+QString ScenarioRunner::format(const Scenario &scenario)
+{
+    auto onOff = [](bool value)
+    {
+        return QString(value ? "on" : "off");
+    };
+
+    QString text;
+    text += "scenario " + scenario.name + "\n";
+    text += QString("seed %1\n").arg(scenario.seed);
+    text += "protocol " + scenario.protocol + "\n";
+    text += QString("condition %1\n").arg(CONDITION_NAMES[scenario.condition]);
+    text += QString("shocks %1\n").arg(scenario.shocks);
+    text += QString("pads %1\n").arg(scenario.padsAttached ? "attached" : "detached");
+    text += QString("battery %1 %2 %3\n").arg(scenario.batteryLevel).arg(scenario.batteryUnitsPerShock).arg(scenario.batteryUnitsWhenIdle);
+    text += "poor-contact " + onOff(scenario.poorContact) + "\n";
+    text += "lose-connection " + onOff(scenario.loseConnection) + "\n";
+    text += "start-with-asystole " + onOff(scenario.startWithAsystole) + "\n";
+    text += "physiology " + onOff(scenario.physiologyModel) + "\n";
+
+    for (const ScenarioAction &action : scenario.actions)
+    {
+        QString occurrence = action.occurrence == 0 ? QString("every") : QString::number(action.occurrence);
+        text += QString("on %1 %2 %3").arg(aedStateName(action.state), occurrence, INPUT_NAMES[action.input]);
+        if (action.input == INPUT_LOSE_CONNECTION || action.input == INPUT_POOR_CONTACT)
+        {
+            text += " " + onOff(action.enabled);
+        }
+        text += "\n";
+    }
+
+    text += "expect " + stateList(scenario.expected) + "\n";
+    text += "end\n";
+    return text;
+}
@@ -0,0 +1,120 @@
+#ifndef SCENARIORUNNER_H
+#define SCENARIORUNNER_H
+
+// Qt imports
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+// Local imports
+#include "defs.h"
+
+// Scripted scenarios. A session waiting on an input that never comes is powered off after the timeout.
+#define SCENARIO_TIMEOUT 10000
+#define SCENARIO_MAX_STEPS 10000
+
+class AED;
+class SessionArchive;
+
+// Operator inputs a scenario can give.
+enum ScenarioInput
+{
+    INPUT_ATTACH_PADS,      // Attach the pads and notify the device.
+    INPUT_DETACH_PADS,      // Take the pads off the patient.
+    INPUT_RECONNECT,        // Plug the cable back in.
+    INPUT_POWER_OFF,        // Press the power button.
+    INPUT_CHANGE_BATTERIES, // Swap in a full battery.
+    INPUT_RESET,            // Set the device to OFF, as the main window does once a session is over.
+    INPUT_LOSE_CONNECTION,  // Turn simulated connection loss on or off.
+    INPUT_POOR_CONTACT      // Turn simulated poor pad contact on or off.
+};
+
+// An input given when the device enters a state for the given time.
+struct ScenarioAction
+{
+    AEDState state;
+    int occurrence; // 1 for the first time the state is entered, 0 for every time.
+    ScenarioInput input;
+    bool enabled;   // For the inputs turning a simulation on or off.
+};
+
+// A device configuration, the inputs given during the session and the states
+// the device is expected to go through.
+struct Scenario
+{
+    QString name;
+    int line = 0;
+    quint32 seed = 1;
+    QString protocol = DEFAULT_PROTOCOL_NAME;
+    HeartState condition = VENTRICULAR_FIBRILLATION;
+    int shocks = 1;
+    bool padsAttached = true;
+    int batteryLevel = MAX_BATTERY_LEVEL;
+    int batteryUnitsPerShock = 5;
+    int batteryUnitsWhenIdle = 1;
+    bool poorContact = false;
+    bool loseConnection = false;
+    bool startWithAsystole = false;
+    bool physiologyModel = false;
+    QVector<ScenarioAction> actions;
+    QVector<AEDState> expected;
+};
+
+// What the device did in a session of a scenario.
+struct ScenarioResult
+{
+    QVector<AEDState> states;
+    bool timedOut = false;   // Still waiting on the operator after the timeout, and powered off.
+    bool deadlocked = false; // Powering off did not end it either. The device was abandoned.
+    QString violation;       // How the session departed from the protocol, empty if it did not.
+    double wallMs = 0.0;
+    double simulatedSeconds = 0.0;
+
+    bool failed() const { return timedOut || deadlocked || !violation.isEmpty(); }
+};
+
+// Runs scripted sessions end to end through the device protocol, on a simulated
+// clock and with seeded randomness, and checks the exact sequence of states the
+// device reports. A whole session takes as long as its steps take to compute.
+class ScenarioRunner
+{
+public:
+    ScenarioRunner();
+    ~ScenarioRunner();
+
+    // Reads the scenarios of a script. Errors are reported with their line.
+    bool load(const QString &fileName);
+
+    // Runs every scenario loaded and reports each of them. Returns the number that failed.
+    int run();
+
+    // Appends the session of every scenario run to the archive, under the name of the scenario.
+    void setArchive(SessionArchive *archive);
+
+    // Runs one session of a scenario on a device that is off. A device that
+    // deadlocks is replaced by a new one. The observer is called on the device
+    // thread with every state reported, before the inputs given at it.
+    static ScenarioResult play(AED *&device, const Scenario &scenario, int timeout,
+                               const std::function<void(const AED *, AEDState)> &observe = nullptr);
+
+    // Applies the configuration of a scenario to a device that is off.
+    static void configure(AED *device, const Scenario &scenario);
+
+    // Gives an input the way the main window does. Can be called from any thread.
+    static void give(AED *device, ScenarioInput input, bool enabled);
+
+    // The scenario as a script that load() reads back.
+    static QString format(const Scenario &scenario);
+
+private:
+    bool parse(const QString &text, QString &error);
+    bool runScenario(const Scenario &scenario);
+
+    // Created on the first run and reused until the runner is destroyed.
+    AED *device;
+    SessionArchive *archive;
+    QVector<Scenario> scenarios;
+};
+
+#endif
@@ -0,0 +1,528 @@
+// IMPORTS
+#include "SessionArchive.h"
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutexLocker>
+#include <QtEndian>
+
+#include <climits>
+
+/*
+    Function: put()
+    Purpose: Appends a value in little endian.
+    Inputs:
+        QByteArray &out: Where the value is appended.
+        T value: The value.
+    Outputs:
+        None
+*/
+template <typename T>
+static void put(QByteArray &out, T value)
+{
+    T little = qToLittleEndian(value);
+    out.append(reinterpret_cast<const char *>(&little), sizeof(T));
+}
+
+/*
+    Function: putColumn()
+    Purpose: Appends a column, with a value of every session.
+    Inputs:
+        QByteArray &out: Where the column is appended.
+        const QVector<ArchivedSession> &sessions: The sessions.
+        F value: Gets the value of a session.
+    Outputs:
+        None
+*/
+template <typename T, typename F>
+static void putColumn(QByteArray &out, const QVector<ArchivedSession> &sessions, F value)
+{
+    for (const ArchivedSession &session : sessions)
+    {
+        put<T>(out, T(value(session)));
+    }
+}
+
+/*
+    Function: sessionEvents()
+    Purpose: Counts the events of a session that have both a state and a time.
+    Inputs:
+        const ArchivedSession &session: The session.
+    Outputs:
+        The number of events.
+*/
+static int sessionEvents(const ArchivedSession &session)
+{
+    return qMin(session.states.size(), session.timesMs.size());
+}
+
+/*
+    Function: putNames()
+    Purpose: Appends the names a column indexes, each with its length.
+    Inputs:
+        QByteArray &out: Where the names are appended.
+        const QStringList &names: The names.
+    Outputs:
+        None
+*/
+static void putNames(QByteArray &out, const QStringList &names)
+{
+    put<quint16>(out, quint16(names.size()));
+    for (const QString &name : names)
+    {
+        QByteArray utf8 = name.toUtf8().left(0xffff);
+        put<quint16>(out, quint16(utf8.size()));
+        out.append(utf8);
+    }
+}
+
+/*
+    Function: take()
+    Purpose: Takes the next bytes of a mapped file.
+    Inputs:
+        const uchar *data: The file.
+        qint64 size: The size of the file.
+        qint64 &offset: Where the bytes start. Moved past them.
+        qint64 bytes: How many bytes.
+    Outputs:
+        The bytes, null if the file ends before them.
+*/
+static const uchar *take(const uchar *data, qint64 size, qint64 &offset, qint64 bytes)
+{
+    if (bytes < 0 || size - offset < bytes)
+        return nullptr;
+
+    const uchar *at = data + offset;
+    offset += bytes;
+    return at;
+}
+
+/*
+    Function: takeNames()
+    Purpose: Takes the names a column indexes.
+    Inputs:
+        const uchar *data: The file.
+        qint64 size: The size of the file.
+        qint64 &offset: Where the names start. Moved past them.
+        QStringList &names: Set to the names.
+    Outputs:
+        False if the file ends before the names, true otherwise.
+*/
+static bool takeNames(const uchar *data, qint64 size, qint64 &offset, QStringList &names)
+{
+    const uchar *count = take(data, size, offset, sizeof(quint16));
+    if (count == nullptr)
+        return false;
+
+    for (int i = 0; i < qFromLittleEndian<quint16>(count); ++i)
+    {
+        const uchar *length = take(data, size, offset, sizeof(quint16));
+        if (length == nullptr)
+            return false;
+
+        const uchar *name = take(data, size, offset, qFromLittleEndian<quint16>(length));
+        if (name == nullptr)
+            return false;
+
+        names.append(QString::fromUtf8(reinterpret_cast<const char *>(name), qFromLittleEndian<quint16>(length)));
+    }
+
+    return true;
+}
+
+/*
+    Function: takeSegment()
+    Purpose: Finds the columns of the next segment of a mapped file, and checks that
+             every session's events are within the segment.
+    Inputs:
+        const uchar *data: The file.
+        qint64 size: The size of the file.
+        qint64 &offset: Where the segment starts. Moved past it.
+        ArchiveSegment &segment: Set to the segment.
+    Outputs:
+        False if the segment is cut short or inconsistent, true otherwise.
+*/
+static bool takeSegment(const uchar *data, qint64 size, qint64 &offset, ArchiveSegment &segment)
+{
+    const uchar *counts = take(data, size, offset, 2 * sizeof(quint32));
+    if (counts == nullptr)
+        return false;
+
+    qint64 sessions = qFromLittleEndian<quint32>(counts);
+    qint64 events = qFromLittleEndian<quint32>(counts + sizeof(quint32));
+    if (sessions > ARCHIVE_SEGMENT_SESSIONS || events > INT_MAX)
+        return false;
+
+    segment.sessions = int(sessions);
+    segment.events = int(events);
+    if (!takeNames(data, size, offset, segment.scenarios) || !takeNames(data, size, offset, segment.protocols))
+        return false;
+
+    // In the order they are written. A failed take does not move the offset, so a later,
+    // smaller column could still fit: the segment ends at the first column cut short.
+    const struct
+    {
+        const uchar **column;
+        qint64 bytes;
+    } columns[] = {
+        {&segment.startMsColumn, sessions * qint64(sizeof(qint64))},
+        {&segment.durationMsColumn, sessions * qint64(sizeof(quint32))},
+        {&segment.eventEndColumn, sessions * qint64(sizeof(quint32))},
+        {&segment.scenarioColumn, sessions * qint64(sizeof(quint16))},
+        {&segment.protocolColumn, sessions * qint64(sizeof(quint16))},
+        {&segment.conditionColumn, sessions},
+        {&segment.finalConditionColumn, sessions},
+        {&segment.shocksColumn, sessions * qint64(sizeof(quint16))},
+        {&segment.batteryColumn, sessions},
+        {&segment.stateColumn, events},
+        {&segment.timeMsColumn, events * qint64(sizeof(quint32))}};
+
+    for (const auto &column : columns)
+    {
+        *column.column = take(data, size, offset, column.bytes);
+        if (*column.column == nullptr)
+            return false;
+    }
+
+    // Queries trust the event ranges, so they are checked once here.
+    int end = 0;
+    for (int i = 0; i < segment.sessions; ++i)
+    {
+        if (segment.eventEnd(i) < end || segment.eventEnd(i) > segment.events)
+            return false;
+        end = segment.eventEnd(i);
+    }
+
+    return end == segment.events;
+}
+
+/*
+    Function: SessionArchive()
+    Purpose: Constructor. Makes an archive with no file, dropping the sessions appended.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+SessionArchive::SessionArchive()
+{
+}
+
+/*
+    Function: ~SessionArchive()
+    Purpose: Destructor. Writes the sessions buffered.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+SessionArchive::~SessionArchive()
+{
+    flush();
+}
+
+/*
+    Function: open()
+    Purpose: Opens a file to append sessions to. A new file gets the header, and an
+             existing one loses a segment cut short at its end, so that the segments
+             appended after it can be read.
+    Inputs:
+        const QString &fileName: The file.
+    Outputs:
+        False if the file cannot be written or is not an archive, true otherwise.
+*/
+bool SessionArchive::open(const QString &fileName)
+{
+    QMutexLocker locker(&mutex);
+
+    // An empty file is written from the start, like a new one.
+    qint64 end = 0;
+    if (QFileInfo(fileName).size() > 0)
+    {
+        ArchiveReader reader;
+        if (!reader.open(fileName))
+            return false;
+        end = reader.validSize();
+    }
+
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadWrite))
+    {
+        qWarning().noquote() << "Could not open the session archive" << fileName;
+        return false;
+    }
+
+    if (end == 0)
+    {
+        QByteArray header;
+        put<quint32>(header, ARCHIVE_MAGIC);
+        put<quint32>(header, ARCHIVE_VERSION);
+        end = header.size();
+        if (file.write(header) != end)
+        {
+            qWarning().noquote() << "Could not write the session archive" << fileName;
+            file.close();
+            return false;
+        }
+    }
+
+    if (!file.resize(end) || !file.seek(end))
+    {
+        qWarning().noquote() << "Could not append to the session archive" << fileName;
+        file.close();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Function: append()
+    Purpose: Buffers a session, writing a segment once there are enough of them.
+             Can be called from any thread.
+    Inputs:
+        const ArchivedSession &session: The session.
+    Outputs:
+        None
+*/
+void SessionArchive::append(const ArchivedSession &session)
+{
+    QMutexLocker locker(&mutex);
+    if (!file.isOpen())
+        return;
+
+    pending.append(session);
+    if (pending.size() >= ARCHIVE_SEGMENT_SESSIONS)
+    {
+        writeSegment();
+    }
+}
+
+/*
+    Function: flush()
+    Purpose: Writes the sessions buffered as a segment, however few there are.
+    Inputs:
+        None
+    Outputs:
+        False if the segment could not be written, true otherwise.
+*/
+bool SessionArchive::flush()
+{
+    QMutexLocker locker(&mutex);
+    return writeSegment();
+}
+
+/*
+    Function: writeSegment()
+    Purpose: Writes the sessions buffered as a segment, one column after the other,
+             in a single write. Called with the mutex held.
+    Inputs:
+        None
+    Outputs:
+        False if the segment could not be written, true otherwise.
+*/
+bool SessionArchive::writeSegment()
+{
+    if (pending.isEmpty() || !file.isOpen())
+        return true;
+
+    // The names of a segment, in the order first seen.
+    QStringList scenarios;
+    QStringList protocols;
+    QHash<QString, int> scenarioIndexes;
+    QHash<QString, int> protocolIndexes;
+    QVector<quint16> scenarioColumn;
+    QVector<quint16> protocolColumn;
+    quint32 events = 0;
+    for (const ArchivedSession &session : pending)
+    {
+        if (!scenarioIndexes.contains(session.scenario))
+        {
+            scenarioIndexes.insert(session.scenario, scenarios.size());
+            scenarios.append(session.scenario);
+        }
+        if (!protocolIndexes.contains(session.protocol))
+        {
+            protocolIndexes.insert(session.protocol, protocols.size());
+            protocols.append(session.protocol);
+        }
+        scenarioColumn.append(quint16(scenarioIndexes.value(session.scenario)));
+        protocolColumn.append(quint16(protocolIndexes.value(session.protocol)));
+        events += quint32(sessionEvents(session));
+    }
+
+    QByteArray segment;
+    put<quint32>(segment, quint32(pending.size()));
+    put<quint32>(segment, events);
+    putNames(segment, scenarios);
+    putNames(segment, protocols);
+
+    putColumn<qint64>(segment, pending, [](const ArchivedSession &session)
+                      { return session.startMs; });
+    putColumn<quint32>(segment, pending, [](const ArchivedSession &session)
+                       { return session.durationMs; });
+
+    quint32 eventEnd = 0;
+    putColumn<quint32>(segment, pending, [&eventEnd](const ArchivedSession &session)
+                       { return eventEnd += quint32(sessionEvents(session)); });
+
+    for (quint16 index : scenarioColumn)
+    {
+        put<quint16>(segment, index);
+    }
+    for (quint16 index : protocolColumn)
+    {
+        put<quint16>(segment, index);
+    }
+
+    putColumn<quint8>(segment, pending, [](const ArchivedSession &session)
+                      { return quint8(session.condition); });
+    putColumn<quint8>(segment, pending, [](const ArchivedSession &session)
+                      { return quint8(session.finalCondition); });
+    putColumn<quint16>(segment, pending, [](const ArchivedSession &session)
+                       { return quint16(qBound(0, session.shocks, 0xffff)); });
+    putColumn<quint8>(segment, pending, [](const ArchivedSession &session)
+                      { return quint8(qBound(0, session.batteryLevel, 0xff)); });
+
+    for (const ArchivedSession &session : pending)
+    {
+        for (int i = 0; i < sessionEvents(session); ++i)
+        {
+            put<quint8>(segment, quint8(session.states[i]));
+        }
+    }
+    for (const ArchivedSession &session : pending)
+    {
+        for (int i = 0; i < sessionEvents(session); ++i)
+        {
+            put<quint32>(segment, session.timesMs[i]);
+        }
+    }
+
+    pending.clear();
+    if (file.write(segment) != segment.size() || !file.flush())
+    {
+        qWarning().noquote() << "Could not write sessions to the archive" << file.fileName();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Function: open()
+    Purpose: Maps an archive and finds the columns of every segment.
+    Inputs:
+        const QString &fileName: The file.
+    Outputs:
+        False if the file cannot be read or is not an archive, true otherwise.
+*/
+bool ArchiveReader::open(const QString &fileName)
+{
+    segments.clear();
+    end = 0;
+
+    file.reset(new QFile(fileName));
+    if (!file->open(QIODevice::ReadOnly))
+    {
+        qWarning().noquote() << "Could not open the session archive" << fileName;
+        return false;
+    }
+
+    qint64 size = file->size();
+    const uchar *data = size >= 2 * qint64(sizeof(quint32)) ? file->map(0, size) : nullptr;
+    if (data == nullptr || qFromLittleEndian<quint32>(data) != ARCHIVE_MAGIC)
+    {
+        qWarning().noquote() << "Not a session archive:" << fileName;
+        return false;
+    }
+
+    quint32 version = qFromLittleEndian<quint32>(data + sizeof(quint32));
+    if (version != ARCHIVE_VERSION)
+    {
+        qWarning().noquote() << QString("The session archive %1 is version %2, only version %3 is read")
+                                    .arg(fileName).arg(version).arg(ARCHIVE_VERSION);
+        return false;
+    }
+
+    qint64 offset = 2 * sizeof(quint32);
+    end = offset;
+    while (offset < size)
+    {
+        ArchiveSegment segment;
+        if (!takeSegment(data, size, offset, segment))
+        {
+            qWarning().noquote() << QString("The session archive %1 is cut short after %2 segments")
+                                        .arg(fileName).arg(segments.size());
+            break;
+        }
+
+        segments.append(segment);
+        end = offset;
+    }
+
+    return true;
+}
+
+/*
+    Function: getSegments()
+    Purpose: Gets the segments of the archive.
+    Inputs:
+        None
+    Outputs:
+        The segments, in the order they were written.
+*/
+const QVector<ArchiveSegment> &ArchiveReader::getSegments() const
+{
+    return segments;
+}
+
+/*
+    Function: validSize()
+    Purpose: Gets where the last whole segment ends.
+    Inputs:
+        None
+    Outputs:
+        The size in bytes of the archive, without a segment cut short.
+*/
+qint64 ArchiveReader::validSize() const
+{
+    return end;
+}
+
+/*
+    Function: sessionCount()
+    Purpose: Counts the sessions of every segment.
+    Inputs:
+        None
+    Outputs:
+        The number of sessions.
+*/
+qint64 ArchiveReader::sessionCount() const
+{
+    qint64 count = 0;
+    for (const ArchiveSegment &segment : segments)
+    {
+        count += segment.sessions;
+    }
+    return count;
+}
+
+/*
+    Function: eventCount()
+    Purpose: Counts the events of every segment.
+    Inputs:
+        None
+    Outputs:
+        The number of events.
+*/
+qint64 ArchiveReader::eventCount() const
+{
+    qint64 count = 0;
+    for (const ArchiveSegment &segment : segments)
+    {
+        count += segment.events;
+    }
+    return count;
+}
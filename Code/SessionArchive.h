@@ -0,0 +1,124 @@
+#ifndef SESSIONARCHIVE_H
+#define SESSIONARCHIVE_H
+
+// Qt imports
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtEndian>
+
+#include <memory>
+
+// Local imports
+#include "defs.h"
+
+// Session archive, "AEDA" followed by the layout version. Sessions are written in segments.
+#define ARCHIVE_MAGIC 0x41454441
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_SEGMENT_SESSIONS 4096
+
+// A session as archived: what it was run with, how it ended, and the state it
+// entered at every transition. Times are in milliseconds since power on.
+struct ArchivedSession
+{
+    qint64 startMs = 0;      // Wall clock time of the power on, since the epoch.
+    quint32 durationMs = 0;
+    QString scenario;        // What the session was run for, such as the name of a scripted scenario.
+    QString protocol;
+    HeartState condition = SINUS_RHYTHM;      // At power on.
+    HeartState finalCondition = SINUS_RHYTHM;
+    int shocks = 0;
+    int batteryLevel = 0;    // At the end of the session.
+    QVector<AEDState> states;
+    QVector<quint32> timesMs;
+};
+
+// The sessions of a segment, one column after the other, as they are laid out in
+// the archive. Values are little endian, and read where they are.
+struct ArchiveSegment
+{
+    int sessions = 0;
+    int events = 0;
+
+    // The names the scenario and protocol columns index.
+    QStringList scenarios;
+    QStringList protocols;
+
+    const uchar *startMsColumn = nullptr;
+    const uchar *durationMsColumn = nullptr;
+    const uchar *eventEndColumn = nullptr; // Where the events of each session end, the next ones start.
+    const uchar *scenarioColumn = nullptr;
+    const uchar *protocolColumn = nullptr;
+    const uchar *conditionColumn = nullptr;
+    const uchar *finalConditionColumn = nullptr;
+    const uchar *shocksColumn = nullptr;
+    const uchar *batteryColumn = nullptr;
+    const uchar *stateColumn = nullptr;
+    const uchar *timeMsColumn = nullptr;
+
+    qint64 startMs(int session) const { return qFromLittleEndian<qint64>(startMsColumn + session * sizeof(qint64)); }
+    quint32 durationMs(int session) const { return qFromLittleEndian<quint32>(durationMsColumn + session * sizeof(quint32)); }
+    int eventBegin(int session) const { return session == 0 ? 0 : eventEnd(session - 1); }
+    int eventEnd(int session) const { return int(qFromLittleEndian<quint32>(eventEndColumn + session * sizeof(quint32))); }
+    int scenario(int session) const { return qFromLittleEndian<quint16>(scenarioColumn + session * sizeof(quint16)); }
+    int protocol(int session) const { return qFromLittleEndian<quint16>(protocolColumn + session * sizeof(quint16)); }
+    HeartState condition(int session) const { return (HeartState)conditionColumn[session]; }
+    HeartState finalCondition(int session) const { return (HeartState)finalConditionColumn[session]; }
+    int shocks(int session) const { return qFromLittleEndian<quint16>(shocksColumn + session * sizeof(quint16)); }
+    int batteryLevel(int session) const { return batteryColumn[session]; }
+    AEDState state(int event) const { return (AEDState)stateColumn[event]; }
+    quint32 timeMs(int event) const { return qFromLittleEndian<quint32>(timeMsColumn + event * sizeof(quint32)); }
+};
+
+// An append only file of sessions, stored column by column in segments of up to
+// ARCHIVE_SEGMENT_SESSIONS sessions, so that a query only reads the columns it
+// needs and the segments can be scanned in parallel. Sessions are buffered and
+// written a segment at a time. Appending can be done from any thread.
+class SessionArchive
+{
+public:
+    SessionArchive();
+
+    // Writes the sessions buffered.
+    ~SessionArchive();
+
+    // Opens a file to append to, creating it if it does not exist.
+    bool open(const QString &fileName);
+
+    void append(const ArchivedSession &session);
+
+    // Writes the sessions buffered as a segment.
+    bool flush();
+
+private:
+    bool writeSegment();
+
+    QFile file;
+    QVector<ArchivedSession> pending;
+    QMutex mutex;
+};
+
+// Reads an archive by mapping it, without copying the columns.
+class ArchiveReader
+{
+public:
+    // Maps a file and finds its segments. A segment cut short, by a crash while it
+    // was written, ends the archive.
+    bool open(const QString &fileName);
+
+    const QVector<ArchiveSegment> &getSegments() const;
+    qint64 sessionCount() const;
+    qint64 eventCount() const;
+
+    // Where the last whole segment ends, for appending after it.
+    qint64 validSize() const;
+
+private:
+    std::unique_ptr<QFile> file;
+    QVector<ArchiveSegment> segments;
+    qint64 end = 0;
+};
+
+#endif
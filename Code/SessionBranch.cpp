@@ -0,0 +1,396 @@
+// IMPORTS
+#include "SessionBranch.h"
+#include "ShockWaveform.h"
+
+#include <QElapsedTimer>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+// Branches have no impedance monitor, they shock into a typical patient.
+static const double BRANCH_IMPEDANCE = (IMPEDANCE_MIN_PATIENT + IMPEDANCE_MAX_PATIENT) / 2.0;
+
+/*
+    Function: State()
+    Purpose: Constructor for the simulation state of a branch.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+SessionBranch::State::State()
+    : patient(1), program(nullptr), step(0), analyzed(false), shockNeeded(false), cycle(0), batteryLevel(MAX_BATTERY_LEVEL),
+      batteryUnitsPerShock(5), shockCount(0), changeMade(false), finished(false), elapsedSeconds(0.0)
+{
+}
+
+/*
+    Function: SessionBranch()
+    Purpose: Constructor. Starts a branch at the step of the program a snapshot was
+             taken at, or at the first analysis if the snapshot was taken before the pads
+             were attached. A session that ran without the heart model starts the model
+             from its heart condition.
+    Inputs:
+        const SessionSnapshot &snapshot: The session to branch from.
+        std::uint32_t seed: Seed of the patient's random numbers.
+    Outputs:
+        None
+*/
+SessionBranch::SessionBranch(const SessionSnapshot &snapshot, std::uint32_t seed)
+    : d(new State), reseed(seed)
+{
+    if (snapshot.physiologyModel)
+    {
+        d->patient.setPatientState(0, snapshot.patient);
+    }
+    else
+    {
+        d->patient.resetPatient(0, snapshot.patientHeartCondition, 0.65f);
+    }
+
+    const ResuscitationProtocol *protocol = ProtocolLibrary::instance()->at(ProtocolLibrary::instance()->find(snapshot.protocol));
+    d->program = &protocol->getProgram(snapshot.pediatricPads);
+
+    // Branches have no operator to attach the pads, so they start once the pads are on.
+    d->step = std::max(snapshot.step, d->program->find(PROTOCOL_ANALYZE));
+    d->cycle = snapshot.cycle;
+
+    // Like the device resuming, a snapshot taken once the shock was advised or not does not analyze again.
+    d->analyzed = snapshot.step == d->step && (snapshot.state == SHOCK_ADVISED || snapshot.state == NO_SHOCK_ADVISED);
+
+    d->batteryLevel = snapshot.batteryLevel;
+    d->batteryUnitsPerShock = snapshot.batteryUnitsPerShock;
+    d->shockCount = snapshot.shockCount;
+}
+
+/*
+    Function: fork()
+    Purpose: Makes a copy of this branch. The copy shares all data with this branch
+             until one of them runs.
+    Inputs:
+        std::uint32_t seed: Seed of the patient's random numbers in the copy.
+    Outputs:
+        The new branch.
+*/
+SessionBranch SessionBranch::fork(std::uint32_t seed) const
+{
+    SessionBranch branch(*this);
+    branch.reseed = seed;
+    return branch;
+}
+
+/*
+    Function: run()
+    Purpose: Runs the program of the protocol like the device does with the heart
+             model, except that the patient also changes during the steps between
+             analysis and CPR, and that the pads and the cable are never lost unless
+             the change loses them.
+    Inputs:
+        BranchChange change: What to do differently from the protocol.
+        int stopAt: A step of the program to stop before, or -1 to run until the session ends.
+    Outputs:
+        None
+*/
+void SessionBranch::run(BranchChange change, int stopAt)
+{
+    if (d.constData()->finished || d.constData()->step == stopAt)
+        return;
+
+    // Copies the shared state, if it is still shared.
+    State &s = *d;
+
+    if (reseed != 0)
+    {
+        CardiacModel::PatientState patient = s.patient.getPatientState(0);
+        patient.rng = reseed * 2654435761u | 1u;
+        s.patient.setPatientState(0, patient);
+        reseed = 0;
+    }
+
+    while (!s.finished && s.step != stopAt)
+    {
+        const ProtocolStep &current = s.program->steps[s.step];
+        int next = s.step + 1;
+
+        switch (current.op)
+        {
+        case PROTOCOL_ANALYZE:
+        {
+            if (!s.analyzed)
+            {
+                advance(current.time, false);
+            }
+            s.analyzed = false;
+
+            HeartState rhythm = s.patient.getRhythm(0);
+            s.shockNeeded = rhythm == VENTRICULAR_FIBRILLATION || rhythm == VENTRICULAR_TACHYCARDIA;
+            advance(SLEEP, false);
+
+            // Normal rhythm, the device turns off.
+            s.finished = !s.shockNeeded && rhythm == SINUS_RHYTHM;
+            break;
+        }
+
+        case PROTOCOL_UNLESS_SHOCK:
+            if (!s.shockNeeded)
+                next = current.target;
+            break;
+
+        case PROTOCOL_CHARGE:
+            // Not enough battery left for the shock.
+            if (s.batteryLevel - s.batteryUnitsPerShock < SUFFICIENT_BATTERY_LEVEL)
+            {
+                s.finished = true;
+                break;
+            }
+
+            if (!s.changeMade && change == BRANCH_PADS_LOST)
+            {
+                // Once the pads are back on, the rhythm has to be analyzed again.
+                advance(BRANCH_PADS_LOST_TIME, false);
+                s.changeMade = true;
+                while (s.program->steps[next].op != PROTOCOL_ANALYZE)
+                {
+                    next--;
+                }
+            }
+            break;
+
+        case PROTOCOL_PROMPT:
+            advance(current.time, false);
+            break;
+
+        case PROTOCOL_SHOCK:
+            if (!s.changeMade && change == BRANCH_DELAYED_SHOCK)
+            {
+                advance(BRANCH_SHOCK_DELAY_TIME, false);
+                s.changeMade = true;
+            }
+
+            shock();
+            advance(current.time, false);
+            break;
+
+        case PROTOCOL_CPR:
+            advance(current.time, change != BRANCH_MISSED_CPR);
+            break;
+
+        case PROTOCOL_NEXT_SHOCK:
+            if (++s.cycle >= MAX_PHYSIOLOGY_CYCLES)
+                next = current.target;
+            break;
+
+        case PROTOCOL_REPEAT:
+            if (++s.cycle < MAX_PHYSIOLOGY_CYCLES)
+                next = current.target;
+            break;
+
+        case PROTOCOL_END:
+            s.finished = true;
+            break;
+
+        default:
+            // The self test, the pads and the cable need no time without an operator.
+            break;
+        }
+
+        if (!s.finished)
+        {
+            s.step = next;
+        }
+    }
+}
+
+/*
+    Function: advance()
+    Purpose: Lets time pass for the patient.
+    Inputs:
+        unsigned long time: The time in milliseconds.
+        bool cpr: True if compressions are given meanwhile.
+    Outputs:
+        None
+*/
+void SessionBranch::advance(unsigned long time, bool cpr)
+{
+    CardiacModel &patient = d->patient;
+    patient.setCPR(0, cpr);
+    patient.advance(time / 1000.0f);
+    patient.setCPR(0, false);
+    d->elapsedSeconds += time / 1000.0;
+}
+
+/*
+    Function: shock()
+    Purpose: Charges for the next shock of the program, delivers it and uses the battery for it.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void SessionBranch::shock()
+{
+    State &s = *d;
+
+    double charge = ShockWaveform::compensatedChargeEnergy(s.program->energy(s.shockCount), BRANCH_IMPEDANCE);
+    ShockResult result = ShockWaveform::simulate(charge, BRANCH_IMPEDANCE);
+
+    s.patient.applyShock(0, result.deliveredEnergy);
+    s.shockCount++;
+    s.batteryLevel -= s.batteryUnitsPerShock;
+}
+
+/*
+    Function: runWhatIf()
+    Purpose: Forks a trunk into branchesPerChange branches for every change, and runs
+             them all to the end on the global thread pool.
+    Inputs:
+        const SessionBranch &trunk: The branch to fork.
+        const QVector<BranchChange> &changes: The changes to try.
+        int branchesPerChange: The number of branches for each change.
+        std::uint32_t seed: Seed of the branches' random numbers.
+    Outputs:
+        The finished branches, grouped by change in the order given.
+*/
+QVector<SessionBranch> SessionBranch::runWhatIf(const SessionBranch &trunk, const QVector<BranchChange> &changes,
+                                                int branchesPerChange, std::uint32_t seed)
+{
+    QVector<SessionBranch> branches;
+    QVector<int> indexes;
+    branches.reserve(changes.size() * branchesPerChange);
+    indexes.reserve(changes.size() * branchesPerChange);
+
+    for (int i = 0; i < changes.size() * branchesPerChange; ++i)
+    {
+        branches.append(trunk.fork(seed + std::uint32_t(i) + 1));
+        indexes.append(i);
+    }
+
+    // Every index touches only its own branch.
+    SessionBranch *data = branches.data();
+    QtConcurrent::blockingMap(indexes, [data, &changes, branchesPerChange](int index)
+                              { data[index].run(changes.at(index / branchesPerChange)); });
+
+    return branches;
+}
+
+/*
+    Function: reportWhatIf()
+    Purpose: Branches a session into every change and averages the outcomes of each.
+    Inputs:
+        const SessionSnapshot &snapshot: The session to branch.
+        int branchesPerChange: The number of branches for each change.
+        std::uint32_t seed: Seed of the branches' random numbers.
+    Outputs:
+        A line with the time taken, then a line per change.
+*/
+QStringList SessionBranch::reportWhatIf(const SessionSnapshot &snapshot, int branchesPerChange, std::uint32_t seed)
+{
+    static const char *const changeNames[] = {"As is", "Delayed shock", "Missed CPR", "Pads lost"};
+    QVector<BranchChange> changes = {BRANCH_AS_IS, BRANCH_DELAYED_SHOCK, BRANCH_MISSED_CPR, BRANCH_PADS_LOST};
+    int count = qMax(1, branchesPerChange);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    SessionBranch trunk(snapshot, 0);
+    QVector<SessionBranch> branches = runWhatIf(trunk, changes, count, seed);
+
+    QStringList lines;
+    lines.append(QString("Ran %1 branches in %2 s").arg(branches.size()).arg(timer.nsecsElapsed() / 1e9, 0, 'f', 2));
+
+    for (int c = 0; c < changes.size(); ++c)
+    {
+        int sinus = 0;
+        double shocks = 0.0, seconds = 0.0;
+        for (int i = c * count; i < (c + 1) * count; ++i)
+        {
+            sinus += branches[i].getRhythm() == SINUS_RHYTHM ? 1 : 0;
+            shocks += branches[i].getShockCount();
+            seconds += branches[i].getElapsedSeconds();
+        }
+
+        lines.append(QString("%1: sinus rhythm %2%, %3 shocks, %4 s on average")
+                         .arg(changeNames[changes[c]], -13).arg(100.0 * sinus / count, 0, 'f', 1)
+                         .arg(shocks / count, 0, 'f', 2).arg(seconds / count, 0, 'f', 0));
+    }
+
+    return lines;
+}
+
+/*
+    Function: getStep()
+    Purpose: Gets the step of the program the branch will run next.
+    Inputs:
+        None
+    Outputs:
+        The index of the step.
+*/
+int SessionBranch::getStep() const
+{
+    return d->step;
+}
+
+/*
+    Function: isFinished()
+    Purpose: Checks whether the session has ended.
+    Inputs:
+        None
+    Outputs:
+        True if the session has ended, false otherwise.
+*/
+bool SessionBranch::isFinished() const
+{
+    return d->finished;
+}
+
+/*
+    Function: getRhythm()
+    Purpose: Gets the rhythm of the patient.
+    Inputs:
+        None
+    Outputs:
+        The rhythm.
+*/
+HeartState SessionBranch::getRhythm() const
+{
+    return d->patient.getRhythm(0);
+}
+
+/*
+    Function: getViability()
+    Purpose: Gets the myocardial viability of the patient.
+    Inputs:
+        None
+    Outputs:
+        The viability, between 0 and 1.
+*/
+float SessionBranch::getViability() const
+{
+    return d->patient.getViability(0);
+}
+
+/*
+    Function: getShockCount()
+    Purpose: Gets the number of shocks delivered.
+    Inputs:
+        None
+    Outputs:
+        The number of shocks.
+*/
+int SessionBranch::getShockCount() const
+{
+    return d->shockCount;
+}
+
+/*
+    Function: getElapsedSeconds()
+    Purpose: Gets the simulated time since the branch started.
+    Inputs:
+        None
+    Outputs:
+        The time in seconds.
+*/
+double SessionBranch::getElapsedSeconds() const
+{
+    return d->elapsedSeconds;
+}
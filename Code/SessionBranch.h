@@ -0,0 +1,92 @@
+#ifndef SESSIONBRANCH_H
+#define SESSIONBRANCH_H
+
+// Qt imports
+#include <QSharedData>
+#include <QSharedDataPointer>
+#include <QStringList>
+#include <QVector>
+
+#include <cstdint>
+
+// Local imports
+#include "defs.h"
+#include "CardiacModel.h"
+#include "ResuscitationProtocol.h"
+#include "SessionSnapshot.h"
+
+// What-if branches, times in milliseconds.
+#define BRANCH_SHOCK_DELAY_TIME 30000
+#define BRANCH_PADS_LOST_TIME 20000
+
+// What a branch does differently from the protocol.
+enum BranchChange
+{
+    BRANCH_AS_IS,         // Follow the protocol.
+    BRANCH_DELAYED_SHOCK, // The first shock comes BRANCH_SHOCK_DELAY_TIME late, without CPR meanwhile.
+    BRANCH_MISSED_CPR,    // No compressions during CPR.
+    BRANCH_PADS_LOST      // The pads come off before the first shock and the rhythm is analyzed again.
+};
+
+// A simulated session that can be forked into alternative futures. Branches run
+// the program of the session's protocol in simulated time on the heart model, with
+// no device thread, so thousands of them can run in parallel. Forks share their
+// state with the branch they came from until they change it.
+class SessionBranch
+{
+public:
+    // Start from the step a snapshot was taken at, whose protocol must be in the library.
+    // A seed of 0 keeps the snapshot's random numbers.
+    SessionBranch(const SessionSnapshot &snapshot, std::uint32_t seed);
+
+    // A copy of this branch with its own random numbers from here on.
+    SessionBranch fork(std::uint32_t seed) const;
+
+    // Run the protocol with the given change, until the session ends or the step
+    // stopAt of the program is about to run.
+    void run(BranchChange change, int stopAt = -1);
+
+    int getStep() const;
+    bool isFinished() const;
+    HeartState getRhythm() const;
+    float getViability() const;
+    int getShockCount() const;
+    double getElapsedSeconds() const;
+
+    // Fork branchesPerChange branches for every change and run them all to the end, in parallel.
+    static QVector<SessionBranch> runWhatIf(const SessionBranch &trunk, const QVector<BranchChange> &changes,
+                                            int branchesPerChange, std::uint32_t seed);
+
+    // Runs branchesPerChange branches of a snapshot for every change, and reports the
+    // outcomes of each change as lines of text.
+    static QStringList reportWhatIf(const SessionSnapshot &snapshot, int branchesPerChange, std::uint32_t seed);
+
+private:
+    struct State : QSharedData
+    {
+        State();
+
+        CardiacModel patient;
+        const ProtocolProgram *program; // Of the snapshot's protocol and pads, in the library.
+        int step;                       // Step of the program run next.
+        bool analyzed;                  // The analysis of the step was over when the snapshot was taken.
+        bool shockNeeded;
+        int cycle;
+        int batteryLevel;
+        int batteryUnitsPerShock;
+        int shockCount;
+        bool changeMade; // For changes that happen once.
+        bool finished;
+        double elapsedSeconds;
+    };
+
+    void advance(unsigned long time, bool cpr);
+    void shock();
+
+    QSharedDataPointer<State> d;
+
+    // Seed for the patient, applied when the fork first runs so that it stays shared until then.
+    std::uint32_t reseed;
+};
+
+#endif
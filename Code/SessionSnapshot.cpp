@@ -0,0 +1,126 @@
+// IMPORTS
+#include "SessionSnapshot.h"
+#include "ResuscitationProtocol.h"
+
+#include <QDataStream>
+
+/*
+    Function: shockAdvised()
+    Purpose: Makes the snapshot of a VF patient with a shock just advised, on a full battery.
+    Inputs:
+        quint32 seed: Seed of the patient's random numbers.
+    Outputs:
+        The snapshot.
+*/
+SessionSnapshot SessionSnapshot::shockAdvised(quint32 seed)
+{
+    CardiacModel patient(1, seed);
+    patient.resetPatient(0, VENTRICULAR_FIBRILLATION, 0.7f);
+
+    SessionSnapshot snapshot;
+    snapshot.protocol = DEFAULT_PROTOCOL_NAME;
+    snapshot.step = ProtocolLibrary::instance()->at(0)->getProgram(false).find(PROTOCOL_ANALYZE);
+    snapshot.state = SHOCK_ADVISED;
+    snapshot.cycle = 0;
+    snapshot.patientHeartCondition = VENTRICULAR_FIBRILLATION;
+    snapshot.startWithAsystole = false;
+    snapshot.shockUntilHealthy = 0;
+    snapshot.physiologyModel = true;
+    snapshot.patient = patient.getPatientState(0);
+    snapshot.padsAttached = true;
+    snapshot.pediatricPads = false;
+    snapshot.simulatePoorContact = false;
+    snapshot.loseConnection = false;
+    snapshot.batteryLevel = MAX_BATTERY_LEVEL;
+    snapshot.batteryUnitsPerShock = 5;
+    snapshot.batteryUnitsWhenIdle = 1;
+    snapshot.shockCount = 0;
+    snapshot.shockEnergy = 0.0;
+    return snapshot;
+}
+
+/*
+    Function: serialize()
+    Purpose: Writes the snapshot in its binary form.
+    Inputs:
+        None
+    Outputs:
+        The snapshot, about a hundred bytes.
+*/
+QByteArray SessionSnapshot::serialize() const
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    stream << quint32(SNAPSHOT_MAGIC) << quint16(SNAPSHOT_VERSION);
+
+    stream << protocol << qint32(step) << qint32(state) << qint32(cycle);
+
+    stream << qint32(patientHeartCondition) << startWithAsystole << qint32(shockUntilHealthy) << physiologyModel;
+    stream << patient.v << patient.w << patient.viability << quint8(patient.cpr) << qint32(patient.rhythm) << quint32(patient.rng);
+
+    stream << padsAttached << pediatricPads << simulatePoorContact << loseConnection;
+
+    stream << qint32(batteryLevel) << qint32(batteryUnitsPerShock) << qint32(batteryUnitsWhenIdle)
+           << qint32(shockCount) << shockEnergy;
+
+    return data;
+}
+
+/*
+    Function: deserialize()
+    Purpose: Reads a snapshot written by serialize().
+    Inputs:
+        const QByteArray &data: The binary snapshot.
+        SessionSnapshot &snapshot: Receives the snapshot.
+    Outputs:
+        True if the data is a complete snapshot of the current version, false otherwise.
+*/
+bool SessionSnapshot::deserialize(const QByteArray &data, SessionSnapshot &snapshot)
+{
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic;
+    quint16 version;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION)
+        return false;
+
+    qint32 step, state, cycle, condition, shockUntilHealthy, rhythm;
+    qint32 batteryLevel, unitsPerShock, unitsWhenIdle, shockCount;
+    quint8 cpr;
+    quint32 rng;
+    SessionSnapshot result;
+
+    stream >> result.protocol >> step >> state >> cycle;
+
+    stream >> condition >> result.startWithAsystole >> shockUntilHealthy >> result.physiologyModel;
+    stream >> result.patient.v >> result.patient.w >> result.patient.viability >> cpr >> rhythm >> rng;
+
+    stream >> result.padsAttached >> result.pediatricPads >> result.simulatePoorContact >> result.loseConnection;
+
+    stream >> batteryLevel >> unitsPerShock >> unitsWhenIdle >> shockCount >> result.shockEnergy;
+
+    if (stream.status() != QDataStream::Ok || !stream.atEnd())
+        return false;
+    if (state < OFF || state > CHECK_PADS || condition < SINUS_RHYTHM || condition > ASYSTOLE || step < 0 || cycle < 0)
+        return false;
+
+    result.step = step;
+    result.state = AEDState(state);
+    result.cycle = cycle;
+    result.patientHeartCondition = HeartState(condition);
+    result.shockUntilHealthy = shockUntilHealthy;
+    result.patient.cpr = cpr;
+    result.patient.rhythm = rhythm;
+    result.patient.rng = rng;
+    result.batteryLevel = batteryLevel;
+    result.batteryUnitsPerShock = unitsPerShock;
+    result.batteryUnitsWhenIdle = unitsWhenIdle;
+    result.shockCount = shockCount;
+
+    snapshot = result;
+    return true;
+}
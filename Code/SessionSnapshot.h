@@ -0,0 +1,56 @@
+#ifndef SESSIONSNAPSHOT_H
+#define SESSIONSNAPSHOT_H
+
+// Qt imports
+#include <QByteArray>
+#include <QString>
+
+// Local imports
+#include "defs.h"
+#include "CardiacModel.h"
+
+// Session snapshots, "AEDS" followed by the layout version.
+#define SNAPSHOT_MAGIC 0x41454453
+#define SNAPSHOT_VERSION 2
+
+// Everything needed to continue an AED session at the step it was on, for
+// example after the process died. Snapshots are taken at the start of a step,
+// so a restored session repeats that step in full.
+//
+// The binary layout starts with SNAPSHOT_MAGIC and SNAPSHOT_VERSION. Bump the
+// version whenever a field is added, removed or reordered.
+struct SessionSnapshot
+{
+    QString protocol; // Name of the protocol followed.
+    int step;         // Step of its program.
+    AEDState state;
+    int cycle;        // Analysis of the protocol.
+
+    HeartState patientHeartCondition;
+    bool startWithAsystole;
+    int shockUntilHealthy;
+    bool physiologyModel;
+    CardiacModel::PatientState patient;
+
+    bool padsAttached;
+    bool pediatricPads;
+    bool simulatePoorContact;
+    bool loseConnection;
+
+    int batteryLevel;
+    int batteryUnitsPerShock;
+    int batteryUnitsWhenIdle;
+    int shockCount;
+    double shockEnergy;
+
+    // A VF patient on the heart model, at the analysis of the built-in protocol, with
+    // a shock just advised. The start of the what-if branches when no session is given.
+    static SessionSnapshot shockAdvised(quint32 seed);
+
+    QByteArray serialize() const;
+
+    // Returns false if the data is not a complete snapshot of this version.
+    static bool deserialize(const QByteArray &data, SessionSnapshot &snapshot);
+};
+
+#endif
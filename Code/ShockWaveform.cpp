@@ -0,0 +1,175 @@
+// IMPORTS
+#include "ShockWaveform.h"
+
+#include <algorithm>
+#include <cmath>
+
+/*
+    Function: nominalEnergy()
+    Purpose: Gets the energy that should reach the patient. It escalates through
+             ADULT_SHOCK_ENERGIES with every shock and is attenuated for pediatric pads.
+    Inputs:
+        int shockIndex: The number of shocks already delivered.
+        bool pediatric: True for pediatric pads, false for adult pads.
+    Outputs:
+        The nominal energy in joules.
+*/
+double ShockWaveform::nominalEnergy(int shockIndex, bool pediatric)
+{
+    static const double adultEnergies[] = ADULT_SHOCK_ENERGIES;
+    static const int levels = sizeof(adultEnergies) / sizeof(adultEnergies[0]);
+
+    double energy = adultEnergies[std::min(std::max(shockIndex, 0), levels - 1)];
+    if (pediatric)
+    {
+        energy *= PEDIATRIC_ENERGY_ATTENUATION;
+    }
+
+    return energy;
+}
+
+/*
+    Function: compensatedChargeEnergy()
+    Purpose: Computes the energy to charge for a shock. Part of the charged energy is
+             lost in the device, more so at low patient impedance, so the charge is
+             raised to make up for it.
+    Inputs:
+        double nominalEnergy: The energy that should reach the patient in joules.
+        double patientImpedance: The impedance between the pads in ohms.
+    Outputs:
+        The energy to charge in joules, at most MAX_CHARGE_ENERGY.
+*/
+double ShockWaveform::compensatedChargeEnergy(double nominalEnergy, double patientImpedance)
+{
+    double patient = std::max(patientImpedance, IMPEDANCE_MIN_GOOD_CONTACT);
+    double energy = nominalEnergy * (patient + DEVICE_INTERNAL_RESISTANCE) / patient;
+
+    return std::min(energy, MAX_CHARGE_ENERGY);
+}
+
+/*
+    Function: simulate()
+    Purpose: Simulates a single shock.
+    Inputs:
+        double chargeEnergy: The energy stored in the capacitor in joules.
+        double patientImpedance: The impedance between the pads in ohms.
+        bool keepTrace: True to record the voltage and current over time.
+    Outputs:
+        The phase durations, peak current and energy delivered to the patient.
+*/
+ShockResult ShockWaveform::simulate(double chargeEnergy, double patientImpedance, bool keepTrace)
+{
+    ShockResult result;
+    integrate(chargeEnergy, patientImpedance, result, keepTrace);
+    return result;
+}
+
+/*
+    Function: simulateBatch()
+    Purpose: Simulates many shocks without recording traces, for batch simulations.
+    Inputs:
+        const double *chargeEnergies: The energy stored for each shock in joules.
+        const double *patientImpedances: The patient impedance for each shock in ohms.
+        double *deliveredEnergies: Receives the energy delivered by each shock in joules.
+        std::size_t count: The number of shocks.
+    Outputs:
+        None
+*/
+void ShockWaveform::simulateBatch(const double *chargeEnergies, const double *patientImpedances,
+                                  double *deliveredEnergies, std::size_t count)
+{
+    ShockResult result;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        integrate(chargeEnergies[i], patientImpedances[i], result, false);
+        deliveredEnergies[i] = result.deliveredEnergy;
+    }
+}
+
+/*
+    Function: integrate()
+    Purpose: Integrates the capacitor discharge dV/dt = -V / (R C), where R is the
+             patient impedance in series with the internal resistance of the device.
+             Each step is a fourth-order Runge-Kutta step, which for this linear
+             equation reduces to multiplying by a constant factor. The energy in the
+             patient is integrated alongside with the trapezoidal rule.
+    Inputs:
+        double chargeEnergy: The energy stored in the capacitor in joules.
+        double patientImpedance: The impedance between the pads in ohms.
+        ShockResult &result: Receives the outcome of the shock.
+        bool keepTrace: True to record the voltage and current over time.
+    Outputs:
+        None
+*/
+void ShockWaveform::integrate(double chargeEnergy, double patientImpedance, ShockResult &result, bool keepTrace)
+{
+    const double capacitance = CAPACITOR_CAPACITANCE;
+    const double patient = std::max(patientImpedance, 1.0);
+    const double resistance = patient + DEVICE_INTERNAL_RESISTANCE;
+    const double dt = WAVEFORM_TIME_STEP;
+
+    // Fourth-order Runge-Kutta factor for dV/dt = -k V.
+    const double h = dt / (resistance * capacitance);
+    const double rk4 = 1.0 - h + h * h / 2.0 - h * h * h / 6.0 + h * h * h * h / 24.0;
+
+    // Power in the patient is (V / R)^2 * Z.
+    const double powerPerVolt2 = patient / (resistance * resistance);
+
+    const long traceEvery = std::max(1L, std::lround(WAVEFORM_TRACE_INTERVAL / dt));
+    const long maxSteps = std::lround(MAX_PHASE_DURATION / dt);
+
+    double voltage = std::sqrt(2.0 * std::max(chargeEnergy, 0.0) / capacitance);
+    double energy = 0.0;
+    long step = 0;
+
+    result.chargeVoltage = voltage;
+    result.peakCurrent = voltage / resistance;
+    result.trace.clear();
+
+    auto record = [&](double polarity)
+    {
+        if (keepTrace && step % traceEvery == 0)
+        {
+            double current = polarity * voltage / resistance;
+            result.trace.push_back({step * dt, current * patient, current});
+        }
+    };
+
+    // Phase 1: positive polarity until the voltage has dropped by the tilt.
+    const double phase1End = voltage * (1.0 - PHASE1_TILT);
+    long phase1Steps = 0;
+    while (voltage > phase1End && phase1Steps < maxSteps)
+    {
+        record(1.0);
+
+        double next = voltage * rk4;
+        energy += 0.5 * (voltage * voltage + next * next) * powerPerVolt2 * dt;
+        voltage = next;
+
+        phase1Steps++;
+        step++;
+    }
+
+    // Phase 2: reversed polarity for a fixed share of the first phase.
+    const long phase2Steps = std::lround(phase1Steps * PHASE2_DURATION_RATIO);
+    for (long i = 0; i < phase2Steps; ++i)
+    {
+        record(-1.0);
+
+        double next = voltage * rk4;
+        energy += 0.5 * (voltage * voltage + next * next) * powerPerVolt2 * dt;
+        voltage = next;
+
+        step++;
+    }
+
+    // The waveform is truncated, the remaining charge is dumped internally.
+    if (keepTrace)
+    {
+        result.trace.push_back({step * dt, 0.0, 0.0});
+    }
+
+    result.phase1Duration = phase1Steps * dt;
+    result.phase2Duration = phase2Steps * dt;
+    result.deliveredEnergy = energy;
+}
@@ -0,0 +1,68 @@
+#ifndef SHOCKWAVEFORM_H
+#define SHOCKWAVEFORM_H
+
+#include <cstddef>
+#include <vector>
+
+// Local imports
+#include "defs.h"
+
+// Biphasic truncated exponential shock waveform.
+#define CAPACITOR_CAPACITANCE 100e-6
+#define PHASE1_TILT 0.6
+#define PHASE2_DURATION_RATIO 0.667
+#define MAX_PHASE_DURATION 0.02
+#define WAVEFORM_TIME_STEP 2e-6
+#define WAVEFORM_TRACE_INTERVAL 10e-6
+
+// Resistance of the device in series with the patient, in ohms.
+#define DEVICE_INTERNAL_RESISTANCE 5.0
+
+// A point of the waveform seen by the patient.
+struct WaveformSample
+{
+    double time;    // Seconds since the start of the shock.
+    double voltage; // Volts across the patient.
+    double current; // Amperes through the patient.
+};
+
+// Outcome of a single shock.
+struct ShockResult
+{
+    double chargeVoltage;
+    double phase1Duration;
+    double phase2Duration;
+    double peakCurrent;
+    double deliveredEnergy; // Joules dissipated in the patient.
+
+    // Only filled in when a trace is requested.
+    std::vector<WaveformSample> trace;
+};
+
+// Simulates the discharge of the shock capacitor into the patient as a
+// biphasic truncated exponential waveform. The capacitor voltage is integrated
+// numerically, the first phase ends once the voltage has dropped by PHASE1_TILT,
+// and the second phase runs with reversed polarity for PHASE2_DURATION_RATIO of
+// the first phase.
+class ShockWaveform
+{
+public:
+    // Energy that should reach the patient for the given shock, escalating with every shock.
+    static double nominalEnergy(int shockIndex, bool pediatric);
+
+    // Energy to charge so that the nominal energy reaches the patient, despite the
+    // losses in the internal resistance of the device.
+    static double compensatedChargeEnergy(double nominalEnergy, double patientImpedance);
+
+    // Simulate a shock of the given charged energy into the given patient impedance.
+    static ShockResult simulate(double chargeEnergy, double patientImpedance, bool keepTrace = false);
+
+    // Simulate many shocks at once, without traces. Writes the delivered energies.
+    static void simulateBatch(const double *chargeEnergies, const double *patientImpedances,
+                              double *deliveredEnergies, std::size_t count);
+
+private:
+    static void integrate(double chargeEnergy, double patientImpedance, ShockResult &result, bool keepTrace);
+};
+
+#endif
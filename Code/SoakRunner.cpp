@@ -0,0 +1,456 @@
+// IMPORTS
+#include "SoakRunner.h"
+#include "AED.h"
+#include "MainWindow.h"
+
+#include <QAbstractEventDispatcher>
+#include <QApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSaveFile>
+#include <QTimer>
+#include <private/qhooks_p.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Qt calls the hooks of qtHookData for every QObject made and destroyed, as debugging
+// tools do. Other hooks installed before ours are called after it.
+static std::atomic<qint64> liveObjects(0);
+static QHooks::AddQObjectCallback nextAddObject = nullptr;
+static QHooks::RemoveQObjectCallback nextRemoveObject = nullptr;
+
+/*
+    Function: SoakRunner()
+    Purpose: Constructor.
+    Inputs:
+        int sessions: The number of sessions to run.
+        quint32 seed: The seed the sessions are drawn from.
+    Outputs:
+        None
+*/
+SoakRunner::SoakRunner(int sessions, quint32 seed)
+    : QObject(nullptr), sessions(qMax(1, sessions)), seed(seed), random(seed),
+      powerButton(nullptr), padsButton(nullptr), batteriesButton(nullptr), conditionSelector(nullptr),
+      steps(0), stopAfter(0), stopped(false), released(false), over(false)
+{
+}
+
+/*
+    Function: run()
+    Purpose: Makes a main window and a device, runs the sessions through them while
+             sampling, and reports what grew.
+    Inputs:
+        const QString &reportFile: The file the samples are written to, none if empty.
+    Outputs:
+        True if nothing grew without bound, false otherwise.
+*/
+bool SoakRunner::run(const QString &reportFile)
+{
+    installObjectHooks();
+    qInfo().noquote() << QString("Soak: %1 sessions, seed %2").arg(sessions).arg(seed);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QVector<Sample> samples;
+    bool failed = false;
+    {
+        MainWindow window;
+        std::unique_ptr<AED> device(new AED());
+        device->setSimulatedClock(true);
+        window.addAED(device.get());
+        device->setGUI(&window);
+        window.getScheduler()->setSimulatedClock(true);
+
+        powerButton = window.findChild<QAbstractButton *>("powerBtn");
+        padsButton = window.findChild<QAbstractButton *>("cprPadsAttached");
+        batteriesButton = window.findChild<QAbstractButton *>("changeBatteries");
+        conditionSelector = window.findChild<QComboBox *>("conditionSelector");
+
+        // Holds the device at the step the session is stopped at, until the window has
+        // powered it off, so that the simulated clock does not run ahead of the window.
+        AED *held = device.get();
+        connect(held, &AED::updateGUI, this, [this](int state)
+                {
+            if (stopped || ++steps < stopAfter || !stoppable((AEDState)state))
+                return;
+
+            stopped = true;
+            wake();
+
+            // The power off is taken once the device is let go, at the start of the next step.
+            QElapsedTimer timer;
+            timer.start();
+            while (!released && timer.elapsed() < SOAK_SESSION_TIMEOUT)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            } }, Qt::DirectConnection);
+
+        samples.append(sample(0));
+        for (int i = 1; i <= sessions && !failed; ++i)
+        {
+            if (!session(device.get(), window))
+            {
+                qCritical().noquote() << QString("Soak: session %1 did not end within %2 ms").arg(i).arg(SOAK_SESSION_TIMEOUT);
+                failed = true;
+            }
+            if (i % SOAK_SAMPLE_INTERVAL == 0)
+            {
+                samples.append(sample(i));
+            }
+        }
+
+        disconnect(held, &AED::updateGUI, this, nullptr);
+    }
+
+    double elapsed = timer.nsecsElapsed() / 1e9;
+    qInfo().noquote() << QString("Soak: %1 sessions in %2 s (%3 sessions per second)")
+                             .arg(samples.last().session).arg(elapsed, 0, 'f', 1)
+                             .arg(samples.last().session / qMax(elapsed, 1e-9), 0, 'f', 1);
+
+    if (!reportFile.isEmpty())
+    {
+        QString report = "session,resident_bytes,heap_bytes,live_objects,timers\n";
+        for (const Sample &s : samples)
+        {
+            report += QString("%1,%2,%3,%4,%5\n").arg(s.session).arg(s.residentBytes).arg(s.heapBytes).arg(s.liveObjects).arg(s.timers);
+        }
+
+        QSaveFile file(reportFile);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text) || file.write(report.toUtf8()) < 0 || !file.commit())
+        {
+            qWarning().noquote() << "Soak: cannot write" << reportFile;
+        }
+    }
+
+    // Every measure is checked, so that all that grew are reported.
+    bool grew = grows(samples, "resident memory", &Sample::residentBytes, SOAK_RESIDENT_TOLERANCE);
+    grew = grows(samples, "heap in use", &Sample::heapBytes, SOAK_HEAP_TOLERANCE) || grew;
+    grew = grows(samples, "live QObjects", &Sample::liveObjects, SOAK_OBJECT_TOLERANCE) || grew;
+    grew = grows(samples, "timers", &Sample::timers, SOAK_TIMER_TOLERANCE) || grew;
+
+    return !failed && !grew;
+}
+
+/*
+    Function: session()
+    Purpose: Runs one session the way an operator would: sets up the patient, powers
+             on, and powers off once the device has been held at the step drawn. A
+             session that ends by itself, such as on a failed self test, is left to
+             the window to power off. The window's clock is moved on by the time the
+             session took, and by the time the window waits after it.
+    Inputs:
+        AED *device: The device, which is off.
+        MainWindow &window: The window of the device.
+    Outputs:
+        True if the session ended, false if it is stuck.
+*/
+bool SoakRunner::session(AED *device, MainWindow &window)
+{
+    if (batteriesButton->isEnabled())
+    {
+        batteriesButton->click();
+    }
+    conditionSelector->setCurrentIndex(random.bounded(conditionSelector->count()));
+    padsButton->setChecked(true);
+
+    steps = 0;
+    stopAfter = random.bounded(SOAK_MIN_STEPS, SOAK_MAX_STEPS + 1);
+    stopped = false;
+    released = false;
+    over = false;
+
+    powerButton->setChecked(true);
+
+    // Queued behind powerOn, so it runs once the session is over.
+    QMetaObject::invokeMethod(device, [this]()
+                              {
+        over = true;
+        wake(); }, Qt::QueuedConnection);
+
+    if (!waitFor([this]()
+                 { return stopped || over; }))
+        return false;
+
+    QVector<TransitionTiming> timings = device->getTransitionTimings();
+    if (!timings.isEmpty())
+    {
+        window.getScheduler()->advance(int(timings.last().actualNs / 1000000));
+    }
+
+    if (!over)
+    {
+        // The window catches up with the steps before its operator powers off.
+        QCoreApplication::processEvents();
+        powerButton->setChecked(false);
+    }
+    released = true;
+
+    if (!waitFor([this]()
+                 { return bool(over); }))
+        return false;
+
+    QCoreApplication::processEvents();
+    window.getScheduler()->advance(ELAPSED_TIME_RESET_TIME);
+    if (powerButton->isChecked())
+    {
+        powerButton->setChecked(false);
+    }
+
+    QCoreApplication::processEvents();
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+    return true;
+}
+
+/*
+    Function: waitFor()
+    Purpose: Handles events until the device thread is done with something.
+    Inputs:
+        const std::function<void()> &done: Checks if it is done.
+    Outputs:
+        True if it got done, false if it took longer than SOAK_SESSION_TIMEOUT.
+*/
+bool SoakRunner::waitFor(const std::function<bool()> &done)
+{
+    // Wakes the wait to check the time, in case the device thread never does.
+    QTimer guard;
+    guard.start(SOAK_SESSION_TIMEOUT / 10);
+
+    QElapsedTimer timer;
+    timer.start();
+    while (!done())
+    {
+        if (timer.elapsed() > SOAK_SESSION_TIMEOUT)
+            return false;
+
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+
+    return true;
+}
+
+/*
+    Function: wake()
+    Purpose: Wakes a wait of the GUI thread. Can be called from any thread.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void SoakRunner::wake()
+{
+    QMetaObject::invokeMethod(this, []() {}, Qt::QueuedConnection);
+}
+
+/*
+    Function: sample()
+    Purpose: Measures the process, once objects waiting to be deleted are.
+    Inputs:
+        int session: The number of sessions run.
+    Outputs:
+        The sample.
+*/
+SoakRunner::Sample SoakRunner::sample(int session)
+{
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+    return Sample{session, residentBytes(), heapBytes(), liveObjects.load(), timers()};
+}
+
+/*
+    Function: grows()
+    Purpose: Compares the highest value of a measure in the first and second half of
+             the samples past the warm up, and reports it if it grew.
+    Inputs:
+        const QVector<Sample> &samples: The samples.
+        const char *name: The name of the measure.
+        qint64 Sample::*measure: The measure.
+        qint64 tolerance: How much it may grow by.
+    Outputs:
+        True if it grew by more than the tolerance, false otherwise.
+*/
+bool SoakRunner::grows(const QVector<Sample> &samples, const char *name, qint64 Sample::*measure, qint64 tolerance)
+{
+    QVector<qint64> values;
+    for (const Sample &s : samples)
+    {
+        if (s.session >= SOAK_WARMUP_SESSIONS && s.*measure >= 0)
+        {
+            values.append(s.*measure);
+        }
+    }
+
+    if (values.size() < 2)
+    {
+        qInfo().noquote() << QString("Soak: %1 not measured").arg(name);
+        return false;
+    }
+
+    int half = values.size() / 2;
+    qint64 first = *std::max_element(values.begin(), values.begin() + half);
+    qint64 second = *std::max_element(values.begin() + half, values.end());
+    bool grew = second - first > tolerance;
+
+    qInfo().noquote() << QString("Soak: %1 %2 from %3 to %4, highest %5 then %6")
+                             .arg(grew ? "FAIL" : "ok", -4).arg(name).arg(values.first()).arg(values.last()).arg(first).arg(second);
+    return grew;
+}
+
+/*
+    Function: stoppable()
+    Purpose: Checks if the window powers the device off at a step. It does not during
+             a shock, and a session that failed its self test or needs new batteries
+             ends by itself.
+    Inputs:
+        AEDState state: The step.
+    Outputs:
+        True if it can be powered off, false otherwise.
+*/
+bool SoakRunner::stoppable(AEDState state)
+{
+    static const QList<AEDState> unstoppable = {OFF, ABORT, SELF_TEST_FAIL, CHANGE_BATTERIES, STAND_CLEAR, SHOCKING, SHOCK_DELIVERED};
+    return !unstoppable.contains(state);
+}
+
+/*
+    Function: residentBytes()
+    Purpose: Gets the memory of the process that is in RAM.
+    Inputs:
+        None
+    Outputs:
+        The bytes, or -1 where it is not known.
+*/
+qint64 SoakRunner::residentBytes()
+{
+#ifdef Q_OS_LINUX
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly))
+        return -1;
+
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    return fields.size() < 2 ? -1 : fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
+
+/*
+    Function: heapBytes()
+    Purpose: Gets the memory allocated on the heap and not yet freed.
+    Inputs:
+        None
+    Outputs:
+        The bytes, or -1 where it is not known.
+*/
+qint64 SoakRunner::heapBytes()
+{
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+    return qint64(mallinfo2().uordblks);
+#else
+    return qint64(unsigned(mallinfo().uordblks));
+#endif
+#else
+    return -1;
+#endif
+}
+
+/*
+    Function: timers()
+    Purpose: Counts the timers of the windows and everything in them, and of the
+             application.
+    Inputs:
+        None
+    Outputs:
+        The number of timers.
+*/
+qint64 SoakRunner::timers()
+{
+    QAbstractEventDispatcher *dispatcher = QAbstractEventDispatcher::instance();
+    if (dispatcher == nullptr)
+        return -1;
+
+    QList<QObject *> objects;
+    objects.append(QCoreApplication::instance());
+    for (QWidget *widget : QApplication::topLevelWidgets())
+    {
+        objects.append(widget);
+    }
+
+    qint64 count = 0;
+    for (QObject *root : objects)
+    {
+        count += dispatcher->registeredTimers(root).size();
+        for (QObject *child : root->findChildren<QObject *>())
+        {
+            count += dispatcher->registeredTimers(child).size();
+        }
+    }
+
+    return count;
+}
+
+/*
+    Function: installObjectHooks()
+    Purpose: Starts counting the QObjects made and destroyed, keeping any hooks that
+             were already installed. Objects that already exist are not counted, so
+             only the growth of the count means anything.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void SoakRunner::installObjectHooks()
+{
+    if (qtHookData[QHooks::AddQObject] == reinterpret_cast<quintptr>(&addObject))
+        return;
+
+    nextAddObject = reinterpret_cast<QHooks::AddQObjectCallback>(qtHookData[QHooks::AddQObject]);
+    nextRemoveObject = reinterpret_cast<QHooks::RemoveQObjectCallback>(qtHookData[QHooks::RemoveQObject]);
+    qtHookData[QHooks::AddQObject] = reinterpret_cast<quintptr>(&addObject);
+    qtHookData[QHooks::RemoveQObject] = reinterpret_cast<quintptr>(&removeObject);
+}
+
+/*
+    Function: addObject()
+    Purpose: Called by Qt for every QObject made, on the thread making it.
+    Inputs:
+        QObject *object: The object, not yet constructed.
+    Outputs:
+        None
+*/
+void SoakRunner::addObject(QObject *object)
+{
+    liveObjects++;
+    if (nextAddObject != nullptr)
+    {
+        nextAddObject(object);
+    }
+}
+
+/*
+    Function: removeObject()
+    Purpose: Called by Qt for every QObject destroyed, on the thread destroying it.
+    Inputs:
+        QObject *object: The object.
+    Outputs:
+        None
+*/
+void SoakRunner::removeObject(QObject *object)
+{
+    liveObjects--;
+    if (nextRemoveObject != nullptr)
+    {
+        nextRemoveObject(object);
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef SOAKRUNNER_H
+#define SOAKRUNNER_H
+
+// Qt imports
+#include <QAbstractButton>
+#include <QComboBox>
+#include <QObject>
+#include <QRandomGenerator>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+#include <functional>
+
+// Local imports
+#include "defs.h"
+
+// Sessions are stopped after a random number of steps in the range. A measure
+// fails if it grows by more than its tolerance, in bytes or in objects.
+#define SOAK_MIN_STEPS 1
+#define SOAK_MAX_STEPS 40
+#define SOAK_SAMPLE_INTERVAL 50
+#define SOAK_WARMUP_SESSIONS 100
+#define SOAK_SESSION_TIMEOUT 10000
+#define SOAK_RESIDENT_TOLERANCE (8 * 1024 * 1024)
+#define SOAK_HEAP_TOLERANCE (2 * 1024 * 1024)
+#define SOAK_OBJECT_TOLERANCE 16
+#define SOAK_TIMER_TOLERANCE 2
+
+class AED;
+class MainWindow;
+
+// Runs back to back sessions through a main window and its device, both on a
+// simulated clock, powering the device on and off with the window's own buttons
+// after a random number of steps. Every SOAK_SAMPLE_INTERVAL sessions, the resident
+// memory, the heap in use, the live QObjects and the timers of the windows are
+// sampled. Past the warm up, a measure that is higher in the second half of the
+// samples than in the first by more than its tolerance is taken to grow without
+// bound, and fails the soak.
+class SoakRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    SoakRunner(int sessions, quint32 seed);
+
+    // Writes the samples as CSV to the report file, if one is given.
+    // Returns true if nothing grew.
+    bool run(const QString &reportFile);
+
+private:
+    struct Sample
+    {
+        int session;
+        qint64 residentBytes; // -1 where not known, on every sample.
+        qint64 heapBytes;
+        qint64 liveObjects;
+        qint64 timers;
+    };
+
+    bool session(AED *device, MainWindow &window);
+    bool waitFor(const std::function<bool()> &done);
+    void wake();
+
+    static Sample sample(int session);
+    static bool grows(const QVector<Sample> &samples, const char *name, qint64 Sample::*measure, qint64 tolerance);
+    static bool stoppable(AEDState state);
+
+    static qint64 residentBytes();
+    static qint64 heapBytes();
+    static qint64 timers();
+
+    static void installObjectHooks();
+    static void addObject(QObject *object);
+    static void removeObject(QObject *object);
+
+    int sessions;
+    quint32 seed;
+    QRandomGenerator random;
+
+    QAbstractButton *powerButton;
+    QAbstractButton *padsButton;
+    QAbstractButton *batteriesButton;
+    QComboBox *conditionSelector;
+
+    // Shared with the device thread. The session is stopped at the first step it
+    // can be powered off at after stopAfter steps, and released once powered off.
+    std::atomic<int> steps;
+    std::atomic<int> stopAfter;
+    std::atomic<bool> stopped;
+    std::atomic<bool> released;
+    std::atomic<bool> over;
+};
+
+#endif
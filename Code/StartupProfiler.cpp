@@ -0,0 +1,135 @@
+// IMPORTS
+#include "StartupProfiler.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QEvent>
+#include <QTimer>
+
+/*
+    Function: StartupProfiler()
+    Purpose: Constructor. Starts the clock as early as possible so that
+             the first phase covers everything before the first mark.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+StartupProfiler::StartupProfiler()
+    : QObject(nullptr), enabled(qEnvironmentVariableIsSet("AED_PROFILE_STARTUP")), firstPaintSeen(false), lastMarkNs(0)
+{
+    clock.start();
+}
+
+/*
+    Function: instance()
+    Purpose: Gets the process-wide profiler.
+    Inputs:
+        None
+    Outputs:
+        A pointer to the profiler.
+*/
+StartupProfiler *StartupProfiler::instance()
+{
+    static StartupProfiler profiler;
+    return &profiler;
+}
+
+/*
+    Function: isEnabled()
+    Purpose: Checks whether start-up profiling was requested.
+    Inputs:
+        None
+    Outputs:
+        True if AED_PROFILE_STARTUP is set, false otherwise.
+*/
+bool StartupProfiler::isEnabled() const
+{
+    return enabled;
+}
+
+/*
+    Function: mark()
+    Purpose: Records the time spent since the previous mark under the given phase name.
+    Inputs:
+        const QString &phase: The name of the phase that has just finished.
+    Outputs:
+        None
+*/
+void StartupProfiler::mark(const QString &phase)
+{
+    if (!enabled)
+        return;
+
+    qint64 now = clock.nsecsElapsed();
+    phases.append(qMakePair(phase, now - lastMarkNs));
+    lastMarkNs = now;
+}
+
+/*
+    Function: watchFirstFrame()
+    Purpose: Watches the application for its first paint event. The report is
+             printed once the event loop has finished painting the first frame.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void StartupProfiler::watchFirstFrame()
+{
+    if (!enabled || QCoreApplication::instance() == nullptr)
+        return;
+
+    QCoreApplication::instance()->installEventFilter(this);
+}
+
+/*
+    Function: eventFilter()
+    Purpose: Detects the first paint event of the application.
+    Inputs:
+        QObject *watched: The object receiving the event.
+        QEvent *event: The event.
+    Outputs:
+        Always false, the event is never consumed.
+*/
+bool StartupProfiler::eventFilter(QObject *watched, QEvent *event)
+{
+    if (!firstPaintSeen && event->type() == QEvent::Paint)
+    {
+        firstPaintSeen = true;
+        mark("event loop until first paint");
+
+        // All widgets of the first frame are painted within the same pass,
+        // so the next turn of the event loop marks the end of the frame.
+        QTimer::singleShot(0, this, [this]()
+                           {
+            QCoreApplication::instance()->removeEventFilter(this);
+            mark("first frame painted");
+            report(); });
+    }
+
+    return QObject::eventFilter(watched, event);
+}
+
+/*
+    Function: report()
+    Purpose: Prints the duration of every recorded phase and the time to first frame.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void StartupProfiler::report() const
+{
+    if (!enabled)
+        return;
+
+    qint64 total = 0;
+    qInfo().noquote() << "Start-up profile:";
+    for (const auto &phase : phases)
+    {
+        total += phase.second;
+        qInfo().noquote() << QString("  %1 %2 ms").arg(phase.first, -32).arg(phase.second / 1e6, 8, 'f', 2);
+    }
+    qInfo().noquote() << QString("  %1 %2 ms").arg("time to first frame", -32).arg(total / 1e6, 8, 'f', 2);
+}
@@ -0,0 +1,48 @@
+#ifndef STARTUPPROFILER_H
+#define STARTUPPROFILER_H
+
+// Qt imports
+#include <QObject>
+#include <QElapsedTimer>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+class QEvent;
+
+// Records how long each phase of application start-up takes, up to
+// the first frame being painted. Enabled by setting AED_PROFILE_STARTUP.
+class StartupProfiler : public QObject
+{
+    Q_OBJECT
+
+public:
+    static StartupProfiler *instance();
+
+    bool isEnabled() const;
+
+    // Mark the end of a start-up phase.
+    void mark(const QString &phase);
+
+    // Report once the first frame has been painted.
+    void watchFirstFrame();
+
+    void report() const;
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    StartupProfiler();
+
+    bool enabled;
+    bool firstPaintSeen;
+
+    QElapsedTimer clock;
+    qint64 lastMarkNs;
+
+    // Phase name and its duration in nanoseconds.
+    QList<QPair<QString, qint64>> phases;
+};
+
+#endif
@@ -0,0 +1,299 @@
+// IMPORTS
+#include "TickScheduler.h"
+#include "MetricsRegistry.h"
+
+#include <algorithm>
+#include <iterator>
+
+static MetricCounter &schedulerWakeups = MetricsRegistry::instance()->counter("aed_gui_scheduler_wakeups_total", "Times the GUI tick scheduler woke to run work.");
+static MetricCounter &schedulerRuns = MetricsRegistry::instance()->counter("aed_gui_scheduler_runs_total", "Tasks run by the GUI tick scheduler.");
+
+/*
+    Function: TickScheduler()
+    Purpose: Constructor. Starts the clock, with nothing scheduled.
+    Inputs:
+        QObject *parent: The parent object.
+    Outputs:
+        None
+*/
+TickScheduler::TickScheduler(QObject *parent)
+    : QObject(parent), wheel(TICK_WHEEL_SLOTS), lastTick(0), nextTask(1), wakeups(0),
+      timer(new QTimer(this)), simulatedClock(false), simulatedNow(0)
+{
+    timer->setSingleShot(true);
+    connect(timer, &QTimer::timeout, this, &TickScheduler::wake);
+    clock.start();
+}
+
+/*
+    Function: every()
+    Purpose: Schedules work to run every period, on the ticks that are multiples of it.
+    Inputs:
+        int period: The period in milliseconds.
+        std::function<void()> work: The work.
+    Outputs:
+        The task, to cancel it with.
+*/
+TickScheduler::Task TickScheduler::every(int period, std::function<void()> work)
+{
+    qint64 ticks = std::max<qint64>(1, (period + TICK_RESOLUTION / 2) / TICK_RESOLUTION);
+    qint64 tick = std::max(lastTick, now() / TICK_RESOLUTION);
+    return add((tick / ticks + 1) * ticks, ticks, std::move(work));
+}
+
+/*
+    Function: after()
+    Purpose: Schedules work to run once, at the first tick at least the delay from now.
+    Inputs:
+        int delay: The delay in milliseconds.
+        std::function<void()> work: The work.
+    Outputs:
+        The task, to cancel it with.
+*/
+TickScheduler::Task TickScheduler::after(int delay, std::function<void()> work)
+{
+    qint64 due = (now() + std::max(delay, 0) + TICK_RESOLUTION - 1) / TICK_RESOLUTION;
+    return add(std::max(due, lastTick + 1), 0, std::move(work));
+}
+
+/*
+    Function: cancel()
+    Purpose: Takes a task off the wheel. Its work will not run again, even if it was
+             due at the tick running now.
+    Inputs:
+        Task task: The task.
+    Outputs:
+        None
+*/
+void TickScheduler::cancel(Task task)
+{
+    auto due = dueTicks.find(task);
+    if (due == dueTicks.end())
+        return;
+
+    std::vector<Entry> &slot = wheel[std::size_t(due.value() % TICK_WHEEL_SLOTS)];
+    slot.erase(std::remove_if(slot.begin(), slot.end(), [task](const Entry &entry)
+                              { return entry.task == task; }),
+               slot.end());
+    dueTicks.erase(due);
+}
+
+/*
+    Function: isScheduled()
+    Purpose: Checks if a task will still run.
+    Inputs:
+        Task task: The task.
+    Outputs:
+        True if it is scheduled, false otherwise.
+*/
+bool TickScheduler::isScheduled(Task task) const
+{
+    return dueTicks.contains(task);
+}
+
+/*
+    Function: setSimulatedClock()
+    Purpose: Switches between the real clock and a simulated one, which starts where
+             the real one is and only moves by advance.
+    Inputs:
+        bool simulated: True for the simulated clock.
+    Outputs:
+        None
+*/
+void TickScheduler::setSimulatedClock(bool simulated)
+{
+    simulatedNow = clock.elapsed();
+    simulatedClock = simulated;
+    arm();
+}
+
+/*
+    Function: advance()
+    Purpose: Moves the simulated clock on, running the work due by then in order.
+    Inputs:
+        int milliseconds: The time to move on by.
+    Outputs:
+        None
+*/
+void TickScheduler::advance(int milliseconds)
+{
+    if (!simulatedClock)
+        return;
+
+    simulatedNow += std::max(milliseconds, 0);
+    runUntil(simulatedNow / TICK_RESOLUTION);
+}
+
+/*
+    Function: now()
+    Purpose: Gets the time of the scheduler clock.
+    Inputs:
+        None
+    Outputs:
+        The milliseconds since the scheduler was made.
+*/
+qint64 TickScheduler::now() const
+{
+    return simulatedClock ? simulatedNow : clock.elapsed();
+}
+
+/*
+    Function: getWakeups()
+    Purpose: Gets the number of times the timer woke the scheduler.
+    Inputs:
+        None
+    Outputs:
+        The number of wakeups.
+*/
+quint64 TickScheduler::getWakeups() const
+{
+    return wakeups;
+}
+
+/*
+    Function: wake()
+    Purpose: Runs the work due by now when the timer fires.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void TickScheduler::wake()
+{
+    wakeups++;
+    schedulerWakeups.add();
+    runUntil(now() / TICK_RESOLUTION);
+}
+
+/*
+    Function: add()
+    Purpose: Puts a new task on the wheel.
+    Inputs:
+        qint64 due: The tick it is first due at.
+        qint64 period: The period in ticks, zero to run once.
+        std::function<void()> work: The work.
+    Outputs:
+        The task.
+*/
+TickScheduler::Task TickScheduler::add(qint64 due, qint64 period, std::function<void()> work)
+{
+    // Nothing ran while the wheel was empty, so the ticks since are skipped.
+    if (dueTicks.isEmpty())
+    {
+        lastTick = std::max(lastTick, now() / TICK_RESOLUTION);
+    }
+
+    Task task = nextTask++;
+    insert(Entry{task, due, period, std::move(work)});
+    arm();
+    return task;
+}
+
+/*
+    Function: insert()
+    Purpose: Puts an entry in the slot of the tick it is due at.
+    Inputs:
+        Entry entry: The entry.
+    Outputs:
+        None
+*/
+void TickScheduler::insert(Entry entry)
+{
+    dueTicks.insert(entry.task, entry.due);
+    wheel[std::size_t(entry.due % TICK_WHEEL_SLOTS)].push_back(std::move(entry));
+}
+
+/*
+    Function: runUntil()
+    Purpose: Runs every tick after the last one run, up to the given one. At each tick
+             the entries due are taken out of their slot, in the order they were
+             scheduled, and periodic ones are put back at their next tick before
+             their work runs, so the work may cancel or schedule anything.
+    Inputs:
+        qint64 tick: The last tick to run.
+    Outputs:
+        None
+*/
+void TickScheduler::runUntil(qint64 tick)
+{
+    while (lastTick < tick)
+    {
+        qint64 current = ++lastTick;
+        if (dueTicks.isEmpty())
+        {
+            lastTick = tick;
+            break;
+        }
+
+        std::vector<Entry> &slot = wheel[std::size_t(current % TICK_WHEEL_SLOTS)];
+        std::vector<Entry> due;
+        auto later = std::stable_partition(slot.begin(), slot.end(), [current](const Entry &entry)
+                                           { return entry.due != current; });
+        std::move(later, slot.end(), std::back_inserter(due));
+        slot.erase(later, slot.end());
+        std::sort(due.begin(), due.end(), [](const Entry &a, const Entry &b)
+                  { return a.task < b.task; });
+
+        for (Entry &entry : due)
+        {
+            // Cancelled by work that ran before it at this tick.
+            if (dueTicks.value(entry.task, -1) != current)
+                continue;
+
+            std::function<void()> work = entry.work;
+            if (entry.period > 0)
+            {
+                entry.due = std::max(current, tick) / entry.period * entry.period + entry.period;
+                insert(std::move(entry));
+            }
+            else
+            {
+                dueTicks.remove(entry.task);
+            }
+
+            schedulerRuns.add();
+            work();
+        }
+    }
+
+    arm();
+}
+
+/*
+    Function: arm()
+    Purpose: Arms the timer for the next tick with something due. The wheel is looked
+             through one turn ahead, and only if nothing is due in that turn are all
+             the tasks looked at.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void TickScheduler::arm()
+{
+    if (simulatedClock || dueTicks.isEmpty())
+    {
+        timer->stop();
+        return;
+    }
+
+    qint64 next = -1;
+    for (qint64 tick = lastTick + 1; tick <= lastTick + TICK_WHEEL_SLOTS && next < 0; ++tick)
+    {
+        for (const Entry &entry : wheel[std::size_t(tick % TICK_WHEEL_SLOTS)])
+        {
+            if (entry.due == tick)
+            {
+                next = tick;
+                break;
+            }
+        }
+    }
+
+    if (next < 0)
+    {
+        next = *std::min_element(dueTicks.cbegin(), dueTicks.cend());
+    }
+
+    timer->start(int(std::max<qint64>(0, next * TICK_RESOLUTION - clock.elapsed())));
+}
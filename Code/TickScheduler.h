@@ -0,0 +1,90 @@
+#ifndef TICKSCHEDULER_H
+#define TICKSCHEDULER_H
+
+// Qt imports
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+
+#include <functional>
+#include <vector>
+
+// Local imports
+#include "defs.h"
+
+// Length of a tick in milliseconds, and slots of the wheel.
+#define TICK_RESOLUTION 50
+#define TICK_WHEEL_SLOTS 128
+
+// Runs periodic and one-shot work of the thread it lives on from a single timer.
+// Time is cut into ticks of TICK_RESOLUTION, and tasks are kept in a wheel of
+// TICK_WHEEL_SLOTS slots by the tick they are due at. A periodic task is due on
+// multiples of its period since the scheduler was made, so tasks with periods that
+// divide each other run on the same wakeup. The timer is only armed for the next
+// tick with something due, and not at all when nothing is scheduled. Tasks due at
+// the same tick run in the order they were scheduled, and a wakeup that comes late
+// runs the ticks it missed in order, so the order of work only depends on the
+// schedule. On a simulated clock there is no timer, and time only moves by advance.
+class TickScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef int Task;
+
+    explicit TickScheduler(QObject *parent = nullptr);
+
+    // Runs the work every period, rounded to whole ticks. A period that is late
+    // by more than a period runs once, not once for every period missed.
+    Task every(int period, std::function<void()> work);
+
+    // Runs the work once, at the first tick at least the delay from now.
+    Task after(int delay, std::function<void()> work);
+
+    // Cancelling a task that is not scheduled does nothing.
+    void cancel(Task task);
+    bool isScheduled(Task task) const;
+
+    void setSimulatedClock(bool simulated);
+
+    // Moves the simulated clock on and runs the work due by then.
+    void advance(int milliseconds);
+
+    qint64 now() const;
+    quint64 getWakeups() const;
+
+private slots:
+    void wake();
+
+private:
+    struct Entry
+    {
+        Task task;
+        qint64 due;    // Tick the task runs at.
+        qint64 period; // In ticks, zero for a one-shot task.
+        std::function<void()> work;
+    };
+
+    Task add(qint64 due, qint64 period, std::function<void()> work);
+    void insert(Entry entry);
+    void runUntil(qint64 tick);
+    void arm();
+
+    std::vector<std::vector<Entry>> wheel;
+
+    // The tick each scheduled task is due at.
+    QHash<Task, qint64> dueTicks;
+
+    // Every tick up to this one has run.
+    qint64 lastTick;
+    Task nextTask;
+    quint64 wakeups;
+
+    QTimer *timer;
+    QElapsedTimer clock;
+    bool simulatedClock;
+    qint64 simulatedNow;
+};
+
+#endif
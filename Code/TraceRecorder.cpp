@@ -0,0 +1,175 @@
+// IMPORTS
+#include "TraceRecorder.h"
+
+#include <QDebug>
+#include <QSaveFile>
+
+std::atomic<bool> TraceRecorder::enabled(false);
+
+/*
+    Function: TraceRecorder()
+    Purpose: Constructor. Spans are timed from here.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+TraceRecorder::TraceRecorder()
+    : origin(std::chrono::steady_clock::now())
+{
+}
+
+/*
+    Function: instance()
+    Purpose: Gets the process-wide recorder.
+    Inputs:
+        None
+    Outputs:
+        A pointer to the recorder.
+*/
+TraceRecorder *TraceRecorder::instance()
+{
+    static TraceRecorder recorder;
+    return &recorder;
+}
+
+/*
+    Function: enable()
+    Purpose: Starts recording spans. Tracing stays on until the application exits.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void TraceRecorder::enable()
+{
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+/*
+    Function: setThreadName()
+    Purpose: Names the calling thread in the trace.
+    Inputs:
+        const char *name: A string literal naming the thread.
+    Outputs:
+        None
+*/
+void TraceRecorder::setThreadName(const char *name)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    std::lock_guard<std::mutex> locker(buffer->mutex);
+    buffer->name = name;
+}
+
+/*
+    Function: record()
+    Purpose: Adds a span to the buffer of the calling thread. Once a thread has
+             TRACE_MAX_EVENTS_PER_THREAD spans, further spans are only counted.
+    Inputs:
+        const TraceEvent &event: The span.
+    Outputs:
+        None
+*/
+void TraceRecorder::record(const TraceEvent &event)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    std::lock_guard<std::mutex> locker(buffer->mutex);
+
+    if (buffer->events.size() < std::size_t(TRACE_MAX_EVENTS_PER_THREAD))
+    {
+        buffer->events.push_back(event);
+    }
+    else
+    {
+        buffer->dropped++;
+    }
+}
+
+/*
+    Function: threadBuffer()
+    Purpose: Gets the buffer of the calling thread, creating it on first use. Buffers
+             belong to the recorder, so the spans of a finished thread are still written.
+    Inputs:
+        None
+    Outputs:
+        The buffer of the calling thread.
+*/
+TraceRecorder::ThreadBuffer *TraceRecorder::threadBuffer()
+{
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (buffer == nullptr)
+    {
+        std::lock_guard<std::mutex> locker(buffersMutex);
+        buffers.emplace_back(new ThreadBuffer);
+        buffer = buffers.back().get();
+        buffer->id = int(buffers.size());
+        buffer->name = nullptr;
+        buffer->dropped = 0;
+        buffer->events.reserve(TRACE_INITIAL_EVENTS_PER_THREAD);
+    }
+
+    return buffer;
+}
+
+/*
+    Function: write()
+    Purpose: Writes the trace as a JSON object with a traceEvents array of complete
+             ("X") events, timed in microseconds, and a thread_name event per thread.
+    Inputs:
+        const QString &fileName: The file to write.
+    Outputs:
+        True if the file was written, false otherwise.
+*/
+bool TraceRecorder::write(const QString &fileName) const
+{
+    QByteArray json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    std::size_t dropped = 0;
+
+    auto separate = [&]()
+    {
+        if (!first)
+            json += ",\n";
+        first = false;
+    };
+
+    std::lock_guard<std::mutex> buffersLocker(buffersMutex);
+    for (const auto &buffer : buffers)
+    {
+        std::lock_guard<std::mutex> locker(buffer->mutex);
+        dropped += buffer->dropped;
+
+        QByteArray tid = QByteArray::number(buffer->id);
+        separate();
+        json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":\"" +
+                (buffer->name != nullptr ? QByteArray(buffer->name) : QByteArray("Thread ") + tid) + "\"}}";
+
+        for (const TraceEvent &event : buffer->events)
+        {
+            separate();
+            json += "{\"name\":\"";
+            json += event.name;
+            json += "\",\"cat\":\"";
+            json += event.category;
+            json += "\",\"ph\":\"X\",\"ts\":" + QByteArray::number(event.startNs / 1000.0, 'f', 3) +
+                    ",\"dur\":" + QByteArray::number(event.durationNs / 1000.0, 'f', 3) +
+                    ",\"pid\":1,\"tid\":" + tid;
+            if (event.argName != nullptr)
+            {
+                json += ",\"args\":{\"";
+                json += event.argName;
+                json += "\":" + QByteArray::number(qint64(event.arg)) + "}";
+            }
+            json += "}";
+        }
+    }
+    json += "\n]}\n";
+
+    if (dropped > 0)
+    {
+        qWarning() << "The trace is missing" << dropped << "spans, recorded after the buffer of their thread was full";
+    }
+
+    QSaveFile file(fileName);
+    return file.open(QIODevice::WriteOnly) && file.write(json) == json.size() && file.commit();
+}
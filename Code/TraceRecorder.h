@@ -0,0 +1,112 @@
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+// Qt imports
+#include <QString>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Local imports
+#include "defs.h"
+
+// Tracing, spans kept for each thread.
+#define TRACE_INITIAL_EVENTS_PER_THREAD 4096
+#define TRACE_MAX_EVENTS_PER_THREAD 1000000
+
+// A timed span of work on one thread.
+struct TraceEvent
+{
+    const char *name;     // String literals only, they are not copied.
+    const char *category;
+    const char *argName;  // Null without an argument.
+    std::int64_t arg;
+    std::int64_t startNs; // Since the recorder was created.
+    std::int64_t durationNs;
+};
+
+// Records spans on the device and GUI threads and writes them in the trace event
+// format read by chrome://tracing and Perfetto. Disabled until enable() is called,
+// when a span costs a single relaxed load. Each thread appends to a buffer of its
+// own, so threads never wait on each other while recording.
+class TraceRecorder
+{
+public:
+    static TraceRecorder *instance();
+
+    static bool isEnabled()
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    void enable();
+
+    // Name the calling thread in the trace.
+    void setThreadName(const char *name);
+
+    void record(const TraceEvent &event);
+
+    std::int64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    // Writes every span recorded so far. Returns false if the file could not be written.
+    bool write(const QString &fileName) const;
+
+private:
+    struct ThreadBuffer
+    {
+        int id;
+        const char *name;
+        std::size_t dropped;
+        std::vector<TraceEvent> events;
+        mutable std::mutex mutex; // Only contended while the trace is written.
+    };
+
+    TraceRecorder();
+    ThreadBuffer *threadBuffer();
+
+    static std::atomic<bool> enabled;
+
+    std::chrono::steady_clock::time_point origin;
+
+    mutable std::mutex buffersMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+// Records the time from its construction to the end of its scope as a span.
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, const char *category = "aed", const char *argName = nullptr, std::int64_t arg = 0)
+        : name(name), category(category), argName(argName), arg(arg),
+          startNs(TraceRecorder::isEnabled() ? TraceRecorder::instance()->now() : -1)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if (startNs >= 0)
+        {
+            TraceRecorder *recorder = TraceRecorder::instance();
+            recorder->record({name, category, argName, arg, startNs, recorder->now() - startNs});
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *name;
+    const char *category;
+    const char *argName;
+    std::int64_t arg;
+    std::int64_t startNs;
+};
+
+#endif
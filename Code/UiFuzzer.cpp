@@ -0,0 +1,414 @@
+// IMPORTS
+#include "UiFuzzer.h"
+#include "AED.h"
+#include "ProtocolRules.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSaveFile>
+#include <QSemaphore>
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/*
+    Function: UiFuzzer()
+    Purpose: Constructor.
+    Inputs:
+        quint32 seed: The seed every session is drawn from.
+        int devices: The number of devices fuzzed at once, each with its own input thread.
+    Outputs:
+        None
+*/
+UiFuzzer::UiFuzzer(quint32 seed, int devices)
+    : seed(seed), devices(qMax(1, devices)), sessions(0), inputs(0)
+{
+}
+
+/*
+    Function: run()
+    Purpose: Fuzzes the devices for the given time, then reports the failures found and
+             writes their reproducers.
+    Inputs:
+        int seconds: How long to fuzz.
+        const QString &reproducerFile: The file the reproducers are written to, as a scenario script.
+    Outputs:
+        The number of distinct failures.
+*/
+int UiFuzzer::run(int seconds, const QString &reproducerFile)
+{
+    qInfo().noquote() << QString("Fuzzer: %1 devices for %2 s, seed %3").arg(devices).arg(seconds).arg(seed);
+
+    QElapsedTimer timer;
+    timer.start();
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+
+    QRandomGenerator random(seed);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < devices; ++i)
+    {
+        threads.emplace_back(&UiFuzzer::fuzz, this, random.generate(), end);
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+
+    double elapsed = timer.nsecsElapsed() / 1e9;
+    qInfo().noquote() << QString("Fuzzer: %1 sessions, %2 inputs in %3 s (%4 inputs per second), %5 distinct failures")
+                             .arg(sessions.load()).arg(inputs.load()).arg(elapsed, 0, 'f', 1)
+                             .arg(inputs.load() / qMax(elapsed, 1e-9), 0, 'f', 0).arg(failures.size());
+
+    if (failures.isEmpty())
+        return 0;
+
+    QString script;
+    int index = 0;
+    for (auto it = failures.begin(); it != failures.end(); ++it)
+    {
+        Failure &failure = it.value();
+        failure.reproducer.name = QString("fuzz-%1").arg(++index);
+
+        qInfo().noquote() << QString("FAIL %1: %2 (seen %3 times%4)").arg(failure.reproducer.name, it.key()).arg(failure.seen)
+                                 .arg(failure.replays ? "" : ", does not replay");
+
+        script += "# " + it.key() + "\n";
+        script += failure.replays ? QString("# Replays with the inputs below.\n")
+                                  : QString("# Did not replay: the inputs below are where they landed while fuzzing.\n");
+        script += ScenarioRunner::format(failure.reproducer) + "\n";
+    }
+
+    QSaveFile file(reproducerFile);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Text) && file.write(script.toUtf8()) >= 0 && file.commit())
+    {
+        qInfo().noquote() << "Fuzzer: reproducers written to" << reproducerFile;
+    }
+    else
+    {
+        qWarning().noquote() << "Fuzzer: cannot write" << reproducerFile;
+    }
+
+    return failures.size();
+}
+
+/*
+    Function: fuzz()
+    Purpose: Runs random sessions on a device of its own until the end time. The first
+             time a failure is seen, it is shrunk to a reproducer on the same device.
+    Inputs:
+        quint32 seed: The seed of this device's sessions.
+        std::chrono::steady_clock::time_point end: When to stop.
+    Outputs:
+        None
+*/
+void UiFuzzer::fuzz(quint32 seed, std::chrono::steady_clock::time_point end)
+{
+    QRandomGenerator random(seed);
+
+    // Devices live for the whole application.
+    AED *device = new AED();
+
+    while (std::chrono::steady_clock::now() < end)
+    {
+        Scenario scenario = randomScenario(random);
+        QVector<AEDState> states;
+        QVector<GivenInput> given;
+
+        QString failure = session(device, scenario, random, states, given);
+        sessions++;
+        if (failure.isEmpty())
+            continue;
+
+        {
+            QMutexLocker locker(&failuresMutex);
+            auto it = failures.find(failure);
+            if (it != failures.end())
+            {
+                it->seen++;
+                continue;
+            }
+
+            // Claim it, so that no other device shrinks it too.
+            failures.insert(failure, Failure{scenario, false, 1});
+        }
+
+        Failure found = reproduce(device, scenario, states, given);
+
+        QMutexLocker locker(&failuresMutex);
+        found.seen = failures[failure].seen;
+        failures[failure] = found;
+    }
+}
+
+/*
+    Function: randomScenario()
+    Purpose: Draws the configuration of a session. The inputs are drawn with the session.
+    Inputs:
+        QRandomGenerator &random: The generator.
+    Outputs:
+        The scenario, without inputs or expected states.
+*/
+Scenario UiFuzzer::randomScenario(QRandomGenerator &random) const
+{
+    Scenario scenario;
+    scenario.seed = random.generate();
+    scenario.condition = (HeartState)random.bounded(ASYSTOLE + 1);
+    scenario.shocks = random.bounded(FUZZ_MAX_SHOCKS + 1);
+    scenario.padsAttached = random.bounded(2) == 0;
+    scenario.batteryLevel = random.bounded(MIN_BATTERY_LEVEL, MAX_BATTERY_LEVEL + 1);
+    scenario.poorContact = random.bounded(4) == 0;
+    scenario.loseConnection = random.bounded(4) == 0;
+    scenario.startWithAsystole = random.bounded(4) == 0;
+
+    return scenario;
+}
+
+/*
+    Function: session()
+    Purpose: Runs one session, giving random inputs at random times after power on from
+             the calling thread. Once they are all given, an operator that is waited on
+             and has nothing left to give powers the device off.
+    Inputs:
+        AED *&device: A device that is off. Replaced by a new device if it deadlocks.
+        const Scenario &scenario: The configuration of the session.
+        QRandomGenerator &random: The generator the inputs are drawn from.
+        QVector<AEDState> &states: Set to the states reported.
+        QVector<GivenInput> &given: Set to the inputs given.
+    Outputs:
+        A description of the failure, or an empty string if the session did not fail.
+*/
+QString UiFuzzer::session(AED *&device, const Scenario &scenario, QRandomGenerator &random,
+                          QVector<AEDState> &states, QVector<GivenInput> &given)
+{
+    struct PlannedInput
+    {
+        int delay;
+        ScenarioInput input;
+        bool enabled;
+    };
+
+    QVector<PlannedInput> plan(random.bounded(FUZZ_MAX_INPUTS + 1));
+    for (PlannedInput &planned : plan)
+    {
+        planned.delay = random.bounded(FUZZ_MAX_INPUT_DELAY);
+        planned.input = (ScenarioInput)random.bounded(INPUT_POOR_CONTACT + 1);
+        planned.enabled = random.bounded(2) == 0;
+    }
+    std::sort(plan.begin(), plan.end(), [](const PlannedInput &a, const PlannedInput &b)
+              { return a.delay < b.delay; });
+
+    ScenarioRunner::configure(device, scenario);
+
+    QMutex mutex;
+    AED *target = device;
+    QMetaObject::Connection connection = QObject::connect(device, &AED::updateGUI, device, [&, target](int value)
+    {
+        QMutexLocker locker(&mutex);
+        states.append((AEDState)value);
+
+        if (states.size() == SCENARIO_MAX_STEPS)
+        {
+            target->powerOff();
+        }
+    }, Qt::DirectConnection);
+
+    auto give = [&](ScenarioInput input, bool enabled)
+    {
+        int reported;
+        {
+            QMutexLocker locker(&mutex);
+            reported = states.size();
+        }
+
+        ScenarioRunner::give(target, input, enabled);
+        inputs++;
+
+        QMutexLocker locker(&mutex);
+        given.append(GivenInput{reported, int(states.size()), input, enabled});
+    };
+
+    // Shared with the device thread, which may outlive this call if it deadlocks.
+    std::shared_ptr<QSemaphore> finished(new QSemaphore);
+    device->send(DeviceCommand(COMMAND_POWER_ON));
+    QMetaObject::invokeMethod(device, [finished]()
+                              { finished->release(); }, Qt::QueuedConnection);
+
+    // Spin to each input's time, sleeping would round the delays up to the scheduler's tick.
+    auto start = std::chrono::steady_clock::now();
+    for (const PlannedInput &planned : plan)
+    {
+        while (std::chrono::steady_clock::now() < start + std::chrono::microseconds(planned.delay))
+        {
+            std::this_thread::yield();
+        }
+        give(planned.input, planned.enabled);
+    }
+
+    QString failure;
+    bool poweredOff = false;
+    bool deadlocked = false;
+    QElapsedTimer settle;
+    settle.start();
+    while (!finished->tryAcquire(1, 1))
+    {
+        if (poweredOff)
+        {
+            if (settle.elapsed() < FUZZ_HANG_TIMEOUT)
+                continue;
+
+            QMutexLocker locker(&mutex);
+            failure = QString("powering off at %1 did not end the session").arg(aedStateName(states.isEmpty() ? OFF : states.last()));
+            deadlocked = true;
+            break;
+        }
+
+        // Whether the device waits on the operator for an input that was not given. Pads
+        // are waited on until they were last attached, not detached, and the cable until
+        // it was plugged back in after it was lost.
+        AEDState last;
+        bool awaited = false;
+        {
+            QMutexLocker locker(&mutex);
+            last = states.isEmpty() ? OFF : states.last();
+            for (const GivenInput &input : given)
+            {
+                if ((last == ATTACH_PADS || last == CHECK_PADS) && (input.input == INPUT_ATTACH_PADS || input.input == INPUT_DETACH_PADS))
+                {
+                    awaited = input.input == INPUT_ATTACH_PADS;
+                }
+                else if (last == LOST_CONNECTION && input.input == INPUT_RECONNECT && input.reported >= states.size())
+                {
+                    awaited = true;
+                }
+            }
+        }
+
+        bool waiting = (last == ATTACH_PADS || last == CHECK_PADS || last == LOST_CONNECTION) && !awaited;
+        if (!waiting && settle.elapsed() < FUZZ_SETTLE_TIME)
+            continue;
+
+        if (!waiting)
+        {
+            failure = awaited ? QString("lost wakeup: still at %1 after %2").arg(aedStateName(last), last == LOST_CONNECTION ? "reconnect" : "attach-pads")
+                              : QString("the session stalled at %1").arg(aedStateName(last));
+        }
+
+        // The operator gives up.
+        give(INPUT_POWER_OFF, true);
+        poweredOff = true;
+        settle.restart();
+    }
+
+    QObject::disconnect(connection);
+
+    if (deadlocked)
+    {
+        // The thread of the device is stuck, leave it be and carry on with a new device.
+        device = new AED();
+        return failure;
+    }
+
+    if (!failure.isEmpty())
+        return failure;
+
+    // A power off that may have come during the shock is allowed to be refused.
+    QVector<int> powerOffs;
+    for (const GivenInput &input : given)
+    {
+        if (input.input != INPUT_POWER_OFF)
+            continue;
+
+        bool duringShock = false;
+        for (int i = qMax(0, input.reported - 1); i < input.landed && i < states.size(); ++i)
+        {
+            duringShock = duringShock || states[i] == STAND_CLEAR || states[i] == SHOCKING;
+        }
+        if (!duringShock)
+        {
+            powerOffs.append(input.landed);
+        }
+    }
+
+    return ProtocolRules::check(states, powerOffs);
+}
+
+/*
+    Function: reproduce()
+    Purpose: Turns a failed session into a scenario. Every input is given at the state
+             that was reported last when it was given. If the scenario fails, inputs are
+             taken out one at a time as long as it still fails the same way.
+    Inputs:
+        AED *&device: A device that is off. Replaced by a new device if it deadlocks.
+        Scenario scenario: The configuration of the session.
+        const QVector<AEDState> &states: The states reported in the session.
+        const QVector<GivenInput> &given: The inputs given in the session.
+    Outputs:
+        The reproducer.
+*/
+UiFuzzer::Failure UiFuzzer::reproduce(AED *&device, Scenario scenario, const QVector<AEDState> &states, const QVector<GivenInput> &given)
+{
+    if (states.isEmpty())
+        return Failure{scenario, false, 0};
+
+    QMap<AEDState, int> occurrences;
+    int counted = 0;
+    for (const GivenInput &input : given)
+    {
+        // Inputs given before the first state are given at the first state.
+        int at = qBound(1, input.reported, states.size()) - 1;
+        for (; counted <= at; ++counted)
+        {
+            occurrences[states[counted]]++;
+        }
+
+        scenario.actions.append(ScenarioAction{states[at], occurrences[states[at]], input.input, input.enabled});
+    }
+    scenario.expected = states;
+
+    ScenarioResult result = ScenarioRunner::play(device, scenario, FUZZ_HANG_TIMEOUT);
+    if (!result.failed())
+        return Failure{scenario, false, 0};
+
+    const QString failure = describe(result);
+    scenario.expected = result.states;
+
+    for (int i = 0; i < scenario.actions.size();)
+    {
+        Scenario smaller = scenario;
+        smaller.actions.remove(i);
+
+        result = ScenarioRunner::play(device, smaller, FUZZ_HANG_TIMEOUT);
+        if (result.failed() && describe(result) == failure)
+        {
+            scenario = smaller;
+            scenario.expected = result.states;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    return Failure{scenario, true, 0};
+}
+
+/*
+    Function: describe()
+    Purpose: Describes how a scripted session failed.
+    Inputs:
+        const ScenarioResult &result: The session.
+    Outputs:
+        The description, empty if it did not fail.
+*/
+QString UiFuzzer::describe(const ScenarioResult &result)
+{
+    const char *last = aedStateName(result.states.isEmpty() ? OFF : result.states.last());
+    if (result.deadlocked)
+        return QString("powering off at %1 did not end the session").arg(last);
+    if (result.timedOut)
+        return QString("the session stalled at %1").arg(last);
+
+    return result.violation;
+}
@@ -0,0 +1,78 @@
+#ifndef UIFUZZER_H
+#define UIFUZZER_H
+
+// Qt imports
+#include <QMap>
+#include <QMutex>
+#include <QRandomGenerator>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+#include <chrono>
+
+// Local imports
+#include "defs.h"
+#include "ScenarioRunner.h"
+
+// UI fuzzer. Input delays are in microseconds after power on, other times in milliseconds.
+#define FUZZ_MAX_INPUTS 8
+#define FUZZ_MAX_INPUT_DELAY 2000
+#define FUZZ_MAX_SHOCKS 3
+#define FUZZ_SETTLE_TIME 100
+#define FUZZ_HANG_TIMEOUT 1000
+
+class AED;
+
+// Fires randomized operator inputs at devices running on a simulated clock. The
+// inputs come from a thread of their own at random times, so they race the device
+// thread the way the main window does. Every session is checked for deadlocks, lost
+// wakeups and departures from the protocol, and each distinct failure is saved as a
+// scenario script that replays it, shrunk to the fewest inputs that still fail.
+class UiFuzzer
+{
+public:
+    UiFuzzer(quint32 seed, int devices);
+
+    // Fuzzes for the given time and writes the reproducers to a file.
+    // Returns the number of distinct failures found.
+    int run(int seconds, const QString &reproducerFile);
+
+private:
+    // An input as it was given, with the number of states reported just before
+    // and just after, since the device may have moved on meanwhile.
+    struct GivenInput
+    {
+        int reported;
+        int landed;
+        ScenarioInput input;
+        bool enabled;
+    };
+
+    struct Failure
+    {
+        Scenario reproducer;
+        bool replays; // False if the scripted inputs did not bring the failure back.
+        int seen;
+    };
+
+    void fuzz(quint32 seed, std::chrono::steady_clock::time_point end);
+    Scenario randomScenario(QRandomGenerator &random) const;
+    QString session(AED *&device, const Scenario &scenario, QRandomGenerator &random,
+                    QVector<AEDState> &states, QVector<GivenInput> &given);
+    Failure reproduce(AED *&device, Scenario scenario, const QVector<AEDState> &states, const QVector<GivenInput> &given);
+
+    static QString describe(const ScenarioResult &result);
+
+    quint32 seed;
+    int devices;
+
+    std::atomic<quint64> sessions;
+    std::atomic<quint64> inputs;
+
+    // Distinct failures, by description.
+    QMutex failuresMutex;
+    QMap<QString, Failure> failures;
+};
+
+#endif
@@ -0,0 +1,572 @@
+// IMPORTS
+#include "VoicePrompter.h"
+#include "AED.h"
+#include "MetricsRegistry.h"
+#include "TraceRecorder.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QtEndian>
+#include <QtMath>
+
+#include <algorithm>
+
+static MetricHistogram &promptStartLatency = MetricsRegistry::instance()->histogram("aed_prompt_start_latency_seconds", "Time from the device entering a step to the first sample of its prompt reaching the audio sink, for prompts that did not queue.", 1e-6);
+static MetricHistogram &promptQueueWait = MetricsRegistry::instance()->histogram("aed_prompt_queue_wait_seconds", "Time from the device entering a step to its prompt starting, for prompts that queued behind another.", 1e-6);
+static MetricCounter &promptsLate = MetricsRegistry::instance()->counter("aed_prompts_late_total", "Prompts that did not queue but started later than the latency target.");
+static MetricCounter &promptsInterrupted = MetricsRegistry::instance()->counter("aed_prompts_interrupted_total", "Prompts cut short by a more urgent one or by the device turning off.");
+static MetricCounter &promptsDropped = MetricsRegistry::instance()->counter("aed_prompts_dropped_total", "Prompts dropped from the queue unplayed.");
+
+// Tones of the prompts without a clip.
+static const float TONE_AMPLITUDE = 0.3f * 32767.0f;
+static const int TONE_GAP_TIME = 60;
+static const int TONE_RAMP_TIME = 5;
+
+// Clicks of the CPR metronome.
+static const float CLICK_AMPLITUDE = 0.5f * 32767.0f;
+static const float CLICK_FREQUENCY = 2000.0f;
+static const int CLICK_TIME = 15;
+
+/*
+    Function: VoicePrompter()
+    Purpose: Constructor. Decodes a clip for every step and starts the prompter thread.
+    Inputs:
+        std::unique_ptr<AudioSink> sink: Where the prompts are played.
+        const QString &clipDirectory: The directory of the clips, empty for tones only.
+    Outputs:
+        None
+*/
+VoicePrompter::VoicePrompter(std::unique_ptr<AudioSink> sink, const QString &clipDirectory)
+    : QObject(nullptr), sink(std::move(sink)), sinkOpen(false), periodTimer(nullptr), clockStart(std::chrono::steady_clock::now()), written(0), playing(false),
+      current{OFF, std::chrono::steady_clock::time_point(), false}, started(false), position(0), fading(false), fadeRemaining(0),
+      period(PROMPT_SAMPLE_RATE * PROMPT_PERIOD_TIME / 1000)
+{
+    for (int state = SELF_TEST_SUCCESS; state <= CHECK_PADS; ++state)
+    {
+        if (state == ABORT)
+            continue;
+
+        if (!clipDirectory.isEmpty())
+        {
+            QString fileName = QDir(clipDirectory).filePath(QString(aedStateName((AEDState)state)) + ".wav");
+            clips[state] = loadClip(fileName);
+            if (clips[state].empty() && QFile::exists(fileName))
+            {
+                qWarning().noquote() << QString("%1 is not 16 bit mono PCM at %2 Hz, a tone is played instead").arg(fileName).arg(PROMPT_SAMPLE_RATE);
+            }
+        }
+
+        if (clips[state].empty())
+        {
+            clips[state] = toneClip((AEDState)state);
+        }
+    }
+
+    // A short decaying burst, heard over a prompt.
+    int clickLength = PROMPT_SAMPLE_RATE * CLICK_TIME / 1000;
+    for (int i = 0; i < clickLength; ++i)
+    {
+        float decay = 1.0f - float(i) / float(clickLength);
+        clickClip.push_back(qint16(CLICK_AMPLITUDE * decay * decay * qSin(2.0f * float(M_PI) * CLICK_FREQUENCY * float(i) / float(PROMPT_SAMPLE_RATE))));
+    }
+
+    m_thread.reset(new QThread);
+    moveToThread(m_thread.get());
+    m_thread->start();
+}
+
+/*
+    Function: ~VoicePrompter()
+    Purpose: Destructor. Closes the sink and stops the prompter thread.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+VoicePrompter::~VoicePrompter()
+{
+    QMetaObject::invokeMethod(this, "shutDown", Qt::BlockingQueuedConnection);
+    m_thread->quit();
+    m_thread->wait();
+}
+
+/*
+    Function: follow()
+    Purpose: Prompts every step of a device. The prompt is asked for on the device
+             thread as the step is entered, so a busy GUI does not hold it back.
+    Inputs:
+        AED *device: The device.
+    Outputs:
+        None
+*/
+void VoicePrompter::follow(AED *device)
+{
+    connect(device, &AED::updateGUI, this, &VoicePrompter::prompt, Qt::DirectConnection);
+}
+
+/*
+    Function: priority()
+    Purpose: Gets how urgent the prompt of a step is.
+    Inputs:
+        AEDState state: The step.
+    Outputs:
+        The priority of its prompt.
+*/
+PromptPriority VoicePrompter::priority(AEDState state)
+{
+    switch (state)
+    {
+    case SELF_TEST_FAIL:
+    case CHANGE_BATTERIES:
+    case STAND_CLEAR:
+    case SHOCKING:
+    case LOST_CONNECTION:
+    case CHECK_PADS:
+        return PROMPT_URGENT;
+
+    case ATTACH_PADS:
+    case ANALYZING:
+    case SHOCK_ADVISED:
+    case NO_SHOCK_ADVISED:
+    case SHOCK_DELIVERED:
+    case CPR:
+    case STOP_CPR:
+        return PROMPT_NORMAL;
+
+    default:
+        return PROMPT_INFO;
+    }
+}
+
+/*
+    Function: prompt()
+    Purpose: Asks for the prompt of a step, timed from now. Can be called from any thread.
+    Inputs:
+        int state: The step.
+    Outputs:
+        None
+*/
+void VoicePrompter::prompt(int state)
+{
+    Request asked{(AEDState)state, std::chrono::steady_clock::now(), false};
+    QMetaObject::invokeMethod(this, [this, asked]()
+                              { request(asked); }, Qt::QueuedConnection);
+}
+
+/*
+    Function: request()
+    Purpose: Plays, queues or drops a prompt, interrupting the one playing if the new
+             prompt is more urgent.
+    Inputs:
+        Request request: The prompt asked for.
+    Outputs:
+        None
+*/
+void VoicePrompter::request(Request request)
+{
+    // The session is over.
+    if (request.state == OFF || request.state == ABORT)
+    {
+        promptsDropped.add(queue.size());
+        queue.clear();
+        fadeOut();
+        render();
+        return;
+    }
+
+    if (request.state < OFF || request.state > CHECK_PADS || clips[request.state].empty())
+        return;
+
+    PromptPriority urgency = priority(request.state);
+    if (playing)
+    {
+        // Already being said, such as CHECK PADS asked for again a second later.
+        if (request.state == current.state && !fading)
+            return;
+
+        if (urgency > priority(current.state))
+        {
+            auto lessUrgent = std::remove_if(queue.begin(), queue.end(), [urgency](const Request &queued)
+                                             { return priority(queued.state) < urgency; });
+            promptsDropped.add(queue.end() - lessUrgent);
+            queue.erase(lessUrgent, queue.end());
+
+            // Played once the current prompt has faded out.
+            queue.push_front(request);
+            fadeOut();
+            render();
+            return;
+        }
+
+        request.queued = true;
+    }
+
+    if (queue.size() >= PROMPT_QUEUE_LENGTH)
+    {
+        // Make room by dropping the oldest of the least urgent, unless that is the new prompt.
+        auto least = std::min_element(queue.begin(), queue.end(), [](const Request &a, const Request &b)
+                                      { return priority(a.state) < priority(b.state); });
+        promptsDropped.add();
+        if (priority(least->state) > urgency)
+            return;
+
+        queue.erase(least);
+    }
+
+    queue.push_back(request);
+    if (!playing)
+    {
+        playNext();
+        render();
+    }
+}
+
+/*
+    Function: playNext()
+    Purpose: Starts the most urgent queued prompt, the oldest of equals, skipping those
+             that waited too long.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void VoicePrompter::playNext()
+{
+    auto now = std::chrono::steady_clock::now();
+    while (!queue.empty())
+    {
+        auto next = std::max_element(queue.begin(), queue.end(), [](const Request &a, const Request &b)
+                                     { return priority(a.state) < priority(b.state); });
+        Request request = *next;
+        queue.erase(next);
+
+        if (now - request.asked > std::chrono::milliseconds(PROMPT_MAX_AGE))
+        {
+            promptsDropped.add();
+            continue;
+        }
+
+        current = request;
+        playing = true;
+        started = false;
+        position = 0;
+        fading = false;
+        fadeRemaining = 0;
+        wake();
+        return;
+    }
+
+    playing = false;
+}
+
+/*
+    Function: wake()
+    Purpose: Starts feeding the sink, if it was idle, from now on. The sink is opened
+             the first time.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void VoicePrompter::wake()
+{
+    if (!sinkOpen)
+    {
+        TraceRecorder::instance()->setThreadName("Voice prompts");
+
+        // A sink that could not be opened drops what it is given.
+        sink->open(PROMPT_SAMPLE_RATE);
+        sinkOpen = true;
+    }
+
+    // Created here so that the timer belongs to the prompter thread.
+    if (periodTimer == nullptr)
+    {
+        periodTimer = new QTimer(this);
+        periodTimer->setTimerType(Qt::PreciseTimer);
+        connect(periodTimer, &QTimer::timeout, this, &VoicePrompter::render);
+    }
+
+    if (!periodTimer->isActive())
+    {
+        clockStart = std::chrono::steady_clock::now();
+        written = 0;
+        periodTimer->start(PROMPT_PERIOD_TIME);
+    }
+}
+
+/*
+    Function: fadeOut()
+    Purpose: Ends the prompt playing within PROMPT_FADE_TIME, without a click.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void VoicePrompter::fadeOut()
+{
+    if (!playing || fading)
+        return;
+
+    promptsInterrupted.add();
+    fading = true;
+    fadeRemaining = std::min(std::size_t(PROMPT_SAMPLE_RATE * PROMPT_FADE_TIME / 1000), clips[current.state].size() - position);
+}
+
+/*
+    Function: click()
+    Purpose: Plays a click a fixed time after the given deadline, PROMPT_LEAD_TIME and a
+             period, by which the samples of that moment are still to be written. Every
+             click is as late as the others, so their rhythm is exact to the sample.
+             Can be called from any thread.
+    Inputs:
+        qint64 deadlineNs: The deadline, in nanoseconds of the steady clock.
+    Outputs:
+        None
+*/
+void VoicePrompter::click(qint64 deadlineNs)
+{
+    auto deadline = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(deadlineNs)));
+    QMetaObject::invokeMethod(this, [this, deadline]()
+    {
+        wake();
+
+        auto at = deadline + std::chrono::milliseconds(PROMPT_LEAD_TIME + PROMPT_PERIOD_TIME);
+        qint64 sample = std::chrono::duration_cast<std::chrono::nanoseconds>(at - clockStart).count() * PROMPT_SAMPLE_RATE / 1000000000;
+        clicks.push_back(std::max(sample, written));
+        render();
+    }, Qt::QueuedConnection);
+}
+
+/*
+    Function: render()
+    Purpose: Feeds the sink up to PROMPT_LEAD_TIME ahead of the time played, with the
+             clicks mixed in, moving on to the next prompt as each one ends. Stops the
+             period timer once there is nothing left to play.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void VoicePrompter::render()
+{
+    const std::size_t fadeSamples = PROMPT_SAMPLE_RATE * PROMPT_FADE_TIME / 1000;
+    qint64 elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - clockStart).count();
+    qint64 due = elapsedNs * PROMPT_SAMPLE_RATE / 1000000000 + PROMPT_SAMPLE_RATE * PROMPT_LEAD_TIME / 1000;
+
+    while ((playing || !clicks.empty()) && written < due)
+    {
+        int count = int(std::min<qint64>(due - written, qint64(period.size())));
+        std::size_t end = 0;
+        if (playing)
+        {
+            const std::vector<qint16> &clip = clips[current.state];
+            end = fading ? position + fadeRemaining : clip.size();
+            count = int(std::min<qint64>(count, qint64(end - position)));
+            for (int i = 0; i < count; ++i)
+            {
+                float gain = fading ? float(fadeRemaining - i) / float(fadeSamples) : 1.0f;
+                period[i] = qint16(clip[position + i] * gain);
+            }
+        }
+        else
+        {
+            std::fill(period.begin(), period.begin() + count, qint16(0));
+        }
+
+        for (qint64 at : clicks)
+        {
+            for (int i = int(qMax<qint64>(0, at - written)); i < count && written + i - at < qint64(clickClip.size()); ++i)
+            {
+                period[i] = qint16(qBound(-32768, period[i] + clickClip[std::size_t(written + i - at)], 32767));
+            }
+        }
+
+        int taken = count > 0 ? sink->write(period.data(), count) : 0;
+        if (playing && taken > 0 && !started)
+        {
+            started = true;
+            record(current);
+        }
+
+        written += taken;
+        while (!clicks.empty() && clicks.front() + qint64(clickClip.size()) <= written)
+        {
+            clicks.pop_front();
+        }
+
+        if (playing)
+        {
+            position += taken;
+            if (fading)
+            {
+                fadeRemaining -= taken;
+            }
+
+            if (position >= end)
+            {
+                playNext();
+                continue;
+            }
+        }
+
+        if (taken < count)
+        {
+            // The sink is full, the rest goes in the next period.
+            break;
+        }
+    }
+
+    if (!playing && clicks.empty() && periodTimer != nullptr)
+    {
+        periodTimer->stop();
+    }
+}
+
+/*
+    Function: record()
+    Purpose: Records how long a prompt took to start.
+    Inputs:
+        const Request &request: The prompt, as its first samples reach the sink.
+    Outputs:
+        None
+*/
+void VoicePrompter::record(const Request &request)
+{
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request.asked).count();
+    if (request.queued)
+    {
+        promptQueueWait.record(latency);
+        return;
+    }
+
+    promptStartLatency.record(latency);
+    if (latency > PROMPT_LATENCY_TARGET * 1000)
+    {
+        promptsLate.add();
+    }
+}
+
+/*
+    Function: shutDown()
+    Purpose: Stops playing and closes the sink, on the prompter thread.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void VoicePrompter::shutDown()
+{
+    if (periodTimer != nullptr)
+    {
+        periodTimer->stop();
+    }
+    playing = false;
+    queue.clear();
+    clicks.clear();
+
+    if (sinkOpen)
+    {
+        sink->close();
+        sinkOpen = false;
+    }
+}
+
+/*
+    Function: loadClip()
+    Purpose: Reads a WAV file of 16 bit mono PCM at PROMPT_SAMPLE_RATE.
+    Inputs:
+        const QString &fileName: The file.
+    Outputs:
+        The samples, empty if the file cannot be read or has another format.
+*/
+std::vector<qint16> VoicePrompter::loadClip(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+
+    QByteArray data = file.readAll();
+    if (data.size() < 12 || !data.startsWith("RIFF") || data.mid(8, 4) != "WAVE")
+        return {};
+
+    const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+    bool formatMatches = false;
+    qint64 offset = 12;
+    while (offset + 8 <= data.size())
+    {
+        QByteArray id = data.mid(int(offset), 4);
+        qint64 size = qFromLittleEndian<quint32>(bytes + offset + 4);
+        offset += 8;
+        if (size > data.size() - offset)
+            break;
+
+        if (id == "fmt " && size >= 16)
+        {
+            formatMatches = qFromLittleEndian<quint16>(bytes + offset) == 1 && qFromLittleEndian<quint16>(bytes + offset + 2) == 1 &&
+                            qFromLittleEndian<quint32>(bytes + offset + 4) == PROMPT_SAMPLE_RATE && qFromLittleEndian<quint16>(bytes + offset + 14) == 16;
+        }
+        else if (id == "data" && formatMatches)
+        {
+            std::vector<qint16> clip(std::size_t(size / 2));
+            for (std::size_t i = 0; i < clip.size(); ++i)
+            {
+                clip[i] = qFromLittleEndian<qint16>(bytes + offset + 2 * i);
+            }
+            return clip;
+        }
+
+        // Chunks are padded to an even size.
+        offset += size + (size & 1);
+    }
+
+    return {};
+}
+
+/*
+    Function: toneClip()
+    Purpose: Makes a tone for a step without a clip. Urgent prompts alternate two high
+             tones and normal ones start with a beep. The last beep is pitched by the
+             step, so that steps can be told apart by ear.
+    Inputs:
+        AEDState state: The step.
+    Outputs:
+        The samples.
+*/
+std::vector<qint16> VoicePrompter::toneClip(AEDState state)
+{
+    struct Beep
+    {
+        float frequency;
+        int time;
+    };
+
+    std::vector<Beep> beeps;
+    PromptPriority urgency = priority(state);
+    if (urgency == PROMPT_URGENT)
+    {
+        beeps = {{880.0f, 150}, {660.0f, 150}, {880.0f, 150}, {660.0f, 150}};
+    }
+    else if (urgency == PROMPT_NORMAL)
+    {
+        beeps = {{660.0f, 150}};
+    }
+    beeps.push_back({400.0f + 40.0f * state, 250});
+
+    std::vector<qint16> clip;
+    const int ramp = PROMPT_SAMPLE_RATE * TONE_RAMP_TIME / 1000;
+    for (const Beep &beep : beeps)
+    {
+        int length = PROMPT_SAMPLE_RATE * beep.time / 1000;
+        for (int i = 0; i < length; ++i)
+        {
+            float envelope = std::min(1.0f, float(std::min(i, length - 1 - i)) / float(ramp));
+            float phase = 2.0f * float(M_PI) * beep.frequency * float(i) / float(PROMPT_SAMPLE_RATE);
+            clip.push_back(qint16(TONE_AMPLITUDE * envelope * qSin(phase)));
+        }
+        clip.insert(clip.end(), std::size_t(PROMPT_SAMPLE_RATE * TONE_GAP_TIME / 1000), 0);
+    }
+
+    return clip;
+}
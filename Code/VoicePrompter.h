@@ -0,0 +1,112 @@
+#ifndef VOICEPROMPTER_H
+#define VOICEPROMPTER_H
+
+// Qt imports
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QTimer>
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Local imports
+#include "defs.h"
+#include "AudioSink.h"
+
+// Voice prompts, 16 bit mono PCM. Times in milliseconds.
+#define PROMPT_SAMPLE_RATE 16000
+#define PROMPT_FADE_TIME 20
+#define PROMPT_QUEUE_LENGTH 3
+#define PROMPT_MAX_AGE 3000
+#define PROMPT_LATENCY_TARGET 30
+
+class AED;
+
+// How a prompt gets along with the one playing.
+enum PromptPriority
+{
+    PROMPT_INFO,   // Waits its turn, such as STAY CALM.
+    PROMPT_NORMAL, // Waits its turn, and interrupts information.
+    PROMPT_URGENT  // Interrupts anything less urgent, such as STAND CLEAR.
+};
+
+// Speaks the prompt of each step the device enters, on a thread of its own. Every
+// clip is decoded when the prompter is made, so starting one is only a copy into
+// the sink. A prompt more urgent than the one playing fades it out and takes its
+// place, dropping the less urgent prompts queued. Other prompts queue behind it,
+// and are dropped if they wait longer than PROMPT_MAX_AGE, since the device has
+// moved on by then. The time from a step being entered to the first sample of its
+// prompt reaching the sink is recorded, and is kept within PROMPT_LATENCY_TARGET
+// unless the prompt had to queue.
+class VoicePrompter : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Clips are read from <STATE>.wav files in the directory, as 16 bit mono PCM
+    // at PROMPT_SAMPLE_RATE. Steps without one get a tone.
+    VoicePrompter(std::unique_ptr<AudioSink> sink, const QString &clipDirectory = QString());
+    ~VoicePrompter();
+
+    // Speaks the steps of the device as it enters them, on the device thread.
+    void follow(AED *device);
+
+    static PromptPriority priority(AEDState state);
+
+public slots:
+    // Can be called from any thread. OFF and ABORT silence the prompts.
+    void prompt(int state);
+
+    // Clicks over the prompts, for the CPR metronome. Can be called from any thread.
+    void click(qint64 deadlineNs);
+
+private slots:
+    void render();
+    void shutDown();
+
+private:
+    struct Request
+    {
+        AEDState state;
+        std::chrono::steady_clock::time_point asked;
+        bool queued; // True if it had to wait for another prompt to finish.
+    };
+
+    void request(Request request);
+    void playNext();
+    void wake();
+    void fadeOut();
+    void record(const Request &request);
+
+    static std::vector<qint16> loadClip(const QString &fileName);
+    static std::vector<qint16> toneClip(AEDState state);
+
+    // One per state, only read after the constructor.
+    std::vector<qint16> clips[CHECK_PADS + 1];
+
+    // Only used on the prompter thread.
+    std::unique_ptr<AudioSink> sink;
+    bool sinkOpen;
+    QTimer *periodTimer;
+    std::chrono::steady_clock::time_point clockStart;
+    qint64 written;
+    std::deque<Request> queue;
+    bool playing;
+    Request current;
+    bool started;
+    std::size_t position;
+    bool fading;
+    std::size_t fadeRemaining;
+    std::vector<qint16> period;
+
+    // Clicks to play, by the sample they start at.
+    std::vector<qint16> clickClip;
+    std::deque<qint64> clicks;
+
+    std::unique_ptr<QThread> m_thread;
+};
+
+#endif
@@ -0,0 +1,562 @@
+// IMPORTS
+#include "WardDashboard.h"
+#include "AED.h"
+#include "EcgArtifacts.h"
+
+#include <QPainter>
+#include <QPaintEvent>
+#include <QRandomGenerator>
+#include <QScrollBar>
+#include <QtMath>
+
+#include <cmath>
+
+// Inner padding of a tile and the width of its ECG strip.
+static const int TILE_PADDING = 8;
+static const int ECG_WIDTH = WARD_TILE_WIDTH - 2 * TILE_PADDING;
+
+// Pixels the ECG strip scrolls by on each refresh.
+static const int ECG_STEP = 2;
+
+/*
+    Function: gaussian()
+    Purpose: Bell-shaped bump used to build the ECG complexes.
+    Inputs:
+        qreal x: Position.
+        qreal centre: Centre of the bump.
+        qreal width: Width of the bump.
+    Outputs:
+        The height of the bump at x, between 0 and 1.
+*/
+static qreal gaussian(qreal x, qreal centre, qreal width)
+{
+    qreal d = (x - centre) / width;
+    return qExp(-d * d);
+}
+
+/*
+    Function: buildWaveform()
+    Purpose: Builds two periods of a waveform over the width of an ECG strip.
+             Every component repeats a whole number of times across the strip
+             so that scrolling wraps around seamlessly.
+    Inputs:
+        HeartState condition: The rhythm to draw.
+    Outputs:
+        The waveform, with y between -1 and 1.
+*/
+static QPolygonF buildWaveform(HeartState condition)
+{
+    QPolygonF waveform;
+    waveform.reserve(2 * ECG_WIDTH);
+
+    for (int x = 0; x < 2 * ECG_WIDTH; ++x)
+    {
+        qreal u = qreal(x % ECG_WIDTH) / ECG_WIDTH;
+        qreal y = 0.0;
+
+        switch (condition)
+        {
+        case SINUS_RHYTHM:
+        {
+            // Three beats per strip: P wave, QRS complex and T wave.
+            qreal beat = std::fmod(u * 3.0, 1.0);
+            y = 0.15 * gaussian(beat, 0.15, 0.03)
+              - 0.15 * gaussian(beat, 0.27, 0.01)
+              + 1.00 * gaussian(beat, 0.30, 0.012)
+              - 0.25 * gaussian(beat, 0.33, 0.01)
+              + 0.30 * gaussian(beat, 0.55, 0.05);
+            break;
+        }
+
+        case VENTRICULAR_TACHYCARDIA:
+            // Fast, wide and regular complexes.
+            y = 0.8 * qSin(2.0 * M_PI * 7.0 * u);
+            break;
+
+        case VENTRICULAR_FIBRILLATION:
+            // Chaotic, low amplitude activity.
+            y = 0.35 * qSin(2.0 * M_PI * 11.0 * u)
+              + 0.25 * qSin(2.0 * M_PI * 17.0 * u + 1.0)
+              + 0.15 * qSin(2.0 * M_PI * 29.0 * u + 2.0);
+            break;
+
+        default:
+            break;
+        }
+
+        waveform << QPointF(x, y);
+    }
+
+    return waveform;
+}
+
+/*
+    Function: WardDashboard(QWidget *parent)
+    Purpose: Constructor.
+    Input:
+        parent - The parent widget.
+    Output:
+        None
+*/
+WardDashboard::WardDashboard(QWidget *parent)
+    : QAbstractScrollArea(parent), artifacts(0)
+{
+    setWindowTitle("AED Ward");
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    viewport()->setAttribute(Qt::WA_OpaquePaintEvent);
+    viewport()->setAutoFillBackground(false);
+    resize(4 * (WARD_TILE_WIDTH + WARD_TILE_SPACING) + WARD_TILE_SPACING + verticalScrollBar()->sizeHint().width(),
+           5 * (WARD_TILE_HEIGHT + WARD_TILE_SPACING) + WARD_TILE_SPACING);
+
+    waveforms << buildWaveform(SINUS_RHYTHM)
+              << buildWaveform(VENTRICULAR_FIBRILLATION)
+              << buildWaveform(VENTRICULAR_TACHYCARDIA);
+
+    for (int x = 0; x < 2 * ECG_WIDTH; ++x)
+    {
+        flatLine << QPointF(x, 0.0);
+    }
+
+    ecgTimer = new QTimer(this);
+    connect(ecgTimer, &QTimer::timeout, this, &WardDashboard::advanceECG);
+    ecgTimer->start(WARD_ECG_REFRESH_TIME);
+}
+
+/*
+    Function: addAED(AED *device)
+    Purpose: Add an AED device to the dashboard.
+    Input:
+        device - A pointer to the AED device.
+    Output:
+        None
+*/
+void WardDashboard::addAED(AED *device)
+{
+    if (device == nullptr)
+        return;
+
+    int index = tiles.size();
+    tiles.append({device, OFF, SINUS_RHYTHM, device->getBatteryLevel(), 0, 0});
+
+    // Device signals are emitted from the device thread and queued to this one.
+    connect(device, &AED::updateGUI, this, [this, index](int state)
+            { updateTile(index, (AEDState)state); });
+    connect(device, &AED::batteryChanged, this, [this, index](int level)
+            {
+        tiles[index].batteryLevel = level;
+        repaintIfVisible(tileRect(index)); });
+    connect(device, &AED::updateShockCount, this, [this, index](int count)
+            {
+        tiles[index].shockCount = count;
+        repaintIfVisible(tileRect(index)); });
+    connect(device, &AED::updatePatientCondition, this, [this, index](int condition)
+            {
+        tiles[index].condition = (HeartState)condition;
+        repaintIfVisible(ecgRect(index)); });
+
+    updateScrollBars();
+}
+
+/*
+    Function: startAll()
+    Purpose: Power on every device with a random scenario.
+    Input:
+        None
+    Output:
+        None
+*/
+void WardDashboard::startAll()
+{
+    for (int i = 0; i < tiles.size(); ++i)
+    {
+        QTimer::singleShot(i * WARD_START_STAGGER_TIME, this, [this, i]()
+                           { restartDevice(i); });
+    }
+}
+
+/*
+    Function: setStartSnapshot(const QByteArray &snapshot)
+    Purpose: Start every device from a session snapshot instead of a random scenario.
+    Input:
+        snapshot - The binary snapshot, or an empty one for random scenarios.
+    Output:
+        None
+*/
+void WardDashboard::setStartSnapshot(const QByteArray &snapshot)
+{
+    startSnapshot = snapshot;
+}
+
+/*
+    Function: setArtifacts(int artifacts)
+    Purpose: Set the ECG artifacts the devices may pick up. Every session picks some of them at random.
+    Input:
+        artifacts - EcgArtifact flags.
+    Output:
+        None
+*/
+void WardDashboard::setArtifacts(int artifacts)
+{
+    this->artifacts = artifacts;
+}
+
+/*
+    Function: deviceCount()
+    Purpose: Gets the number of devices shown on the dashboard.
+    Input:
+        None
+    Output:
+        The number of devices.
+*/
+int WardDashboard::deviceCount() const
+{
+    return tiles.size();
+}
+
+/*
+    Function: restartDevice(int index)
+    Purpose: Configure a device with a random scenario and power it on.
+    Input:
+        index - The index of the device.
+    Output:
+        None
+*/
+void WardDashboard::restartDevice(int index)
+{
+    Tile &tile = tiles[index];
+    QRandomGenerator *random = QRandomGenerator::global();
+
+    tile.state = OFF;
+    tile.condition = (HeartState)random->bounded(3);
+    tile.shockCount = 0;
+    tile.batteryLevel = MAX_BATTERY_LEVEL;
+
+    // The device might still be in a final state from its previous session. Every
+    // command is applied on the device thread, in the order sent, before it powers on.
+    tile.device->send(DeviceCommand(COMMAND_SET_STATE, OFF));
+
+    // The restore is sent after the reset, and sends its own condition and counters.
+    if (!startSnapshot.isEmpty() && tile.device->restoreSnapshot(startSnapshot))
+    {
+        tile.device->send(DeviceCommand(COMMAND_POWER_ON));
+        repaintIfVisible(tileRect(index));
+        return;
+    }
+
+    tile.device->send(DeviceCommand(COMMAND_SET_BATTERY_SPECS, MAX_BATTERY_LEVEL, 5, 1));
+    tile.device->send(DeviceCommand(COMMAND_SET_HEART_CONDITION, tile.condition));
+    tile.device->send(DeviceCommand(COMMAND_SET_SHOCKS_UNTIL_HEALTHY, 1 + random->bounded(3)));
+    tile.device->send(DeviceCommand(COMMAND_SET_START_WITH_ASYSTOLE, false));
+    tile.device->send(DeviceCommand(COMMAND_SET_PADS_ATTACHED, true));
+    tile.device->send(DeviceCommand(COMMAND_SET_LOST_CONNECTION, false));
+    tile.device->send(DeviceCommand(COMMAND_SET_ARTIFACTS, artifacts & random->bounded(ARTIFACT_ALL + 1)));
+    tile.device->send(DeviceCommand(COMMAND_POWER_ON));
+
+    repaintIfVisible(tileRect(index));
+}
+
+/*
+    Function: updateTile(int index, AEDState state)
+    Purpose: Update the tile of a device after it changed state.
+    Input:
+        index - The index of the device.
+        state - The new state of the device.
+    Output:
+        None
+*/
+void WardDashboard::updateTile(int index, AEDState state)
+{
+    tiles[index].state = state;
+
+    // Keep the floor busy by starting a new scenario once a session is over.
+    if (state == ABORT || state == SELF_TEST_FAIL || state == CHANGE_BATTERIES)
+    {
+        QTimer::singleShot(WARD_RESTART_TIME, this, [this, index]()
+                           { restartDevice(index); });
+    }
+
+    repaintIfVisible(tileRect(index));
+}
+
+/*
+    Function: advanceECG()
+    Purpose: Scroll the ECG strips of the visible, running devices.
+    Input:
+        None
+    Output:
+        None
+*/
+void WardDashboard::advanceECG()
+{
+    int first, last;
+    if (!visibleRange(first, last))
+        return;
+
+    for (int i = first; i <= last; ++i)
+    {
+        Tile &tile = tiles[i];
+        if (tile.state == OFF || tile.state == ABORT)
+            continue;
+
+        tile.ecgPhase = (tile.ecgPhase + ECG_STEP) % ECG_WIDTH;
+        viewport()->update(ecgRect(i));
+    }
+}
+
+/*
+    Function: repaintIfVisible(const QRect &rect)
+    Purpose: Schedule a repaint of part of a tile, only if it is on screen.
+    Input:
+        rect - The area of the tile to repaint, in viewport coordinates.
+    Output:
+        None
+*/
+void WardDashboard::repaintIfVisible(const QRect &rect)
+{
+    if (rect.intersects(viewport()->rect()))
+    {
+        viewport()->update(rect);
+    }
+}
+
+/*
+    Function: columns()
+    Purpose: Gets the number of tile columns that fit in the viewport.
+    Input:
+        None
+    Output:
+        The number of columns, at least one.
+*/
+int WardDashboard::columns() const
+{
+    int available = viewport()->width() - WARD_TILE_SPACING;
+    return qMax(1, available / (WARD_TILE_WIDTH + WARD_TILE_SPACING));
+}
+
+/*
+    Function: tileRect(int index)
+    Purpose: Gets the area covered by a tile.
+    Input:
+        index - The index of the device.
+    Output:
+        The area of the tile in viewport coordinates.
+*/
+QRect WardDashboard::tileRect(int index) const
+{
+    int cols = columns();
+    int x = WARD_TILE_SPACING + (index % cols) * (WARD_TILE_WIDTH + WARD_TILE_SPACING);
+    int y = WARD_TILE_SPACING + (index / cols) * (WARD_TILE_HEIGHT + WARD_TILE_SPACING) - verticalScrollBar()->value();
+    return QRect(x, y, WARD_TILE_WIDTH, WARD_TILE_HEIGHT);
+}
+
+/*
+    Function: ecgRect(int index)
+    Purpose: Gets the area covered by the ECG strip of a tile.
+    Input:
+        index - The index of the device.
+    Output:
+        The area of the ECG strip in viewport coordinates.
+*/
+QRect WardDashboard::ecgRect(int index) const
+{
+    QRect tile = tileRect(index);
+    return QRect(tile.left() + TILE_PADDING, tile.bottom() - TILE_PADDING - WARD_ECG_HEIGHT + 1,
+                 ECG_WIDTH, WARD_ECG_HEIGHT);
+}
+
+/*
+    Function: visibleRange(int &first, int &last)
+    Purpose: Finds the devices whose tiles intersect the viewport.
+    Input:
+        first - Set to the index of the first visible device.
+        last - Set to the index of the last visible device.
+    Output:
+        False if no tile is visible, true otherwise.
+*/
+bool WardDashboard::visibleRange(int &first, int &last) const
+{
+    if (tiles.isEmpty())
+        return false;
+
+    int rowHeight = WARD_TILE_HEIGHT + WARD_TILE_SPACING;
+    int top = verticalScrollBar()->value();
+    int firstRow = qMax(0, (top - WARD_TILE_SPACING) / rowHeight);
+    int lastRow = (top + viewport()->height()) / rowHeight;
+
+    first = firstRow * columns();
+    last = qMin(tiles.size() - 1, (lastRow + 1) * columns() - 1);
+
+    return first <= last;
+}
+
+/*
+    Function: updateScrollBars()
+    Purpose: Update the scroll range after devices were added or the view resized.
+    Input:
+        None
+    Output:
+        None
+*/
+void WardDashboard::updateScrollBars()
+{
+    int rows = (tiles.size() + columns() - 1) / columns();
+    int contentHeight = WARD_TILE_SPACING + rows * (WARD_TILE_HEIGHT + WARD_TILE_SPACING);
+
+    verticalScrollBar()->setRange(0, qMax(0, contentHeight - viewport()->height()));
+    verticalScrollBar()->setPageStep(viewport()->height());
+    verticalScrollBar()->setSingleStep(WARD_TILE_HEIGHT / 4);
+}
+
+/*
+    Function: resizeEvent(QResizeEvent *event)
+    Purpose: Re-flow the tiles when the view is resized.
+    Input:
+        event - The resize event.
+    Output:
+        None
+*/
+void WardDashboard::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+/*
+    Function: paintEvent(QPaintEvent *event)
+    Purpose: Paint the visible tiles that intersect the area to repaint.
+    Input:
+        event - The paint event.
+    Output:
+        None
+*/
+void WardDashboard::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(viewport());
+    painter.fillRect(event->rect(), QColor("#f2f2f2"));
+
+    int first, last;
+    if (!visibleRange(first, last))
+        return;
+
+    for (int i = first; i <= last; ++i)
+    {
+        if (event->region().intersects(tileRect(i)))
+        {
+            paintTile(painter, i);
+        }
+    }
+}
+
+/*
+    Function: paintTile(QPainter &painter, int index)
+    Purpose: Paint a single tile.
+    Input:
+        painter - The painter of the viewport.
+        index - The index of the device.
+    Output:
+        None
+*/
+void WardDashboard::paintTile(QPainter &painter, int index) const
+{
+    const Tile &tile = tiles[index];
+    QRect rect = tileRect(index);
+
+    QColor background("#5d5d5f");
+    switch (tile.state)
+    {
+    case OFF:
+    case ABORT:
+        background = QColor("#9a9a9c");
+        break;
+    case SELF_TEST_FAIL:
+    case CHANGE_BATTERIES:
+    case LOST_CONNECTION:
+    case CHECK_PADS:
+        background = QColor("#c98a1b");
+        break;
+    case STAND_CLEAR:
+    case SHOCKING:
+    case SHOCK_DELIVERED:
+        background = QColor("#b3261e");
+        break;
+    case CPR:
+        background = QColor("#1e5fb3");
+        break;
+    default:
+        break;
+    }
+
+    painter.save();
+    painter.setRenderHint(QPainter::Antialiasing, false);
+    painter.fillRect(rect, background);
+
+    // Device details.
+    painter.setPen(Qt::white);
+    QRect text = rect.adjusted(TILE_PADDING, TILE_PADDING, -TILE_PADDING, -TILE_PADDING - WARD_ECG_HEIGHT);
+    painter.drawText(text, Qt::AlignLeft | Qt::AlignTop, QString("AED %1").arg(index + 1, 2, 10, QChar('0')));
+    painter.drawText(text, Qt::AlignRight | Qt::AlignTop, QString("BAT %1%").arg(tile.batteryLevel));
+    painter.drawText(text, Qt::AlignLeft | Qt::AlignVCenter, stateLabel(tile.state));
+    painter.drawText(text, Qt::AlignLeft | Qt::AlignBottom, QString("SHOCKS: %1").arg(tile.shockCount, 2, 10, QChar('0')));
+
+    // ECG strip.
+    QRect strip = ecgRect(index);
+    painter.fillRect(strip, Qt::black);
+    painter.setClipRect(strip);
+    painter.translate(strip.left() - tile.ecgPhase, strip.center().y());
+    painter.scale(1.0, -0.45 * WARD_ECG_HEIGHT);
+    painter.setPen(QPen(QColor("#3ddc84"), 0));
+    painter.drawPolyline(ecgWaveform(tile));
+    painter.restore();
+}
+
+/*
+    Function: ecgWaveform(const Tile &tile)
+    Purpose: Gets the waveform to draw for a tile.
+    Input:
+        tile - The tile.
+    Output:
+        The waveform of the patient rhythm, or a flat line if the device is not analyzing.
+*/
+const QPolygonF &WardDashboard::ecgWaveform(const Tile &tile) const
+{
+    if (tile.state < ANALYZING || tile.state == ABORT || tile.condition >= waveforms.size())
+        return flatLine;
+
+    return waveforms[tile.condition];
+}
+
+/*
+    Function: stateLabel(AEDState state)
+    Purpose: Gets the short label shown on a tile for a state.
+    Input:
+        state - The state of the device.
+    Output:
+        The label.
+*/
+QString WardDashboard::stateLabel(AEDState state)
+{
+    switch (state)
+    {
+    case OFF:               return "OFF";
+    case SELF_TEST_SUCCESS: return "UNIT OK";
+    case SELF_TEST_FAIL:    return "UNIT FAILED";
+    case CHANGE_BATTERIES:  return "CHANGE BATTERIES";
+    case STAY_CALM:         return "STAY CALM";
+    case CHECK_RESPONSE:    return "CHECK RESPONSIVENESS";
+    case CALL_HELP:         return "CALL HELP";
+    case ATTACH_PADS:       return "ATTACH DEFIB PADS";
+    case ANALYZING:         return "ANALYZING";
+    case SHOCK_ADVISED:     return "SHOCK ADVISED";
+    case NO_SHOCK_ADVISED:  return "NO SHOCK ADVISED";
+    case STAND_CLEAR:       return "STAND CLEAR";
+    case SHOCKING:          return "SHOCKING";
+    case SHOCK_DELIVERED:   return "SHOCK DELIVERED";
+    case CPR:               return "CPR";
+    case STOP_CPR:          return "STOP CPR";
+    case ABORT:             return "DONE";
+    case LOST_CONNECTION:   return "PLUG IN CABLE";
+    case CHECK_PADS:        return "CHECK PADS";
+    }
+
+    return "";
+}
@@ -0,0 +1,93 @@
+#ifndef WARDDASHBOARD_H
+#define WARDDASHBOARD_H
+
+// Qt imports
+#include <QAbstractScrollArea>
+#include <QList>
+#include <QPolygonF>
+#include <QTimer>
+#include <QVector>
+
+// Local imports
+#include "defs.h"
+
+// Layout of the tiles in pixels, times in milliseconds.
+#define WARD_TILE_WIDTH 210
+#define WARD_TILE_HEIGHT 120
+#define WARD_TILE_SPACING 8
+#define WARD_ECG_HEIGHT 40
+#define WARD_ECG_REFRESH_TIME 40
+#define WARD_START_STAGGER_TIME 150
+#define WARD_RESTART_TIME 5000
+
+class AED;
+
+// Shows many simulated AED devices at once as a grid of compact tiles.
+// Only tiles inside the viewport are painted, and a device update only
+// repaints its own tile when that tile is visible.
+class WardDashboard : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit WardDashboard(QWidget *parent = nullptr);
+
+    void addAED(AED *device);
+
+    // Start every device with a random scenario, staggered over time.
+    void startAll();
+
+    // Start every device from a session snapshot instead of a random scenario,
+    // which skips the steps before the snapshot's step.
+    void setStartSnapshot(const QByteArray &snapshot);
+    void setArtifacts(int artifacts);
+
+    int deviceCount() const;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+
+private slots:
+    void advanceECG();
+
+private:
+    // What a tile displays for a single device.
+    struct Tile
+    {
+        AED *device;
+        AEDState state;
+        HeartState condition;
+        int batteryLevel;
+        int shockCount;
+        int ecgPhase;
+    };
+
+    void updateTile(int index, AEDState state);
+    void restartDevice(int index);
+
+    void updateScrollBars();
+    int columns() const;
+    QRect tileRect(int index) const;
+    QRect ecgRect(int index) const;
+    bool visibleRange(int &first, int &last) const;
+    void repaintIfVisible(const QRect &rect);
+
+    void paintTile(QPainter &painter, int index) const;
+    const QPolygonF &ecgWaveform(const Tile &tile) const;
+
+    static QString stateLabel(AEDState state);
+
+    QVector<Tile> tiles;
+
+    // One period of each waveform, built once and shared by all tiles.
+    QVector<QPolygonF> waveforms;
+    QPolygonF flatLine;
+
+    QTimer *ecgTimer;
+
+    QByteArray startSnapshot;
+    int artifacts;
+};
+
+#endif
@@ -0,0 +1,12 @@
+TARGET = AED
+TEMPLATE = app
+
+include(../AED.pri)
+
+SOURCES += \
+    ../main.cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -24,6 +24,36 @@
 #define SHOCK_INDICATOR 5
 #define BATTERY_DRAIN_TIME 5000
 
+// Step scheduling, in microseconds.
+#define SCHEDULE_SPIN_MARGIN 200
+#define TRANSITION_JITTER_TARGET 2000
+
+// Pad impedance, in ohms.
+#define IMPEDANCE_MIN_PATIENT 50.0
+#define IMPEDANCE_MAX_PATIENT 150.0
+#define IMPEDANCE_MIN_GOOD_CONTACT 25.0
+#define IMPEDANCE_MAX_GOOD_CONTACT 180.0
+
+// Shock energy, in joules.
+#define ADULT_SHOCK_ENERGIES { 120.0, 150.0, 200.0 }
+#define PEDIATRIC_ENERGY_ATTENUATION 0.42
+#define MAX_CHARGE_ENERGY 360.0
+
+// Cardiac physiology model, times in seconds.
+#define MODEL_TIME_STEP 0.004f
+#define MAX_PHYSIOLOGY_CYCLES 10
+
+// Multi-lead ECG, one sample per model time step. Blocks are acquired every ECG_BLOCK_TIME milliseconds.
+#define ECG_SAMPLE_RATE 250
+#define ECG_BLOCK_TIME 40
+#define ECG_BUFFER_SECONDS 60
+
+// Mains frequency in hertz, of the hum artifact and of the notch filter.
+#define MAINS_FREQUENCY 60.0f
+
+// Protocol followed unless another one is named.
+#define DEFAULT_PROTOCOL_NAME "default"
+
 #define RANDOM_BOUND 1
 // Device state.
 enum AEDState
@@ -45,15 +75,33 @@ enum AEDState
     CPR,               // Start CPR.
     STOP_CPR,          // Stop CPR.
     ABORT,             // Turn off if the patient was determined to be healthy.
-    LOST_CONNECTION    // Simulate losing connection.
+    LOST_CONNECTION,   // Simulate losing connection.
+    CHECK_PADS         // Poor pad contact, check the pads.
 };
 
+// Name of each device state, as used in reports.
+inline const char *aedStateName(AEDState state)
+{
+    static const char *const names[] = {
+        "OFF", "SELF_TEST_SUCCESS", "SELF_TEST_FAIL", "CHANGE_BATTERIES",
+        "STAY_CALM", "CHECK_RESPONSE", "CALL_HELP", "ATTACH_PADS",
+        "ANALYZING", "SHOCK_ADVISED", "NO_SHOCK_ADVISED", "STAND_CLEAR",
+        "SHOCKING", "SHOCK_DELIVERED", "CPR", "STOP_CPR",
+        "ABORT", "LOST_CONNECTION", "CHECK_PADS"};
+
+    if (state < OFF || state > CHECK_PADS)
+        return "UNKNOWN";
+
+    return names[state];
+}
+
 // Specifies heart condition of the patient.
 enum HeartState
 {
     SINUS_RHYTHM,             // Normal sinus rhythm
     VENTRICULAR_FIBRILLATION, // Ventricular fibrillation
     VENTRICULAR_TACHYCARDIA,  // Ventricular tachycardia
+    ASYSTOLE,                 // No electrical activity
 };
 
 #endif
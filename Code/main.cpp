@@ -1,25 +1,428 @@
 #include "MainWindow.h"
 #include "AED.h"
+#include "ArchiveQuery.h"
+#include "AudioSink.h"
+#include "CardiacModel.h"
+#include "CprMetronome.h"
+#include "EcgArtifacts.h"
+#include "EcgBenchmark.h"
+#include "JitterBenchmark.h"
+#include "MetricsRegistry.h"
+#include "ProtocolExplorer.h"
+#include "ResuscitationProtocol.h"
+#include "ScenarioRunner.h"
+#include "SessionArchive.h"
+#include "SessionBranch.h"
+#include "SoakRunner.h"
+#include "StartupProfiler.h"
+#include "TraceRecorder.h"
+#include "UiFuzzer.h"
+#include "VoicePrompter.h"
+#include "WardDashboard.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
 #include <QStyleFactory>
+#include <QThread>
+#include <QTimer>
+#include <QtMath>
+
+#include <algorithm>
 
 int main(int argc, char *argv[])
 {
+    StartupProfiler *profiler = StartupProfiler::instance();
+
     QApplication a(argc, argv);
+    profiler->mark("application");
+
     a.setStyle(QStyleFactory::create("Fusion"));
+    profiler->mark("style");
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption wardOption("ward", "Show a dashboard of <count> simulated devices instead of a single device.", "count");
+    parser.addOption(wardOption);
+    QCommandLineOption priorityOption("high-priority", "Run the device loop at an elevated thread priority.");
+    parser.addOption(priorityOption);
+    QCommandLineOption jitterReportOption("jitter-report", "Measure step timing under synthetic load and write a JSON report to <file>.", "file");
+    parser.addOption(jitterReportOption);
+    QCommandLineOption jitterRunsOption("jitter-runs", "Number of protocol runs measured for the jitter report.", "runs", "1");
+    parser.addOption(jitterRunsOption);
+    QCommandLineOption physiologyOption("physiology", "Simulate the patient with a model of the heart instead of a fixed number of shocks.");
+    parser.addOption(physiologyOption);
+    QCommandLineOption monitorLeadsOption("monitor-leads", "Acquire <leads> ECG monitor leads (0, 3 or 12) besides the pad lead.", "leads", "0");
+    parser.addOption(monitorLeadsOption);
+    QCommandLineOption ecgRecordOption("ecg-record", "Write the compressed ECG of the session to <file> when it ends.", "file");
+    parser.addOption(ecgRecordOption);
+    QCommandLineOption codecBenchmarkOption("ecg-codec-benchmark", "Measure compression of a 10 minute ECG of <leads> leads and print the throughput.", "leads");
+    parser.addOption(codecBenchmarkOption);
+    QCommandLineOption artifactsOption("artifacts", "Add artifacts to the ECG: a comma separated list of hum, wander, motion, cpr, contact or all.", "list");
+    parser.addOption(artifactsOption);
+    QCommandLineOption filterBenchmarkOption("filter-benchmark", "Measure the analyzer front end filters on a 10 minute ECG of <leads> leads and print the throughput.", "leads");
+    parser.addOption(filterBenchmarkOption);
+    QCommandLineOption batchOutcomesOption("batch-outcomes", "Simulate the protocol on <patients> random patients and print the outcomes.", "patients");
+    parser.addOption(batchOutcomesOption);
+    QCommandLineOption snapshotOption("snapshot", "Write a snapshot of the session to <file> at the start of every step.", "file");
+    parser.addOption(snapshotOption);
+    QCommandLineOption resumeOption("resume", "Resume the session saved in the snapshot <file>. With --ward, every device starts from it.", "file");
+    parser.addOption(resumeOption);
+    QCommandLineOption whatIfOption("what-if", "Branch the session into <branches> futures for each change and print the outcomes. Branches from --resume if given, otherwise from a shock advised for VF.", "branches");
+    parser.addOption(whatIfOption);
+    QCommandLineOption traceOption("trace", "Record the device and GUI threads and write a trace event file, for chrome://tracing or Perfetto, to <file> on exit.", "file");
+    parser.addOption(traceOption);
+    QCommandLineOption metricsOption("metrics", "Write device metrics in the Prometheus text format to <file> every few seconds and on exit.", "file");
+    parser.addOption(metricsOption);
+    QCommandLineOption scenariosOption("scenarios", "Run the scripted sessions in <file> on a simulated clock and check the states the device goes through.", "file");
+    parser.addOption(scenariosOption);
+    QCommandLineOption fuzzOption("fuzz", "Fire random operator inputs at devices for <seconds> and save a script reproducing each failure found.", "seconds");
+    parser.addOption(fuzzOption);
+    QCommandLineOption fuzzSeedOption("fuzz-seed", "Seed of the fuzzer, random if not given.", "seed");
+    parser.addOption(fuzzSeedOption);
+    QCommandLineOption fuzzReproducersOption("fuzz-reproducers", "File the fuzzer writes its reproducers to.", "file", "fuzz-reproducers.txt");
+    parser.addOption(fuzzReproducersOption);
+    QCommandLineOption exploreOption("explore", "Explore every reachable state of the protocol under all operator inputs and check its properties.");
+    parser.addOption(exploreOption);
+    QCommandLineOption exploreCounterexamplesOption("explore-counterexamples", "File the explorer writes its counterexamples to.", "file", "explorer-counterexamples.txt");
+    parser.addOption(exploreCounterexamplesOption);
+    QCommandLineOption promptAudioOption("prompt-audio", "Play the voice prompts on the speaker, on null to drop them, or to a WAV <sink> file written on exit.", "sink", "speaker");
+    parser.addOption(promptAudioOption);
+    QCommandLineOption promptClipsOption("prompt-clips", "Read the voice prompts from <STATE>.wav files in <dir>, 16 bit mono PCM at 16 kHz.", "dir");
+    parser.addOption(promptClipsOption);
+    QCommandLineOption cprRateOption("cpr-rate", "Beat the CPR metronome at <bpm> compressions per minute, from 100 to 120.", "bpm", QString::number(CPR_METRONOME_RATE));
+    parser.addOption(cprRateOption);
+    QCommandLineOption soakOption("soak", "Run <sessions> back to back sessions through the main window and the device on a simulated clock, and fail if memory, QObjects or timers keep growing.", "sessions");
+    parser.addOption(soakOption);
+    QCommandLineOption soakReportOption("soak-report", "Write the measures of the soak, sampled as it goes, to the CSV <file>.", "file");
+    parser.addOption(soakReportOption);
+    QCommandLineOption protocolsOption("protocols", "Load the resuscitation protocols defined in <file>, for --protocol and scenarios to follow.", "file");
+    parser.addOption(protocolsOption);
+    QCommandLineOption protocolOption("protocol", "Follow the resuscitation protocol <name>, the built-in one or one loaded with --protocols.", "name", DEFAULT_PROTOCOL_NAME);
+    parser.addOption(protocolOption);
+    QCommandLineOption archiveOption("archive", "Append every session that ends to the session archive <file>, or query it with --archive-query.", "file");
+    parser.addOption(archiveOption);
+    QCommandLineOption archiveQueryOption("archive-query", "Answer <query> over the sessions of --archive: summary, time-to-shock, cpr-fraction or self-test-failures.", "query");
+    parser.addOption(archiveQueryOption);
+    QCommandLineOption archiveBenchmarkOption("archive-benchmark", "Archive <sessions> synthetic sessions to a temporary file, run every query over them and print the throughput.", "sessions");
+    parser.addOption(archiveBenchmarkOption);
+    parser.process(a);
+
+    if (parser.isSet(traceOption))
+    {
+        TraceRecorder::instance()->enable();
+        TraceRecorder::instance()->setThreadName("GUI");
+    }
+
+    // Written periodically for scrapers to collect.
+    QTimer metricsTimer;
+    if (parser.isSet(metricsOption))
+    {
+        QObject::connect(&metricsTimer, &QTimer::timeout, [&]()
+                         {
+            if (!MetricsRegistry::instance()->write(parser.value(metricsOption)))
+            {
+                qWarning().noquote() << "Could not write the metrics to" << parser.value(metricsOption);
+            } });
+        metricsTimer.start(METRICS_WRITE_INTERVAL);
+    }
+
+    // Opened once no query is asked of it. It lives for the whole application, like
+    // the devices appending to it.
+    SessionArchive *archive = nullptr;
+
+    // Writes the trace, the last metrics and the sessions buffered once the event loop is done.
+    auto finish = [&](int result)
+    {
+        if (archive != nullptr)
+        {
+            archive->flush();
+        }
+        if (parser.isSet(traceOption) && !TraceRecorder::instance()->write(parser.value(traceOption)))
+        {
+            qCritical().noquote() << "Could not write the trace to" << parser.value(traceOption);
+        }
+        if (parser.isSet(metricsOption) && !MetricsRegistry::instance()->write(parser.value(metricsOption)))
+        {
+            qCritical().noquote() << "Could not write the metrics to" << parser.value(metricsOption);
+        }
+        return result;
+    };
+
+    int artifacts = 0;
+    for (const QString &name : parser.value(artifactsOption).split(',', Qt::SkipEmptyParts))
+    {
+        static const QMap<QString, int> artifactNames = {{"hum", ARTIFACT_MAINS_HUM}, {"wander", ARTIFACT_BASELINE_WANDER},
+                                                         {"motion", ARTIFACT_MOTION}, {"cpr", ARTIFACT_CPR},
+                                                         {"contact", ARTIFACT_PAD_CONTACT}, {"all", ARTIFACT_ALL}};
+        if (!artifactNames.contains(name.trimmed()))
+        {
+            qCritical().noquote() << "Unknown artifact:" << name;
+            return 1;
+        }
+        artifacts |= artifactNames.value(name.trimmed());
+    }
+
+    // Compiled once, so that a device switching protocols only switches programs.
+    if (parser.isSet(protocolsOption))
+    {
+        QVector<ResuscitationProtocol> protocols;
+        if (!ResuscitationProtocol::load(parser.value(protocolsOption), protocols))
+            return 1;
+
+        for (const ResuscitationProtocol &protocol : protocols)
+        {
+            ProtocolLibrary::instance()->add(protocol);
+        }
+    }
+
+    int protocol = ProtocolLibrary::instance()->find(parser.value(protocolOption));
+    if (protocol < 0)
+    {
+        qCritical().noquote() << "Unknown protocol:" << parser.value(protocolOption);
+        return 1;
+    }
+
+    QByteArray resumeSnapshot;
+    if (parser.isSet(resumeOption))
+    {
+        QFile file(parser.value(resumeOption));
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            qCritical().noquote() << "Could not read the snapshot" << file.fileName();
+            return 1;
+        }
+        resumeSnapshot = file.readAll();
+    }
+
+    if (parser.isSet(whatIfOption))
+    {
+        SessionSnapshot snapshot = SessionSnapshot::shockAdvised(QRandomGenerator::global()->generate());
+        if (!resumeSnapshot.isEmpty() && !SessionSnapshot::deserialize(resumeSnapshot, snapshot))
+        {
+            qCritical().noquote() << "Not a valid snapshot:" << parser.value(resumeOption);
+            return 1;
+        }
+
+        // Branches run the program the snapshot was taken in, as the device does when it resumes.
+        const ResuscitationProtocol *branched = ProtocolLibrary::instance()->at(ProtocolLibrary::instance()->find(snapshot.protocol));
+        if (branched == nullptr || snapshot.step >= branched->getProgram(snapshot.pediatricPads).steps.size())
+        {
+            qCritical().noquote() << "The protocol of the snapshot is not loaded:" << snapshot.protocol;
+            return 1;
+        }
+
+        for (const QString &line : SessionBranch::reportWhatIf(snapshot, parser.value(whatIfOption).toInt(), QRandomGenerator::global()->generate()))
+        {
+            qInfo().noquote() << line;
+        }
+
+        return finish(0);
+    }
+
+    if (parser.isSet(codecBenchmarkOption))
+    {
+        QStringList lines;
+        bool lossless = EcgBenchmark::codec(parser.value(codecBenchmarkOption).toInt(), QRandomGenerator::global()->generate(), lines);
+        for (const QString &line : lines)
+        {
+            qInfo().noquote() << line;
+        }
+
+        return finish(lossless ? 0 : 1);
+    }
+
+    if (parser.isSet(filterBenchmarkOption))
+    {
+        QStringList lines;
+        EcgBenchmark::filters(parser.value(filterBenchmarkOption).toInt(), QRandomGenerator::global()->generate(), lines);
+        for (const QString &line : lines)
+        {
+            qInfo().noquote() << line;
+        }
+
+        return finish(0);
+    }
+
+    if (parser.isSet(archiveQueryOption))
+    {
+        ArchiveQueryType query;
+        if (!ArchiveQuery::find(parser.value(archiveQueryOption), query))
+        {
+            qCritical().noquote() << "Unknown query:" << parser.value(archiveQueryOption);
+            return 1;
+        }
+
+        ArchiveReader reader;
+        if (!reader.open(parser.value(archiveOption)))
+            return 1;
+
+        for (const QString &line : ArchiveQuery::run(reader, query))
+        {
+            qInfo().noquote() << line;
+        }
+
+        return finish(0);
+    }
+
+    if (parser.isSet(archiveBenchmarkOption))
+    {
+        QStringList lines;
+        bool ok = ArchiveQuery::benchmark(parser.value(archiveBenchmarkOption).toInt(), QRandomGenerator::global()->generate(), lines);
+        for (const QString &line : lines)
+        {
+            qInfo().noquote() << line;
+        }
+
+        return finish(ok ? 0 : 1);
+    }
+
+    if (parser.isSet(archiveOption))
+    {
+        archive = new SessionArchive;
+        if (!archive->open(parser.value(archiveOption)))
+            return 1;
+    }
+
+    if (parser.isSet(batchOutcomesOption))
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        OutcomeSummary summary = CardiacModel::runBatch(parser.value(batchOutcomesOption).toUInt(), MAX_PHYSIOLOGY_CYCLES, QRandomGenerator::global()->generate());
+        double seconds = timer.nsecsElapsed() / 1e9;
+
+        qInfo().noquote() << QString("Patients: %1, simulated %2 s each in %3 s (%4 patient-seconds per second)")
+                                 .arg(summary.patients).arg(summary.simulatedSeconds).arg(seconds, 0, 'f', 2)
+                                 .arg(summary.patients * summary.simulatedSeconds / qMax(seconds, 1e-9), 0, 'e', 2);
+        qInfo().noquote() << QString("Sinus rhythm: %1, VF: %2, VT: %3, asystole: %4")
+                                 .arg(summary.finalRhythm[SINUS_RHYTHM]).arg(summary.finalRhythm[VENTRICULAR_FIBRILLATION])
+                                 .arg(summary.finalRhythm[VENTRICULAR_TACHYCARDIA]).arg(summary.finalRhythm[ASYSTOLE]);
+        qInfo().noquote() << QString("Shocks delivered: %1, converted: %2")
+                                 .arg(summary.shocksDelivered).arg(summary.shocksConverted);
+
+        return finish(0);
+    }
+
+    if (parser.isSet(scenariosOption))
+    {
+        ScenarioRunner runner;
+        runner.setArchive(archive);
+        if (!runner.load(parser.value(scenariosOption)))
+            return 1;
+
+        return finish(runner.run() == 0 ? 0 : 1);
+    }
+
+    if (parser.isSet(fuzzOption))
+    {
+        quint32 seed = parser.isSet(fuzzSeedOption) ? parser.value(fuzzSeedOption).toUInt() : QRandomGenerator::global()->generate();
+
+        // Every device has an input thread besides its own.
+        UiFuzzer fuzzer(seed, QThread::idealThreadCount() / 2);
+        int failures = fuzzer.run(qMax(1, parser.value(fuzzOption).toInt()), parser.value(fuzzReproducersOption));
+
+        return finish(failures == 0 ? 0 : 1);
+    }
+
+    if (parser.isSet(exploreOption))
+    {
+        // Every explorer thread drives a device thread.
+        ProtocolExplorer explorer(QThread::idealThreadCount() / 2);
+        return finish(explorer.run(parser.value(exploreCounterexamplesOption)) ? 0 : 1);
+    }
+
+    if (parser.isSet(soakOption))
+    {
+        SoakRunner soak(parser.value(soakOption).toInt(), QRandomGenerator::global()->generate());
+        return finish(soak.run(parser.value(soakReportOption)) ? 0 : 1);
+    }
+
+    if (parser.isSet(jitterReportOption))
+    {
+        JitterBenchmark benchmark(parser.value(jitterReportOption), parser.value(jitterRunsOption).toInt());
+        QObject::connect(&benchmark, &JitterBenchmark::finished, &a, &QApplication::exit);
+        benchmark.start();
+
+        return finish(a.exec());
+    }
+
+    if (parser.isSet(wardOption))
+    {
+        WardDashboard dashboard;
+
+        // Devices live for the whole application, like the single device below.
+        int count = qMax(1, parser.value(wardOption).toInt());
+        for (int i = 0; i < count; ++i)
+        {
+            AED *device = new AED();
+            device->setElevatedPriority(parser.isSet(priorityOption));
+            device->setPhysiologyModel(parser.isSet(physiologyOption));
+            device->setProtocol(protocol);
+            device->setArchive(archive, "ward");
+            dashboard.addAED(device);
+        }
+        dashboard.setStartSnapshot(resumeSnapshot);
+        dashboard.setArtifacts(artifacts);
+
+        dashboard.show();
+        dashboard.startAll();
+
+        return finish(a.exec());
+    }
 
     MainWindow w;
+    profiler->mark("main window");
 
     // Create AED device.
     AED* device = new AED();
+    device->setElevatedPriority(parser.isSet(priorityOption));
+    device->setPhysiologyModel(parser.isSet(physiologyOption));
+    device->setMonitorLeads(parser.value(monitorLeadsOption).toInt());
+    device->setEcgRecordingFile(parser.value(ecgRecordOption));
+    device->setArtifacts(artifacts);
+    device->setSnapshotFile(parser.value(snapshotOption));
+    device->setProtocol(protocol);
+    device->setArchive(archive, "manual");
 
     w.addAED(device);
     device->setGUI(&w);
+    profiler->mark("device");
+
+    VoicePrompter prompter(AudioSink::create(parser.value(promptAudioOption)), parser.value(promptClipsOption));
+    prompter.follow(device);
+
+    // Beats are clicked over the prompts and flashed on the CPR indicator.
+    CprMetronome metronome(parser.value(cprRateOption).toInt());
+    metronome.follow(device);
+    QObject::connect(&metronome, &CprMetronome::tick, &prompter, [&prompter](int, qint64 deadlineNs)
+                     { prompter.click(deadlineNs); }, Qt::DirectConnection);
+    QObject::connect(&metronome, &CprMetronome::tick, &w, &MainWindow::cprBeat);
+    profiler->mark("voice prompts");
+
+    if (!resumeSnapshot.isEmpty())
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        SessionSnapshot restored;
+        if (!device->restoreSnapshot(resumeSnapshot, &restored))
+        {
+            qCritical().noquote() << "Not a valid snapshot:" << parser.value(resumeOption);
+            return 1;
+        }
+        qInfo().noquote() << QString("Checked the snapshot in %1 us").arg(timer.nsecsElapsed() / 1000.0, 0, 'f', 1);
+
+        w.resumeSession(restored.padsAttached);
+    }
 
     // TODO: Put AED class into a separate thread.
 
     w.show();
+    profiler->mark("show");
+    profiler->watchFirstFrame();
 
-    return a.exec();
+    return finish(a.exec());
 }
@@ -0,0 +1,6 @@
+TARGET = tst_jitter
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_jitter.cpp
@@ -0,0 +1,120 @@
+// IMPORTS
+#include "JitterBenchmark.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QtTest>
+
+// A run of the protocol takes a couple of minutes on the real clock.
+static const int JITTER_TEST_TIMEOUT = 240000;
+
+// Runs the protocol under synthetic CPU, memory and GUI load, and fails if any step
+// strays from its nominal dwell by more than TRANSITION_JITTER_TARGET, or if the
+// report does not add up. The run takes minutes and its result depends on the
+// machine, so it is skipped unless AED_JITTER_TEST is set in the environment.
+class TestJitter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void stepsStayWithinTarget();
+};
+
+/*
+    Function: sumOf()
+    Purpose: Adds up the counts of a histogram.
+    Inputs:
+        const QJsonArray &histogram: The counts of each bucket.
+    Outputs:
+        The number of samples in the histogram.
+*/
+static int sumOf(const QJsonArray &histogram)
+{
+    int sum = 0;
+    for (const QJsonValue &count : histogram)
+    {
+        sum += count.toInt();
+    }
+    return sum;
+}
+
+/*
+    Function: initTestCase()
+    Purpose: Skips the test unless it was asked for.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void TestJitter::initTestCase()
+{
+    if (qEnvironmentVariableIsEmpty("AED_JITTER_TEST"))
+        QSKIP("Set AED_JITTER_TEST to measure step timing on this machine");
+}
+
+/*
+    Function: stepsStayWithinTarget()
+    Purpose: Measures one run of a shockable patient, checks the worst deviation and
+             that the histograms of the report account for every step measured.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void TestJitter::stepsStayWithinTarget()
+{
+    QTemporaryDir dir;
+    JitterBenchmark benchmark(dir.filePath("jitter.json"), 1);
+    QSignalSpy finished(&benchmark, &JitterBenchmark::finished);
+
+    benchmark.start();
+    QVERIFY2(finished.wait(JITTER_TEST_TIMEOUT), "The protocol run did not end");
+
+    QFile file(dir.filePath("jitter.json"));
+    QVERIFY2(file.open(QIODevice::ReadOnly), "The report was not written");
+    QJsonObject report = QJsonDocument::fromJson(file.readAll()).object();
+
+    QCOMPARE(report["runs"].toInt(), 1);
+    QCOMPARE(report["targetUs"].toInt(), TRANSITION_JITTER_TARGET);
+
+    QJsonArray bounds = report["bucketUpperBoundsUs"].toArray();
+    QVERIFY(!bounds.isEmpty());
+    for (int i = 1; i < bounds.size(); ++i)
+    {
+        QVERIFY(bounds[i].toDouble() > bounds[i - 1].toDouble());
+    }
+
+    // One bucket per bound, and one for the deviations past the last bound.
+    QJsonObject overall = report["overall"].toObject();
+    QJsonArray histogram = overall["histogram"].toArray();
+    QCOMPARE(histogram.size(), bounds.size() + 1);
+    QVERIFY(overall["samples"].toInt() > 0);
+    QCOMPARE(sumOf(histogram), overall["samples"].toInt());
+    QCOMPARE(qint64(overall["maxAbsUs"].toDouble()), benchmark.getMaxDeviationUs());
+
+    // A shockable patient goes through a shock, and every state adds up to the overall histogram.
+    QJsonObject states = report["states"].toObject();
+    QVERIFY(states.contains("SHOCK_DELIVERED"));
+    int stateSamples = 0;
+    for (const QJsonValue &value : states)
+    {
+        QJsonObject state = value.toObject();
+        QCOMPARE(sumOf(state["histogram"].toArray()), state["samples"].toInt());
+        QVERIFY(state["maxAbsUs"].toDouble() <= overall["maxAbsUs"].toDouble());
+        stateSamples += state["samples"].toInt();
+    }
+    QCOMPARE(stateSamples, overall["samples"].toInt());
+
+    QVERIFY2(benchmark.getMaxDeviationUs() <= TRANSITION_JITTER_TARGET,
+             qPrintable(QString("A step deviated by %1 us, the target is %2 us")
+                            .arg(benchmark.getMaxDeviationUs()).arg(TRANSITION_JITTER_TARGET)));
+    QCOMPARE(finished.first().first().toInt(), 0);
+}
+
+QTEST_MAIN(TestJitter)
+#include "tst_jitter.moc"
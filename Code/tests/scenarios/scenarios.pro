@@ -0,0 +1,10 @@
+TARGET = tst_scenarios
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_scenarios.cpp
+
+DISTFILES += \
+    operator.txt \
+    sessions.txt
@@ -0,0 +1,78 @@
+// IMPORTS
+#include "ScenarioRunner.h"
+#include "AED.h"
+
+#include <QtTest>
+
+// Runs the scripted sessions of this directory on a simulated clock, and fails if
+// any of them goes through other states than the ones it expects.
+class TestScenarios : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void scriptsPass_data();
+    void scriptsPass();
+    void healthyExitIsRecorded();
+};
+
+/*
+    Function: scriptsPass_data()
+    Purpose: Lists the scripts to run.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void TestScenarios::scriptsPass_data()
+{
+    QTest::addColumn<QString>("script");
+
+    QTest::newRow("sessions") << QFINDTESTDATA("sessions.txt");
+    QTest::newRow("operator") << QFINDTESTDATA("operator.txt");
+}
+
+/*
+    Function: scriptsPass()
+    Purpose: Runs every scenario of a script and checks that none failed.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void TestScenarios::scriptsPass()
+{
+    QFETCH(QString, script);
+
+    ScenarioRunner runner;
+    QVERIFY2(runner.load(script), qPrintable("Could not load " + script));
+    QCOMPARE(runner.run(), 0);
+}
+
+/*
+    Function: healthyExitIsRecorded()
+    Purpose: Checks that the device turning off for a healthy patient is a step like any
+             other, recorded with the transitions the archive and the trace are made from.
+    Inputs:
+        None
+    Outputs:
+        None
+*/
+void TestScenarios::healthyExitIsRecorded()
+{
+    Scenario scenario;
+    scenario.condition = SINUS_RHYTHM;
+
+    AED *device = new AED();
+    ScenarioResult result = ScenarioRunner::play(device, scenario, SCENARIO_TIMEOUT);
+    QVector<TransitionTiming> timings = device->getTransitionTimings();
+    delete device;
+
+    QVERIFY(!result.failed());
+    QCOMPARE(result.states.count(ABORT), 1);
+    QVERIFY(!timings.isEmpty());
+    QVERIFY(timings.last().state == ABORT);
+}
+
+QTEST_MAIN(TestScenarios)
+#include "tst_scenarios.moc"
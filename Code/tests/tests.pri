@@ -0,0 +1,7 @@
+# Test programs build against the same sources as the application.
+QT += testlib
+CONFIG += testcase console
+CONFIG -= app_bundle
+TEMPLATE = app
+
+include(../AED.pri)
@@ -0,0 +1,6 @@
+# One test program per directory, each run by "make check".
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    jitter \
+    scenarios